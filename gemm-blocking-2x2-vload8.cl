@@ -1,3 +1,7 @@
+// Blocking metadata for the host, see ndrange.hpp
+#define GEMM_BLOCKING 2
+#define GEMM_VECTOR_WIDTH 8
+
 #define dot8(a,b) \
     (dot(a.hi, b.hi) + dot(a.lo, b.lo))
 
@@ -11,24 +15,24 @@ __kernel void gemm_tn (
     int k        // number of columns/rows in a matrix
 )
 {
-    const int i = get_global_id(0) * 2;
-    const int j = get_global_id(1) * 2;
+    const int i = get_global_id(0) * GEMM_BLOCKING;
+    const int j = get_global_id(1) * GEMM_BLOCKING;
     
     float4 ab = (float4)0.0f;
 
-    for (int l = 0; l < k; l += 8)
+    for (int l = 0; l < k; l += GEMM_VECTOR_WIDTH)
     {
-        float8 a0 = vload8(0, &A[i * k]);
-        float8 a1 = vload8(0, &A[(i+1) * k]);
-        float8 b0 = vload8(0, &B[j * k]);
-        float8 b1 = vload8(0, &B[(j+1) * k]);
+        float8 a0 = vload8(0, &A[i * lda]);
+        float8 a1 = vload8(0, &A[(i+1) * lda]);
+        float8 b0 = vload8(0, &B[j * ldb]);
+        float8 b1 = vload8(0, &B[(j+1) * ldb]);
 
         ab += ( float4 ) ( dot8 (a0 , b0 ), dot8 (a0 , b1 ), dot8 (a1 , b0 ), dot8 (a1 , b1 ));
         
-        A += 8; 
-        B += 8;
+        A += GEMM_VECTOR_WIDTH; 
+        B += GEMM_VECTOR_WIDTH;
     }
 
-    vstore2(ab.s01, 0, &C[i * k + j]);
-    vstore2(ab.s23, 0, &C[(i+1) * k + j]);
+    vstore2(ab.s01, 0, &C[i * ldc + j]);
+    vstore2(ab.s23, 0, &C[(i+1) * ldc + j]);
 }
\ No newline at end of file
@@ -1,3 +1,7 @@
+// Blocking metadata for the host, see ndrange.hpp
+#define GEMM_BLOCKING 4
+#define GEMM_VECTOR_WIDTH 4
+
 __kernel void gemm_tn (
     __global const T * restrict A,
     int lda,    // column stride in elements for matrix A
@@ -7,29 +11,29 @@ __kernel void gemm_tn (
     int ldc,    // column stride in elements for matrix C
     int k        // number of columns/rows in a matrix
 ) {
-    const int i = get_global_id(0) * 4;
-    const int j = get_global_id(1) * 4;
+    const int i = get_global_id(0) * GEMM_BLOCKING;
+    const int j = get_global_id(1) * GEMM_BLOCKING;
     
     float16 sum = (float16)0.0f;
 
-    for (int l = 0; l < k; l += 4)
+    for (int l = 0; l < k; l += GEMM_VECTOR_WIDTH)
     {
-        float8 a01 = (float8) (vload4(0, &A[i * k]), vload4(0, &A[(i+1) * k]));
-        float8 a23 = (float8) (vload4(0, &A[(i+2) * k]), vload4(0, &A[(i+3) * k]));
-        float8 b01 = (float8) (vload4(0, &B[j * k]), vload4(0, &B[(j+1) * k]));
-        float8 b23 = (float8) (vload4(0, &B[(j+2) * k]), vload4(0, &B[(j+3) * k]));
+        float8 a01 = (float8) (vload4(0, &A[i * lda]), vload4(0, &A[(i+1) * lda]));
+        float8 a23 = (float8) (vload4(0, &A[(i+2) * lda]), vload4(0, &A[(i+3) * lda]));
+        float8 b01 = (float8) (vload4(0, &B[j * ldb]), vload4(0, &B[(j+1) * ldb]));
+        float8 b23 = (float8) (vload4(0, &B[(j+2) * ldb]), vload4(0, &B[(j+3) * ldb]));
 
         sum += (float16) (dot(a01.lo, b01.lo), dot(a01.lo, b01.hi), dot(a01.lo, b23.lo), dot(a01.lo, b23.hi),
                           dot(a01.hi, b01.lo), dot(a01.hi, b01.hi), dot(a01.hi, b23.lo), dot(a01.hi, b23.hi),
                           dot(a23.lo, b01.lo), dot(a23.lo, b01.hi), dot(a23.lo, b23.lo), dot(a23.lo, b23.hi),
                           dot(a23.hi, b01.lo), dot(a23.hi, b01.hi), dot(a23.hi, b23.lo), dot(a23.hi, b23.hi));
         
-        A += 4; 
-        B += 4;
+        A += GEMM_VECTOR_WIDTH; 
+        B += GEMM_VECTOR_WIDTH;
     }
 
-    vstore4(sum.lo.lo, 0, &C[i * k + j]);
-    vstore4(sum.lo.hi, 0, &C[(i + 1) * k + j]);
-    vstore4(sum.hi.lo, 0, &C[(i + 2) * k + j]);
-    vstore4(sum.hi.hi, 0, &C[(i + 3) * k + j]);
+    vstore4(sum.lo.lo, 0, &C[i * ldc + j]);
+    vstore4(sum.lo.hi, 0, &C[(i + 1) * ldc + j]);
+    vstore4(sum.hi.lo, 0, &C[(i + 2) * ldc + j]);
+    vstore4(sum.hi.hi, 0, &C[(i + 3) * ldc + j]);
 }
\ No newline at end of file
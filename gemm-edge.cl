@@ -0,0 +1,45 @@
+// Cleanup kernel for the edges of C that the blocked variants of gemm_tn
+// cannot cover: they need M and N divisible by blocking by work-group size
+// and K divisible by the vector width. Layout and arguments are the same
+// as of gemm_tn. Work-item (i, j) computes the sum over l from k_begin to
+// k_end - 1 for C[i * ldc + j]; with accumulate it is added to C, which
+// finishes the remainder of K of the bulk computed by a blocked variant.
+// The NDRange starts at the first row and column of the edge (global work
+// offset) and is rounded up to the work-group size; work-items outside of
+// m rows and n columns do nothing.
+
+__kernel void gemm_tn_edge (
+    __global const T * restrict A,
+    int lda,
+    __global const T * restrict B,
+    int ldb,
+    __global T * restrict C,
+    int ldc,
+    int m,
+    int n,
+    int k_begin,
+    int k_end,
+    int accumulate
+)
+{
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+
+    if(i >= m || j >= n)
+    {
+        return;
+    }
+
+    __global const T* a = A + i * lda;
+    __global const T* b = B + j * ldb;
+
+    T sum = 0;
+
+    for(int l = k_begin; l < k_end; ++l)
+    {
+        sum += a[l] * b[l];
+    }
+
+    __global T* c = C + i * ldc + j;
+    *c = accumulate ? *c + sum : sum;
+}
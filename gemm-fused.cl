@@ -0,0 +1,177 @@
+// GEMM with a fused epilogue for the expression API of the host:
+//     C = epilogue(alpha * A * B + beta * C0 + bias)
+// A(i, l) is at A[i * a_row_stride + l * a_col_stride] and B(l, j) is at
+// B[l * b_row_stride + j * b_col_stride], so any layout of A and B is
+// supported. bias is a row vector added to every row of C. Epilogue bits:
+// FUSED_BIAS adds bias, FUSED_RELU replaces negative results with zero.
+// C0 may be the same buffer as C; with beta == 0 it is not read.
+// The NDRange is (m, n) rounded up to the work-group size,
+// work-items outside of C do nothing.
+//
+// gemm_fused_tn below is the blocked variant for the layout of gemm_tn
+// kernels: A row-major and B column-major (a_col_stride and b_row_stride
+// are 1), with m, n and k divisible by FUSED_BLOCKING. It takes the same
+// arguments; each work-item computes a FUSED_BLOCKING x FUSED_BLOCKING
+// block of C as gemm-blocking-4x4-vload4.cl does and applies the epilogue
+// to it in registers. Its NDRange is (m, n)/FUSED_BLOCKING rounded up to
+// the work-group size.
+
+#define FUSED_BIAS 1
+#define FUSED_RELU 2
+
+// Should match the definition in expression.cpp
+#define FUSED_BLOCKING 4
+
+#define VECTOR_TYPE_(type, width) type##width
+#define VECTOR_TYPE(type, width) VECTOR_TYPE_(type, width)
+#define T4 VECTOR_TYPE(T, 4)
+
+__kernel void gemm_fused (
+    __global const T * A,
+    int a_row_stride,
+    int a_col_stride,
+    __global const T * B,
+    int b_row_stride,
+    int b_col_stride,
+    __global T * C,
+    int ldc,
+    __global const T * C0,
+    int ldc0,
+    __global const T * bias,
+    int m,
+    int n,
+    int k,
+    T alpha,
+    T beta,
+    int epilogue
+)
+{
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+
+    if(i >= m || j >= n)
+    {
+        return;
+    }
+
+    A += i * a_row_stride;
+    B += j * b_col_stride;
+
+    T sum = 0;
+
+    for (int l = 0; l < k; ++l)
+    {
+        sum += A[l * a_col_stride] * B[l * b_row_stride];
+    }
+
+    T result = alpha * sum;
+
+    if(beta != 0)
+    {
+        result += beta * C0[i * ldc0 + j];
+    }
+
+    if(epilogue & FUSED_BIAS)
+    {
+        result += bias[j];
+    }
+
+    if(epilogue & FUSED_RELU)
+    {
+        result = max(result, (T)0);
+    }
+
+    C[i * ldc + j] = result;
+}
+
+
+// Applies the epilogue to one row of a block and stores it to C.
+void store_fused_row (
+    T4 sum,
+    __global T * C,
+    __global const T * C0,
+    __global const T * bias,
+    T alpha,
+    T beta,
+    int epilogue
+)
+{
+    T4 result = alpha * sum;
+
+    if(beta != 0)
+    {
+        result += beta * vload4(0, C0);
+    }
+
+    if(epilogue & FUSED_BIAS)
+    {
+        result += vload4(0, bias);
+    }
+
+    if(epilogue & FUSED_RELU)
+    {
+        result = max(result, (T4)0);
+    }
+
+    vstore4(result, 0, C);
+}
+
+__kernel void gemm_fused_tn (
+    __global const T * A,
+    int a_row_stride,
+    int a_col_stride,
+    __global const T * B,
+    int b_row_stride,
+    int b_col_stride,
+    __global T * C,
+    int ldc,
+    __global const T * C0,
+    int ldc0,
+    __global const T * bias,
+    int m,
+    int n,
+    int k,
+    T alpha,
+    T beta,
+    int epilogue
+)
+{
+    const int i = get_global_id(0) * FUSED_BLOCKING;
+    const int j = get_global_id(1) * FUSED_BLOCKING;
+
+    if(i >= m || j >= n)
+    {
+        return;
+    }
+
+    A += i * a_row_stride;
+    B += j * b_col_stride;
+
+    // Row r of the block is sum_r
+    T4 sum0 = 0;
+    T4 sum1 = 0;
+    T4 sum2 = 0;
+    T4 sum3 = 0;
+
+    for (int l = 0; l < k; l += 4)
+    {
+        T4 a0 = vload4(0, &A[l]);
+        T4 a1 = vload4(0, &A[a_row_stride + l]);
+        T4 a2 = vload4(0, &A[2 * a_row_stride + l]);
+        T4 a3 = vload4(0, &A[3 * a_row_stride + l]);
+        T4 b0 = vload4(0, &B[l]);
+        T4 b1 = vload4(0, &B[b_col_stride + l]);
+        T4 b2 = vload4(0, &B[2 * b_col_stride + l]);
+        T4 b3 = vload4(0, &B[3 * b_col_stride + l]);
+
+        sum0 += (T4)(dot(a0, b0), dot(a0, b1), dot(a0, b2), dot(a0, b3));
+        sum1 += (T4)(dot(a1, b0), dot(a1, b1), dot(a1, b2), dot(a1, b3));
+        sum2 += (T4)(dot(a2, b0), dot(a2, b1), dot(a2, b2), dot(a2, b3));
+        sum3 += (T4)(dot(a3, b0), dot(a3, b1), dot(a3, b2), dot(a3, b3));
+    }
+
+    store_fused_row(sum0, &C[i * ldc + j], &C0[i * ldc0 + j], &bias[j], alpha, beta, epilogue);
+    store_fused_row(sum1, &C[(i + 1) * ldc + j], &C0[(i + 1) * ldc0 + j], &bias[j], alpha, beta, epilogue);
+    store_fused_row(sum2, &C[(i + 2) * ldc + j], &C0[(i + 2) * ldc0 + j], &bias[j], alpha, beta, epilogue);
+    store_fused_row(sum3, &C[(i + 3) * ldc + j], &C0[(i + 3) * ldc0 + j], &bias[j], alpha, beta, epilogue);
+}
@@ -0,0 +1,50 @@
+// Texture-path variant of gemm-blocking-4x4 kernels: A and B are read through
+// image2d_t objects with RGBA float texels, 4 consecutive elements of a row
+// per texel, so the loads go through the texture cache instead of the
+// buffer load path. Each work-item computes a 4x4 block of C.
+
+// Blocking metadata for the host, see ndrange.hpp
+#define GEMM_BLOCKING 4
+#define GEMM_VECTOR_WIDTH 4
+
+__constant sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_NONE | CLK_FILTER_NEAREST;
+
+__kernel void gemm_tn_image (
+    __read_only image2d_t A,    // row i of A is row i of the image, k/4 texels wide
+    __read_only image2d_t B,    // row j of B is row j of the image, k/4 texels wide
+    __global T * restrict C,
+    int ldc,    // row stride in elements for matrix C
+    int k       // number of columns/rows in a matrix
+)
+{
+    const int i = get_global_id(0) * GEMM_BLOCKING;
+    const int j = get_global_id(1) * GEMM_BLOCKING;
+
+    float4 c0 = (float4)0.0f;
+    float4 c1 = (float4)0.0f;
+    float4 c2 = (float4)0.0f;
+    float4 c3 = (float4)0.0f;
+
+    for (int l = 0; l < k/GEMM_VECTOR_WIDTH; ++l)
+    {
+        float4 a0 = read_imagef(A, sampler, (int2)(l, i));
+        float4 a1 = read_imagef(A, sampler, (int2)(l, i + 1));
+        float4 a2 = read_imagef(A, sampler, (int2)(l, i + 2));
+        float4 a3 = read_imagef(A, sampler, (int2)(l, i + 3));
+
+        float4 b0 = read_imagef(B, sampler, (int2)(l, j));
+        float4 b1 = read_imagef(B, sampler, (int2)(l, j + 1));
+        float4 b2 = read_imagef(B, sampler, (int2)(l, j + 2));
+        float4 b3 = read_imagef(B, sampler, (int2)(l, j + 3));
+
+        c0 += (float4)(dot(a0, b0), dot(a0, b1), dot(a0, b2), dot(a0, b3));
+        c1 += (float4)(dot(a1, b0), dot(a1, b1), dot(a1, b2), dot(a1, b3));
+        c2 += (float4)(dot(a2, b0), dot(a2, b1), dot(a2, b2), dot(a2, b3));
+        c3 += (float4)(dot(a3, b0), dot(a3, b1), dot(a3, b2), dot(a3, b3));
+    }
+
+    vstore4(c0, 0, &C[i * ldc + j]);
+    vstore4(c1, 0, &C[(i + 1) * ldc + j]);
+    vstore4(c2, 0, &C[(i + 2) * ldc + j]);
+    vstore4(c3, 0, &C[(i + 3) * ldc + j]);
+}
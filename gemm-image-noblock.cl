@@ -0,0 +1,34 @@
+// Texture-path variant of gemm-noblock kernels: A and B are read through
+// image2d_t objects with RGBA float texels, 4 consecutive elements of a row
+// per texel, so the loads go through the texture cache instead of the
+// buffer load path.
+
+// Blocking metadata for the host, see ndrange.hpp
+#define GEMM_BLOCKING 1
+#define GEMM_VECTOR_WIDTH 4
+
+__constant sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_NONE | CLK_FILTER_NEAREST;
+
+__kernel void gemm_tn_image (
+    __read_only image2d_t A,    // row i of A is row i of the image, k/4 texels wide
+    __read_only image2d_t B,    // row j of B is row j of the image, k/4 texels wide
+    __global T * restrict C,
+    int ldc,    // row stride in elements for matrix C
+    int k       // number of columns/rows in a matrix
+)
+{
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+
+    float4 sum = (float4)0.0f;
+
+    for (int l = 0; l < k/GEMM_VECTOR_WIDTH; ++l)
+    {
+        float4 x = read_imagef(A, sampler, (int2)(l, i));
+        float4 y = read_imagef(B, sampler, (int2)(l, j));
+
+        sum += x * y;
+    }
+
+    C[i * ldc + j] = sum.x + sum.y + sum.z + sum.w;
+}
@@ -1,3 +1,7 @@
+// Blocking metadata for the host, see ndrange.hpp
+#define GEMM_BLOCKING 1
+#define GEMM_VECTOR_WIDTH 16
+
 #define dot16(a,b) \
     (dot(a.lo.lo, b.lo.lo) + dot(a.lo.hi, b.lo.hi)  \
     + dot(a.hi.lo, b.hi.lo) + dot(a.hi.hi, b.hi.hi))
@@ -18,17 +22,17 @@ __kernel void gemm_tn (
 
     float sum = 0.0f;
   
-    A += i * k;
-    B += j * k;
+    A += i * lda;
+    B += j * ldb;
 
-    for (int l = 0; l < k; l += 16)
+    for (int l = 0; l < k; l += GEMM_VECTOR_WIDTH)
     {
         sum += dot16(vload16(0, A), vload16(0, B));
 
-        A += 16; // this is faster than A[i* k + l]. 11 GFlops vs. 10 GFlops.
-        B += 16;
+        A += GEMM_VECTOR_WIDTH; // this is faster than A[i* k + l]. 11 GFlops vs. 10 GFlops.
+        B += GEMM_VECTOR_WIDTH;
     }
 
-    C[i * k + j] = sum;
+    C[i * ldc + j] = sum;
 }
 
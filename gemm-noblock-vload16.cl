@@ -1,3 +1,7 @@
+// Blocking metadata for the host, see ndrange.hpp
+#define GEMM_BLOCKING 1
+#define GEMM_VECTOR_WIDTH 16
+
 __kernel void gemm_tn (
     __global const T * restrict A,
     int lda,    // column stride in elements for matrix A
@@ -13,21 +17,21 @@ __kernel void gemm_tn (
 
     float16 sum = (float16)0.0f;
   
-    A += i * k;
-    B += j * k;
+    A += i * lda;
+    B += j * ldb;
 
-    for (int l = 0; l < k; l += 16)
+    for (int l = 0; l < k; l += GEMM_VECTOR_WIDTH)
     {
         float16 x = vload16(0, A);
         float16 y = vload16(0, B);
 
         sum += x * y;
 
-        A += 16; // this is faster than A[i* k + l]. 11 GFlops vs. 10 GFlops.
-        B += 16;
+        A += GEMM_VECTOR_WIDTH; // this is faster than A[i* k + l]. 11 GFlops vs. 10 GFlops.
+        B += GEMM_VECTOR_WIDTH;
     }
 
-    C[i * k + j] = sum.s0 + sum.s1 + sum.s2 + sum.s3
+    C[i * ldc + j] = sum.s0 + sum.s1 + sum.s2 + sum.s3
                                   + sum.s4 + sum.s5 + sum.s6 + sum.s7
                                   + sum.s8 + sum.s9 + sum.sa + sum.sb
                                       + sum.sc + sum.sd + sum.se + sum.sf;
@@ -1,3 +1,7 @@
+// Blocking metadata for the host, see ndrange.hpp
+#define GEMM_BLOCKING 1
+#define GEMM_VECTOR_WIDTH 8
+
 #define dot8(a,b) \
     (dot(a.hi, b.hi) + dot(a.lo, b.lo))
 
@@ -17,20 +21,20 @@ __kernel void gemm_tn (
 
     float sum = 0.0f;
   
-    A += i * k;
-    B += j * k;
+    A += i * lda;
+    B += j * ldb;
 
-    for (int l = 0; l < k; l += 8)
+    for (int l = 0; l < k; l += GEMM_VECTOR_WIDTH)
     {
         float8 x = vload8(0, A);
         float8 y = vload8(0, B);
 
         sum += dot8(x, y);
 
-        A += 8; // this is faster than A[i* k + l]. 11 GFlops vs. 10 GFlops.
-        B += 8;
+        A += GEMM_VECTOR_WIDTH; // this is faster than A[i* k + l]. 11 GFlops vs. 10 GFlops.
+        B += GEMM_VECTOR_WIDTH;
     }
 
-    C[i * k + j] = sum;
+    C[i * ldc + j] = sum;
 }
 
@@ -0,0 +1,78 @@
+#define dot8(a,b) \
+    (dot(a.hi, b.hi) + dot(a.lo, b.lo))
+
+// Number of ints in one task descriptor, see GEMMTask in persistent.hpp.
+#define TASK_INTS 10
+
+// Persistent kernel: a fixed grid of work-groups pulls small GEMM tasks
+// from the work queue until it is drained, so many problems share one launch.
+// Each task computes C = A * transposed(B) in the tn layout of gemm_tn.
+__kernel void gemm_tn_persistent (
+    __global const int * restrict tasks,    // descriptors of TASK_INTS each
+    int first_task, // tasks from first_task to end_task - 1 are executed
+    int end_task,
+    volatile __global int * head,   // index of the next task to take; zeroed by host before launch
+    __global const T * restrict A,
+    __global const T * restrict B,
+    __global T * restrict C
+)
+{
+    __local int task;
+
+    const int lid = get_local_id(0);
+    const int lsize = get_local_size(0);
+
+    for(;;)
+    {
+        if(lid == 0)
+        {
+            task = first_task + atomic_inc(head);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        const int t = task;
+        // everybody should read task before work-item 0 takes the next one
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if(t >= end_task)
+        {
+            return;
+        }
+
+        __global const int* d = tasks + t * TASK_INTS;
+        const int m = d[0];
+        const int n = d[1];
+        const int k = d[2];
+        const int lda = d[3];
+        const int ldb = d[4];
+        const int ldc = d[5];
+
+        __global const T* a0 = A + d[6];
+        __global const T* b0 = B + d[7];
+        __global T* c0 = C + d[8];
+
+        for(int e = lid; e < m * n; e += lsize)
+        {
+            const int i = e / n;
+            const int j = e - i * n;
+
+            __global const T* a = a0 + i * lda;
+            __global const T* b = b0 + j * ldb;
+
+            T sum = 0;
+            int l = 0;
+
+            for(; l + 8 <= k; l += 8)
+            {
+                sum += dot8(vload8(0, a + l), vload8(0, b + l));
+            }
+
+            for(; l < k; ++l)
+            {
+                sum += a[l] * b[l];
+            }
+
+            c0[i * ldc + j] = sum;
+        }
+    }
+}
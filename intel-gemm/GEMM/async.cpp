@@ -0,0 +1,345 @@
+// Asynchronous host API for GEMM, see async.hpp.
+
+
+#include <cassert>
+
+#include "basic.hpp"
+#include "async.hpp"
+#include "gemmkernel.hpp"
+
+using namespace std;
+
+
+namespace
+{
+
+cl_int executionStatus (cl_event event)
+{
+    cl_int status = CL_COMPLETE;
+    cl_int err = clGetEventInfo(
+        event,
+        CL_EVENT_COMMAND_EXECUTION_STATUS,
+        sizeof(status),
+        &status,
+        0
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    // Negative status is an error code of the terminated command.
+    if(status < 0)
+    {
+        throw Error("Asynchronous command terminated with error " + opencl_error_to_str(status));
+    }
+
+    return status;
+}
+
+}
+
+
+GEMMFuture::GEMMFuture () :
+    command_event(0)
+{
+}
+
+
+GEMMFuture::GEMMFuture (cl_event event) :
+    command_event(event)
+{
+}
+
+
+GEMMFuture::GEMMFuture (const GEMMFuture& other) :
+    command_event(other.command_event)
+{
+    if(command_event)
+    {
+        cl_int err = clRetainEvent(command_event);
+        SAMPLE_CHECK_ERRORS(err);
+    }
+}
+
+
+GEMMFuture& GEMMFuture::operator= (const GEMMFuture& other)
+{
+    if(other.command_event)
+    {
+        cl_int err = clRetainEvent(other.command_event);
+        SAMPLE_CHECK_ERRORS(err);
+    }
+
+    if(command_event)
+    {
+        cl_int err = clReleaseEvent(command_event);
+        SAMPLE_CHECK_ERRORS(err);
+    }
+
+    command_event = other.command_event;
+    return *this;
+}
+
+
+GEMMFuture::~GEMMFuture ()
+{
+    try
+    {
+        if(command_event)
+        {
+            cl_int err = clReleaseEvent(command_event);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+    }
+    catch(...)
+    {
+        destructorException();
+    }
+}
+
+
+bool GEMMFuture::ready () const
+{
+    if(!command_event)
+    {
+        return true;
+    }
+
+    if(executionStatus(command_event) == CL_COMPLETE)
+    {
+        return true;
+    }
+
+    // Commands may stay in the queue till it is flushed, so a host that
+    // only polls would never see them complete.
+    cl_command_queue queue = 0;
+    cl_int err = clGetEventInfo(command_event, CL_EVENT_COMMAND_QUEUE, sizeof(queue), &queue, 0);
+    SAMPLE_CHECK_ERRORS(err);
+
+    if(queue)
+    {
+        err = clFlush(queue);
+        SAMPLE_CHECK_ERRORS(err);
+    }
+
+    return false;
+}
+
+
+void GEMMFuture::wait () const
+{
+    if(!command_event)
+    {
+        return;
+    }
+
+    cl_int err = clWaitForEvents(1, &command_event);
+
+    // The status tells the error of the command itself.
+    if(err == CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST)
+    {
+        executionStatus(command_event);
+    }
+
+    SAMPLE_CHECK_ERRORS(err);
+}
+
+
+GEMMDependencies dependencies (const GEMMFuture& first)
+{
+    return GEMMDependencies(1, first);
+}
+
+
+GEMMDependencies dependencies (const GEMMFuture& first, const GEMMFuture& second)
+{
+    GEMMDependencies result(1, first);
+    result.push_back(second);
+    return result;
+}
+
+
+HostPromise::HostPromise (cl_context context) :
+    user_event(0),
+    completed(false)
+{
+    cl_int err = 0;
+    user_event = clCreateUserEvent(context, &err);
+    SAMPLE_CHECK_ERRORS(err);
+}
+
+
+HostPromise::~HostPromise ()
+{
+    try
+    {
+        if(!completed)
+        {
+            // Any negative value terminates the commands that wait for it.
+            cl_int err = clSetUserEventStatus(user_event, -1);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+
+        cl_int err = clReleaseEvent(user_event);
+        SAMPLE_CHECK_ERRORS(err);
+    }
+    catch(...)
+    {
+        destructorException();
+    }
+}
+
+
+GEMMFuture HostPromise::future () const
+{
+    cl_int err = clRetainEvent(user_event);
+    SAMPLE_CHECK_ERRORS(err);
+    return GEMMFuture(user_event);
+}
+
+
+void HostPromise::complete ()
+{
+    if(completed)
+    {
+        throw Error("Host promise is completed twice");
+    }
+
+    cl_int err = clSetUserEventStatus(user_event, CL_COMPLETE);
+    SAMPLE_CHECK_ERRORS(err);
+    completed = true;
+}
+
+
+template <typename T>
+AsyncGEMM<T>::AsyncGEMM (
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable,
+    size_t blocking,
+    size_t local_size
+) :
+    oclobjects(oclobjects),
+    kernel(executable.kernel),
+    blocking(blocking),
+    local_size(local_size)
+{
+    assert(blocking > 0 && local_size > 0);
+}
+
+
+template <typename T>
+const vector<cl_event>& AsyncGEMM<T>::waitList (const GEMMDependencies& dependencies)
+{
+    wait_list.clear();
+    for(size_t i = 0; i < dependencies.size(); ++i)
+    {
+        if(dependencies[i].event())
+        {
+            wait_list.push_back(dependencies[i].event());
+        }
+    }
+
+    return wait_list;
+}
+
+
+template <typename T>
+GEMMFuture AsyncGEMM<T>::multiply (
+    cl_mem C,
+    cl_mem A,
+    cl_mem B,
+    size_t size,
+    size_t ld,
+    const GEMMDependencies& dependencies
+)
+{
+    if(size == 0 || size % (blocking*local_size) != 0)
+    {
+        throw Error(
+            "Size " + to_str(size) + " of asynchronous GEMM should be a positive multiple of " +
+            to_str(blocking*local_size) + " (blocking by work-group size)"
+        );
+    }
+
+    // Arguments are captured at enqueue, so the kernel is reused by all calls.
+    setGEMMTNArgs(kernel, A, ld, B, ld, C, ld, size);
+
+    size_t global_size[2] = { size/blocking, size/blocking };
+    size_t local[2] = { local_size, local_size };
+
+    const vector<cl_event>& events = waitList(dependencies);
+    cl_event event = 0;
+
+    cl_int err = clEnqueueNDRangeKernel(
+        oclobjects.queue,
+        kernel,
+        2,
+        0,
+        global_size,
+        local,
+        cl_uint(events.size()),
+        events.empty() ? 0 : &events[0],
+        &event
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    return GEMMFuture(event);
+}
+
+
+template <typename T>
+GEMMFuture AsyncGEMM<T>::write (
+    cl_mem buffer,
+    const T* host,
+    size_t count,
+    const GEMMDependencies& dependencies
+)
+{
+    const vector<cl_event>& events = waitList(dependencies);
+    cl_event event = 0;
+
+    cl_int err = clEnqueueWriteBuffer(
+        oclobjects.queue,
+        buffer,
+        CL_FALSE,
+        0,
+        count*sizeof(T),
+        host,
+        cl_uint(events.size()),
+        events.empty() ? 0 : &events[0],
+        &event
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    return GEMMFuture(event);
+}
+
+
+template <typename T>
+GEMMFuture AsyncGEMM<T>::read (
+    T* host,
+    cl_mem buffer,
+    size_t count,
+    const GEMMDependencies& dependencies
+)
+{
+    const vector<cl_event>& events = waitList(dependencies);
+    cl_event event = 0;
+
+    cl_int err = clEnqueueReadBuffer(
+        oclobjects.queue,
+        buffer,
+        CL_FALSE,
+        0,
+        count*sizeof(T),
+        host,
+        cl_uint(events.size()),
+        events.empty() ? 0 : &events[0],
+        &event
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    return GEMMFuture(event);
+}
+
+
+template class AsyncGEMM<float>;
+template class AsyncGEMM<double>;
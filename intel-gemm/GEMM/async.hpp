@@ -0,0 +1,157 @@
+// Asynchronous host API for GEMM.
+//
+// Every call of AsyncGEMM enqueues its command without waiting and returns
+// a GEMMFuture that wraps the cl_event of the command. Calls accept futures
+// of earlier commands as dependencies, which become the event wait list,
+// so a chain of multiplications and transfers is submitted without a sync
+// point between its steps. Host work takes part in the chain through
+// HostPromise: its future is a user event that the host completes when
+// the work is done.
+//
+//     GEMMFuture upload = gemm.write(A, host_A, count);
+//     GEMMFuture product = gemm.multiply(C, A, B, size, ld, dependencies(upload));
+//     GEMMFuture download = gemm.read(host_C, C, count, dependencies(product));
+//     ...  // host work overlapped with the chain
+//     download.wait();
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_ASYNC_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_ASYNC_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include <CL/cl.h>
+
+#include "oclobject.hpp"
+
+
+// Completion of one enqueued command. Copies share the same event.
+class GEMMFuture
+{
+public:
+
+    // Future that is complete already and does not hold any event
+    GEMMFuture ();
+
+    // Takes ownership of the event.
+    explicit GEMMFuture (cl_event event);
+
+    GEMMFuture (const GEMMFuture& other);
+    GEMMFuture& operator= (const GEMMFuture& other);
+    ~GEMMFuture ();
+
+    // Checks without blocking if the command is complete.
+    // Throws Error if it is terminated with an error.
+    bool ready () const;
+
+    // Blocks till the command is complete.
+    // Throws Error if it is terminated with an error.
+    void wait () const;
+
+    // Event of the command, 0 for a future that is complete from the start.
+    cl_event event () const
+    {
+        return command_event;
+    }
+
+private:
+
+    cl_event command_event;
+};
+
+
+// Futures to wait for before a command, as accepted by AsyncGEMM calls
+typedef std::vector<GEMMFuture> GEMMDependencies;
+
+GEMMDependencies dependencies (const GEMMFuture& first);
+GEMMDependencies dependencies (const GEMMFuture& first, const GEMMFuture& second);
+
+
+// Host work that enqueued commands can depend on: its future is complete
+// when complete() is called. A promise destroyed without complete()
+// terminates its future with an error, so dependent commands do not wait
+// forever.
+class HostPromise
+{
+public:
+
+    HostPromise (cl_context context);
+    ~HostPromise ();
+
+    GEMMFuture future () const;
+
+    void complete ();
+
+private:
+
+    cl_event user_event;
+    bool completed;
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    HostPromise (const HostPromise&);
+    HostPromise& operator= (const HostPromise&);
+};
+
+
+// Enqueues multiplications of square matrices with a kernel from gemm.cl
+// and transfers of their data to and from the host.
+template <typename T>
+class AsyncGEMM
+{
+public:
+
+    // blocking is the number of elements of C computed by one work-item
+    // in each dimension, as defined by the kernel.
+    AsyncGEMM (
+        OpenCLBasic& oclobjects,
+        OpenCLProgramOneKernel& executable,
+        size_t blocking,
+        size_t local_size
+    );
+
+    // Enqueues C = A*B for size x size matrices with row stride ld laid
+    // out as the kernel expects. size should be a multiple of
+    // blocking*local_size.
+    GEMMFuture multiply (
+        cl_mem C,
+        cl_mem A,
+        cl_mem B,
+        size_t size,
+        size_t ld,
+        const GEMMDependencies& dependencies = GEMMDependencies()
+    );
+
+    // Enqueues a copy of count elements from the host to the buffer.
+    // The host memory should not be changed till the future is complete.
+    GEMMFuture write (
+        cl_mem buffer,
+        const T* host,
+        size_t count,
+        const GEMMDependencies& dependencies = GEMMDependencies()
+    );
+
+    // Enqueues a copy of count elements from the buffer to the host.
+    // The host memory has the data when the future is complete.
+    GEMMFuture read (
+        T* host,
+        cl_mem buffer,
+        size_t count,
+        const GEMMDependencies& dependencies = GEMMDependencies()
+    );
+
+private:
+
+    OpenCLBasic& oclobjects;
+    cl_kernel kernel;
+    size_t blocking;
+    size_t local_size;
+
+    // Events of dependencies, reused to avoid reallocation
+    std::vector<cl_event> wait_list;
+
+    const std::vector<cl_event>& waitList (const GEMMDependencies& dependencies);
+};
+
+
+#endif  // end of the include guard
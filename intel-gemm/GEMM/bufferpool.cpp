@@ -0,0 +1,200 @@
+// Pool of matrix buffers, see bufferpool.hpp.
+
+
+#include <new>
+#include <memory>
+
+#include "basic.hpp"
+#include "bufferpool.hpp"
+
+using namespace std;
+
+
+template <typename T>
+BufferPool<T>::BufferPool (OpenCLBasic& oclobjects, size_t capacity) :
+    oclobjects(oclobjects),
+    capacity(capacity)
+{
+}
+
+
+template <typename T>
+BufferPool<T>::~BufferPool ()
+{
+    // Blocks still handed out are owned by their users till release,
+    // which should not happen after the pool is destroyed.
+    assert(used.empty());
+
+    while(!idle.empty())
+    {
+        delete idle.front().memory;
+        idle.pop_front();
+    }
+}
+
+
+template <typename T>
+size_t BufferPool<T>::sizeClass (size_t bytes)
+{
+    // The smallest class is one page.
+    const size_t min_class = 4096;
+    if(bytes <= min_class)
+    {
+        return min_class;
+    }
+
+    size_t highest = 1;
+    while(highest <= bytes/2)
+    {
+        highest *= 2;
+    }
+
+    return round_up_aligned(bytes, highest/4);
+}
+
+
+template <typename T>
+OpenCLDeviceAndHostMemory<T>* BufferPool<T>::acquire (size_t size)
+{
+    size_t bytes = sizeClass(size*sizeof(T));
+
+    {
+        unique_lock<mutex> lock(pool_mutex);
+
+        for(typename list<IdleBlock>::iterator i = idle.begin(); i != idle.end(); ++i)
+        {
+            if(i->bytes == bytes)
+            {
+                OpenCLDeviceAndHostMemory<T>* memory = i->memory;
+                idle.erase(i);
+
+                used[memory] = bytes;
+                stats.idle_bytes -= bytes;
+                stats.used_bytes += bytes;
+                ++stats.hits;
+                return memory;
+            }
+        }
+
+        ++stats.misses;
+    }
+
+    // Allocation is done without the lock: it is the slow part.
+    OpenCLDeviceAndHostMemory<T>* memory = create(bytes);
+
+    unique_lock<mutex> lock(pool_mutex);
+    used[memory] = bytes;
+    stats.used_bytes += bytes;
+    return memory;
+}
+
+
+template <typename T>
+void BufferPool<T>::release (OpenCLDeviceAndHostMemory<T>* block)
+{
+    if(!block)
+    {
+        return;
+    }
+
+    unique_lock<mutex> lock(pool_mutex);
+
+    typename map<OpenCLDeviceAndHostMemory<T>*, size_t>::iterator i = used.find(block);
+    assert(i != used.end());
+
+    IdleBlock idle_block = { i->second, block };
+    used.erase(i);
+
+    stats.used_bytes -= idle_block.bytes;
+    stats.idle_bytes += idle_block.bytes;
+    idle.push_front(idle_block);
+
+    trimLocked(capacity);
+}
+
+
+template <typename T>
+void BufferPool<T>::trim (size_t target)
+{
+    unique_lock<mutex> lock(pool_mutex);
+    trimLocked(target);
+}
+
+
+template <typename T>
+BufferPoolStatistics BufferPool<T>::statistics () const
+{
+    unique_lock<mutex> lock(pool_mutex);
+    return stats;
+}
+
+
+template <typename T>
+void BufferPool<T>::trimLocked (size_t target)
+{
+    while(stats.idle_bytes > target)
+    {
+        IdleBlock& oldest = idle.back();
+        stats.idle_bytes -= oldest.bytes;
+        ++stats.trimmed;
+
+        delete oldest.memory;
+        idle.pop_back();
+    }
+}
+
+
+template <typename T>
+OpenCLDeviceAndHostMemory<T>* BufferPool<T>::create (size_t bytes)
+{
+    // The second attempt is made after all idle blocks are released:
+    // they may hold the memory the allocation lacks.
+    for(int attempt = 0; ; ++attempt)
+    {
+        unique_ptr<OpenCLDeviceAndHostMemory<T>> memory(new OpenCLDeviceAndHostMemory<T>);
+        cl_int err = CL_SUCCESS;
+
+        try
+        {
+            memory->host = (T*)aligned_malloc(
+                zeroCopySizeAlignment(bytes, oclobjects.device),
+                zeroCopyPtrAlignment(oclobjects.device)
+            );
+
+            memory->device = clCreateBuffer(
+                oclobjects.context,
+                CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,
+                bytes,
+                memory->host,
+                &err
+            );
+        }
+        catch(const bad_alloc&)
+        {
+            err = CL_OUT_OF_HOST_MEMORY;
+        }
+
+        bool out_of_memory =
+            err == CL_OUT_OF_HOST_MEMORY ||
+            err == CL_OUT_OF_RESOURCES ||
+            err == CL_MEM_OBJECT_ALLOCATION_FAILURE;
+
+        if(out_of_memory && attempt == 0)
+        {
+            unique_lock<mutex> lock(pool_mutex);
+            if(!idle.empty())
+            {
+                ++stats.pressure_trims;
+                trimLocked(0);
+                continue;
+            }
+        }
+
+        SAMPLE_CHECK_ERRORS(err);
+        return memory.release();
+    }
+}
+
+
+template class BufferPool<float>;
+template class BufferPool<double>;
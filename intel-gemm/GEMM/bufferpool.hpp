@@ -0,0 +1,121 @@
+// Pool of matrix buffers for services that run many multiplications.
+//
+// A multiplication needs three blocks of aligned host memory, each wrapped
+// with a cl_mem object. Creating and releasing them for every call costs
+// more than the multiplication itself for small sizes. The pool keeps
+// released blocks and hands them out again to requests of the same size
+// class. Size classes are quarter-octaves: a request is rounded up to
+// a multiple of a quarter of its highest power of two, so at most 25% of
+// a block is wasted. Idle blocks over the capacity and, on allocation
+// failures, all idle blocks are released, least recently used first.
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_BUFFERPOOL_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_BUFFERPOOL_HPP_
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <mutex>
+
+#include <CL/cl.h>
+
+#include "oclobject.hpp"
+
+
+struct BufferPoolStatistics
+{
+    size_t hits;            // requests served by an idle block
+    size_t misses;          // requests that created a new block
+    size_t trimmed;         // idle blocks released by capacity limit or trim
+    size_t pressure_trims;  // times all idle blocks were released to retry a failed allocation
+    size_t used_bytes;      // blocks handed out now
+    size_t idle_bytes;      // blocks kept for reuse
+
+    BufferPoolStatistics () :
+        hits(0), misses(0), trimmed(0), pressure_trims(0), used_bytes(0), idle_bytes(0)
+    {
+    }
+};
+
+
+template <typename T>
+class BufferPool
+{
+public:
+
+    // capacity is the maximum total size of idle blocks in bytes;
+    // with 0 every released block is deallocated at once.
+    BufferPool (OpenCLBasic& oclobjects, size_t capacity);
+    ~BufferPool ();
+
+    // Returns a block of at least size elements: host memory from
+    // aligned_malloc wrapped with CL_MEM_USE_HOST_PTR buffer of the
+    // whole size class. Thread-safe.
+    OpenCLDeviceAndHostMemory<T>* acquire (size_t size);
+
+    // Returns a block from acquire to the pool. Commands that use it
+    // should be finished. Thread-safe.
+    void release (OpenCLDeviceAndHostMemory<T>* block);
+
+    // Releases idle blocks, least recently used first, till their
+    // total size is not greater than target bytes.
+    void trim (size_t target);
+
+    BufferPoolStatistics statistics () const;
+
+    // Size class in bytes for a request of given number of bytes.
+    static size_t sizeClass (size_t bytes);
+
+private:
+
+    struct IdleBlock
+    {
+        size_t bytes;
+        OpenCLDeviceAndHostMemory<T>* memory;
+    };
+
+    OpenCLDeviceAndHostMemory<T>* create (size_t bytes);
+    void trimLocked (size_t target);
+
+    OpenCLBasic& oclobjects;
+    size_t capacity;
+
+    mutable std::mutex pool_mutex;
+    std::list<IdleBlock> idle;  // the most recently released first
+    std::map<OpenCLDeviceAndHostMemory<T>*, size_t> used;   // size class of every block handed out
+    BufferPoolStatistics stats;
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    BufferPool (const BufferPool&);
+    BufferPool& operator= (const BufferPool&);
+};
+
+
+// Block of a pool returned at the end of the scope.
+template <typename T>
+struct PooledMemory
+{
+    BufferPool<T>& pool;
+    OpenCLDeviceAndHostMemory<T>* memory;
+
+    PooledMemory (BufferPool<T>& pool, size_t size) :
+        pool(pool),
+        memory(pool.acquire(size))
+    {
+    }
+
+    ~PooledMemory ()
+    {
+        pool.release(memory);
+    }
+
+private:
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    PooledMemory (const PooledMemory&);
+    PooledMemory& operator= (const PooledMemory&);
+};
+
+
+#endif  // end of the include guard
@@ -23,6 +23,7 @@
 #include <cmath>
 
 #include "cmdoptions.hpp"
+#include "ndrange.hpp"
 
 using namespace std;
 
@@ -93,7 +94,9 @@ CmdParserGEMM::CmdParserGEMM (int argc, const char** argv) :
         0,
         "global-size",
         "<integer>",
-        "global size parameter of OpenCL",
+        "global size parameter of OpenCL; derived as --size divided by the "
+            "blocking that gemm.cl declares if not set, checked against it "
+            "otherwise",
         1024
     ),
     local_size(
@@ -101,7 +104,9 @@ CmdParserGEMM::CmdParserGEMM (int argc, const char** argv) :
         0,
         "local-size",
         "<integer>",
-        "local size parameter of OpenCL",
+        "local size parameter of OpenCL; for gemm.cl that declares its "
+            "blocking, derived as the biggest square power-of-two "
+            "work-group that divides the global size if not set",
         16
     ),
     tile_size_M(
@@ -146,6 +151,314 @@ CmdParserGEMM::CmdParserGEMM (int argc, const char** argv) :
         "Size of block in dot-product direction (applicable for "
             "nn kernel only).",
         8
+    ),
+    backend(
+        *this,
+        0,
+        "backend",
+        "",
+        "Engine that multiplies matrices. opencl uses the selected OpenCL "
+            "device; cpu uses the native host engine with packed panels and "
+            "a SIMD micro-kernel chosen at build time, no OpenCL device is "
+            "needed in this case.",
+        "opencl"
+    ),
+    backend_opencl(backend, "opencl"),
+    backend_cpu(backend, "cpu"),
+    mode(
+        *this,
+        0,
+        "mode",
+        "",
+        "Execution mode. single runs one big multiplication per iteration "
+            "with the kernel from gemm.cl; persistent runs --batch small "
+            "multiplications of --size with the persistent kernel from "
+            "gemm-persistent.cl in one launch; strassen multiplies with "
+            "Strassen-Winograd recursion down to --strassen-cutoff and the "
+            "kernel from gemm.cl at the bottom; hetero splits rows of C "
+            "between the OpenCL device and the native host engine; multi "
+            "splits rows of C between all devices selected by --device; "
+            "tenants measures latency of --tenants concurrent streams of "
+            "multiplications with and without --device-partition; image "
+            "compares the kernel from gemm.cl with the texture-path kernel "
+            "from gemm-image.cl for every size from --sizes; pool runs "
+            "--requests multiplications of sizes from --sizes with and without "
+            "reuse of buffers; fused evaluates C = alpha*A*B + beta*C and "
+            "relu(A*B + bias) with one launch of the kernel from gemm-fused.cl each; "
+            "replay runs a chain of --layers multiplications by setting kernel "
+            "arguments every iteration and by replaying a recorded sequence; "
+            "async runs --requests chains of transfers and multiplications "
+            "through the future-returning API with and without waiting after "
+            "every step; coroutine runs --tenants streams of --requests "
+            "multiplications from one host thread, blocking and as coroutines "
+            "(needs a build with C++20); serve runs the GEMM service daemon on "
+            "--socket till Ctrl+C, coalescing requests of one shape into "
+            "launches of the persistent kernel of up to --batch requests; load "
+            "runs --tenants clients of the service with --requests "
+            "multiplications of sizes from --sizes each; priority runs one "
+            "multiplication of --size in the background and --requests urgent "
+            "ones of sizes from --sizes, in the order of arrival and with "
+            "priority classes and chunks of --chunk-ms; ring submits --requests "
+            "multiplications of --size from 1, 2, 4, ... up to --threads "
+            "producer threads through a mutex queue and a lock-free ring "
+            "drained by one dispatcher thread; trace re-executes the shape "
+            "trace from --trace with every program from --programs; dispatch "
+            "runs every shape from --shapes with the kernel variant selected "
+            "for it; occupancy estimates register pressure and active "
+            "work-items of every kernel variant without running them.",
+        "single"
+    ),
+    mode_single(mode, "single"),
+    mode_persistent(mode, "persistent"),
+    mode_strassen(mode, "strassen"),
+    mode_hetero(mode, "hetero"),
+    mode_multi(mode, "multi"),
+    mode_tenants(mode, "tenants"),
+    mode_image(mode, "image"),
+    mode_pool(mode, "pool"),
+    mode_fused(mode, "fused"),
+    mode_replay(mode, "replay"),
+    mode_async(mode, "async"),
+    mode_coroutine(mode, "coroutine"),
+    mode_serve(mode, "serve"),
+    mode_load(mode, "load"),
+    mode_priority(mode, "priority"),
+    mode_ring(mode, "ring"),
+    mode_trace(mode, "trace"),
+    mode_dispatch(mode, "dispatch"),
+    mode_occupancy(mode, "occupancy"),
+    batch(
+        *this,
+        0,
+        "batch",
+        "<integer>",
+        "Number of independent multiplications of --size submitted together "
+            "in persistent mode, maximum number of requests in one launch in "
+            "serve and ring modes (applicable for persistent, serve and ring "
+            "modes only).",
+        64
+    ),
+    persistent_groups(
+        *this,
+        0,
+        "persistent-groups",
+        "<integer>",
+        "Number of work-groups launched by the persistent kernel. "
+            "Zero selects two work-groups per compute unit.",
+        0
+    ),
+    strassen_cutoff(
+        *this,
+        0,
+        "strassen-cutoff",
+        "<integer>",
+        "Matrices of this size or smaller are multiplied by the kernel "
+            "directly (applicable for strassen mode only).",
+        1024
+    ),
+    threads(
+        *this,
+        0,
+        "threads",
+        "<integer>",
+        "Number of threads of the native host engine; tiles of C are "
+            "distributed between them with work stealing. Zero selects one "
+            "thread per hardware thread. In ring mode, the maximum number of "
+            "producer threads (applicable for cpu backend, hetero and ring "
+            "modes only).",
+        0
+    ),
+    cpu_affinity(
+        *this,
+        0,
+        "cpu-affinity",
+        "<list>",
+        "CPUs the host engine threads are pinned to: none, or comma-separated "
+            "CPU numbers and ranges like 0-3 or 4,5,6,7; thread i is pinned "
+            "to the i-th CPU of the list, cyclically. Useful to run on big or "
+            "LITTLE cores only (applicable for cpu backend and hetero mode only).",
+        "none"
+    ),
+    hetero_share(
+        *this,
+        0,
+        "hetero-share",
+        "<number>",
+        "Initial fraction of rows of C computed by the OpenCL device, from 0 "
+            "to 1; the rest is computed by the host engine. The fraction is "
+            "adjusted after every iteration from measured throughput of both "
+            "sides. Negative value calibrates it by a balanced run first "
+            "(applicable for hetero mode only).",
+        -1
+    ),
+    device_partition(
+        *this,
+        0,
+        "device-partition",
+        "<spec>",
+        "Partitions the selected device into sub-devices with device fission: "
+            "none, equally:<n> for sub-devices of n compute units, "
+            "counts:<n1>,<n2>,... for sub-devices of given sizes, or "
+            "affinity:<domain> with domain numa, l1, l2, l3, l4 or next. "
+            "Sub-devices are used as separate devices by multi and tenants modes.",
+        "none"
+    ),
+    tenants(
+        *this,
+        0,
+        "tenants",
+        "<integer>",
+        "Number of concurrent streams of multiplications, each from its own "
+            "host thread in tenants mode and a coroutine of one host thread in "
+            "coroutine mode, a client of the GEMM service in load mode "
+            "(applicable for tenants, coroutine and load modes only).",
+        4
+    ),
+    requests(
+        *this,
+        0,
+        "requests",
+        "<integer>",
+        "Number of multiplications issued by each stream one after another "
+            "(applicable for tenants, pool, async, coroutine, load, priority and "
+            "ring modes only).",
+        32
+    ),
+    sizes(
+        *this,
+        0,
+        "sizes",
+        "<list>",
+        "Comma-separated list of matrix sizes to compare; global size for "
+            "each of them keeps the blocking given by --size and "
+            "--global-size. Empty list means --size only "
+            "(applicable for image, pool, load and priority modes only).",
+        ""
+    ),
+    pool_capacity(
+        *this,
+        0,
+        "pool-capacity",
+        "<integer>",
+        "Maximum size of idle buffers kept by the buffer pool for reuse, in MB "
+            "(applicable for pool and serve modes only).",
+        256
+    ),
+    layers(
+        *this,
+        0,
+        "layers",
+        "<integer>",
+        "Number of multiplications in the chain, each one uses the result "
+            "of the previous one (applicable for replay mode only).",
+        8
+    ),
+    socket(
+        *this,
+        0,
+        "socket",
+        "<path>",
+        "Unix domain socket of the GEMM service "
+            "(applicable for serve and load modes only).",
+        "/tmp/intelgemm.sock"
+    ),
+    chunk_ms(
+        *this,
+        0,
+        "chunk-ms",
+        "<number>",
+        "Target execution time of one chunk of rows of a background "
+            "multiplication, in milliseconds; it bounds the wait of urgent "
+            "ones (applicable for priority mode only).",
+        5
+    ),
+    trace(
+        *this,
+        0,
+        "trace",
+        "<file>",
+        "Binary trace of the shapes of multiplications: single mode, serve "
+            "mode and the cpu backend write every multiplication to it, trace "
+            "mode reads it; other modes do not support it.",
+        ""
+    ),
+    programs(
+        *this,
+        0,
+        "programs",
+        "<file>,<file>,...",
+        "Comma-separated list of OpenCL program files with the kernel "
+            "selected by --kernel and the same blocking, to compare "
+            "(applicable for trace and occupancy modes only).",
+        "gemm.cl"
+    ),
+    shapes(
+        *this,
+        0,
+        "shapes",
+        "<m>x<n>x<k>,...",
+        "Comma-separated list of shapes of C (m x n) = A (m x k) * B (k x n); "
+            "squares of --sizes if empty (applicable for dispatch mode only).",
+        ""
+    ),
+    memory(
+        *this,
+        0,
+        "memory",
+        "",
+        "How matrices are shared between the host and the device. "
+            "use-host-ptr wraps aligned host memory with CL_MEM_USE_HOST_PTR; "
+            "alloc-host-ptr lets the driver allocate it with CL_MEM_ALLOC_HOST_PTR; "
+            "both are accessed through map/unmap. copy uses device buffers with "
+            "explicit write and read. svm-coarse and svm-fine use OpenCL 2.0 "
+            "coarse- and fine-grain buffer SVM if available "
+            "(applicable for single mode only).",
+        "use-host-ptr"
+    ),
+    memory_use_host_ptr(memory, "use-host-ptr"),
+    memory_alloc_host_ptr(memory, "alloc-host-ptr"),
+    memory_copy(memory, "copy"),
+    memory_svm_coarse(memory, "svm-coarse"),
+    memory_svm_fine(memory, "svm-fine"),
+    padding(
+        *this,
+        0,
+        "padding",
+        "",
+        "Extra padding of matrix rows against memory bank and channel conflicts, "
+            "which appear when the row stride is a large power of two. "
+            "none only aligns rows; model makes the row stride an odd multiple of "
+            "the memory interleaving granularity of the device; probe times the "
+            "kernel with several candidate strides and takes the fastest "
+            "(probe is applicable for single mode only, other modes use model instead).",
+        "none"
+    ),
+    padding_none(padding, "none"),
+    padding_model(padding, "model"),
+    padding_probe(padding, "probe"),
+    huge_pages(
+        *this,
+        0,
+        "huge-pages",
+        "",
+        "Page size for host memory of matrices of 2 MB and larger. "
+            "transparent asks the system for transparent huge pages; "
+            "explicit takes pages from the reserved huge page pool "
+            "(see /proc/sys/vm/nr_hugepages) and falls back to transparent.",
+        "none"
+    ),
+    huge_pages_none(huge_pages, "none"),
+    huge_pages_transparent(huge_pages, "transparent"),
+    huge_pages_explicit(huge_pages, "explicit"),
+    numa(
+        *this,
+        0,
+        "numa",
+        "<placement>",
+        "NUMA placement of host memory of matrices of 2 MB and larger: "
+            "none, bind:<nodes>, interleave (over all nodes) or "
+            "interleave:<nodes>, where <nodes> is a list like 0 or 0-1,3.",
+        "none"
     )
 {
 }
@@ -180,6 +493,20 @@ void CmdParserGEMM::parse ()
             "One of them should be chosen."
         );
     }
+
+    // Other modes launch kernels through paths that do not record shapes,
+    // their trace would be silently empty.
+    if(
+        !trace.getValue().empty() &&
+        !mode_single.isSet() && !mode_serve.isSet() && !mode_trace.isSet()
+    )
+    {
+        throw CmdParser::Error(
+            trace.name() + " is written by single and serve modes and read "
+            "by trace mode only; it is not supported by " + mode.name() + " " +
+            mode.getValue() + "."
+        );
+    }
 }
 
 
@@ -323,3 +650,140 @@ void CmdParserGEMM::validateParameters (
         "should divide matrix size without a remainder"
     );
 }
+
+
+void CmdParserGEMM::deriveNDRange (
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable
+)
+{
+    GEMMKernelMetadata metadata =
+        gemmKernelMetadata(executable.program, executable.kernel, oclobjects.device);
+
+    if(metadata.blocking == 0)
+    {
+        return;
+    }
+
+    validatePositiveness(size);
+
+    size.validate(
+        size.getValue() % metadata.blocking == 0,
+        "should be a multiple of blocking " + to_str(metadata.blocking) + " of the kernel"
+    );
+
+    if(metadata.vector_width)
+    {
+        size.validate(
+            size.getValue() % metadata.vector_width == 0,
+            "should be a multiple of vector width " + to_str(metadata.vector_width) + " of the kernel"
+        );
+    }
+
+    size_t derived_global_size = size.getValue()/metadata.blocking;
+
+    if(global_size.isSet())
+    {
+        global_size.validate(
+            global_size.getValue() == derived_global_size,
+            "should be " + to_str(derived_global_size) + " for blocking " +
+            to_str(metadata.blocking) + " of the kernel; omit it to derive"
+        );
+    }
+    else
+    {
+        global_size.setDefaultValue(derived_global_size);
+    }
+
+    // One value is used for both dimensions.
+    if(!local_size.isSet())
+    {
+        local_size.setDefaultValue(squareWorkGroupEdge(metadata, derived_global_size, 0));
+    }
+}
+
+
+void CmdParserGEMM::validateHostParameters ()
+{
+    validatePositiveness(size);
+
+    iterations.validate(
+        iterations.getValue() >= 0,
+        "negative value is provided; should be positive or zero"
+    );
+
+    if(!mode_single.isSet())
+    {
+        throw CmdParser::Error(
+            "Only single mode is supported by " + backend.name() + " " +
+            backend_cpu.getValue() + "."
+        );
+    }
+}
+
+
+void CmdParserGEMM::validateBatchParameters (
+    OpenCLBasic& oclobjects,
+    size_t size_of_element
+)
+{
+    validatePositiveness(size);
+    validatePositiveness(batch);
+
+    iterations.validate(
+        iterations.getValue() >= 0,
+        "negative value is provided; should be positive or zero"
+    );
+
+    cl_ulong max_alloc_size = 0;
+    cl_int err = clGetDeviceInfo(
+        oclobjects.device,
+        CL_DEVICE_MAX_MEM_ALLOC_SIZE,
+        sizeof(max_alloc_size),
+        &max_alloc_size,
+        0
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    // All matrices of the batch are placed in one buffer
+    // for each of A, B and C.
+    double batch_memory_size =
+        double(batch.getValue())*size.getValue()*size.getValue()*size_of_element;
+
+    batch.validate(
+        batch_memory_size <= double(max_alloc_size),
+        "too big value; all matrices of the batch should fit in " +
+            to_str(max_alloc_size) + " bytes"
+    );
+
+    batch.validate(
+        batch.getValue()*size.getValue()*size.getValue() <=
+            size_t(numeric_limits<int>::max()),
+        "too big value; offsets in the batch cannot be represented as type int"
+    );
+}
+
+
+void CmdParserGEMM::requireKernelTN (const string& mode_name) const
+{
+    if(!kernel_tn.isSet())
+    {
+        throw CmdParser::Error(
+            mode_name + " mode supports tn kernel only; use " + kernel.name() + " tn."
+        );
+    }
+}
+
+
+size_t CmdParserGEMM::kernelBlocking () const
+{
+    if(global_size.getValue() == 0 || size.getValue() % global_size.getValue() != 0)
+    {
+        throw CmdParser::Error(
+            global_size.name() + " should divide matrix size without "
+            "a remainder; their ratio is the blocking of the kernel."
+        );
+    }
+
+    return size.getValue()/global_size.getValue();
+}
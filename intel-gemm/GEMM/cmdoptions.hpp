@@ -57,6 +57,72 @@ public:
     CmdOption<size_t> global_size;
     CmdOption<size_t> local_size;
 
+    CmdOption<string> backend;
+        CmdEnum<string> backend_opencl;
+        CmdEnum<string> backend_cpu;
+
+    CmdOption<string> mode;
+        CmdEnum<string> mode_single;
+        CmdEnum<string> mode_persistent;
+        CmdEnum<string> mode_strassen;
+        CmdEnum<string> mode_hetero;
+        CmdEnum<string> mode_multi;
+        CmdEnum<string> mode_tenants;
+        CmdEnum<string> mode_image;
+        CmdEnum<string> mode_pool;
+        CmdEnum<string> mode_fused;
+        CmdEnum<string> mode_replay;
+        CmdEnum<string> mode_async;
+        CmdEnum<string> mode_coroutine;
+        CmdEnum<string> mode_serve;
+        CmdEnum<string> mode_load;
+        CmdEnum<string> mode_priority;
+        CmdEnum<string> mode_ring;
+        CmdEnum<string> mode_trace;
+        CmdEnum<string> mode_dispatch;
+        CmdEnum<string> mode_occupancy;
+
+    CmdOption<size_t> batch;
+    CmdOption<size_t> persistent_groups;
+    CmdOption<size_t> strassen_cutoff;
+
+    CmdOption<size_t> threads;
+    CmdOption<string> cpu_affinity;
+
+    CmdOption<float> hetero_share;
+
+    CmdOption<string> device_partition;
+    CmdOption<size_t> tenants;
+    CmdOption<size_t> requests;
+
+    CmdOption<string> sizes;
+    CmdOption<size_t> pool_capacity;
+    CmdOption<size_t> layers;
+    CmdOption<string> socket;
+    CmdOption<float> chunk_ms;
+    CmdOption<string> trace;
+    CmdOption<string> programs;
+    CmdOption<string> shapes;
+
+    CmdOption<string> memory;
+        CmdEnum<string> memory_use_host_ptr;
+        CmdEnum<string> memory_alloc_host_ptr;
+        CmdEnum<string> memory_copy;
+        CmdEnum<string> memory_svm_coarse;
+        CmdEnum<string> memory_svm_fine;
+
+    CmdOption<string> padding;
+        CmdEnum<string> padding_none;
+        CmdEnum<string> padding_model;
+        CmdEnum<string> padding_probe;
+
+    CmdOption<string> huge_pages;
+        CmdEnum<string> huge_pages_none;
+        CmdEnum<string> huge_pages_transparent;
+        CmdEnum<string> huge_pages_explicit;
+
+    CmdOption<string> numa;
+
     CmdParserGEMM (int argc, const char** argv);
     virtual void parse ();
 
@@ -69,6 +135,34 @@ public:
         size_t alignment    // alignment requirements in bytes
     );
 
+    // Check parameters for the native host engine,
+    // which does not depend on OpenCL device capabilities.
+    void validateHostParameters ();
+
+    // Sets --global-size and --local-size, if they are not given, from the
+    // blocking the program of executable declares (see ndrange.hpp) and
+    // checks them and --size against it otherwise. Programs without the
+    // declaration use the values as given.
+    void deriveNDRange (
+        OpenCLBasic& oclobjects,
+        OpenCLProgramOneKernel& executable
+    );
+
+    // Check parameters for the modes that run a batch of
+    // small independent multiplications instead of one big one.
+    void validateBatchParameters (
+        OpenCLBasic& oclobjects,
+        size_t size_of_element
+    );
+
+    // Throws if --kernel is not tn: the modes built
+    // around gemm_tn call it with their name.
+    void requireKernelTN (const string& mode_name) const;
+
+    // Blocking of the kernel, the ratio of --size to --global-size.
+    // Throws if --global-size does not divide --size.
+    size_t kernelBlocking () const;
+
 private:
 
     template <typename T>
@@ -0,0 +1,131 @@
+// Coroutine executor that overlaps host work with GEMM on the device,
+// see coexecutor.hpp.
+
+
+#include "coexecutor.hpp"
+
+#ifdef __cpp_impl_coroutine
+
+#include "basic.hpp"
+
+using namespace std;
+
+
+namespace
+{
+
+// Passed to the completion callback of a suspended task
+struct Resumption
+{
+    GEMMExecutor* executor;
+    coroutine_handle<GEMMExecutor::Task::promise_type> handle;
+};
+
+}
+
+
+void GEMMExecutor::Completion::await_suspend (coroutine_handle<Task::promise_type> handle)
+{
+    Resumption* resumption = new Resumption;
+    resumption->executor = &executor;
+    resumption->handle = handle;
+
+    // The callback is called for errors too: the status is negative then.
+    cl_int err = clSetEventCallback(future.event(), CL_COMPLETE, completed, resumption);
+    if(err != CL_SUCCESS)
+    {
+        delete resumption;
+    }
+    SAMPLE_CHECK_ERRORS(err);
+
+    ++executor.suspension_count;
+}
+
+
+GEMMExecutor::GEMMExecutor () :
+    live(0),
+    suspension_count(0)
+{
+}
+
+
+GEMMExecutor::~GEMMExecutor ()
+{
+    // Tasks that were spawned but never run. Suspended tasks
+    // cannot remain: run() returns when all of them are finished.
+    for(size_t i = 0; i < ready.size(); ++i)
+    {
+        ready[i].destroy();
+    }
+}
+
+
+void GEMMExecutor::spawn (Task task)
+{
+    Handle handle = task.handle;
+    task.handle = nullptr;
+
+    ++live;
+    schedule(handle);
+}
+
+
+void GEMMExecutor::run ()
+{
+    exception_ptr first_exception;
+
+    while(live > 0)
+    {
+        Handle handle;
+
+        {
+            unique_lock<mutex> lock(ready_mutex);
+            ready_condition.wait(lock, [this] { return !ready.empty(); });
+            handle = ready.front();
+            ready.pop_front();
+        }
+
+        // Runs till the next suspension on a command or till the end.
+        handle.resume();
+
+        if(handle.done())
+        {
+            if(handle.promise().exception && !first_exception)
+            {
+                first_exception = handle.promise().exception;
+            }
+
+            handle.destroy();
+            --live;
+        }
+    }
+
+    if(first_exception)
+    {
+        rethrow_exception(first_exception);
+    }
+}
+
+
+void GEMMExecutor::schedule (Handle handle)
+{
+    {
+        lock_guard<mutex> lock(ready_mutex);
+        ready.push_back(handle);
+    }
+
+    ready_condition.notify_one();
+}
+
+
+void CL_CALLBACK GEMMExecutor::completed (cl_event event, cl_int status, void* user_data)
+{
+    // Called by a thread of the OpenCL runtime: only hands the task over
+    // to the thread of run(), await_resume checks the status there.
+    Resumption* resumption = static_cast<Resumption*>(user_data);
+    resumption->executor->schedule(resumption->handle);
+    delete resumption;
+}
+
+
+#endif  // __cpp_impl_coroutine
@@ -0,0 +1,166 @@
+// Coroutine executor that overlaps host work with GEMM on the device.
+//
+// Tasks are C++20 coroutines run by one host thread. A task enqueues
+// commands through AsyncGEMM and suspends on their completion with
+//
+//     co_await executor.completion(future);
+//
+// Suspension registers a clSetEventCallback on the event of the future;
+// the callback, called by the OpenCL runtime, puts the task back into the
+// ready queue of the executor. The host thread runs other ready tasks in
+// the meantime and sleeps only when none is ready, without polling or
+// clFinish, so many request streams share one thread and one queue.
+//
+// Coroutines need C++20: the executor is available only when the compiler
+// supports them (configure with -DUSE_cpp20=ON or build with make CPP20=1).
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_COEXECUTOR_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_COEXECUTOR_HPP_
+
+#ifdef __cpp_impl_coroutine
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+
+#include <CL/cl.h>
+
+#include "async.hpp"
+
+
+class GEMMExecutor
+{
+public:
+
+    // Coroutine type of tasks. A task starts when the executor runs,
+    // not when it is created.
+    class Task
+    {
+    public:
+
+        struct promise_type
+        {
+            std::exception_ptr exception;
+
+            Task get_return_object ()
+            {
+                return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend () noexcept { return {}; }
+            std::suspend_always final_suspend () noexcept { return {}; }
+            void return_void () {}
+            void unhandled_exception () { exception = std::current_exception(); }
+        };
+
+        Task (Task&& other) noexcept :
+            handle(other.handle)
+        {
+            other.handle = nullptr;
+        }
+
+        ~Task ()
+        {
+            if(handle)
+            {
+                handle.destroy();
+            }
+        }
+
+    private:
+
+        friend class GEMMExecutor;
+
+        explicit Task (std::coroutine_handle<promise_type> handle) :
+            handle(handle)
+        {
+        }
+
+        std::coroutine_handle<promise_type> handle;
+
+        // Disable copying and assignment to avoid incorrect resource deallocation.
+        Task (const Task&);
+        Task& operator= (const Task&);
+    };
+
+    // Awaiter for completion of a command. Should be awaited
+    // by a Task directly, not by a nested coroutine.
+    class Completion
+    {
+    public:
+
+        bool await_ready () const
+        {
+            return future.ready();
+        }
+
+        void await_suspend (std::coroutine_handle<Task::promise_type> handle);
+
+        // Throws Error if the command is terminated with an error.
+        void await_resume () const
+        {
+            future.wait();
+        }
+
+    private:
+
+        friend class GEMMExecutor;
+
+        Completion (GEMMExecutor& executor, const GEMMFuture& future) :
+            executor(executor),
+            future(future)
+        {
+        }
+
+        GEMMExecutor& executor;
+        GEMMFuture future;
+    };
+
+    GEMMExecutor ();
+    ~GEMMExecutor ();
+
+    // Takes the task to run it with the next run().
+    void spawn (Task task);
+
+    Completion completion (const GEMMFuture& future)
+    {
+        return Completion(*this, future);
+    }
+
+    // Runs all spawned tasks till they are finished. Rethrows the first
+    // exception of the tasks after the others are finished.
+    void run ();
+
+    // Number of times tasks were suspended till their commands completed.
+    size_t suspensions () const
+    {
+        return suspension_count;
+    }
+
+private:
+
+    typedef std::coroutine_handle<Task::promise_type> Handle;
+
+    std::mutex ready_mutex;
+    std::condition_variable ready_condition;
+    std::deque<Handle> ready;   // filled by run() and completion callbacks
+    size_t live;                // spawned and not finished tasks
+    size_t suspension_count;
+
+    void schedule (Handle handle);
+
+    static void CL_CALLBACK completed (cl_event event, cl_int status, void* user_data);
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    GEMMExecutor (const GEMMExecutor&);
+    GEMMExecutor& operator= (const GEMMExecutor&);
+};
+
+
+#endif  // __cpp_impl_coroutine
+
+#endif  // end of the include guard
@@ -0,0 +1,205 @@
+// Record and replay of a fixed sequence of kernel launches, see commandgraph.hpp.
+
+
+#include <cassert>
+#include <cstring>
+
+#include "basic.hpp"
+#include "commandgraph.hpp"
+
+using namespace std;
+
+
+CommandGraph::CommandGraph (cl_command_queue queue) :
+    queue(queue),
+    out_of_order(false)
+{
+    cl_command_queue_properties properties = 0;
+    cl_int err = clGetCommandQueueInfo(
+        queue,
+        CL_QUEUE_PROPERTIES,
+        sizeof(properties),
+        &properties,
+        0
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    // An in-order queue executes launches in the order of enqueuing,
+    // so dependencies do not need events there.
+    out_of_order = (properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) != 0;
+}
+
+
+CommandGraph::~CommandGraph ()
+{
+    try
+    {
+        for(size_t i = 0; i < commands.size(); ++i)
+        {
+            cl_int err = clReleaseKernel(commands[i].kernel);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+
+        for(size_t i = 0; i < retained.size(); ++i)
+        {
+            cl_int err = clReleaseMemObject(retained[i]);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+    }
+    catch(...)
+    {
+        destructorException();
+    }
+}
+
+
+size_t CommandGraph::record (
+    cl_kernel kernel,
+    cl_uint work_dim,
+    const size_t* global_size,
+    const size_t* local_size,
+    const vector<size_t>& dependencies
+)
+{
+    assert(work_dim >= 1 && work_dim <= 3);
+
+    // Arguments of a kernel object cannot be queried back, and the same
+    // kernel can be recorded several times with different arguments,
+    // so every launch gets a new kernel object of the same program.
+    cl_program program = 0;
+    cl_int err = clGetKernelInfo(kernel, CL_KERNEL_PROGRAM, sizeof(program), &program, 0);
+    SAMPLE_CHECK_ERRORS(err);
+
+    size_t name_length = 0;
+    err = clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, 0, 0, &name_length);
+    SAMPLE_CHECK_ERRORS(err);
+
+    vector<char> name(name_length);
+    err = clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, name_length, &name[0], 0);
+    SAMPLE_CHECK_ERRORS(err);
+
+    Command command;
+    command.kernel = clCreateKernel(program, &name[0], &err);
+    SAMPLE_CHECK_ERRORS(err);
+
+    command.work_dim = work_dim;
+    command.has_local_size = local_size != 0;
+    for(cl_uint d = 0; d < 3; ++d)
+    {
+        command.global_size[d] = d < work_dim ? global_size[d] : 1;
+        command.local_size[d] = d < work_dim && local_size ? local_size[d] : 1;
+    }
+
+    command.dependencies = dependencies;
+    command.needs_event = false;
+
+    for(size_t i = 0; i < dependencies.size(); ++i)
+    {
+        if(dependencies[i] >= commands.size())
+        {
+            clReleaseKernel(command.kernel);
+            throw Error(
+                "Recorded launch " + to_str(commands.size()) +
+                " depends on launch " + to_str(dependencies[i]) + ", which is not recorded before"
+            );
+        }
+
+        commands[dependencies[i]].needs_event = out_of_order;
+    }
+
+    commands.push_back(command);
+    return commands.size() - 1;
+}
+
+
+void CommandGraph::setArg (size_t command, cl_uint index, size_t size, const void* value)
+{
+    assert(command < commands.size());
+
+    cl_int err = clSetKernelArg(commands[command].kernel, index, size, value);
+    SAMPLE_CHECK_ERRORS(err);
+}
+
+
+void CommandGraph::retain (cl_mem buffer)
+{
+    cl_int err = clRetainMemObject(buffer);
+    SAMPLE_CHECK_ERRORS(err);
+    retained.push_back(buffer);
+}
+
+
+void CommandGraph::replay ()
+{
+    events.assign(commands.size(), cl_event(0));
+
+    try
+    {
+        for(size_t i = 0; i < commands.size(); ++i)
+        {
+            const Command& command = commands[i];
+
+            wait_list.clear();
+            if(out_of_order)
+            {
+                for(size_t d = 0; d < command.dependencies.size(); ++d)
+                {
+                    wait_list.push_back(events[command.dependencies[d]]);
+                }
+            }
+
+            cl_int err = clEnqueueNDRangeKernel(
+                queue,
+                command.kernel,
+                command.work_dim,
+                0,
+                command.global_size,
+                command.has_local_size ? command.local_size : 0,
+                cl_uint(wait_list.size()),
+                wait_list.empty() ? 0 : &wait_list[0],
+                command.needs_event ? &events[i] : 0
+            );
+            SAMPLE_CHECK_ERRORS(err);
+        }
+    }
+    catch(...)
+    {
+        for(size_t i = 0; i < events.size(); ++i)
+        {
+            if(events[i])
+            {
+                clReleaseEvent(events[i]);
+            }
+        }
+
+        throw;
+    }
+
+    // Releasing an event does not affect the command it belongs to.
+    for(size_t i = 0; i < events.size(); ++i)
+    {
+        if(events[i])
+        {
+            cl_int err = clReleaseEvent(events[i]);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+    }
+}
+
+
+bool CommandGraph::hasCommandBufferExtension () const
+{
+    cl_device_id device = 0;
+    cl_int err = clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(device), &device, 0);
+    SAMPLE_CHECK_ERRORS(err);
+
+    size_t length = 0;
+    err = clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, 0, &length);
+    SAMPLE_CHECK_ERRORS(err);
+
+    vector<char> extensions(length + 1, 0);
+    err = clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, length, &extensions[0], 0);
+    SAMPLE_CHECK_ERRORS(err);
+
+    return strstr(&extensions[0], "cl_khr_command_buffer") != 0;
+}
@@ -0,0 +1,96 @@
+// Record and replay of a fixed sequence of kernel launches.
+//
+// An inference loop enqueues the same launches with the same arguments
+// every step. A CommandGraph is recorded once: every launch gets its own
+// copy of the kernel object with arguments set at recording, and its
+// NDRange and dependencies are stored. replay() then only enqueues the
+// pre-baked launches, without clSetKernelArg calls.
+//
+// cl_khr_command_buffer would let the driver keep the whole sequence, but
+// the sample is built with OpenCL 1.1 headers, which do not declare it, so
+// the pre-baked enqueue list is always used; hasCommandBufferExtension
+// only reports whether the device has it.
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_COMMANDGRAPH_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_COMMANDGRAPH_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include <CL/cl.h>
+
+
+class CommandGraph
+{
+public:
+
+    CommandGraph (cl_command_queue queue);
+    ~CommandGraph ();
+
+    // Records a launch of the kernel and returns its index in the graph.
+    // Dependencies are indices of previously recorded launches that
+    // should be finished before this one; they matter for out-of-order
+    // queues only. local_size can be 0.
+    size_t record (
+        cl_kernel kernel,
+        cl_uint work_dim,
+        const size_t* global_size,
+        const size_t* local_size,
+        const std::vector<size_t>& dependencies = std::vector<size_t>()
+    );
+
+    // Sets an argument of a recorded launch.
+    template <typename A>
+    void setArg (size_t command, cl_uint index, const A& value)
+    {
+        setArg(command, index, sizeof(A), &value);
+    }
+
+    void setArg (size_t command, cl_uint index, size_t size, const void* value);
+
+    // Keeps a memory object alive as long as the graph, for buffers
+    // that are used by recorded launches only.
+    void retain (cl_mem buffer);
+
+    // Enqueues all recorded launches in the order of recording.
+    // Does not wait for them.
+    void replay ();
+
+    size_t size () const
+    {
+        return commands.size();
+    }
+
+    // Checks if the device of the queue reports cl_khr_command_buffer.
+    bool hasCommandBufferExtension () const;
+
+private:
+
+    struct Command
+    {
+        cl_kernel kernel;   // own copy of the recorded kernel
+        cl_uint work_dim;
+        size_t global_size[3];
+        size_t local_size[3];
+        bool has_local_size;
+        std::vector<size_t> dependencies;
+        bool needs_event;   // other launches depend on it
+    };
+
+    cl_command_queue queue;
+    bool out_of_order;
+    std::vector<Command> commands;
+    std::vector<cl_mem> retained;
+
+    // Events of the current replay, reused to avoid reallocation
+    std::vector<cl_event> events;
+    std::vector<cl_event> wait_list;
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    CommandGraph (const CommandGraph&);
+    CommandGraph& operator= (const CommandGraph&);
+};
+
+
+#endif  // end of the include guard
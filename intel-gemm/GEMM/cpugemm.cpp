@@ -0,0 +1,514 @@
+// Native host GEMM engine, see cpugemm.hpp.
+
+
+#include <algorithm>
+#include <cassert>
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "basic.hpp"
+#include "cpugemm.hpp"
+
+using namespace std;
+
+
+namespace
+{
+
+// Register micro-kernel: computes MR x NR block of C from kc columns of
+// packed A sliver (MR elements per column) and kc rows of packed
+// B sliver (NR elements per row). If accumulate is false, the previous
+// content of C block is overwritten, otherwise the product is added to it.
+
+// Portable version; compilers usually keep acc in registers for small MR, NR.
+template <typename T, size_t MR_, size_t NR_>
+struct MicroKernelGeneric
+{
+    static const size_t MR = MR_;
+    static const size_t NR = NR_;
+
+    static const char* name ()
+    {
+        return "generic";
+    }
+
+    static void run (size_t kc, const T* a, const T* b, T* c, size_t ldc, bool accumulate)
+    {
+        T acc[MR*NR] = {0};
+
+        for(size_t p = 0; p < kc; ++p)
+        {
+            for(size_t r = 0; r < MR; ++r)
+            {
+                T ar = a[p*MR + r];
+                for(size_t q = 0; q < NR; ++q)
+                {
+                    acc[r*NR + q] += ar*b[p*NR + q];
+                }
+            }
+        }
+
+        for(size_t r = 0; r < MR; ++r)
+        {
+            for(size_t q = 0; q < NR; ++q)
+            {
+                c[r*ldc + q] = (accumulate ? c[r*ldc + q] : T(0)) + acc[r*NR + q];
+            }
+        }
+    }
+};
+
+
+#if defined(__AVX512F__)
+
+// 6 x 32 floats: 12 zmm accumulators, 2 zmm for B and 1 for broadcast A.
+struct MicroKernelFloat
+{
+    static const size_t MR = 6;
+    static const size_t NR = 32;
+
+    static const char* name ()
+    {
+        return "avx512";
+    }
+
+    static void run (size_t kc, const float* a, const float* b, float* c, size_t ldc, bool accumulate)
+    {
+        __m512 acc[MR][2];
+
+        for(size_t r = 0; r < MR; ++r)
+        {
+            acc[r][0] = _mm512_setzero_ps();
+            acc[r][1] = _mm512_setzero_ps();
+        }
+
+        for(size_t p = 0; p < kc; ++p)
+        {
+            __m512 b0 = _mm512_loadu_ps(b + p*NR);
+            __m512 b1 = _mm512_loadu_ps(b + p*NR + 16);
+
+            for(size_t r = 0; r < MR; ++r)
+            {
+                __m512 ar = _mm512_set1_ps(a[p*MR + r]);
+                acc[r][0] = _mm512_fmadd_ps(ar, b0, acc[r][0]);
+                acc[r][1] = _mm512_fmadd_ps(ar, b1, acc[r][1]);
+            }
+        }
+
+        for(size_t r = 0; r < MR; ++r)
+        {
+            float* cr = c + r*ldc;
+            if(accumulate)
+            {
+                acc[r][0] = _mm512_add_ps(acc[r][0], _mm512_loadu_ps(cr));
+                acc[r][1] = _mm512_add_ps(acc[r][1], _mm512_loadu_ps(cr + 16));
+            }
+            _mm512_storeu_ps(cr, acc[r][0]);
+            _mm512_storeu_ps(cr + 16, acc[r][1]);
+        }
+    }
+};
+
+#elif defined(__AVX2__) && defined(__FMA__)
+
+// 6 x 16 floats: 12 ymm accumulators, 2 ymm for B and 1 for broadcast A.
+struct MicroKernelFloat
+{
+    static const size_t MR = 6;
+    static const size_t NR = 16;
+
+    static const char* name ()
+    {
+        return "avx2-fma";
+    }
+
+    static void run (size_t kc, const float* a, const float* b, float* c, size_t ldc, bool accumulate)
+    {
+        __m256 acc[MR][2];
+
+        for(size_t r = 0; r < MR; ++r)
+        {
+            acc[r][0] = _mm256_setzero_ps();
+            acc[r][1] = _mm256_setzero_ps();
+        }
+
+        for(size_t p = 0; p < kc; ++p)
+        {
+            __m256 b0 = _mm256_loadu_ps(b + p*NR);
+            __m256 b1 = _mm256_loadu_ps(b + p*NR + 8);
+
+            for(size_t r = 0; r < MR; ++r)
+            {
+                __m256 ar = _mm256_broadcast_ss(a + p*MR + r);
+                acc[r][0] = _mm256_fmadd_ps(ar, b0, acc[r][0]);
+                acc[r][1] = _mm256_fmadd_ps(ar, b1, acc[r][1]);
+            }
+        }
+
+        for(size_t r = 0; r < MR; ++r)
+        {
+            float* cr = c + r*ldc;
+            if(accumulate)
+            {
+                acc[r][0] = _mm256_add_ps(acc[r][0], _mm256_loadu_ps(cr));
+                acc[r][1] = _mm256_add_ps(acc[r][1], _mm256_loadu_ps(cr + 8));
+            }
+            _mm256_storeu_ps(cr, acc[r][0]);
+            _mm256_storeu_ps(cr + 8, acc[r][1]);
+        }
+    }
+};
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+// AArch64 has 32 q registers: 8 x 8 floats use 16 of them for accumulators.
+// ARMv7 has only 16, so the block is 4 x 8 there.
+struct MicroKernelFloat
+{
+#if defined(__aarch64__)
+    static const size_t MR = 8;
+#else
+    static const size_t MR = 4;
+#endif
+    static const size_t NR = 8;
+
+    static const char* name ()
+    {
+        return "neon";
+    }
+
+    static void run (size_t kc, const float* a, const float* b, float* c, size_t ldc, bool accumulate)
+    {
+        float32x4_t acc[MR][2];
+
+        for(size_t r = 0; r < MR; ++r)
+        {
+            acc[r][0] = vdupq_n_f32(0);
+            acc[r][1] = vdupq_n_f32(0);
+        }
+
+        for(size_t p = 0; p < kc; ++p)
+        {
+            float32x4_t b0 = vld1q_f32(b + p*NR);
+            float32x4_t b1 = vld1q_f32(b + p*NR + 4);
+
+            for(size_t r = 0; r < MR; ++r)
+            {
+                float ar = a[p*MR + r];
+#if defined(__aarch64__)
+                acc[r][0] = vfmaq_n_f32(acc[r][0], b0, ar);
+                acc[r][1] = vfmaq_n_f32(acc[r][1], b1, ar);
+#else
+                acc[r][0] = vmlaq_n_f32(acc[r][0], b0, ar);
+                acc[r][1] = vmlaq_n_f32(acc[r][1], b1, ar);
+#endif
+            }
+        }
+
+        for(size_t r = 0; r < MR; ++r)
+        {
+            float* cr = c + r*ldc;
+            if(accumulate)
+            {
+                acc[r][0] = vaddq_f32(acc[r][0], vld1q_f32(cr));
+                acc[r][1] = vaddq_f32(acc[r][1], vld1q_f32(cr + 4));
+            }
+            vst1q_f32(cr, acc[r][0]);
+            vst1q_f32(cr + 4, acc[r][1]);
+        }
+    }
+};
+
+#else
+
+typedef MicroKernelGeneric<float, 4, 4> MicroKernelFloat;
+
+#endif
+
+
+template <typename T> struct MicroKernel;
+template <> struct MicroKernel<float> : MicroKernelFloat {};
+template <> struct MicroKernel<double> : MicroKernelGeneric<double, 4, 4> {};
+
+
+// Cache blocking: packed A panel (MC x KC) should stay in L2,
+// a KC x NR sliver of packed B in L1.
+const size_t KC = 256;
+const size_t NC = 2048;
+
+template <typename T>
+size_t blockMC ()
+{
+    // the biggest multiple of MR not greater than 128
+    return 128/MicroKernel<T>::MR*MicroKernel<T>::MR;
+}
+
+
+// Packs mc x kc block of A into slivers of MR rows;
+// element (r, p) of a sliver is at p*MR + r. Rows beyond mc are zeros.
+template <typename T>
+void packA (
+    size_t mc,
+    size_t kc,
+    const T* A,
+    size_t row_stride,
+    size_t col_stride,
+    T* packed
+)
+{
+    const size_t MR = MicroKernel<T>::MR;
+
+    for(size_t ir = 0; ir < mc; ir += MR)
+    {
+        size_t mr = min(MR, mc - ir);
+
+        for(size_t r = 0; r < MR; ++r)
+        {
+            if(r < mr)
+            {
+                const T* a = A + (ir + r)*row_stride;
+                for(size_t p = 0; p < kc; ++p)
+                {
+                    packed[p*MR + r] = a[p*col_stride];
+                }
+            }
+            else
+            {
+                for(size_t p = 0; p < kc; ++p)
+                {
+                    packed[p*MR + r] = T(0);
+                }
+            }
+        }
+
+        packed += MR*kc;
+    }
+}
+
+
+// Packs kc x nc block of B into slivers of NR columns;
+// element (p, q) of a sliver is at p*NR + q. Columns beyond nc are zeros.
+template <typename T>
+void packB (
+    size_t kc,
+    size_t nc,
+    const T* B,
+    size_t row_stride,
+    size_t col_stride,
+    T* packed
+)
+{
+    const size_t NR = MicroKernel<T>::NR;
+
+    for(size_t jr = 0; jr < nc; jr += NR)
+    {
+        size_t nr = min(NR, nc - jr);
+
+        for(size_t q = 0; q < NR; ++q)
+        {
+            if(q < nr)
+            {
+                const T* b = B + (jr + q)*col_stride;
+                for(size_t p = 0; p < kc; ++p)
+                {
+                    packed[p*NR + q] = b[p*row_stride];
+                }
+            }
+            else
+            {
+                for(size_t p = 0; p < kc; ++p)
+                {
+                    packed[p*NR + q] = T(0);
+                }
+            }
+        }
+
+        packed += NR*kc;
+    }
+}
+
+
+// Runs the micro-kernel for a block at the edge of C, which is
+// smaller than MR x NR, through a temporary block.
+template <typename T>
+void microKernelEdge (
+    size_t kc,
+    const T* a,
+    const T* b,
+    T* c,
+    size_t ldc,
+    size_t mr,
+    size_t nr,
+    bool accumulate
+)
+{
+    const size_t MR = MicroKernel<T>::MR;
+    const size_t NR = MicroKernel<T>::NR;
+
+    T block[MR*NR];
+    MicroKernel<T>::run(kc, a, b, block, NR, false);
+
+    for(size_t r = 0; r < mr; ++r)
+    {
+        for(size_t q = 0; q < nr; ++q)
+        {
+            c[r*ldc + q] = (accumulate ? c[r*ldc + q] : T(0)) + block[r*NR + q];
+        }
+    }
+}
+
+}
+
+
+template <typename T>
+CPUGEMMBlocking cpuGEMMBlocking ()
+{
+    CPUGEMMBlocking result;
+    result.MR = MicroKernel<T>::MR;
+    result.NR = MicroKernel<T>::NR;
+    result.MC = blockMC<T>();
+    result.KC = KC;
+    result.NC = NC;
+    result.micro_kernel =
+        string(MicroKernel<T>::name()) + " " +
+        to_str(MicroKernel<T>::MR) + "x" + to_str(MicroKernel<T>::NR);
+    return result;
+}
+
+
+template <typename T>
+CPUGEMMWorkspace<T>::CPUGEMMWorkspace () :
+    packed_A(0),
+    packed_B(0)
+{
+    // 64 bytes is a cache line on all supported targets
+    packed_A = (T*)aligned_malloc(blockMC<T>()*KC*sizeof(T), 64);
+    packed_B = (T*)aligned_malloc(KC*NC*sizeof(T), 64);
+}
+
+
+template <typename T>
+CPUGEMMWorkspace<T>::~CPUGEMMWorkspace ()
+{
+    aligned_free(packed_B);
+    aligned_free(packed_A);
+}
+
+
+template <typename T>
+void cpuGEMMTile (
+    const CPUGEMMProblem<T>& problem,
+    size_t row_begin,
+    size_t row_end,
+    size_t column_begin,
+    size_t column_end,
+    CPUGEMMWorkspace<T>& workspace
+)
+{
+    const size_t MR = MicroKernel<T>::MR;
+    const size_t NR = MicroKernel<T>::NR;
+    const size_t MC = blockMC<T>();
+
+    assert(row_end <= problem.m);
+    assert(column_end <= problem.n);
+
+    if(problem.k == 0)
+    {
+        for(size_t i = row_begin; i < row_end; ++i)
+        {
+            T* c = problem.C + i*problem.ldc;
+            std::fill(c + column_begin, c + column_end, T(0));
+        }
+        return;
+    }
+
+    T* packed_A = workspace.packedA();
+    T* packed_B = workspace.packedB();
+
+    for(size_t jc = column_begin; jc < column_end; jc += NC)
+    {
+        size_t nc = min(NC, column_end - jc);
+
+        for(size_t pc = 0; pc < problem.k; pc += KC)
+        {
+            size_t kc = min(KC, problem.k - pc);
+            bool accumulate = pc > 0;
+
+            packB(
+                kc,
+                nc,
+                problem.B + pc*problem.b_row_stride + jc*problem.b_col_stride,
+                problem.b_row_stride,
+                problem.b_col_stride,
+                packed_B
+            );
+
+            for(size_t ic = row_begin; ic < row_end; ic += MC)
+            {
+                size_t mc = min(MC, row_end - ic);
+
+                packA(
+                    mc,
+                    kc,
+                    problem.A + ic*problem.a_row_stride + pc*problem.a_col_stride,
+                    problem.a_row_stride,
+                    problem.a_col_stride,
+                    packed_A
+                );
+
+                for(size_t jr = 0; jr < nc; jr += NR)
+                {
+                    size_t nr = min(NR, nc - jr);
+                    const T* b = packed_B + jr*kc;
+
+                    for(size_t ir = 0; ir < mc; ir += MR)
+                    {
+                        size_t mr = min(MR, mc - ir);
+                        const T* a = packed_A + ir*kc;
+                        T* c = problem.C + (ic + ir)*problem.ldc + jc + jr;
+
+                        if(mr == MR && nr == NR)
+                        {
+                            MicroKernel<T>::run(kc, a, b, c, problem.ldc, accumulate);
+                        }
+                        else
+                        {
+                            microKernelEdge(kc, a, b, c, problem.ldc, mr, nr, accumulate);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+template <typename T>
+void cpuGEMM (const CPUGEMMProblem<T>& problem)
+{
+    CPUGEMMWorkspace<T> workspace;
+    cpuGEMMTile(problem, 0, problem.m, 0, problem.n, workspace);
+}
+
+
+// Explicit instantiations for the types supported by the sample
+
+template CPUGEMMBlocking cpuGEMMBlocking<float> ();
+template CPUGEMMBlocking cpuGEMMBlocking<double> ();
+
+template class CPUGEMMWorkspace<float>;
+template class CPUGEMMWorkspace<double>;
+
+template void cpuGEMMTile<float> (
+    const CPUGEMMProblem<float>&, size_t, size_t, size_t, size_t, CPUGEMMWorkspace<float>&
+);
+template void cpuGEMMTile<double> (
+    const CPUGEMMProblem<double>&, size_t, size_t, size_t, size_t, CPUGEMMWorkspace<double>&
+);
+
+template void cpuGEMM<float> (const CPUGEMMProblem<float>&);
+template void cpuGEMM<double> (const CPUGEMMProblem<double>&);
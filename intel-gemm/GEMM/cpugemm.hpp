@@ -0,0 +1,99 @@
+// Native host GEMM engine used when there is no suitable OpenCL device.
+//
+// The implementation follows the BLIS scheme: A and B are packed into
+// cache-sized panels (MC x KC of A and KC x NC of B), and an MR x NR register
+// micro-kernel multiplies thin slivers of the panels. The micro-kernel is
+// selected at build time by the instruction set the compiler targets:
+// AVX-512, AVX2 with FMA, NEON, or a portable C++ version otherwise.
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_CPUGEMM_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_CPUGEMM_HPP_
+
+#include <cstddef>
+#include <string>
+
+
+// Description of one multiplication C = A*B of m x k matrix A and
+// k x n matrix B in arbitrary layout:
+//   - element (i, l) of A is A[i*a_row_stride + l*a_col_stride]
+//   - element (l, j) of B is B[l*b_row_stride + j*b_col_stride]
+//   - element (i, j) of C is C[i*ldc + j]
+template <typename T>
+struct CPUGEMMProblem
+{
+    size_t m;
+    size_t n;
+    size_t k;
+
+    const T* A;
+    size_t a_row_stride;
+    size_t a_col_stride;
+
+    const T* B;
+    size_t b_row_stride;
+    size_t b_col_stride;
+
+    T* C;
+    size_t ldc;
+};
+
+
+// Cache and register blocking of the engine for elements of type T.
+struct CPUGEMMBlocking
+{
+    size_t MR;  // rows of C computed by the micro-kernel
+    size_t NR;  // columns of C computed by the micro-kernel
+    size_t MC;  // rows of packed A panel, multiple of MR
+    size_t KC;  // depth of packed panels
+    size_t NC;  // columns of packed B panel, multiple of NR
+    std::string micro_kernel;   // human readable name of the micro-kernel
+};
+
+template <typename T>
+CPUGEMMBlocking cpuGEMMBlocking ();
+
+
+// Buffers for packed panels of A and B. One workspace should be used
+// by one thread at a time.
+template <typename T>
+class CPUGEMMWorkspace
+{
+public:
+
+    CPUGEMMWorkspace ();
+    ~CPUGEMMWorkspace ();
+
+    T* packedA () { return packed_A; }
+    T* packedB () { return packed_B; }
+
+private:
+
+    T* packed_A;
+    T* packed_B;
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    CPUGEMMWorkspace (const CPUGEMMWorkspace&);
+    CPUGEMMWorkspace& operator= (const CPUGEMMWorkspace&);
+};
+
+
+// Computes rows [row_begin, row_end) and columns [column_begin, column_end)
+// of C for a given problem. Other elements of C are not touched, so
+// disjoint tiles can be computed concurrently with different workspaces.
+template <typename T>
+void cpuGEMMTile (
+    const CPUGEMMProblem<T>& problem,
+    size_t row_begin,
+    size_t row_end,
+    size_t column_begin,
+    size_t column_end,
+    CPUGEMMWorkspace<T>& workspace
+);
+
+// Computes the whole C in the calling thread.
+template <typename T>
+void cpuGEMM (const CPUGEMMProblem<T>& problem);
+
+
+#endif  // end of the include guard
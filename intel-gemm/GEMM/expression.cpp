@@ -0,0 +1,240 @@
+// Lazy expression API for GEMM with fused epilogues, see expression.hpp.
+
+
+#include "basic.hpp"
+#include "expression.hpp"
+
+using namespace std;
+
+
+namespace
+{
+
+// Should match the definitions in gemm-fused.cl
+const cl_int FUSED_BIAS = 1;
+const cl_int FUSED_RELU = 2;
+const size_t FUSED_BLOCKING = 4;
+
+// Distance between elements (i, j) and (i + 1, j), and (i, j) and (i, j + 1)
+template <typename T>
+void elementStrides (const Matrix<T>& matrix, cl_int& row_stride, cl_int& col_stride)
+{
+    row_stride = static_cast<cl_int>(matrix.index(1, 0) - matrix.index(0, 0));
+    col_stride = static_cast<cl_int>(matrix.index(0, 1) - matrix.index(0, 0));
+}
+
+string shapeToStr (size_t rows, size_t columns)
+{
+    return to_str(rows) + "x" + to_str(columns);
+}
+
+}
+
+
+template <typename T>
+GEMMExpression<T> GEMMExpression<T>::add (const ScaledMatrix<T>& term) const
+{
+    GEMMExpression<T> result = *this;
+    size_t rows = product.A->rows();
+
+    if(term.matrix->rows() == 1 && rows != 1)
+    {
+        if(bias)
+        {
+            throw Error("Only one bias can be added in a fused GEMM expression");
+        }
+
+        if(term.alpha != T(1))
+        {
+            throw Error("Bias of a fused GEMM expression cannot be scaled");
+        }
+
+        result.bias = term.matrix;
+    }
+    else
+    {
+        if(C)
+        {
+            throw Error("Only one matrix can be accumulated in a fused GEMM expression");
+        }
+
+        result.beta = term.alpha;
+        result.C = term.matrix;
+    }
+
+    return result;
+}
+
+
+template <typename T>
+FusedGEMM<T>::FusedGEMM (
+    OpenCLBasic& oclobjects,
+    OpenCLProgramMultipleKernels& program,
+    size_t local_size
+) :
+    oclobjects(oclobjects),
+    kernel(program["gemm_fused"]),
+    blocked_kernel(program["gemm_fused_tn"]),
+    local_size(local_size),
+    launch_count(0),
+    blocked_launch_count(0)
+{
+}
+
+
+template <typename T>
+void FusedGEMM<T>::assign (Matrix<T>& result, const GEMMExpression<T>& expression)
+{
+    Matrix<T>& A = *expression.product.A;
+    Matrix<T>& B = *expression.product.B;
+
+    size_t m = A.rows();
+    size_t k = A.columns();
+    size_t n = B.columns();
+
+    if(B.rows() != k || result.rows() != m || result.columns() != n)
+    {
+        throw Error(
+            "Inconsistent shapes in fused GEMM expression: " +
+            shapeToStr(result.rows(), result.columns()) + " = " +
+            shapeToStr(m, k) + " * " + shapeToStr(B.rows(), n)
+        );
+    }
+
+    if(&result == &A || &result == &B || &result == expression.bias)
+    {
+        throw Error("Result of fused GEMM expression cannot be its multiplier or bias");
+    }
+
+    // gemm_fused writes C and reads C0 and bias by rows
+    if(result.layout() != ROW_MAJOR || (expression.C && expression.C->layout() != ROW_MAJOR))
+    {
+        throw Error("Result and accumulated matrix of fused GEMM expression should be row-major");
+    }
+
+    if(expression.C && (expression.C->rows() != m || expression.C->columns() != n))
+    {
+        throw Error(
+            "Accumulated matrix of fused GEMM expression should be " + shapeToStr(m, n) +
+            " instead of " + shapeToStr(expression.C->rows(), expression.C->columns())
+        );
+    }
+
+    if(expression.bias && (expression.bias->columns() != n || expression.bias->layout() != ROW_MAJOR))
+    {
+        throw Error("Bias of fused GEMM expression should be a row-major row of " + to_str(n) + " elements");
+    }
+
+    cl_int a_row_stride = 0, a_col_stride = 0;
+    cl_int b_row_stride = 0, b_col_stride = 0;
+    elementStrides(A, a_row_stride, a_col_stride);
+    elementStrides(B, b_row_stride, b_col_stride);
+
+    // Unused C0 and bias are bound to the result buffer:
+    // the kernel does not read them.
+    cl_mem a_buffer = A.device(ACCESS_READ);
+    cl_mem b_buffer = B.device(ACCESS_READ);
+    cl_mem c0_buffer = expression.C ? expression.C->device(ACCESS_READ) : 0;
+    cl_mem bias_buffer = expression.bias ? expression.bias->device(ACCESS_READ) : 0;
+    cl_mem c_buffer = result.device(ACCESS_WRITE);
+
+    if(!c0_buffer)
+    {
+        c0_buffer = c_buffer;
+    }
+
+    if(!bias_buffer)
+    {
+        bias_buffer = c_buffer;
+    }
+
+    cl_int ldc = static_cast<cl_int>(result.stride());
+    cl_int ldc0 = expression.C ? static_cast<cl_int>(expression.C->stride()) : ldc;
+    cl_int cl_m = static_cast<cl_int>(m);
+    cl_int cl_n = static_cast<cl_int>(n);
+    cl_int cl_k = static_cast<cl_int>(k);
+    T alpha = expression.product.alpha;
+    T beta = expression.C ? expression.beta : T(0);
+    cl_int epilogue =
+        (expression.bias ? FUSED_BIAS : 0) |
+        (expression.relu ? FUSED_RELU : 0);
+
+    // Both kernels take the same arguments; the blocked one needs
+    // A by rows and B by columns, as gemm_tn kernels do.
+    bool blocked =
+        a_col_stride == 1 && b_row_stride == 1 &&
+        m % FUSED_BLOCKING == 0 &&
+        n % FUSED_BLOCKING == 0 &&
+        k % FUSED_BLOCKING == 0;
+
+    cl_kernel selected = blocked ? blocked_kernel : kernel;
+    size_t blocking = blocked ? FUSED_BLOCKING : 1;
+
+    cl_uint arg = 0;
+    cl_int err = clSetKernelArg(selected, arg++, sizeof(cl_mem), &a_buffer);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(selected, arg++, sizeof(cl_int), &a_row_stride);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(selected, arg++, sizeof(cl_int), &a_col_stride);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(selected, arg++, sizeof(cl_mem), &b_buffer);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(selected, arg++, sizeof(cl_int), &b_row_stride);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(selected, arg++, sizeof(cl_int), &b_col_stride);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(selected, arg++, sizeof(cl_mem), &c_buffer);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(selected, arg++, sizeof(cl_int), &ldc);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(selected, arg++, sizeof(cl_mem), &c0_buffer);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(selected, arg++, sizeof(cl_int), &ldc0);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(selected, arg++, sizeof(cl_mem), &bias_buffer);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(selected, arg++, sizeof(cl_int), &cl_m);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(selected, arg++, sizeof(cl_int), &cl_n);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(selected, arg++, sizeof(cl_int), &cl_k);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(selected, arg++, sizeof(T), &alpha);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(selected, arg++, sizeof(T), &beta);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(selected, arg++, sizeof(cl_int), &epilogue);
+    SAMPLE_CHECK_ERRORS(err);
+
+    size_t global_size[2] = {
+        round_up_aligned(m/blocking, local_size),
+        round_up_aligned(n/blocking, local_size)
+    };
+
+    size_t local[2] = { local_size, local_size };
+
+    err = clEnqueueNDRangeKernel(
+        oclobjects.queue,
+        selected,
+        2,
+        0,
+        global_size,
+        local,
+        0, 0, 0
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    ++launch_count;
+
+    if(blocked)
+    {
+        ++blocked_launch_count;
+    }
+}
+
+
+template struct GEMMExpression<float>;
+template struct GEMMExpression<double>;
+
+template class FusedGEMM<float>;
+template class FusedGEMM<double>;
@@ -0,0 +1,184 @@
+// Lazy expression API for GEMM with fused epilogues.
+//
+// Arithmetic on Matrix<T> does not compute anything: it builds a small
+// expression object that only refers to the operands. Assigning the
+// expression with FusedGEMM::assign compiles it into a single launch of
+// gemm_fused kernel from gemm-fused.cl, without temporary matrices, or of
+// its blocked variant gemm_fused_tn when operands have gemm_tn layout:
+//
+//     engine.assign(C, alpha*A*B + beta*C);
+//     engine.assign(D, relu(A*B + bias));
+//
+// The supported grammar is what one launch can compute:
+//     [alpha*] A*B [+ [beta*] C] [+ bias], optionally wrapped into relu().
+// A matrix added to the product is accumulated if it has the shape of the
+// result, and is added to every row (broadcast) if it has one row. The
+// launch is enqueued without waiting, the result is available to the host
+// with Matrix::host, which blocks till it is computed.
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_EXPRESSION_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_EXPRESSION_HPP_
+
+#include <cstddef>
+
+#include "oclobject.hpp"
+#include "matrix.hpp"
+
+
+// alpha*M
+template <typename T>
+struct ScaledMatrix
+{
+    T alpha;
+    Matrix<T>* matrix;
+};
+
+// alpha*A*B
+template <typename T>
+struct ProductExpression
+{
+    T alpha;
+    Matrix<T>* A;
+    Matrix<T>* B;
+};
+
+// Everything one gemm_fused launch computes:
+// epilogue(alpha*A*B + beta*C + bias)
+template <typename T>
+struct GEMMExpression
+{
+    ProductExpression<T> product;
+    T beta;
+    Matrix<T>* C;       // accumulated matrix, 0 if none
+    Matrix<T>* bias;    // row vector, 0 if none
+    bool relu;
+
+    GEMMExpression (const ProductExpression<T>& product) :
+        product(product),
+        beta(0),
+        C(0),
+        bias(0),
+        relu(false)
+    {
+    }
+
+    // Adds alpha*M as accumulated matrix or as bias depending on its shape.
+    GEMMExpression add (const ScaledMatrix<T>& term) const;
+};
+
+
+template <typename T>
+ScaledMatrix<T> operator* (T alpha, Matrix<T>& matrix)
+{
+    ScaledMatrix<T> result = { alpha, &matrix };
+    return result;
+}
+
+template <typename T>
+ProductExpression<T> operator* (Matrix<T>& A, Matrix<T>& B)
+{
+    ProductExpression<T> result = { T(1), &A, &B };
+    return result;
+}
+
+template <typename T>
+ProductExpression<T> operator* (const ScaledMatrix<T>& A, Matrix<T>& B)
+{
+    ProductExpression<T> result = { A.alpha, A.matrix, &B };
+    return result;
+}
+
+template <typename T>
+ProductExpression<T> operator* (T alpha, const ProductExpression<T>& product)
+{
+    ProductExpression<T> result = { alpha*product.alpha, product.A, product.B };
+    return result;
+}
+
+template <typename T>
+GEMMExpression<T> operator+ (const ProductExpression<T>& product, const ScaledMatrix<T>& term)
+{
+    return GEMMExpression<T>(product).add(term);
+}
+
+template <typename T>
+GEMMExpression<T> operator+ (const ProductExpression<T>& product, Matrix<T>& term)
+{
+    return GEMMExpression<T>(product).add(T(1)*term);
+}
+
+template <typename T>
+GEMMExpression<T> operator+ (const GEMMExpression<T>& expression, const ScaledMatrix<T>& term)
+{
+    return expression.add(term);
+}
+
+template <typename T>
+GEMMExpression<T> operator+ (const GEMMExpression<T>& expression, Matrix<T>& term)
+{
+    return expression.add(T(1)*term);
+}
+
+template <typename T>
+GEMMExpression<T> relu (const GEMMExpression<T>& expression)
+{
+    GEMMExpression<T> result = expression;
+    result.relu = true;
+    return result;
+}
+
+template <typename T>
+GEMMExpression<T> relu (const ProductExpression<T>& product)
+{
+    return relu(GEMMExpression<T>(product));
+}
+
+
+// Compiles expressions into gemm_fused and gemm_fused_tn launches.
+template <typename T>
+class FusedGEMM
+{
+public:
+
+    // program should be built from gemm-fused.cl with T defined.
+    FusedGEMM (
+        OpenCLBasic& oclobjects,
+        OpenCLProgramMultipleKernels& program,
+        size_t local_size
+    );
+
+    // Enqueues result = expression. result may be the accumulated
+    // matrix of the expression, but not A, B or bias. Throws Error
+    // for operands of inconsistent shapes or unsupported layouts.
+    void assign (Matrix<T>& result, const GEMMExpression<T>& expression);
+
+    void assign (Matrix<T>& result, const ProductExpression<T>& product)
+    {
+        assign(result, GEMMExpression<T>(product));
+    }
+
+    // Number of kernel launches enqueued so far.
+    size_t launches () const
+    {
+        return launch_count;
+    }
+
+    // How many of them were launches of blocked gemm_fused_tn.
+    size_t blockedLaunches () const
+    {
+        return blocked_launch_count;
+    }
+
+private:
+
+    OpenCLBasic& oclobjects;
+    cl_kernel kernel;
+    cl_kernel blocked_kernel;
+    size_t local_size;
+    size_t launch_count;
+    size_t blocked_launch_count;
+};
+
+
+#endif  // end of the include guard
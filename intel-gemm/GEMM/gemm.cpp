@@ -23,16 +23,48 @@
 #include <ctime>
 #include <limits>
 #include <cmath>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <exception>
 
 #include <CL/cl.h>
 
 #include "basic.hpp"
 #include "cmdoptions.hpp"
 #include "oclobject.hpp"
+#include "cpugemm.hpp"
+#include "threadpool.hpp"
+#include "persistent.hpp"
+#include "strassen.hpp"
+#include "gemmkernel.hpp"
+#include "memstrategy.hpp"
+#include "padding.hpp"
+#include "bufferpool.hpp"
+#include "matrix.hpp"
+#include "expression.hpp"
+#include "commandgraph.hpp"
+#include "async.hpp"
+#include "coexecutor.hpp"
+#include "service.hpp"
+#include "scheduler.hpp"
+#include "submitring.hpp"
+#include "shapetrace.hpp"
+#include "kerneldispatch.hpp"
+#include "occupancy.hpp"
 
 using namespace std;
 
 
+// Relative error tolerance used by checkValidity
+template <class T>
+T validationTolerance ()
+{
+    return T(1e-4);
+}
+
+
 // Check validity for multiplication of square matrices: Cresult == A*Btransposed(B)
 template <class T>
 bool checkValidity (
@@ -61,7 +93,7 @@ bool checkValidity (
     // that initial matrix values are from [0, 1]
     T max_value = 1;
     // T error_tol = T(2) * max_value * max_value * T(2) * size * numeric_limits<T>::epsilon();
-    T error_tol = T(1e-4);
+    T error_tol = validationTolerance<T>();
 
     for(size_t i = 0; i < size; ++i)
     {
@@ -96,13 +128,169 @@ bool checkValidity (
 }
 
 
+// Computes golden values for C with the same conventions as checkValidity;
+// reference is size x size with row stride ldabc.
+template <class T>
+void computeReference (
+    const T* A,
+    const T* B,
+    T* reference,
+    size_t size,
+    size_t ldabc,
+    bool Atransposed,
+    bool Btransposed
+)
+{
+    size_t listride = Atransposed ? 1 : ldabc;
+    size_t istride = Atransposed ? ldabc : 1;
+    size_t ljstride = Btransposed ? ldabc : 1;
+    size_t jstride = Btransposed ? 1 : ldabc;
+
+    for(size_t i = 0; i < size; ++i)
+    {
+        for(size_t j = 0; j < size; ++j)
+        {
+            T accum = 0;
+            for(size_t l = 0; l < size; ++l)
+            {
+                accum += A[l*listride + i * istride] * B[l * ljstride + j * jstride];
+            }
+            reference[i*ldabc + j] = accum;
+        }
+    }
+}
+
+
+// Maximum over all elements of |C - reference|/reference, the value
+// that checkValidity compares with validationTolerance.
+template <class T>
+T maxRelativeError (const T* C, const T* reference, size_t size, size_t ldabc)
+{
+    T result = 0;
+    for(size_t i = 0; i < size; ++i)
+    {
+        for(size_t j = 0; j < size; ++j)
+        {
+            T golden = reference[i*ldabc + j];
+            result = max(result, T(abs(C[i*ldabc + j] - golden)/golden));
+        }
+    }
+    return result;
+}
+
+
+// Matrix sizes from --sizes, or --size if the list is empty.
+vector<size_t> sizesToRun (CmdParserGEMM& cmdparser)
+{
+    vector<size_t> sizes;
+    const string& sizes_list = cmdparser.sizes.getValue();
+    for(size_t pos = 0, next = 0; !sizes_list.empty() && next != string::npos; pos = next + 1)
+    {
+        next = sizes_list.find(',', pos);
+        sizes.push_back(
+            str_to<size_t>(sizes_list.substr(pos, next == string::npos ? string::npos : next - pos))
+        );
+    }
+
+    if(sizes.empty())
+    {
+        sizes.push_back(cmdparser.size.getValue());
+    }
+
+    return sizes;
+}
+
+
+struct GEMMShape
+{
+    size_t m;
+    size_t n;
+    size_t k;
+};
+
+
+// Shapes <m>x<n>x<k> from --shapes; squares of --sizes if it is empty.
+vector<GEMMShape> shapesToRun (CmdParserGEMM& cmdparser)
+{
+    vector<GEMMShape> shapes;
+    const string& shapes_list = cmdparser.shapes.getValue();
+    for(size_t pos = 0, next = 0; !shapes_list.empty() && next != string::npos; pos = next + 1)
+    {
+        next = shapes_list.find(',', pos);
+        string shape = shapes_list.substr(pos, next == string::npos ? string::npos : next - pos);
+
+        size_t first = shape.find('x');
+        size_t second = first == string::npos ? string::npos : shape.find('x', first + 1);
+        if(second == string::npos)
+        {
+            throw CmdParser::Error(
+                "Shape " + inquotes(shape) + " in " + cmdparser.shapes.name() +
+                " should be <m>x<n>x<k>."
+            );
+        }
+
+        GEMMShape parsed = {
+            str_to<size_t>(shape.substr(0, first)),
+            str_to<size_t>(shape.substr(first + 1, second - first - 1)),
+            str_to<size_t>(shape.substr(second + 1))
+        };
+
+        if(parsed.m == 0 || parsed.n == 0 || parsed.k == 0)
+        {
+            throw CmdParser::Error("Shape " + inquotes(shape) + " should not be empty.");
+        }
+
+        shapes.push_back(parsed);
+    }
+
+    if(shapes.empty())
+    {
+        vector<size_t> sizes = sizesToRun(cmdparser);
+        for(size_t s = 0; s < sizes.size(); ++s)
+        {
+            GEMMShape square = { sizes[s], sizes[s], sizes[s] };
+            shapes.push_back(square);
+        }
+    }
+
+    return shapes;
+}
+
+
+// Row stride in elements for the modes that do not time candidate strides
+// themselves: --padding probe is replaced by the model there.
+size_t paddedRowStride (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    size_t size,
+    size_t size_of_element,
+    size_t rowAlignment
+)
+{
+    PaddingPolicy padding = parsePaddingPolicy(cmdparser.padding.getValue());
+    if(padding == PADDING_PROBE)
+    {
+        padding = PADDING_MODEL;
+    }
+
+    return modelRowStride(
+        padding,
+        size,
+        size_of_element,
+        rowAlignment,
+        paddingGranularity(oclobjects.device, rowAlignment)
+    );
+}
+
+
 // The main GEMM function with all application specific
 // OpenCL host side code.
 template <typename T>
 void gemm (
     CmdParserGEMM& cmdparser,
     OpenCLBasic& oclobjects,
-    OpenCLProgramOneKernel& executable
+    OpenCLProgramOneKernel& executable,
+    ShapeTraceWriter* trace
 )
 {
     // -----------------------------------------------------------------------
@@ -128,17 +316,51 @@ void gemm (
         << "Running gemm_" << cmdparser.kernel.getValue()
         << " kernel with matrix size: " << size << "x" << size << "\n";
 
-    // Ensures that each matrix memory row is aligned
-    size_t stride = (size*sizeof(T) + rowAlignment - 1) & ~(rowAlignment - 1);
-    cout << "Memory row stride to ensure necessary alignment: " << stride << " bytes\n";
-    // calculate row stride in elements of T
-    stride /= sizeof(T);
+    // Ensures that each matrix memory row is aligned and, depending on
+    // --padding, adds padding against memory bank conflicts
+    PaddingPolicy padding = parsePaddingPolicy(cmdparser.padding.getValue());
+    size_t granularity = paddingGranularity(oclobjects.device, rowAlignment);
+    size_t stride = 0;
+
+    if(padding == PADDING_PROBE)
+    {
+        size_t probe_global_size[2] = {
+            cmdparser.global_size.getValue(),
+            cmdparser.global_size.getValue()
+        };
+
+        size_t probe_local_size[2] = {
+            cmdparser.local_size.getValue(),
+            cmdparser.local_size.getValue()
+        };
+
+        stride = probeRowStride(
+            oclobjects,
+            executable,
+            size,
+            sizeof(T),
+            rowAlignment,
+            granularity,
+            probe_global_size,
+            probe_local_size,
+            4,  // candidates: up to 3 granules of padding
+            3   // launches for each candidate
+        );
+    }
+    else
+    {
+        stride = modelRowStride(padding, size, sizeof(T), rowAlignment, granularity);
+    }
+
+    cout
+        << "Memory row stride with " << cmdparser.padding.getValue() << " padding: "
+        << stride*sizeof(T) << " bytes (padding " << (stride - size)*sizeof(T) << " bytes)\n";
     assert(size <= stride);
 
-    if(stride/sizeof(T) > size_t(numeric_limits<cl_int>::max()))
+    if(stride > size_t(numeric_limits<cl_int>::max()))
     {
         throw Error(
-            "Memory row stride in elements " + to_str(stride/sizeof(T)) +
+            "Memory row stride in elements " + to_str(stride) +
             " cannot be represented as type int, which can be maximum " +
             to_str(numeric_limits<cl_int>::max()) + "."
         );
@@ -147,63 +369,24 @@ void gemm (
     size_t matrix_memory_size = size*stride*sizeof(T);
     cout << "Size of memory region for one matrix: " << matrix_memory_size << " bytes\n";
 
-    // Allocate aligned memory for matrices to use them in
-    // buffers with CL_MEM_USE_HOST_PTR.
-    // OpenCLDeviceAndHostMemory is used just for
-    // convenient resource deallocation:
-    // a pair of pointer and cl_mem object; cl_mem object is
-    // be creater later.
-
-    size_t alignmentForPtr = zeroCopyPtrAlignment(oclobjects.device);
-    size_t alignedSize = zeroCopySizeAlignment(matrix_memory_size, oclobjects.device);
+    // Allocate memory for matrices with the strategy selected by --memory.
+    // MatrixStorage is used just for convenient resource deallocation and
+    // to hide how the host and the device access the same matrix.
+    // Host memory is aligned to satisfy zero-copy requirements.
 
-    OpenCLDeviceAndHostMemory<T> matrix_A;
-    matrix_A.host = (T*)aligned_malloc(alignedSize, alignmentForPtr);
+    MemoryStrategy memory_strategy = parseMemoryStrategy(cmdparser.memory.getValue());
+    checkMemoryStrategy(memory_strategy, oclobjects);
 
-    OpenCLDeviceAndHostMemory<T> matrix_B;
-    matrix_B.host = (T*)aligned_malloc(alignedSize, alignmentForPtr);
+    cout << "Memory strategy: " << cmdparser.memory.getValue() << "\n";
 
-    OpenCLDeviceAndHostMemory<T> matrix_C;
-    matrix_C.host = (T*)aligned_malloc(alignedSize, alignmentForPtr);
+    size_t alignmentForPtr = zeroCopyPtrAlignment(oclobjects.device);
 
-    // -----------------------------------------------------------------------
-    // Allocating device-side resources for matrices
-    // -----------------------------------------------------------------------
+    MatrixStorage matrix_A(oclobjects, memory_strategy, matrix_memory_size, alignmentForPtr);
+    MatrixStorage matrix_B(oclobjects, memory_strategy, matrix_memory_size, alignmentForPtr);
+    MatrixStorage matrix_C(oclobjects, memory_strategy, matrix_memory_size, alignmentForPtr);
 
     cl_int err = 0; // OpenCL error code
 
-    // Create OpenCL buffers for the matrices based on allocated memory regions
-    // Create buffers with CL_MEM_USE_HOST_PTR to minimize copying and
-    // model situation when matrices are hosted by some native library that
-    // uses OpenCL to accelerate calculations.
-
-    matrix_A.device = clCreateBuffer(
-        oclobjects.context,
-        CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
-        matrix_memory_size,
-        matrix_A.host,
-        &err
-    );
-    SAMPLE_CHECK_ERRORS(err);
-
-    matrix_B.device = clCreateBuffer(
-        oclobjects.context,
-        CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
-        matrix_memory_size,
-        matrix_B.host,
-        &err
-    );
-    SAMPLE_CHECK_ERRORS(err);
-
-    matrix_C.device = clCreateBuffer(
-        oclobjects.context,
-        CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,
-        matrix_memory_size,
-        matrix_C.host,
-        &err
-    );
-    SAMPLE_CHECK_ERRORS(err);
-
     cl_int cl_size = static_cast<int>(size);  // kernel requires int value
     cl_int ldabc = static_cast<int>(stride);  // kernel requires int value
 
@@ -236,16 +419,13 @@ void gemm (
     // Setting kernel arguments
     // -----------------------------------------------------------------------
 
-    err = clSetKernelArg(executable.kernel, 0, sizeof(cl_mem), &matrix_A.device);
-    SAMPLE_CHECK_ERRORS(err);
+    matrix_A.setKernelArg(executable.kernel, 0);
     err = clSetKernelArg(executable.kernel, 1, sizeof(cl_int), &ldabc);
     SAMPLE_CHECK_ERRORS(err);
-    err = clSetKernelArg(executable.kernel, 2, sizeof(cl_mem), &matrix_B.device);
-    SAMPLE_CHECK_ERRORS(err);
+    matrix_B.setKernelArg(executable.kernel, 2);
     err = clSetKernelArg(executable.kernel, 3, sizeof(cl_int), &ldabc);
     SAMPLE_CHECK_ERRORS(err);
-    err = clSetKernelArg(executable.kernel, 4, sizeof(cl_mem), &matrix_C.device);
-    SAMPLE_CHECK_ERRORS(err);
+    matrix_C.setKernelArg(executable.kernel, 4);
     err = clSetKernelArg(executable.kernel, 5, sizeof(cl_int), &ldabc);
     SAMPLE_CHECK_ERRORS(err);
     err = clSetKernelArg(executable.kernel, 6, sizeof(cl_int), &cl_size);
@@ -264,12 +444,20 @@ void gemm (
 
     for(int i = 0; i < cmdparser.iterations.getValue(); ++i)
     {
-        // Initialize matrices row by row.
+        T* host_A = (T*)matrix_A.beginHostAccess(CL_MAP_WRITE);
+        T* host_B = (T*)matrix_B.beginHostAccess(CL_MAP_WRITE);
+        T* host_C = (T*)matrix_C.beginHostAccess(CL_MAP_WRITE);
+
+        // Initialize matrices row by row. The first iteration also
+        // touches the pages for the first time, so its time shows the
+        // effect of --huge-pages and --numa on page faults.
+        double init_start = time_stamp();
+
         for(size_t i = 0; i < size; ++i)
         {
-            T* row_A = matrix_A.host + i*stride;
-            T* row_B = matrix_B.host + i*stride;
-            T* row_C = matrix_C.host + i*stride;
+            T* row_A = host_A + i*stride;
+            T* row_B = host_B + i*stride;
+            T* row_C = host_C + i*stride;
 
             // Fill the rows with random values from range [0, 1]
             fill_rand_uniform_01(row_A, size);
@@ -281,6 +469,16 @@ void gemm (
             std::fill(row_C, row_C + size, T(0));
         }
 
+        double init_time = time_stamp() - init_start;
+
+        // Transfer of the inputs to the device: unmap, explicit write
+        // or nothing depending on the memory strategy.
+        double transfer_start = time_stamp();
+        matrix_A.endHostAccess();
+        matrix_B.endHostAccess();
+        matrix_C.endHostAccess();
+        double transfer_in_time = time_stamp() - transfer_start;
+
         // Here we start measuring host time for kernel execution
         cl_event event = 0;
         double start = time_stamp();
@@ -309,9 +507,30 @@ void gemm (
         clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &deviceStartTime, NULL);
         clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &deviceEndTime, NULL);
 
+        // Transfer of the result to the host
+        transfer_start = time_stamp();
+        host_C = (T*)matrix_C.beginHostAccess(CL_MAP_READ);
+        double transfer_out_time = time_stamp() - transfer_start;
+
+        if(trace)
+        {
+            trace->record(
+                size, size, size,
+                gemmLayout(Atransposed, Btransposed),
+                sizeof(T),
+                time,
+                double(deviceEndTime - deviceStartTime)/1e9
+            );
+        }
+
         cout << "Host time: " << time << " sec.\n";
         cout << "Host perf: " << flops/time/1e9 << " GFLOPS\n";
         cout << "Device perf: " << " " << flops / (deviceEndTime - deviceStartTime) << endl;
+        cout
+            << "Transfer in: " << transfer_in_time << " sec., compute: " << time
+            << " sec., transfer out: " << transfer_out_time << " sec., total: "
+            << transfer_in_time + time + transfer_out_time << " sec.\n";
+        cout << "Host init: " << init_time << " sec.\n";
         cout.flush();
 
         if(i == 0 && cmdparser.validation.getValue())
@@ -324,26 +543,17 @@ void gemm (
             // every iteration but validation procedures assumes that
             // C initial values are all zeros.
 
-            clEnqueueMapBuffer(
-                oclobjects.queue,
-                matrix_C.device,
-                CL_TRUE,    // blocking map
-                CL_MAP_READ,
-                0,
-                matrix_memory_size,
-                0, 0, 0,
-                &err
-            );
-            SAMPLE_CHECK_ERRORS(err);
+            // Inputs are mapped for reading together with the result.
+            host_A = (T*)matrix_A.beginHostAccess(CL_MAP_READ);
+            host_B = (T*)matrix_B.beginHostAccess(CL_MAP_READ);
+
+            double validation_start = time_stamp();
 
-            // After map call, host-memory area for matrix C is
-            // automatically updated with the latest bits from the device
-            // So we just use it by original pointer as well as input matrices:
             if(
                 !checkValidity(
-                    matrix_A.host,
-                    matrix_B.host,
-                    matrix_C.host,
+                    host_A,
+                    host_B,
+                    host_C,
                     size,
                     stride,
                     Atransposed,
@@ -354,80 +564,4387 @@ void gemm (
                 throw Error("Validation procedure reported failures");
             }
 
+            cout << "Validation time: " << time_stamp() - validation_start << " sec.\n";
             cout.flush();
 
-            err = clEnqueueUnmapMemObject(
-                oclobjects.queue,
-                matrix_C.device,
-                matrix_C.host,
-                0, 0, 0
-            );
-            SAMPLE_CHECK_ERRORS(err);
-
-            // Finish here is only required for correct time measurment on the next iteration
-            // It does not affect correctness of calculations because you use the in-order OpenCL queue here.
-            err = clFinish(oclobjects.queue);
-            SAMPLE_CHECK_ERRORS(err);
+            matrix_A.endHostAccess();
+            matrix_B.endHostAccess();
         }
+
+        // The end of access also waits for the queue, which is
+        // only required for correct time measurment on the next iteration.
+        matrix_C.endHostAccess();
     }
 
     // All resources are deallocated automatically.
 }
 
 
-// Entry point for sample application, command-line parsing,
-// generic OpenCL resources allocation and deallocation.
-int main (int argc, const char** argv)
+// Same as gemm, but with the native host engine instead of OpenCL device.
+template <typename T>
+void gemmCPU (CmdParserGEMM& cmdparser, ShapeTraceWriter* trace)
 {
-    try
+    cmdparser.validateHostParameters();
+
+    size_t size = cmdparser.size.getValue();
+
+    CPUGEMMBlocking blocking = cpuGEMMBlocking<T>();
+
+    cout
+        << "Running host GEMM " << cmdparser.kernel.getValue()
+        << " with " << blocking.micro_kernel << " micro-kernel"
+        << " (MC=" << blocking.MC << ", KC=" << blocking.KC << ", NC=" << blocking.NC << ")"
+        << " with matrix size: " << size << "x" << size << "\n";
+
+    // Rows are aligned to cache line
+    size_t stride = round_up_aligned(size*sizeof(T), 64)/sizeof(T);
+    cout << "Memory row stride to ensure necessary alignment: " << stride*sizeof(T) << " bytes\n";
+
+    size_t matrix_memory_size = size*stride*sizeof(T);
+    cout << "Size of memory region for one matrix: " << matrix_memory_size << " bytes\n";
+
+    // Only host parts are used; device parts stay zero.
+    OpenCLDeviceAndHostMemory<T> matrix_A;
+    matrix_A.host = (T*)aligned_malloc(matrix_memory_size, 4096);
+
+    OpenCLDeviceAndHostMemory<T> matrix_B;
+    matrix_B.host = (T*)aligned_malloc(matrix_memory_size, 4096);
+
+    OpenCLDeviceAndHostMemory<T> matrix_C;
+    matrix_C.host = (T*)aligned_malloc(matrix_memory_size, 4096);
+
+    bool Atransposed = cmdparser.kernel_tn.isSet() or cmdparser.kernel_tt.isSet();
+    bool Btransposed = cmdparser.kernel_nt.isSet() or cmdparser.kernel_tt.isSet();
+
+    // The same strides as checkValidity uses
+    CPUGEMMProblem<T> problem;
+    problem.m = problem.n = problem.k = size;
+    problem.A = matrix_A.host;
+    problem.a_row_stride = Atransposed ? stride : 1;
+    problem.a_col_stride = Atransposed ? 1 : stride;
+    problem.B = matrix_B.host;
+    problem.b_row_stride = Btransposed ? stride : 1;
+    problem.b_col_stride = Btransposed ? 1 : stride;
+    problem.C = matrix_C.host;
+    problem.ldc = stride;
+
+    WorkStealingPool pool(
+        cmdparser.threads.getValue(),
+        parseCPUList(cmdparser.cpu_affinity.getValue())
+    );
+
+    // One workspace per thread, released automatically
+    vector<unique_ptr<CPUGEMMWorkspace<T>>> workspace_storage;
+    vector<CPUGEMMWorkspace<T>*> workspaces;
+    for(size_t w = 0; w < pool.size(); ++w)
     {
-        // Define and parse command-line arguments.
-        CmdParserGEMM cmdparser(argc, argv);
-        cmdparser.parse();
+        workspace_storage.push_back(unique_ptr<CPUGEMMWorkspace<T>>(new CPUGEMMWorkspace<T>));
+        workspaces.push_back(workspace_storage.back().get());
+    }
 
-        // Immediatly exit if user wanted to see the usage information only.
-        if(cmdparser.help.isSet())
+    // Tiles are much smaller than C to have enough of them for
+    // stealing, but still amortize packing of the panels.
+    size_t tile_rows = blocking.MC;
+    size_t tile_columns = round_up_aligned(256, blocking.NR);
+
+    cout
+        << "Host threads: " << pool.size()
+        << ", tile: " << tile_rows << "x" << tile_columns << "\n";
+
+    double flops = double(size)*size*(size + size);
+
+    for(int i = 0; i < cmdparser.iterations.getValue(); ++i)
+    {
+        double init_start = time_stamp();
+
+        for(size_t r = 0; r < size; ++r)
         {
-            return 0;
+            fill_rand_uniform_01(matrix_A.host + r*stride, size);
+            fill_rand_uniform_01(matrix_B.host + r*stride, size);
+            std::fill(matrix_C.host + r*stride, matrix_C.host + r*stride + size, T(0));
         }
 
-        // Create the necessary OpenCL objects up to device queue.
-        OpenCLBasic oclobjects(
-            cmdparser.platform.getValue(),
-            cmdparser.device_type.getValue(),
-            cmdparser.device.getValue()
-        );
+        cout << "Host init: " << time_stamp() - init_start << " sec.\n";
 
-        // Form build options string from given parameters: macros definitions to pass into kernels
-        string build_options =
-            "-DT=" + cmdparser.arithmetic.getValue() +
-            // " -cl-nv-maxrregcount=4" +
-            (cmdparser.arithmetic_double.isSet() ? " -DSAMPLE_NEEDS_DOUBLE" : "") +
-            " -DTILE_SIZE_M=" + to_str(cmdparser.tile_size_M.getValue()) +
-            " -DTILE_GROUP_M=" + to_str(cmdparser.tile_group_M.getValue()) +
-            " -DTILE_SIZE_N=" + to_str(cmdparser.tile_size_N.getValue()) +
-            " -DTILE_GROUP_N=" + to_str(cmdparser.tile_group_N.getValue()) +
-            " -DTILE_SIZE_K=" + to_str(cmdparser.tile_size_K.getValue());
+        double start = time_stamp();
+        if(pool.size() == 1)
+        {
+            cpuGEMM(problem);
+        }
+        else
+        {
+            cpuGEMMParallel(problem, pool, workspaces, tile_rows, tile_columns);
+        }
+        double time = time_stamp() - start;
 
-        cout << "Build program options: " << inquotes(build_options) << "\n";
+        if(trace)
+        {
+            trace->record(size, size, size, gemmLayout(Atransposed, Btransposed), sizeof(T), time, 0);
+        }
 
-        // Build kernel
-        OpenCLProgramOneKernel executable(
-            oclobjects,
-            L"gemm.cl",
-            "",
-            "gemm_" + cmdparser.kernel.getValue(),
-            build_options
-        );
+        cout << "Host time: " << time << " sec.\n";
+        cout << "Host perf: " << flops/time/1e9 << " GFLOPS\n";
+
+        if(pool.size() > 1)
+        {
+            // Uneven numbers point to cores of different speed.
+            cout << "Tasks executed (stolen) per thread:";
+            for(size_t w = 0; w < pool.size(); ++w)
+            {
+                cout << " " << pool.executedTasks()[w] << " (" << pool.stolenTasks()[w] << ")";
+            }
+            cout << "\n";
+        }
+
+        cout.flush();
+
+        if(i == 0 && cmdparser.validation.getValue())
+        {
+            double validation_start = time_stamp();
+
+            if(
+                !checkValidity(
+                    matrix_A.host,
+                    matrix_B.host,
+                    matrix_C.host,
+                    size,
+                    stride,
+                    Atransposed,
+                    Btransposed
+                )
+            )
+            {
+                throw Error("Validation procedure reported failures");
+            }
+
+            cout << "Validation time: " << time_stamp() - validation_start << " sec.\n";
+            cout.flush();
+        }
+    }
+}
+
+
+// Runs a batch of small independent multiplications with the persistent
+// kernel: all of them are executed by a single launch. For comparison,
+// the same tasks are also executed with one launch per multiplication.
+template <typename T>
+void gemmPersistent (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable
+)
+{
+    cmdparser.requireKernelTN("Persistent");
+
+    cmdparser.validateBatchParameters(oclobjects, sizeof(T));
+
+    size_t size = cmdparser.size.getValue();
+    size_t batch = cmdparser.batch.getValue();
+
+    // Matrices of the batch are packed one after another without
+    // padding, so each of them has row stride equal to size.
+    size_t matrix_elements = size*size;
+    size_t batch_memory_size = batch*matrix_elements*sizeof(T);
+
+    size_t alignmentForPtr = zeroCopyPtrAlignment(oclobjects.device);
+    size_t alignedSize = zeroCopySizeAlignment(batch_memory_size, oclobjects.device);
+
+    OpenCLDeviceAndHostMemory<T> matrix_A;
+    matrix_A.host = (T*)aligned_malloc(alignedSize, alignmentForPtr);
+
+    OpenCLDeviceAndHostMemory<T> matrix_B;
+    matrix_B.host = (T*)aligned_malloc(alignedSize, alignmentForPtr);
+
+    OpenCLDeviceAndHostMemory<T> matrix_C;
+    matrix_C.host = (T*)aligned_malloc(alignedSize, alignmentForPtr);
+
+    cl_int err = 0;
+
+    matrix_A.device = clCreateBuffer(
+        oclobjects.context,
+        CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+        batch_memory_size,
+        matrix_A.host,
+        &err
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    matrix_B.device = clCreateBuffer(
+        oclobjects.context,
+        CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+        batch_memory_size,
+        matrix_B.host,
+        &err
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    matrix_C.device = clCreateBuffer(
+        oclobjects.context,
+        CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,
+        batch_memory_size,
+        matrix_C.host,
+        &err
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    PersistentGEMMQueue work_queue(
+        oclobjects,
+        executable,
+        batch,
+        cmdparser.persistent_groups.getValue(),
+        cmdparser.local_size.getValue()*cmdparser.local_size.getValue()
+    );
+
+    cout
+        << "Running gemm_tn_persistent kernel with " << batch
+        << " matrices of size " << size << "x" << size
+        << " on " << work_queue.numGroups() << " work-groups of "
+        << work_queue.groupSize() << " work-items\n";
+
+    GEMMTask task;
+    task.m = task.n = task.k = static_cast<cl_int>(size);
+    task.lda = task.ldb = task.ldc = static_cast<cl_int>(size);
+    task.reserved = 0;
+
+    double flops = double(batch)*size*size*(size + size);
+
+    for(int i = 0; i < cmdparser.iterations.getValue(); ++i)
+    {
+        fill_rand_uniform_01(matrix_A.host, batch*matrix_elements);
+        fill_rand_uniform_01(matrix_B.host, batch*matrix_elements);
+        std::fill(matrix_C.host, matrix_C.host + batch*matrix_elements, T(0));
+
+        for(size_t b = 0; b < batch; ++b)
+        {
+            task.a_offset = task.b_offset = task.c_offset =
+                static_cast<cl_int>(b*matrix_elements);
+            work_queue.append(task);
+        }
+
+        // One launch per multiplication, the way single mode would do it.
+        double start = time_stamp();
+
+        for(size_t b = 0; b < batch; ++b)
+        {
+            cl_event event = work_queue.launch(
+                matrix_A.device,
+                matrix_B.device,
+                matrix_C.device,
+                b,
+                1
+            );
+            err = clReleaseEvent(event);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+
+        err = clFinish(oclobjects.queue);
+        SAMPLE_CHECK_ERRORS(err);
+
+        double separate_time = time_stamp() - start;
+
+        // All multiplications in one launch.
+        start = time_stamp();
+
+        cl_event event = work_queue.flush(matrix_A.device, matrix_B.device, matrix_C.device);
+
+        err = clFinish(oclobjects.queue);
+        SAMPLE_CHECK_ERRORS(err);
+
+        double persistent_time = time_stamp() - start;
+
+        double device_time = eventExecutionTime(event);
+        err = clReleaseEvent(event);
+        SAMPLE_CHECK_ERRORS(err);
+
+        cout << "Separate launches host time: " << separate_time << " sec.\n";
+        cout << "Separate launches host perf: " << flops/separate_time/1e9 << " GFLOPS\n";
+        cout << "Persistent launch host time: " << persistent_time << " sec.\n";
+        cout << "Persistent launch host perf: " << flops/persistent_time/1e9 << " GFLOPS\n";
+        cout << "Persistent launch device perf: " << flops/device_time/1e9 << " GFLOPS\n";
+        cout.flush();
+
+        if(i == 0 && cmdparser.validation.getValue())
+        {
+            clEnqueueMapBuffer(
+                oclobjects.queue,
+                matrix_C.device,
+                CL_TRUE,    // blocking map
+                CL_MAP_READ,
+                0,
+                batch_memory_size,
+                0, 0, 0,
+                &err
+            );
+            SAMPLE_CHECK_ERRORS(err);
+
+            for(size_t b = 0; b < batch; ++b)
+            {
+                if(
+                    !checkValidity(
+                        matrix_A.host + b*matrix_elements,
+                        matrix_B.host + b*matrix_elements,
+                        matrix_C.host + b*matrix_elements,
+                        size,
+                        size,
+                        true,
+                        false
+                    )
+                )
+                {
+                    throw Error(
+                        "Validation procedure reported failures for matrix " +
+                        to_str(b) + " of the batch"
+                    );
+                }
+            }
+
+            cout.flush();
+
+            err = clEnqueueUnmapMemObject(
+                oclobjects.queue,
+                matrix_C.device,
+                matrix_C.host,
+                0, 0, 0
+            );
+            SAMPLE_CHECK_ERRORS(err);
+
+            err = clFinish(oclobjects.queue);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+    }
+}
+
+
+// Multiplies one big matrix with Strassen-Winograd algorithm, which
+// dispatches multiplications at the bottom of the recursion to the gemm_tn
+// kernel from gemm.cl. For comparison the same matrices are multiplied by a
+// single gemm_tn launch; with validation, error growth is reported as
+// maximum relative error of both results.
+template <typename T>
+void gemmStrassen (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable,
+    OpenCLProgramMultipleKernels& matrix_ops
+)
+{
+    cmdparser.requireKernelTN("Strassen");
+
+    size_t rowAlignment = requiredOpenCLAlignment(oclobjects.device);
+    cmdparser.validateParameters(oclobjects, executable, sizeof(T), rowAlignment);
+
+    size_t size = cmdparser.size.getValue();
+    size_t local_size = cmdparser.local_size.getValue();
+
+    StrassenGEMM strassen(
+        oclobjects,
+        executable,
+        matrix_ops,
+        sizeof(T),
+        cmdparser.kernelBlocking(),
+        local_size
+    );
+
+    size_t levels = strassen.depth(size, cmdparser.strassen_cutoff.getValue());
+
+    cout
+        << "Running Strassen-Winograd with gemm_tn kernel with matrix size: "
+        << size << "x" << size << ", recursion levels: " << levels
+        << ", leaf size: " << (size >> levels) << "\n";
+
+    // Temporaries are allocated once, outside of the timed multiplications.
+    strassen.reserve(size, levels);
+
+    size_t stride = paddedRowStride(cmdparser, oclobjects, size, sizeof(T), rowAlignment);
+    cout << "Memory row stride: " << stride*sizeof(T) << " bytes\n";
+
+    // Movable matrices with lazy synchronization: map and unmap commands
+    // are enqueued only when the other side accesses the data.
+    vector<Matrix<T>> matrices;
+    for(int m = 0; m < 3; ++m)
+    {
+        matrices.push_back(Matrix<T>(oclobjects, size, size, stride));
+    }
+
+    Matrix<T>& matrix_A = matrices[0];
+    Matrix<T>& matrix_B = matrices[1];
+    Matrix<T>& matrix_C = matrices[2];
+
+    cl_int err = 0;
+
+    // Strassen-Winograd does fewer operations, the performance below is
+    // computed for the classical algorithm to be comparable with single mode.
+    double flops = double(size)*size*(size + size);
+
+    std::vector<T> classical_result;
+    std::vector<T> reference;
+
+    for(int i = 0; i < cmdparser.iterations.getValue(); ++i)
+    {
+        T* host_A = matrix_A.host(ACCESS_WRITE);
+        T* host_B = matrix_B.host(ACCESS_WRITE);
+        T* host_C = matrix_C.host(ACCESS_WRITE);
+
+        for(size_t r = 0; r < size; ++r)
+        {
+            fill_rand_uniform_01(host_A + r*stride, size);
+            fill_rand_uniform_01(host_B + r*stride, size);
+            std::fill(host_C + r*stride, host_C + (r + 1)*stride, T(0));
+        }
+
+        bool validate = i == 0 && cmdparser.validation.getValue();
+
+        StrassenMatrix A(matrix_A.device(ACCESS_READ), 0, stride);
+        StrassenMatrix B(matrix_B.device(ACCESS_READ), 0, stride);
+
+        double classical_start = time_stamp();
+        strassen.multiply(A, B, StrassenMatrix(matrix_C.device(ACCESS_WRITE), 0, stride), size, 0);
+        err = clFinish(oclobjects.queue);
+        SAMPLE_CHECK_ERRORS(err);
+        double classical_time = time_stamp() - classical_start;
+
+        cout << "Single launch host time: " << classical_time << " sec.\n";
+        cout << "Single launch host perf: " << flops/classical_time/1e9 << " GFLOPS\n";
+
+        if(validate)
+        {
+            host_C = matrix_C.host(ACCESS_READ);
+            classical_result.assign(host_C, host_C + size*stride);
+        }
+
+        // C is unmapped here only if it was mapped for validation.
+        StrassenMatrix C(matrix_C.device(ACCESS_WRITE), 0, stride);
+
+        double start = time_stamp();
+        strassen.multiply(A, B, C, size, levels);
+        err = clFinish(oclobjects.queue);
+        SAMPLE_CHECK_ERRORS(err);
+        double time = time_stamp() - start;
+
+        cout << "Strassen-Winograd host time: " << time << " sec.\n";
+        cout << "Strassen-Winograd effective host perf: " << flops/time/1e9 << " GFLOPS\n";
+        cout.flush();
+
+        if(validate)
+        {
+            host_C = matrix_C.host(ACCESS_READ);
+
+            cout << "Compute reference on host..." << flush;
+            reference.resize(size*stride);
+            computeReference(
+                matrix_A.host(ACCESS_READ),
+                matrix_B.host(ACCESS_READ),
+                &reference[0],
+                size,
+                stride,
+                true,
+                false
+            );
+            cout << " DONE\n";
+
+            T strassen_error = maxRelativeError(host_C, &reference[0], size, stride);
+            T tolerance = validationTolerance<T>();
+
+            cout << "Max relative error of Strassen-Winograd (" << levels << " levels): " << strassen_error << "\n";
+
+            T classical_error = maxRelativeError(&classical_result[0], &reference[0], size, stride);
+            cout << "Max relative error of single launch: " << classical_error << "\n";
+            if(classical_error > 0)
+            {
+                cout << "Error growth: " << strassen_error/classical_error << "x\n";
+            }
+
+            cout << "checkValidity tolerance: " << tolerance << "\n";
+
+            if(strassen_error > tolerance)
+            {
+                throw Error("Validation procedure reported failures");
+            }
+        }
+    }
+
+    cout
+        << "Map/unmap commands for A, B and C: " << matrix_A.synchronizations() << ", "
+        << matrix_B.synchronizations() << ", " << matrix_C.synchronizations() << "\n";
+
+    cout
+        << "Enqueued " << strassen.leafMultiplications() << " gemm_tn launches and "
+        << strassen.elementwiseOperations() << " elementwise operations\n";
+}
+
+
+// Sub-buffer covering rows [first_row, first_row + rows) of a matrix,
+// released at the end of the scope. Empty range gives no sub-buffer.
+struct MatrixRows
+{
+    cl_mem buffer;
+
+    MatrixRows (cl_mem matrix, size_t first_row, size_t rows, size_t row_size) :
+        buffer(0)
+    {
+        if(rows == 0)
+        {
+            return;
+        }
+
+        cl_buffer_region region = { first_row*row_size, rows*row_size };
+
+        cl_int err = 0;
+        buffer = clCreateSubBuffer(
+            matrix,
+            0,  // inherit flags of the parent
+            CL_BUFFER_CREATE_TYPE_REGION,
+            &region,
+            &err
+        );
+        SAMPLE_CHECK_ERRORS(err);
+    }
+
+    ~MatrixRows ()
+    {
+        try
+        {
+            if(buffer)
+            {
+                cl_int err = clReleaseMemObject(buffer);
+                SAMPLE_CHECK_ERRORS(err);
+            }
+        }
+        catch(...)
+        {
+            destructorException();
+        }
+    }
+
+private:
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    MatrixRows (const MatrixRows&);
+    MatrixRows& operator= (const MatrixRows&);
+};
+
+
+// Timings of one multiplication in hetero mode, in seconds.
+struct HeteroTimes
+{
+    double total;   // host time of the whole multiplication
+    double device;  // kernel execution time of the device rows
+    double host;    // time of the host engine for the host rows
+};
+
+
+// Multiplies one big matrix by the OpenCL device and the native host engine
+// together: the first rows of C are computed by the gemm_tn kernel, the rest
+// by the host engine at the same time. Both parts are written into the same
+// zero-copy C buffer through its non-overlapping sub-buffers, so no gathering
+// copy is needed. The fraction of rows given to the device is calibrated and
+// then adjusted after every iteration to balance measured times of both sides.
+template <typename T>
+void gemmHetero (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable
+)
+{
+    cmdparser.requireKernelTN("Hetero");
+
+    size_t rowAlignment = requiredOpenCLAlignment(oclobjects.device);
+    cmdparser.validateParameters(oclobjects, executable, sizeof(T), rowAlignment);
+
+    size_t size = cmdparser.size.getValue();
+    size_t global_size = cmdparser.global_size.getValue();
+    size_t local_size = cmdparser.local_size.getValue();
+    size_t blocking = cmdparser.kernelBlocking();
+
+    float initial_share = cmdparser.hetero_share.getValue();
+    cmdparser.hetero_share.validate(
+        initial_share <= 1,
+        "should be from 0 to 1, or negative for calibration"
+    );
+
+    // Rows of C are given to the device by whole work-groups.
+    size_t row_granularity = blocking*local_size;
+
+    // Sub-buffer origins are row boundaries, which satisfy base address
+    // alignment of the device with any padding.
+    size_t stride = paddedRowStride(cmdparser, oclobjects, size, sizeof(T), rowAlignment);
+    cout << "Memory row stride: " << stride*sizeof(T) << " bytes\n";
+
+    size_t row_size = stride*sizeof(T);
+    size_t matrix_memory_size = size*row_size;
+    size_t alignmentForPtr = zeroCopyPtrAlignment(oclobjects.device);
+    size_t alignedSize = zeroCopySizeAlignment(matrix_memory_size, oclobjects.device);
+
+    OpenCLDeviceAndHostMemory<T> matrix_A;
+    matrix_A.host = (T*)aligned_malloc(alignedSize, alignmentForPtr);
+
+    OpenCLDeviceAndHostMemory<T> matrix_B;
+    matrix_B.host = (T*)aligned_malloc(alignedSize, alignmentForPtr);
+
+    OpenCLDeviceAndHostMemory<T> matrix_C;
+    matrix_C.host = (T*)aligned_malloc(alignedSize, alignmentForPtr);
+
+    cl_int err = 0;
+
+    matrix_A.device = clCreateBuffer(
+        oclobjects.context,
+        CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+        matrix_memory_size,
+        matrix_A.host,
+        &err
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    matrix_B.device = clCreateBuffer(
+        oclobjects.context,
+        CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+        matrix_memory_size,
+        matrix_B.host,
+        &err
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    matrix_C.device = clCreateBuffer(
+        oclobjects.context,
+        CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,
+        matrix_memory_size,
+        matrix_C.host,
+        &err
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    WorkStealingPool pool(
+        cmdparser.threads.getValue(),
+        parseCPUList(cmdparser.cpu_affinity.getValue())
+    );
+
+    vector<unique_ptr<CPUGEMMWorkspace<T>>> workspace_storage;
+    vector<CPUGEMMWorkspace<T>*> workspaces;
+    for(size_t w = 0; w < pool.size(); ++w)
+    {
+        workspace_storage.push_back(unique_ptr<CPUGEMMWorkspace<T>>(new CPUGEMMWorkspace<T>));
+        workspaces.push_back(workspace_storage.back().get());
+    }
+
+    CPUGEMMBlocking host_blocking = cpuGEMMBlocking<T>();
+    size_t tile_rows = host_blocking.MC;
+    size_t tile_columns = round_up_aligned(256, host_blocking.NR);
+
+    cout
+        << "Running gemm_tn kernel together with host GEMM ("
+        << host_blocking.micro_kernel << " micro-kernel, " << pool.size()
+        << " threads) with matrix size: " << size << "x" << size << "\n";
+
+    cl_kernel kernel = executable.kernel;
+
+    auto quantize = [&](float share) -> size_t
+    {
+        size_t groups = size_t(share*size/row_granularity + 0.5f);
+        return min(groups*row_granularity, size);
+    };
+
+    auto multiply = [&](size_t device_rows) -> HeteroTimes
+    {
+        size_t host_rows = size - device_rows;
+        HeteroTimes times = { 0, 0, 0 };
+
+        // The kernel must not write to a mapped memory object, so it gets
+        // its own sub-buffer of C, disjoint from the mapped host rows.
+        MatrixRows device_C(matrix_C.device, 0, device_rows, row_size);
+        MatrixRows host_C(matrix_C.device, device_rows, host_rows, row_size);
+
+        double start = time_stamp();
+
+        // Mapping for reading allows the device to read A and B at the same time.
+        T* A = (T*)clEnqueueMapBuffer(
+            oclobjects.queue, matrix_A.device, CL_TRUE, CL_MAP_READ,
+            0, matrix_memory_size, 0, 0, 0, &err
+        );
+        SAMPLE_CHECK_ERRORS(err);
+
+        T* B = (T*)clEnqueueMapBuffer(
+            oclobjects.queue, matrix_B.device, CL_TRUE, CL_MAP_READ,
+            0, matrix_memory_size, 0, 0, 0, &err
+        );
+        SAMPLE_CHECK_ERRORS(err);
+
+        T* C = 0;
+        if(host_rows > 0)
+        {
+            C = (T*)clEnqueueMapBuffer(
+                oclobjects.queue, host_C.buffer, CL_TRUE, CL_MAP_WRITE,
+                0, host_rows*row_size, 0, 0, 0, &err
+            );
+            SAMPLE_CHECK_ERRORS(err);
+        }
+
+        cl_event event = 0;
+        if(device_rows > 0)
+        {
+            setGEMMTNArgs(
+                kernel,
+                matrix_A.device, stride,
+                matrix_B.device, stride,
+                device_C.buffer, stride,
+                size
+            );
+
+            size_t global[2] = { device_rows/blocking, global_size };
+            size_t local[2] = { local_size, local_size };
+
+            err = clEnqueueNDRangeKernel(
+                oclobjects.queue,
+                kernel,
+                2,
+                0,
+                global,
+                local,
+                0, 0, &event
+            );
+            SAMPLE_CHECK_ERRORS(err);
+
+            err = clFlush(oclobjects.queue);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+
+        if(host_rows > 0)
+        {
+            double host_start = time_stamp();
+
+            // The same strides as checkValidity uses for tn
+            CPUGEMMProblem<T> problem;
+            problem.m = host_rows;
+            problem.n = problem.k = size;
+            problem.A = A + device_rows*stride;
+            problem.a_row_stride = stride;
+            problem.a_col_stride = 1;
+            problem.B = B;
+            problem.b_row_stride = 1;
+            problem.b_col_stride = stride;
+            problem.C = C;
+            problem.ldc = stride;
+
+            cpuGEMMParallel(problem, pool, workspaces, tile_rows, tile_columns);
+
+            times.host = time_stamp() - host_start;
+        }
+
+        if(event)
+        {
+            err = clWaitForEvents(1, &event);
+            SAMPLE_CHECK_ERRORS(err);
+            times.device = eventExecutionTime(event);
+            err = clReleaseEvent(event);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+
+        if(C)
+        {
+            err = clEnqueueUnmapMemObject(oclobjects.queue, host_C.buffer, C, 0, 0, 0);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+
+        err = clEnqueueUnmapMemObject(oclobjects.queue, matrix_B.device, B, 0, 0, 0);
+        SAMPLE_CHECK_ERRORS(err);
+        err = clEnqueueUnmapMemObject(oclobjects.queue, matrix_A.device, A, 0, 0, 0);
+        SAMPLE_CHECK_ERRORS(err);
+
+        err = clFinish(oclobjects.queue);
+        SAMPLE_CHECK_ERRORS(err);
+
+        times.total = time_stamp() - start;
+        return times;
+    };
+
+    // Share of rows that balances both sides at their measured throughput;
+    // negative if one of the sides was not measured.
+    auto balancedShare = [&](size_t device_rows, const HeteroTimes& times) -> float
+    {
+        size_t host_rows = size - device_rows;
+        if(device_rows == 0 || host_rows == 0 || times.device <= 0 || times.host <= 0)
+        {
+            return -1;
+        }
+
+        double device_rate = device_rows/times.device;
+        double host_rate = host_rows/times.host;
+        return float(device_rate/(device_rate + host_rate));
+    };
+
+    auto initialize = [&]()
+    {
+        for(size_t r = 0; r < size; ++r)
+        {
+            fill_rand_uniform_01(matrix_A.host + r*stride, size);
+            fill_rand_uniform_01(matrix_B.host + r*stride, size);
+            std::fill(matrix_C.host + r*stride, matrix_C.host + (r + 1)*stride, T(0));
+        }
+    };
+
+    float share = initial_share;
+
+    if(share < 0)
+    {
+        initialize();
+
+        size_t device_rows = quantize(0.5f);
+        HeteroTimes times = multiply(device_rows);
+        share = balancedShare(device_rows, times);
+
+        if(share < 0)
+        {
+            // Matrix is too small to split: give it to the device.
+            share = 1;
+        }
+
+        cout << "Calibrated device share of rows: " << share << "\n";
+    }
+
+    double flops = double(size)*size*(size + size);
+
+    for(int i = 0; i < cmdparser.iterations.getValue(); ++i)
+    {
+        initialize();
+
+        size_t device_rows = quantize(share);
+        HeteroTimes times = multiply(device_rows);
+
+        cout
+            << "Device rows: " << device_rows << ", host rows: " << size - device_rows << "\n"
+            << "Device part time: " << times.device << " sec., "
+            << "host part time: " << times.host << " sec.\n"
+            << "Host time: " << times.total << " sec.\n"
+            << "Host perf: " << flops/times.total/1e9 << " GFLOPS\n";
+
+        // Smoothing filters out noise of a single measurement.
+        float measured = balancedShare(device_rows, times);
+        if(measured >= 0)
+        {
+            share = (share + measured)/2;
+            cout << "Next device share of rows: " << share << "\n";
+        }
+
+        cout.flush();
+
+        if(i == 0 && cmdparser.validation.getValue())
+        {
+            // Both parts are gathered in the host memory of C.
+            clEnqueueMapBuffer(
+                oclobjects.queue,
+                matrix_C.device,
+                CL_TRUE,
+                CL_MAP_READ,
+                0,
+                matrix_memory_size,
+                0, 0, 0,
+                &err
+            );
+            SAMPLE_CHECK_ERRORS(err);
+
+            if(
+                !checkValidity(
+                    matrix_A.host,
+                    matrix_B.host,
+                    matrix_C.host,
+                    size,
+                    stride,
+                    true,
+                    false
+                )
+            )
+            {
+                throw Error("Validation procedure reported failures");
+            }
+
+            cout.flush();
+
+            err = clEnqueueUnmapMemObject(oclobjects.queue, matrix_C.device, matrix_C.host, 0, 0, 0);
+            SAMPLE_CHECK_ERRORS(err);
+
+            err = clFinish(oclobjects.queue);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+    }
+}
+
+
+// Splits rows of C between all devices selected with --device (for example
+// "all" or "0,1"): every device gets its own queue and sub-buffers of A and C
+// with its rows, B is shared. Rows are distributed proportionally to the
+// number of compute units. The same multiplication on the first device only
+// is the baseline for scaling efficiency.
+template <typename T>
+void gemmMulti (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable
+)
+{
+    cmdparser.requireKernelTN("Multi");
+
+    size_t num_devices = oclobjects.devices.size();
+
+    // Sub-buffer origins should satisfy alignment of every device.
+    size_t rowAlignment = 0;
+    vector<unsigned> compute_units(num_devices);  // cl_uint values
+    for(size_t d = 0; d < num_devices; ++d)
+    {
+        rowAlignment = max<size_t>(rowAlignment, requiredOpenCLAlignment(oclobjects.devices[d]));
+
+        cl_int err = clGetDeviceInfo(
+            oclobjects.devices[d],
+            CL_DEVICE_MAX_COMPUTE_UNITS,
+            sizeof(compute_units[d]),
+            &compute_units[d],
+            0
+        );
+        SAMPLE_CHECK_ERRORS(err);
+    }
+
+    cmdparser.validateParameters(oclobjects, executable, sizeof(T), rowAlignment);
+
+    size_t size = cmdparser.size.getValue();
+    size_t global_size = cmdparser.global_size.getValue();
+    size_t local_size = cmdparser.local_size.getValue();
+
+    // Rows of C are given to devices by whole work-groups.
+    size_t blocking = cmdparser.kernelBlocking();
+    size_t row_granularity = blocking*local_size;
+
+    size_t stride = paddedRowStride(cmdparser, oclobjects, size, sizeof(T), rowAlignment);
+    cout << "Memory row stride: " << stride*sizeof(T) << " bytes\n";
+
+    // Rows of each device, proportional to its compute units.
+    size_t total_compute_units = 0;
+    for(size_t d = 0; d < num_devices; ++d)
+    {
+        total_compute_units += compute_units[d];
+    }
+
+    vector<size_t> device_rows(num_devices);
+    size_t assigned_groups = 0;
+    size_t total_groups = size/row_granularity;
+    for(size_t d = 0, units = 0; d < num_devices; ++d)
+    {
+        units += compute_units[d];
+        size_t groups = (total_groups*units + total_compute_units/2)/total_compute_units;
+        device_rows[d] = (groups - assigned_groups)*row_granularity;
+        assigned_groups = groups;
+    }
+
+    vector<size_t> single_rows(num_devices, 0);
+    single_rows[0] = size;
+
+    size_t row_size = stride*sizeof(T);
+    size_t matrix_memory_size = size*row_size;
+    size_t alignmentForPtr = zeroCopyPtrAlignment(oclobjects.device);
+    size_t alignedSize = zeroCopySizeAlignment(matrix_memory_size, oclobjects.device);
+
+    OpenCLDeviceAndHostMemory<T> matrix_A;
+    matrix_A.host = (T*)aligned_malloc(alignedSize, alignmentForPtr);
+
+    OpenCLDeviceAndHostMemory<T> matrix_B;
+    matrix_B.host = (T*)aligned_malloc(alignedSize, alignmentForPtr);
+
+    OpenCLDeviceAndHostMemory<T> matrix_C;
+    matrix_C.host = (T*)aligned_malloc(alignedSize, alignmentForPtr);
+
+    cl_int err = 0;
+
+    matrix_A.device = clCreateBuffer(
+        oclobjects.context,
+        CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+        matrix_memory_size,
+        matrix_A.host,
+        &err
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    matrix_B.device = clCreateBuffer(
+        oclobjects.context,
+        CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+        matrix_memory_size,
+        matrix_B.host,
+        &err
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    matrix_C.device = clCreateBuffer(
+        oclobjects.context,
+        CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,
+        matrix_memory_size,
+        matrix_C.host,
+        &err
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    cout
+        << "Running gemm_tn kernel on " << num_devices
+        << " devices with matrix size: " << size << "x" << size << "\n";
+
+    for(size_t d = 0; d < num_devices; ++d)
+    {
+        cout
+            << "    device " << d << ": " << compute_units[d]
+            << " compute units, " << device_rows[d] << " rows\n";
+    }
+
+    cl_kernel kernel = executable.kernel;
+
+    // Enqueues rows[d] rows of C to the d-th device, waits for all devices
+    // and returns host time. Kernel times are stored in device_times.
+    vector<double> device_times(num_devices);
+    auto multiply = [&](const vector<size_t>& rows) -> double
+    {
+        vector<unique_ptr<MatrixRows>> A_rows;
+        vector<unique_ptr<MatrixRows>> C_rows;
+        vector<cl_event> events(num_devices, cl_event(0));
+
+        for(size_t d = 0, first_row = 0; d < num_devices; first_row += rows[d], ++d)
+        {
+            A_rows.push_back(unique_ptr<MatrixRows>(new MatrixRows(matrix_A.device, first_row, rows[d], row_size)));
+            C_rows.push_back(unique_ptr<MatrixRows>(new MatrixRows(matrix_C.device, first_row, rows[d], row_size)));
+        }
+
+        double start = time_stamp();
+
+        // Arguments are captured at enqueue time, so one kernel
+        // object serves all devices one after another.
+        for(size_t d = 0; d < num_devices; ++d)
+        {
+            if(rows[d] == 0)
+            {
+                continue;
+            }
+
+            setGEMMTNArgs(
+                kernel,
+                A_rows[d]->buffer, stride,
+                matrix_B.device, stride,
+                C_rows[d]->buffer, stride,
+                size
+            );
+
+            size_t global[2] = { rows[d]/blocking, global_size };
+            size_t local[2] = { local_size, local_size };
+
+            err = clEnqueueNDRangeKernel(
+                oclobjects.queues[d],
+                kernel,
+                2,
+                0,
+                global,
+                local,
+                0, 0, &events[d]
+            );
+            SAMPLE_CHECK_ERRORS(err);
+
+            err = clFlush(oclobjects.queues[d]);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+
+        for(size_t d = 0; d < num_devices; ++d)
+        {
+            err = clFinish(oclobjects.queues[d]);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+
+        double time = time_stamp() - start;
+
+        for(size_t d = 0; d < num_devices; ++d)
+        {
+            device_times[d] = 0;
+            if(events[d])
+            {
+                device_times[d] = eventExecutionTime(events[d]);
+                err = clReleaseEvent(events[d]);
+                SAMPLE_CHECK_ERRORS(err);
+            }
+        }
+
+        return time;
+    };
+
+    // Speedup of the ideal scaling over the first device alone
+    double ideal_speedup = double(total_compute_units)/compute_units[0];
+
+    double flops = double(size)*size*(size + size);
+
+    for(int i = 0; i < cmdparser.iterations.getValue(); ++i)
+    {
+        for(size_t r = 0; r < size; ++r)
+        {
+            fill_rand_uniform_01(matrix_A.host + r*stride, size);
+            fill_rand_uniform_01(matrix_B.host + r*stride, size);
+            std::fill(matrix_C.host + r*stride, matrix_C.host + (r + 1)*stride, T(0));
+        }
+
+        double single_time = multiply(single_rows);
+        double multi_time = multiply(device_rows);
+
+        cout << "Single device host time: " << single_time << " sec.\n";
+        cout << "Single device host perf: " << flops/single_time/1e9 << " GFLOPS\n";
+        cout << "All devices host time: " << multi_time << " sec.\n";
+        cout << "All devices host perf: " << flops/multi_time/1e9 << " GFLOPS\n";
+
+        for(size_t d = 0; d < num_devices; ++d)
+        {
+            cout << "    device " << d << " kernel time: " << device_times[d] << " sec.\n";
+        }
+
+        double speedup = single_time/multi_time;
+        cout
+            << "Speedup: " << speedup << "x of ideal " << ideal_speedup
+            << "x, scaling efficiency: " << 100*speedup/ideal_speedup << "%\n";
+        cout.flush();
+
+        if(i == 0 && cmdparser.validation.getValue())
+        {
+            // Both runs write the same values, validate the last one.
+            clEnqueueMapBuffer(
+                oclobjects.queue,
+                matrix_C.device,
+                CL_TRUE,
+                CL_MAP_READ,
+                0,
+                matrix_memory_size,
+                0, 0, 0,
+                &err
+            );
+            SAMPLE_CHECK_ERRORS(err);
+
+            if(
+                !checkValidity(
+                    matrix_A.host,
+                    matrix_B.host,
+                    matrix_C.host,
+                    size,
+                    stride,
+                    true,
+                    false
+                )
+            )
+            {
+                throw Error("Validation procedure reported failures");
+            }
+
+            cout.flush();
+
+            err = clEnqueueUnmapMemObject(oclobjects.queue, matrix_C.device, matrix_C.host, 0, 0, 0);
+            SAMPLE_CHECK_ERRORS(err);
+
+            err = clFinish(oclobjects.queue);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+    }
+}
+
+
+// Latency statistics of one run of tenants mode
+struct TenantsLatency
+{
+    double p50;     // latency percentiles of single multiplication, in seconds
+    double p95;
+    double p99;
+    double max;
+    double gflops;  // aggregate throughput of all tenants
+};
+
+
+// Resources of one tenant: its own queue on the assigned device,
+// kernel object to set arguments independently and buffers.
+struct Tenant
+{
+    cl_command_queue queue;
+    cl_kernel kernel;
+    cl_mem A;
+    cl_mem B;
+    cl_mem C;
+    std::vector<double> latencies;
+
+    Tenant () :
+        queue(0), kernel(0), A(0), B(0), C(0)
+    {
+    }
+
+    ~Tenant ()
+    {
+        try
+        {
+            cl_mem buffers[3] = { A, B, C };
+            for(int i = 0; i < 3; ++i)
+            {
+                if(buffers[i])
+                {
+                    cl_int err = clReleaseMemObject(buffers[i]);
+                    SAMPLE_CHECK_ERRORS(err);
+                }
+            }
+
+            if(kernel)
+            {
+                cl_int err = clReleaseKernel(kernel);
+                SAMPLE_CHECK_ERRORS(err);
+            }
+
+            if(queue)
+            {
+                cl_int err = clReleaseCommandQueue(queue);
+                SAMPLE_CHECK_ERRORS(err);
+            }
+        }
+        catch(...)
+        {
+            destructorException();
+        }
+    }
+
+private:
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    Tenant (const Tenant&);
+    Tenant& operator= (const Tenant&);
+};
+
+
+// Runs --tenants concurrent streams of --requests multiplications each. Every
+// stream is issued by its own host thread to its own queue; tenant t uses
+// device t mod number of devices, so without partitioning all of them contend
+// on one device and with partitioning each gets its own sub-device.
+template <typename T>
+TenantsLatency runTenants (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable,
+    const string& kernel_name
+)
+{
+    size_t rowAlignment = requiredOpenCLAlignment(oclobjects.device);
+    cmdparser.validateParameters(oclobjects, executable, sizeof(T), rowAlignment);
+
+    size_t size = cmdparser.size.getValue();
+    size_t num_tenants = cmdparser.tenants.getValue();
+    size_t num_requests = cmdparser.requests.getValue();
+    size_t num_devices = oclobjects.devices.size();
+
+    if(num_tenants == 0 || num_requests == 0)
+    {
+        throw CmdParser::Error(
+            cmdparser.tenants.name() + " and " + cmdparser.requests.name() +
+            " should be positive."
+        );
+    }
+
+    // Tenants use dense matrices: row stride is equal to size.
+    size_t matrix_memory_size = size*size*sizeof(T);
+
+    std::vector<T> host_A(size*size);
+    std::vector<T> host_B(size*size);
+    fill_rand_uniform_01(&host_A[0], size*size);
+    fill_rand_uniform_01(&host_B[0], size*size);
+
+    vector<unique_ptr<Tenant>> tenants;
+
+    for(size_t t = 0; t < num_tenants; ++t)
+    {
+        tenants.push_back(unique_ptr<Tenant>(new Tenant));
+        Tenant& tenant = *tenants.back();
+
+        cl_int err = 0;
+
+        tenant.queue = clCreateCommandQueue(
+            oclobjects.context,
+            oclobjects.devices[t % num_devices],
+            0,
+            &err
+        );
+        SAMPLE_CHECK_ERRORS(err);
+
+        tenant.kernel = clCreateKernel(executable.program, kernel_name.c_str(), &err);
+        SAMPLE_CHECK_ERRORS(err);
+
+        tenant.A = clCreateBuffer(
+            oclobjects.context,
+            CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+            matrix_memory_size,
+            &host_A[0],
+            &err
+        );
+        SAMPLE_CHECK_ERRORS(err);
+
+        tenant.B = clCreateBuffer(
+            oclobjects.context,
+            CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+            matrix_memory_size,
+            &host_B[0],
+            &err
+        );
+        SAMPLE_CHECK_ERRORS(err);
+
+        tenant.C = clCreateBuffer(
+            oclobjects.context,
+            CL_MEM_READ_WRITE,
+            matrix_memory_size,
+            0,
+            &err
+        );
+        SAMPLE_CHECK_ERRORS(err);
+
+        setGEMMTNArgs(tenant.kernel, tenant.A, size, tenant.B, size, tenant.C, size, size);
+
+        // Warm up: the first launch includes lazy initialization.
+        size_t global_size[2] = { cmdparser.global_size.getValue(), cmdparser.global_size.getValue() };
+        size_t local_size[2] = { cmdparser.local_size.getValue(), cmdparser.local_size.getValue() };
+
+        err = clEnqueueNDRangeKernel(tenant.queue, tenant.kernel, 2, 0, global_size, local_size, 0, 0, 0);
+        SAMPLE_CHECK_ERRORS(err);
+        err = clFinish(tenant.queue);
+        SAMPLE_CHECK_ERRORS(err);
+    }
+
+    std::atomic<bool> go(false);
+    std::vector<std::exception_ptr> errors(num_tenants);
+    std::vector<std::thread> threads;
+
+    for(size_t t = 0; t < num_tenants; ++t)
+    {
+        threads.push_back(
+            std::thread(
+                [&, t]()
+                {
+                    try
+                    {
+                        Tenant& tenant = *tenants[t];
+
+                        size_t global_size[2] = { cmdparser.global_size.getValue(), cmdparser.global_size.getValue() };
+                        size_t local_size[2] = { cmdparser.local_size.getValue(), cmdparser.local_size.getValue() };
+
+                        while(!go)
+                        {
+                            std::this_thread::yield();
+                        }
+
+                        for(size_t r = 0; r < num_requests; ++r)
+                        {
+                            double start = time_stamp();
+
+                            cl_int err = clEnqueueNDRangeKernel(
+                                tenant.queue,
+                                tenant.kernel,
+                                2,
+                                0,
+                                global_size,
+                                local_size,
+                                0, 0, 0
+                            );
+                            SAMPLE_CHECK_ERRORS(err);
+
+                            err = clFinish(tenant.queue);
+                            SAMPLE_CHECK_ERRORS(err);
+
+                            tenant.latencies.push_back(time_stamp() - start);
+                        }
+                    }
+                    catch(...)
+                    {
+                        errors[t] = std::current_exception();
+                    }
+                }
+            )
+        );
+    }
+
+    double start = time_stamp();
+    go = true;
+
+    for(size_t t = 0; t < num_tenants; ++t)
+    {
+        threads[t].join();
+    }
+
+    double time = time_stamp() - start;
+
+    for(size_t t = 0; t < num_tenants; ++t)
+    {
+        if(errors[t])
+        {
+            std::rethrow_exception(errors[t]);
+        }
+    }
+
+    if(cmdparser.validation.getValue())
+    {
+        std::vector<T> host_C(size*size);
+
+        cl_int err = clEnqueueReadBuffer(
+            tenants[0]->queue,
+            tenants[0]->C,
+            CL_TRUE,
+            0,
+            matrix_memory_size,
+            &host_C[0],
+            0, 0, 0
+        );
+        SAMPLE_CHECK_ERRORS(err);
+
+        if(
+            !checkValidity(
+                &host_A[0],
+                &host_B[0],
+                &host_C[0],
+                size,
+                size,
+                cmdparser.kernel_tn.isSet() or cmdparser.kernel_tt.isSet(),
+                cmdparser.kernel_nt.isSet() or cmdparser.kernel_tt.isSet()
+            )
+        )
+        {
+            throw Error("Validation procedure reported failures");
+        }
+    }
+
+    std::vector<double> latencies;
+    for(size_t t = 0; t < num_tenants; ++t)
+    {
+        latencies.insert(latencies.end(), tenants[t]->latencies.begin(), tenants[t]->latencies.end());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    auto percentile = [&](double p) -> double
+    {
+        return latencies[min(latencies.size() - 1, size_t(p*latencies.size()))];
+    };
+
+    TenantsLatency result;
+    result.p50 = percentile(0.50);
+    result.p95 = percentile(0.95);
+    result.p99 = percentile(0.99);
+    result.max = latencies.back();
+    result.gflops = double(latencies.size())*size*size*(size + size)/time/1e9;
+
+    return result;
+}
+
+
+// Tail latency of concurrent tenants on the whole device and on sub-devices
+// created by --device-partition, each in its own context.
+template <typename T>
+void gemmTenants (CmdParserGEMM& cmdparser, const string& build_options)
+{
+    string kernel_name = "gemm_" + cmdparser.kernel.getValue();
+
+    vector<string> partitions(1, "none");
+    if(cmdparser.device_partition.getValue() != "none")
+    {
+        partitions.push_back(cmdparser.device_partition.getValue());
+    }
+
+    vector<TenantsLatency> results;
+
+    for(size_t i = 0; i < partitions.size(); ++i)
+    {
+        OpenCLBasic oclobjects(
+            cmdparser.platform.getValue(),
+            cmdparser.device_type.getValue(),
+            cmdparser.device.getValue(),
+            CL_QUEUE_PROFILING_ENABLE,
+            0,
+            partitions[i]
+        );
+
+        OpenCLProgramOneKernel executable(
+            oclobjects,
+            L"gemm.cl",
+            "",
+            kernel_name,
+            build_options
+        );
+
+        cmdparser.deriveNDRange(oclobjects, executable);
+
+        cout
+            << "Running " << cmdparser.tenants.getValue() << " tenants with "
+            << cmdparser.requests.getValue() << " multiplications of size "
+            << cmdparser.size.getValue() << " on " << oclobjects.devices.size()
+            << " devices, partition: " << partitions[i] << "\n";
+
+        results.push_back(runTenants<T>(cmdparser, oclobjects, executable, kernel_name));
+    }
+
+    cout << "Latency of one multiplication, sec. (p50 / p95 / p99 / max), aggregate GFLOPS:\n";
+
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        cout
+            << "    partition " << partitions[i] << ": "
+            << results[i].p50 << " / " << results[i].p95 << " / "
+            << results[i].p99 << " / " << results[i].max << ", "
+            << results[i].gflops << "\n";
+    }
+}
+
+
+// Read-only image with rows of a matrix as RGBA float texels: 4 consecutive
+// elements of a row per texel. Released at the end of the scope.
+struct TexelImage
+{
+    cl_mem image;
+
+    TexelImage (cl_context context, const float* matrix, size_t size, size_t stride) :
+        image(0)
+    {
+        cl_image_format format = { CL_RGBA, CL_FLOAT };
+
+        cl_int err = 0;
+        image = clCreateImage2D(
+            context,
+            CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+            &format,
+            size/4,
+            size,
+            stride*sizeof(float),
+            const_cast<float*>(matrix),
+            &err
+        );
+        SAMPLE_CHECK_ERRORS(err);
+    }
+
+    ~TexelImage ()
+    {
+        try
+        {
+            cl_int err = clReleaseMemObject(image);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+        catch(...)
+        {
+            destructorException();
+        }
+    }
+
+private:
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    TexelImage (const TexelImage&);
+    TexelImage& operator= (const TexelImage&);
+};
+
+
+// Compares the buffer kernel from gemm.cl, which reads A and B with vloadn,
+// with the texture-path kernel from gemm-image.cl, which reads them through
+// image2d_t objects, for every size from --sizes. Both kernels should have
+// the same blocking, which is derived from --size and --global-size.
+template <typename T>
+void gemmImage (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& buffer_executable,
+    OpenCLProgramOneKernel& image_executable
+)
+{
+    cmdparser.requireKernelTN("Image");
+
+    if(!cmdparser.arithmetic_float.isSet())
+    {
+        throw CmdParser::Error(
+            "Image mode supports float arithmetic only: "
+            "read_imagef reads float texels."
+        );
+    }
+
+    cl_bool image_support = CL_FALSE;
+    cl_int err = clGetDeviceInfo(
+        oclobjects.device,
+        CL_DEVICE_IMAGE_SUPPORT,
+        sizeof(image_support),
+        &image_support,
+        0
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    if(!image_support)
+    {
+        throw Error("Device does not support images");
+    }
+
+    size_t max_image_size[2] = { 0, 0 };
+    err = clGetDeviceInfo(
+        oclobjects.device,
+        CL_DEVICE_IMAGE2D_MAX_WIDTH,
+        sizeof(max_image_size[0]),
+        &max_image_size[0],
+        0
+    );
+    SAMPLE_CHECK_ERRORS(err);
+    err = clGetDeviceInfo(
+        oclobjects.device,
+        CL_DEVICE_IMAGE2D_MAX_HEIGHT,
+        sizeof(max_image_size[1]),
+        &max_image_size[1],
+        0
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    size_t rowAlignment = requiredOpenCLAlignment(oclobjects.device);
+    cmdparser.validateParameters(oclobjects, buffer_executable, sizeof(T), rowAlignment);
+
+    size_t local_size = cmdparser.local_size.getValue();
+    size_t blocking = cmdparser.kernelBlocking();
+
+    vector<size_t> sizes = sizesToRun(cmdparser);
+
+    // Best perf of each kernel for every size; zero for skipped sizes
+    vector<double> buffer_perf(sizes.size(), 0);
+    vector<double> image_perf(sizes.size(), 0);
+
+    for(size_t s = 0; s < sizes.size(); ++s)
+    {
+        size_t size = sizes[s];
+        size_t stride = paddedRowStride(cmdparser, oclobjects, size, sizeof(T), rowAlignment);
+
+        // gemm_tn kernels walk rows by up to 16 elements
+        if(
+            size == 0 ||
+            size % 16 != 0 ||
+            size % (blocking*local_size) != 0 ||
+            size/4 > max_image_size[0] ||
+            size > max_image_size[1]
+        )
+        {
+            cout
+                << "Size " << size << " is skipped: it should be a multiple of 16 and of "
+                << blocking*local_size << ", and fit into "
+                << max_image_size[0] << "x" << max_image_size[1] << " texels\n";
+            continue;
+        }
+
+        cout << "Running gemm_tn and gemm_tn_image kernels with matrix size: " << size << "x" << size << "\n";
+
+        size_t matrix_memory_size = size*stride*sizeof(T);
+        size_t alignmentForPtr = zeroCopyPtrAlignment(oclobjects.device);
+        size_t alignedSize = zeroCopySizeAlignment(matrix_memory_size, oclobjects.device);
+
+        OpenCLDeviceAndHostMemory<T> matrix_A;
+        matrix_A.host = (T*)aligned_malloc(alignedSize, alignmentForPtr);
+
+        OpenCLDeviceAndHostMemory<T> matrix_B;
+        matrix_B.host = (T*)aligned_malloc(alignedSize, alignmentForPtr);
+
+        OpenCLDeviceAndHostMemory<T> matrix_C;
+        matrix_C.host = (T*)aligned_malloc(alignedSize, alignmentForPtr);
+
+        OpenCLDeviceAndHostMemory<T> image_C;
+        image_C.host = (T*)aligned_malloc(alignedSize, alignmentForPtr);
+
+        // The same inputs for all iterations, images copy them once.
+        fill_rand_uniform_01(matrix_A.host, size*stride);
+        fill_rand_uniform_01(matrix_B.host, size*stride);
+
+        matrix_A.device = clCreateBuffer(
+            oclobjects.context,
+            CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+            matrix_memory_size,
+            matrix_A.host,
+            &err
+        );
+        SAMPLE_CHECK_ERRORS(err);
+
+        matrix_B.device = clCreateBuffer(
+            oclobjects.context,
+            CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+            matrix_memory_size,
+            matrix_B.host,
+            &err
+        );
+        SAMPLE_CHECK_ERRORS(err);
+
+        matrix_C.device = clCreateBuffer(
+            oclobjects.context,
+            CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,
+            matrix_memory_size,
+            matrix_C.host,
+            &err
+        );
+        SAMPLE_CHECK_ERRORS(err);
+
+        image_C.device = clCreateBuffer(
+            oclobjects.context,
+            CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,
+            matrix_memory_size,
+            image_C.host,
+            &err
+        );
+        SAMPLE_CHECK_ERRORS(err);
+
+        TexelImage image_A(oclobjects.context, (const float*)matrix_A.host, size, stride);
+        TexelImage image_B(oclobjects.context, (const float*)matrix_B.host, size, stride);
+
+        cl_int ld = static_cast<cl_int>(stride);
+        cl_int cl_size = static_cast<cl_int>(size);
+
+        cl_kernel kernel = buffer_executable.kernel;
+        setGEMMTNArgs(
+            kernel,
+            matrix_A.device, stride,
+            matrix_B.device, stride,
+            matrix_C.device, stride,
+            size
+        );
+
+        kernel = image_executable.kernel;
+        err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &image_A.image);
+        SAMPLE_CHECK_ERRORS(err);
+        err = clSetKernelArg(kernel, 1, sizeof(cl_mem), &image_B.image);
+        SAMPLE_CHECK_ERRORS(err);
+        err = clSetKernelArg(kernel, 2, sizeof(cl_mem), &image_C.device);
+        SAMPLE_CHECK_ERRORS(err);
+        err = clSetKernelArg(kernel, 3, sizeof(cl_int), &ld);
+        SAMPLE_CHECK_ERRORS(err);
+        err = clSetKernelArg(kernel, 4, sizeof(cl_int), &cl_size);
+        SAMPLE_CHECK_ERRORS(err);
+
+        size_t global[2] = { size/blocking, size/blocking };
+        size_t local[2] = { local_size, local_size };
+
+        // Device time of one launch of a given kernel
+        auto run = [&](cl_kernel kernel) -> double
+        {
+            cl_event event = 0;
+            err = clEnqueueNDRangeKernel(oclobjects.queue, kernel, 2, 0, global, local, 0, 0, &event);
+            SAMPLE_CHECK_ERRORS(err);
+            err = clFinish(oclobjects.queue);
+            SAMPLE_CHECK_ERRORS(err);
+
+            double time = eventExecutionTime(event);
+            err = clReleaseEvent(event);
+            SAMPLE_CHECK_ERRORS(err);
+            return time;
+        };
+
+        double flops = double(size)*size*(size + size);
+
+        for(int i = 0; i < cmdparser.iterations.getValue(); ++i)
+        {
+            double buffer_time = run(buffer_executable.kernel);
+            double image_time = run(image_executable.kernel);
+
+            cout << "Buffer kernel device perf: " << flops/buffer_time/1e9 << " GFLOPS\n";
+            cout << "Image kernel device perf: " << flops/image_time/1e9 << " GFLOPS\n";
+            cout.flush();
+
+            buffer_perf[s] = max(buffer_perf[s], flops/buffer_time/1e9);
+            image_perf[s] = max(image_perf[s], flops/image_time/1e9);
+
+            if(i == 0 && cmdparser.validation.getValue())
+            {
+                OpenCLDeviceAndHostMemory<T>* results[2] = { &matrix_C, &image_C };
+
+                for(int r = 0; r < 2; ++r)
+                {
+                    clEnqueueMapBuffer(
+                        oclobjects.queue,
+                        results[r]->device,
+                        CL_TRUE,
+                        CL_MAP_READ,
+                        0,
+                        matrix_memory_size,
+                        0, 0, 0,
+                        &err
+                    );
+                    SAMPLE_CHECK_ERRORS(err);
+
+                    if(
+                        !checkValidity(
+                            matrix_A.host,
+                            matrix_B.host,
+                            results[r]->host,
+                            size,
+                            stride,
+                            true,
+                            false
+                        )
+                    )
+                    {
+                        throw Error(
+                            string("Validation procedure reported failures for ") +
+                            (r == 0 ? "buffer" : "image") + " kernel"
+                        );
+                    }
+
+                    err = clEnqueueUnmapMemObject(oclobjects.queue, results[r]->device, results[r]->host, 0, 0, 0);
+                    SAMPLE_CHECK_ERRORS(err);
+                }
+
+                err = clFinish(oclobjects.queue);
+                SAMPLE_CHECK_ERRORS(err);
+                cout.flush();
+            }
+        }
+    }
+
+    cout << "Best device perf, GFLOPS (size: buffer / image, image to buffer ratio):\n";
+    for(size_t s = 0; s < sizes.size(); ++s)
+    {
+        if(buffer_perf[s] > 0)
+        {
+            cout
+                << "    " << sizes[s] << ": " << buffer_perf[s] << " / " << image_perf[s]
+                << ", " << image_perf[s]/buffer_perf[s] << "x\n";
+        }
+    }
+}
+
+
+// Runs --requests independent multiplications as a service would do:
+// every request takes its own A, B and C, cycling over sizes from --sizes.
+// The requests are run twice: with a pool of capacity 0, which creates and
+// releases blocks for every request, and with a pool of --pool-capacity.
+template <typename T>
+void gemmPool (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable
+)
+{
+    size_t rowAlignment = requiredOpenCLAlignment(oclobjects.device);
+    cmdparser.validateParameters(oclobjects, executable, sizeof(T), rowAlignment);
+
+    size_t local_size = cmdparser.local_size.getValue();
+    size_t blocking = cmdparser.kernelBlocking();
+    size_t num_requests = cmdparser.requests.getValue();
+
+    vector<size_t> sizes = sizesToRun(cmdparser);
+    for(size_t s = 0; s < sizes.size(); ++s)
+    {
+        // gemm_tn kernels walk rows by up to 16 elements
+        if(sizes[s] == 0 || sizes[s] % 16 != 0 || sizes[s] % (blocking*local_size) != 0)
+        {
+            throw CmdParser::Error(
+                "Size " + to_str(sizes[s]) + " in " + cmdparser.sizes.name() +
+                " should be a multiple of 16 and of " + to_str(blocking*local_size) + "."
+            );
+        }
+    }
+
+    if(num_requests == 0)
+    {
+        throw CmdParser::Error(cmdparser.requests.name() + " should be positive.");
+    }
+
+    bool Atransposed = cmdparser.kernel_tn.isSet() or cmdparser.kernel_tt.isSet();
+    bool Btransposed = cmdparser.kernel_nt.isSet() or cmdparser.kernel_tt.isSet();
+
+    size_t capacities[2] = { 0, cmdparser.pool_capacity.getValue()*1024*1024 };
+
+    for(int p = 0; p < 2; ++p)
+    {
+        BufferPool<T> pool(oclobjects, capacities[p]);
+
+        cout
+            << "Running " << num_requests << " requests with pool capacity "
+            << capacities[p] << " bytes" << (p == 0 ? " (no reuse)" : "") << "\n";
+
+        double total_time = 0;
+        double acquire_time = 0;
+        double kernel_time = 0;
+        double flops = 0;
+
+        for(size_t r = 0; r < num_requests; ++r)
+        {
+            size_t size = sizes[r % sizes.size()];
+            size_t stride = paddedRowStride(cmdparser, oclobjects, size, sizeof(T), rowAlignment);
+            size_t matrix_memory_size = size*stride*sizeof(T);
+
+            double request_start = time_stamp();
+
+            {
+                PooledMemory<T> A(pool, size*stride);
+                PooledMemory<T> B(pool, size*stride);
+                PooledMemory<T> C(pool, size*stride);
+
+                acquire_time += time_stamp() - request_start;
+
+                cl_int err = 0;
+                OpenCLDeviceAndHostMemory<T>* inputs[2] = { A.memory, B.memory };
+
+                for(int m = 0; m < 2; ++m)
+                {
+                    clEnqueueMapBuffer(
+                        oclobjects.queue,
+                        inputs[m]->device,
+                        CL_TRUE,
+                        CL_MAP_WRITE,
+                        0,
+                        matrix_memory_size,
+                        0, 0, 0,
+                        &err
+                    );
+                    SAMPLE_CHECK_ERRORS(err);
+
+                    fill_rand_uniform_01(inputs[m]->host, size*stride);
+
+                    err = clEnqueueUnmapMemObject(oclobjects.queue, inputs[m]->device, inputs[m]->host, 0, 0, 0);
+                    SAMPLE_CHECK_ERRORS(err);
+                }
+
+                setGEMMTNArgs(
+                    executable.kernel,
+                    A.memory->device, stride,
+                    B.memory->device, stride,
+                    C.memory->device, stride,
+                    size
+                );
+
+                size_t request_global_size[2] = { size/blocking, size/blocking };
+                size_t request_local_size[2] = { local_size, local_size };
+
+                double kernel_start = time_stamp();
+
+                err = clEnqueueNDRangeKernel(
+                    oclobjects.queue,
+                    executable.kernel,
+                    2,
+                    0,
+                    request_global_size,
+                    request_local_size,
+                    0, 0, 0
+                );
+                SAMPLE_CHECK_ERRORS(err);
+
+                err = clFinish(oclobjects.queue);
+                SAMPLE_CHECK_ERRORS(err);
+
+                kernel_time += time_stamp() - kernel_start;
+                flops += double(size)*size*(size + size);
+
+                // The first request of every size is validated.
+                if(r < sizes.size() && cmdparser.validation.getValue())
+                {
+                    OpenCLDeviceAndHostMemory<T>* matrices[3] = { A.memory, B.memory, C.memory };
+
+                    for(int m = 0; m < 3; ++m)
+                    {
+                        clEnqueueMapBuffer(
+                            oclobjects.queue,
+                            matrices[m]->device,
+                            CL_TRUE,
+                            CL_MAP_READ,
+                            0,
+                            matrix_memory_size,
+                            0, 0, 0,
+                            &err
+                        );
+                        SAMPLE_CHECK_ERRORS(err);
+                    }
+
+                    if(
+                        !checkValidity(
+                            A.memory->host,
+                            B.memory->host,
+                            C.memory->host,
+                            size,
+                            stride,
+                            Atransposed,
+                            Btransposed
+                        )
+                    )
+                    {
+                        throw Error("Validation procedure reported failures");
+                    }
+
+                    for(int m = 0; m < 3; ++m)
+                    {
+                        err = clEnqueueUnmapMemObject(oclobjects.queue, matrices[m]->device, matrices[m]->host, 0, 0, 0);
+                        SAMPLE_CHECK_ERRORS(err);
+                    }
+
+                    err = clFinish(oclobjects.queue);
+                    SAMPLE_CHECK_ERRORS(err);
+                }
+            }
+
+            total_time += time_stamp() - request_start;
+        }
+
+        BufferPoolStatistics stats = pool.statistics();
+
+        cout
+            << "Average request time: " << total_time/num_requests << " sec., "
+            << "acquire: " << acquire_time/num_requests << " sec., "
+            << "kernel: " << kernel_time/num_requests << " sec.\n"
+            << "Kernel perf: " << flops/kernel_time/1e9 << " GFLOPS\n"
+            << "Pool hits: " << stats.hits << ", misses: " << stats.misses
+            << ", trimmed blocks: " << stats.trimmed
+            << ", trims under memory pressure: " << stats.pressure_trims
+            << ", idle bytes: " << stats.idle_bytes << "\n";
+        cout.flush();
+    }
+}
+
+
+// Evaluates two expressions of the lazy expression API with --size
+// matrices: C = alpha*A*B + beta*C and D = relu(A*B + bias). Each of them
+// is one launch of a kernel from gemm-fused.cl: blocked gemm_fused_tn if
+// --size is divisible by its blocking, gemm_fused otherwise.
+template <typename T>
+void gemmFused (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    OpenCLProgramMultipleKernels& program
+)
+{
+    size_t size = cmdparser.size.getValue();
+    size_t local_size = cmdparser.local_size.getValue();
+
+    if(size == 0 || local_size == 0)
+    {
+        throw CmdParser::Error(
+            cmdparser.size.name() + " and " + cmdparser.local_size.name() +
+            " should be positive."
+        );
+    }
+
+    size_t rowAlignment = requiredOpenCLAlignment(oclobjects.device);
+    size_t stride = paddedRowStride(cmdparser, oclobjects, size, sizeof(T), rowAlignment);
+
+    cout
+        << "Running fused expressions with matrix size: " << size << "x" << size
+        << ", memory row stride: " << stride*sizeof(T) << " bytes\n";
+
+    // B is stored transposed as for gemm_tn kernels.
+    Matrix<T> A(oclobjects, size, size, stride);
+    Matrix<T> B(oclobjects, size, size, stride, COLUMN_MAJOR);
+    Matrix<T> C(oclobjects, size, size, stride);
+    Matrix<T> D(oclobjects, size, size, stride);
+    Matrix<T> bias(oclobjects, 1, size, stride);
+
+    FusedGEMM<T> engine(oclobjects, program, local_size);
+
+    const T alpha = T(0.5);
+    const T beta = T(2);
+
+    // Elements of A*B are about size/4, so about a half of results
+    // with bias from [-size/2, 0] is cut by relu.
+    fill_rand_uniform_01(A.host(ACCESS_WRITE), size*stride);
+    fill_rand_uniform_01(B.host(ACCESS_WRITE), size*stride);
+
+    T* host_bias = bias.host(ACCESS_WRITE);
+    fill_rand_uniform_01(host_bias, size);
+    for(size_t j = 0; j < size; ++j)
+    {
+        host_bias[j] *= -T(size)/2;
+    }
+
+    std::vector<T> initial_C(size*stride);
+    fill_rand_uniform_01(&initial_C[0], size*stride);
+
+    // Both expressions do the same multiplication
+    double flops = 2*double(size)*size*(size + size);
+
+    for(int i = 0; i < cmdparser.iterations.getValue(); ++i)
+    {
+        std::copy(initial_C.begin(), initial_C.end(), C.host(ACCESS_WRITE));
+
+        size_t launches = engine.launches();
+        size_t blocked_launches = engine.blockedLaunches();
+        double start = time_stamp();
+
+        engine.assign(C, alpha*A*B + beta*C);
+        engine.assign(D, relu(A*B + bias));
+
+        cl_int err = clFinish(oclobjects.queue);
+        SAMPLE_CHECK_ERRORS(err);
+        double time = time_stamp() - start;
+
+        cout << "Host time: " << time << " sec.\n";
+        cout << "Host perf: " << flops/time/1e9 << " GFLOPS\n";
+        cout
+            << "Kernel launches for 2 expressions: " << engine.launches() - launches
+            << ", blocked: " << engine.blockedLaunches() - blocked_launches << "\n";
+        cout.flush();
+
+        if(i == 0 && cmdparser.validation.getValue())
+        {
+            const T* host_A = A.host(ACCESS_READ);
+            const T* host_B = B.host(ACCESS_READ);
+            const T* host_C = C.host(ACCESS_READ);
+            const T* host_D = D.host(ACCESS_READ);
+            host_bias = bias.host(ACCESS_READ);
+
+            T max_error = 0;
+
+            for(size_t r = 0; r < size; ++r)
+            {
+                for(size_t c = 0; c < size; ++c)
+                {
+                    T product = 0;
+                    for(size_t l = 0; l < size; ++l)
+                    {
+                        product += host_A[A.index(r, l)] * host_B[B.index(l, c)];
+                    }
+
+                    T expected_C = alpha*product + beta*initial_C[C.index(r, c)];
+                    T expected_D = max(product + host_bias[c], T(0));
+
+                    // Errors are relative to the magnitude of the terms:
+                    // the sum with bias can cancel out to nearly zero.
+                    T scale_C = max(abs(alpha*product) + abs(beta*initial_C[C.index(r, c)]), T(1));
+                    T scale_D = max(abs(product) + abs(host_bias[c]), T(1));
+
+                    max_error = max(max_error, T(abs(host_C[C.index(r, c)] - expected_C)/scale_C));
+                    max_error = max(max_error, T(abs(host_D[D.index(r, c)] - expected_D)/scale_D));
+                }
+            }
+
+            cout << "Max relative error: " << max_error << ", tolerance: " << validationTolerance<T>() << "\n";
+
+            if(max_error > validationTolerance<T>())
+            {
+                throw Error("Validation procedure reported failures");
+            }
+        }
+    }
+}
+
+
+// Runs a chain of --layers multiplications X[l + 1] = X[l]*W[l] with the
+// kernel from gemm.cl, as an inference loop does every step. The chain is
+// issued in two ways: by setting all kernel arguments and enqueuing each
+// launch every iteration, and by replaying a CommandGraph recorded once.
+// Host time spent to submit the chain is compared.
+template <typename T>
+void gemmReplay (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable
+)
+{
+    size_t rowAlignment = requiredOpenCLAlignment(oclobjects.device);
+    cmdparser.validateParameters(oclobjects, executable, sizeof(T), rowAlignment);
+
+    size_t size = cmdparser.size.getValue();
+    size_t layers = cmdparser.layers.getValue();
+    int iterations = cmdparser.iterations.getValue();
+
+    if(layers == 0)
+    {
+        throw CmdParser::Error(cmdparser.layers.name() + " should be positive.");
+    }
+
+    size_t stride = paddedRowStride(cmdparser, oclobjects, size, sizeof(T), rowAlignment);
+
+    cout
+        << "Running chain of " << layers << " gemm_" << cmdparser.kernel.getValue()
+        << " multiplications with matrix size: " << size << "x" << size
+        << ", memory row stride: " << stride*sizeof(T) << " bytes\n";
+
+    // Activations are ping-ponged between two matrices after the input,
+    // so every iteration computes the same result from the same input.
+    vector<Matrix<T>> activations;
+    vector<Matrix<T>> weights;
+
+    for(int m = 0; m < 3; ++m)
+    {
+        activations.push_back(Matrix<T>(oclobjects, size, size, stride));
+    }
+
+    for(size_t l = 0; l < layers; ++l)
+    {
+        weights.push_back(Matrix<T>(oclobjects, size, size, stride));
+
+        // Elements of the product stay about 1 along the chain.
+        T* host_W = weights[l].host(ACCESS_WRITE);
+        fill_rand_uniform_01(host_W, size*stride);
+        for(size_t i = 0; i < size*stride; ++i)
+        {
+            host_W[i] *= T(2)/size;
+        }
+    }
+
+    fill_rand_uniform_01(activations[0].host(ACCESS_WRITE), size*stride);
+
+    // Buffers are bound once, the kernel does not change their placement.
+    vector<cl_mem> layer_input(layers);
+    vector<cl_mem> layer_weights(layers);
+    vector<cl_mem> layer_output(layers);
+
+    for(size_t l = 0; l < layers; ++l)
+    {
+        layer_input[l] = activations[l == 0 ? 0 : 1 + (l - 1) % 2].device(ACCESS_READ_WRITE);
+        layer_weights[l] = weights[l].device(ACCESS_READ);
+        layer_output[l] = activations[1 + l % 2].device(ACCESS_READ_WRITE);
+    }
+
+    Matrix<T>& output = activations[1 + (layers - 1) % 2];
+
+    cl_int cl_size = static_cast<cl_int>(size);
+    cl_int ld = static_cast<cl_int>(stride);
+
+    size_t global_size[2] = {
+        cmdparser.global_size.getValue(),
+        cmdparser.global_size.getValue()
+    };
+
+    size_t local_size[2] = {
+        cmdparser.local_size.getValue(),
+        cmdparser.local_size.getValue()
+    };
+
+    CommandGraph graph(oclobjects.queue);
+
+    for(size_t l = 0; l < layers; ++l)
+    {
+        vector<size_t> dependencies;
+        if(l > 0)
+        {
+            dependencies.push_back(l - 1);
+        }
+
+        size_t command = graph.record(executable.kernel, 2, global_size, local_size, dependencies);
+        graph.setArg(command, 0, layer_input[l]);
+        graph.setArg(command, 1, ld);
+        graph.setArg(command, 2, layer_weights[l]);
+        graph.setArg(command, 3, ld);
+        graph.setArg(command, 4, layer_output[l]);
+        graph.setArg(command, 5, ld);
+        graph.setArg(command, 6, cl_size);
+    }
+
+    cout
+        << "Device reports cl_khr_command_buffer: "
+        << (graph.hasCommandBufferExtension() ? "yes" : "no")
+        << ", replaying pre-baked enqueue list of " << graph.size() << " launches\n";
+
+    double flops = double(layers)*size*size*(size + size);
+    vector<T> direct_result;
+
+    for(int replay = 0; replay < 2; ++replay)
+    {
+        double submit_time = 0;
+        double total_time = 0;
+
+        for(int i = 0; i < iterations; ++i)
+        {
+            double start = time_stamp();
+
+            if(replay)
+            {
+                graph.replay();
+            }
+            else
+            {
+                for(size_t l = 0; l < layers; ++l)
+                {
+                    setGEMMTNArgs(
+                        executable.kernel,
+                        layer_input[l], stride,
+                        layer_weights[l], stride,
+                        layer_output[l], stride,
+                        size
+                    );
+
+                    cl_int err = clEnqueueNDRangeKernel(
+                        oclobjects.queue,
+                        executable.kernel,
+                        2,
+                        0,
+                        global_size,
+                        local_size,
+                        0, 0, 0
+                    );
+                    SAMPLE_CHECK_ERRORS(err);
+                }
+            }
+
+            submit_time += time_stamp() - start;
+
+            cl_int err = clFinish(oclobjects.queue);
+            SAMPLE_CHECK_ERRORS(err);
+
+            total_time += time_stamp() - start;
+        }
+
+        cout
+            << (replay ? "Replay of recorded sequence" : "Direct enqueue") << ":\n"
+            << "    Average submission time: " << submit_time/iterations << " sec., "
+            << submit_time/iterations/layers*1e6 << " usec. per launch\n"
+            << "    Average chain time: " << total_time/iterations << " sec.\n"
+            << "    Host perf: " << flops*iterations/total_time/1e9 << " GFLOPS\n";
+        cout.flush();
+
+        // Both ways run the same launches on the same data,
+        // so results should be identical.
+        if(cmdparser.validation.getValue())
+        {
+            const T* host_output = output.host(ACCESS_READ);
+
+            if(!replay)
+            {
+                direct_result.assign(host_output, host_output + size*stride);
+            }
+            else
+            {
+                for(size_t i = 0; i < size; ++i)
+                {
+                    for(size_t j = 0; j < size; ++j)
+                    {
+                        if(host_output[i*stride + j] != direct_result[i*stride + j])
+                        {
+                            throw Error(
+                                "Result of the replayed sequence differs from the direct one at (" +
+                                to_str(i) + ", " + to_str(j) + ")"
+                            );
+                        }
+                    }
+                }
+
+                cout << "Results of direct enqueue and replay are identical\n";
+            }
+
+            output.device(ACCESS_READ_WRITE);
+        }
+    }
+}
+
+
+// Runs --requests independent requests C = (A*B)*B through the asynchronous
+// API: upload of A, two chained multiplications and download of C. In the
+// pipelined run the host waits only before it reuses buffers of a request
+// two steps back, so it generates the next input and consumes the previous
+// result while the device works. The blocking run waits after every step
+// as the other modes do with clFinish.
+template <typename T>
+void gemmAsync (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable
+)
+{
+    size_t rowAlignment = requiredOpenCLAlignment(oclobjects.device);
+    cmdparser.validateParameters(oclobjects, executable, sizeof(T), rowAlignment);
+
+    size_t size = cmdparser.size.getValue();
+    size_t blocking = size/cmdparser.global_size.getValue();
+    size_t num_requests = cmdparser.requests.getValue();
+
+    if(num_requests == 0)
+    {
+        throw CmdParser::Error(cmdparser.requests.name() + " should be positive.");
+    }
+
+    size_t stride = paddedRowStride(cmdparser, oclobjects, size, sizeof(T), rowAlignment);
+    size_t count = size*stride;
+
+    cout
+        << "Running " << num_requests << " asynchronous requests of two chained gemm_"
+        << cmdparser.kernel.getValue() << " multiplications with matrix size: "
+        << size << "x" << size << ", memory row stride: " << stride*sizeof(T) << " bytes\n";
+
+    bool Atransposed = cmdparser.kernel_tn.isSet() or cmdparser.kernel_tt.isSet();
+    bool Btransposed = cmdparser.kernel_nt.isSet() or cmdparser.kernel_tt.isSet();
+
+    AsyncGEMM<T> gemm(oclobjects, executable, blocking, cmdparser.local_size.getValue());
+
+    // Device buffers are not accessed by the host directly: the data goes
+    // through explicit transfers that are chained with the multiplications.
+    const int slots = 2;
+    OpenCLDeviceAndHostMemory<T> B;
+    OpenCLDeviceAndHostMemory<T> A[slots], product[slots], C[slots];
+    OpenCLDeviceAndHostMemory<T>* buffers[] = { &B, &A[0], &A[1], &product[0], &product[1], &C[0], &C[1] };
+
+    for(size_t b = 0; b < sizeof(buffers)/sizeof(buffers[0]); ++b)
+    {
+        cl_int err = 0;
+        buffers[b]->device = clCreateBuffer(oclobjects.context, CL_MEM_READ_WRITE, count*sizeof(T), 0, &err);
+        SAMPLE_CHECK_ERRORS(err);
+    }
+
+    // Elements of B are small enough for the chain to keep the results about 1.
+    vector<T> host_B(count);
+    fill_rand_uniform_01(&host_B[0], count);
+    for(size_t i = 0; i < count; ++i)
+    {
+        host_B[i] *= T(2)/size;
+    }
+
+    gemm.write(B.device, &host_B[0], count).wait();
+
+    vector<T> host_A[slots], host_C[slots];
+    for(int s = 0; s < slots; ++s)
+    {
+        host_A[s].resize(count);
+        host_C[s].resize(count);
+    }
+
+    double flops = 2*double(size)*size*(size + size);
+
+    for(int pipelined = 0; pipelined < 2; ++pipelined)
+    {
+        GEMMFuture downloads[slots];
+        double checksum = 0;
+        size_t consumed = 0;
+
+        // Host work on a finished request: checksum of C,
+        // and validation of the first request.
+        auto consume = [&] (int s)
+        {
+            for(size_t i = 0; i < size; ++i)
+            {
+                for(size_t j = 0; j < size; ++j)
+                {
+                    checksum += host_C[s][i*stride + j];
+                }
+            }
+
+            if(consumed++ == 0 && cmdparser.validation.getValue())
+            {
+                vector<T> reference_product(count), reference(count);
+                computeReference(&host_A[s][0], &host_B[0], &reference_product[0], size, stride, Atransposed, Btransposed);
+                computeReference(&reference_product[0], &host_B[0], &reference[0], size, stride, Atransposed, Btransposed);
+
+                T error = maxRelativeError(&host_C[s][0], &reference[0], size, stride);
+                cout << "Max relative error of the first request: " << error << "\n";
+
+                if(error > validationTolerance<T>())
+                {
+                    // The other request still writes to host memory.
+                    clFinish(oclobjects.queue);
+                    throw Error("Validation procedure reported failures");
+                }
+            }
+        };
+
+        double start = time_stamp();
+
+        for(size_t r = 0; r < num_requests; ++r)
+        {
+            int s = int(r % slots);
+
+            // Buffers of the slot are free when the request that used
+            // them is downloaded.
+            downloads[s].wait();
+            if(r >= size_t(slots))
+            {
+                consume(s);
+            }
+
+            fill_rand_uniform_01(&host_A[s][0], count);
+
+            GEMMFuture upload = gemm.write(A[s].device, &host_A[s][0], count);
+            if(!pipelined)
+            {
+                upload.wait();
+            }
+
+            GEMMFuture first = gemm.multiply(product[s].device, A[s].device, B.device, size, stride, dependencies(upload));
+            if(!pipelined)
+            {
+                first.wait();
+            }
+
+            GEMMFuture second = gemm.multiply(C[s].device, product[s].device, B.device, size, stride, dependencies(first));
+            if(!pipelined)
+            {
+                second.wait();
+            }
+
+            downloads[s] = gemm.read(&host_C[s][0], C[s].device, count, dependencies(second));
+            if(!pipelined)
+            {
+                downloads[s].wait();
+            }
+        }
+
+        for(size_t r = num_requests < size_t(slots) ? 0 : num_requests - slots; r < num_requests; ++r)
+        {
+            int s = int(r % slots);
+            downloads[s].wait();
+            consume(s);
+        }
+
+        double time = time_stamp() - start;
+
+        cout
+            << (pipelined ? "Pipelined" : "Blocking") << " requests:\n"
+            << "    Average request time: " << time/num_requests << " sec.\n"
+            << "    Host perf: " << flops*num_requests/time/1e9 << " GFLOPS\n"
+            << "    Checksum: " << checksum << "\n";
+        cout.flush();
+    }
+}
+
+
+#ifdef __cpp_impl_coroutine
+
+// Buffers of one request stream of coroutine mode
+template <typename T>
+struct CoroutineStream
+{
+    OpenCLDeviceAndHostMemory<T> A;
+    OpenCLDeviceAndHostMemory<T> C;
+    vector<T> host_A;
+    vector<T> host_C;
+    double checksum;
+};
+
+
+// Host work on a finished request of coroutine mode: checksum of C,
+// and validation of the first request of the first stream.
+template <typename T>
+void consumeCoroutineRequest (
+    CoroutineStream<T>& stream,
+    const vector<T>& host_B,
+    size_t size,
+    size_t stride,
+    bool validate,
+    bool Atransposed,
+    bool Btransposed
+)
+{
+    for(size_t i = 0; i < size; ++i)
+    {
+        for(size_t j = 0; j < size; ++j)
+        {
+            stream.checksum += stream.host_C[i*stride + j];
+        }
+    }
+
+    if(validate)
+    {
+        vector<T> reference(size*stride);
+        computeReference(&stream.host_A[0], &host_B[0], &reference[0], size, stride, Atransposed, Btransposed);
+
+        T error = maxRelativeError(&stream.host_C[0], &reference[0], size, stride);
+        cout << "Max relative error of the first request: " << error << "\n";
+
+        if(error > validationTolerance<T>())
+        {
+            throw Error("Validation procedure reported failures");
+        }
+    }
+}
+
+
+// One request stream of coroutine mode: every request generates A on the
+// host, uploads it, multiplies and downloads C, and suspends till C is
+// on the host. With await set to false the stream waits in place
+// instead, which is the blocking baseline.
+template <typename T>
+GEMMExecutor::Task gemmCoroutineStream (
+    GEMMExecutor& executor,
+    AsyncGEMM<T>& gemm,
+    CoroutineStream<T>& stream,
+    cl_mem B,
+    const vector<T>& host_B,
+    size_t size,
+    size_t stride,
+    size_t requests,
+    bool validate,
+    bool Atransposed,
+    bool Btransposed
+)
+{
+    size_t count = size*stride;
+
+    for(size_t r = 0; r < requests; ++r)
+    {
+        fill_rand_uniform_01(&stream.host_A[0], count);
+
+        GEMMFuture upload = gemm.write(stream.A.device, &stream.host_A[0], count);
+        GEMMFuture product = gemm.multiply(stream.C.device, stream.A.device, B, size, stride, dependencies(upload));
+
+        co_await executor.completion(gemm.read(&stream.host_C[0], stream.C.device, count, dependencies(product)));
+
+        consumeCoroutineRequest(stream, host_B, size, stride, validate && r == 0, Atransposed, Btransposed);
+    }
+}
+
+#endif  // __cpp_impl_coroutine
+
+
+// Runs --tenants request streams of --requests requests each from one host
+// thread: first one stream after another with a blocking wait for every
+// request, then all of them as coroutines of GEMMExecutor that suspend on
+// completion callbacks, so host work of one stream overlaps with
+// multiplications of the others.
+template <typename T>
+void gemmCoroutines (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable
+)
+{
+#ifdef __cpp_impl_coroutine
+    size_t rowAlignment = requiredOpenCLAlignment(oclobjects.device);
+    cmdparser.validateParameters(oclobjects, executable, sizeof(T), rowAlignment);
+
+    size_t size = cmdparser.size.getValue();
+    size_t blocking = size/cmdparser.global_size.getValue();
+    size_t num_streams = cmdparser.tenants.getValue();
+    size_t num_requests = cmdparser.requests.getValue();
+
+    if(num_streams == 0 || num_requests == 0)
+    {
+        throw CmdParser::Error(
+            cmdparser.tenants.name() + " and " + cmdparser.requests.name() + " should be positive."
+        );
+    }
+
+    size_t stride = paddedRowStride(cmdparser, oclobjects, size, sizeof(T), rowAlignment);
+    size_t count = size*stride;
+
+    cout
+        << "Running " << num_streams << " streams of " << num_requests << " gemm_"
+        << cmdparser.kernel.getValue() << " requests with matrix size: " << size << "x" << size
+        << " from one host thread\n";
+
+    bool Atransposed = cmdparser.kernel_tn.isSet() or cmdparser.kernel_tt.isSet();
+    bool Btransposed = cmdparser.kernel_nt.isSet() or cmdparser.kernel_tt.isSet();
+
+    AsyncGEMM<T> gemm(oclobjects, executable, blocking, cmdparser.local_size.getValue());
+
+    OpenCLDeviceAndHostMemory<T> B;
+    vector<CoroutineStream<T>> streams(num_streams);
+
+    cl_int err = 0;
+    B.device = clCreateBuffer(oclobjects.context, CL_MEM_READ_ONLY, count*sizeof(T), 0, &err);
+    SAMPLE_CHECK_ERRORS(err);
+
+    for(size_t s = 0; s < num_streams; ++s)
+    {
+        streams[s].A.device = clCreateBuffer(oclobjects.context, CL_MEM_READ_ONLY, count*sizeof(T), 0, &err);
+        SAMPLE_CHECK_ERRORS(err);
+        streams[s].C.device = clCreateBuffer(oclobjects.context, CL_MEM_WRITE_ONLY, count*sizeof(T), 0, &err);
+        SAMPLE_CHECK_ERRORS(err);
+        streams[s].host_A.resize(count);
+        streams[s].host_C.resize(count);
+    }
+
+    vector<T> host_B(count);
+    fill_rand_uniform_01(&host_B[0], count);
+    gemm.write(B.device, &host_B[0], count).wait();
+
+    double flops = double(num_streams)*num_requests*size*size*(size + size);
+    bool validate = cmdparser.validation.getValue();
+
+    for(int coroutines = 0; coroutines < 2; ++coroutines)
+    {
+        for(size_t s = 0; s < num_streams; ++s)
+        {
+            streams[s].checksum = 0;
+        }
+
+        size_t suspensions = 0;
+        double start = time_stamp();
+
+        if(coroutines)
+        {
+            GEMMExecutor executor;
+
+            for(size_t s = 0; s < num_streams; ++s)
+            {
+                executor.spawn(
+                    gemmCoroutineStream(
+                        executor, gemm, streams[s], B.device, host_B,
+                        size, stride, num_requests,
+                        validate && s == 0, Atransposed, Btransposed
+                    )
+                );
+            }
+
+            executor.run();
+            suspensions = executor.suspensions();
+        }
+        else
+        {
+            for(size_t s = 0; s < num_streams; ++s)
+            {
+                for(size_t r = 0; r < num_requests; ++r)
+                {
+                    CoroutineStream<T>& stream = streams[s];
+                    fill_rand_uniform_01(&stream.host_A[0], count);
+
+                    GEMMFuture upload = gemm.write(stream.A.device, &stream.host_A[0], count);
+                    GEMMFuture product = gemm.multiply(stream.C.device, stream.A.device, B.device, size, stride, dependencies(upload));
+                    gemm.read(&stream.host_C[0], stream.C.device, count, dependencies(product)).wait();
+
+                    consumeCoroutineRequest(stream, host_B, size, stride, validate && s == 0 && r == 0, Atransposed, Btransposed);
+                }
+            }
+        }
+
+        double time = time_stamp() - start;
+
+        double checksum = 0;
+        for(size_t s = 0; s < num_streams; ++s)
+        {
+            checksum += streams[s].checksum;
+        }
+
+        cout << (coroutines ? "Coroutine streams" : "Blocking streams") << ":\n";
+        if(coroutines)
+        {
+            cout << "    Suspensions on completion callbacks: " << suspensions << "\n";
+        }
+        cout
+            << "    Average request time: " << time/(num_streams*num_requests) << " sec.\n"
+            << "    Host perf: " << flops/time/1e9 << " GFLOPS\n"
+            << "    Checksum: " << checksum << "\n";
+        cout.flush();
+    }
+#else
+    throw CmdParser::Error(
+        "Coroutine mode needs C++20 coroutines: configure with -DUSE_cpp20=ON "
+        "or build with make CPP20=1."
+    );
+#endif
+}
+
+
+// Runs the GEMM service daemon with gemm_tn_persistent kernel till
+// SIGINT or SIGTERM; requests of one shape received together are
+// executed by one launch of up to --batch multiplications.
+template <typename T>
+void gemmServe (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable,
+    ShapeTraceWriter* trace
+)
+{
+#ifdef __linux__
+    if(cmdparser.batch.getValue() == 0)
+    {
+        throw CmdParser::Error(cmdparser.batch.name() + " should be positive.");
+    }
+
+    GEMMService<T> service(
+        oclobjects,
+        executable,
+        cmdparser.socket.getValue(),
+        cmdparser.batch.getValue(),
+        cmdparser.persistent_groups.getValue(),
+        cmdparser.local_size.getValue()*cmdparser.local_size.getValue(),
+        cmdparser.pool_capacity.getValue()*1024*1024,
+        trace
+    );
+
+    cout
+        << "GEMM service listens on " << inquotes(cmdparser.socket.getValue())
+        << " with up to " << cmdparser.batch.getValue()
+        << " requests per launch; stop it with Ctrl+C\n";
+    cout.flush();
+
+    service.run();
+
+    const GEMMServiceStatistics& stats = service.statistics();
+
+    cout
+        << "\nClients: " << stats.clients << ", requests: " << stats.requests
+        << ", rejected: " << stats.rejected << ", failed: " << stats.failed
+        << ", launches: " << stats.launches
+        << ", requests per launch: " << (stats.launches ? double(stats.requests)/stats.launches : 0.0)
+        << "\n";
+#else
+    throw CmdParser::Error("GEMM service is supported on Linux only.");
+#endif
+}
+
+
+// Load generator for the GEMM service: --tenants clients, each from its
+// own host thread and with its own connection, run --requests
+// multiplications of sizes from --sizes one after another.
+template <typename T>
+void gemmServiceLoad (CmdParserGEMM& cmdparser)
+{
+#ifdef __linux__
+    size_t num_clients = cmdparser.tenants.getValue();
+    size_t num_requests = cmdparser.requests.getValue();
+    vector<size_t> sizes = sizesToRun(cmdparser);
+    bool validate = cmdparser.validation.getValue();
+
+    if(num_clients == 0 || num_requests == 0)
+    {
+        throw CmdParser::Error(
+            cmdparser.tenants.name() + " and " + cmdparser.requests.name() + " should be positive."
+        );
+    }
+
+    size_t max_size = *max_element(sizes.begin(), sizes.end());
+    if(max_size == 0)
+    {
+        throw CmdParser::Error("Matrix sizes should be positive.");
+    }
+
+    cout
+        << "Running " << num_clients << " clients of GEMM service at "
+        << inquotes(cmdparser.socket.getValue()) << " with "
+        << num_requests << " requests each\n";
+
+    vector<vector<double>> latencies(num_clients);
+    vector<size_t> batched(num_clients, 0);
+    vector<exception_ptr> errors(num_clients);
+    vector<thread> clients;
+
+    double start = time_stamp();
+
+    for(size_t c = 0; c < num_clients; ++c)
+    {
+        clients.push_back(thread([&, c] ()
+        {
+            try
+            {
+                // A, B and C of the largest size one after another
+                size_t matrix_bytes = max_size*max_size*sizeof(T);
+                GEMMServiceClient client(cmdparser.socket.getValue(), 3*matrix_bytes, sizeof(T));
+
+                T* A = (T*)client.segment();
+                T* B = (T*)(client.segment() + matrix_bytes);
+                T* C = (T*)(client.segment() + 2*matrix_bytes);
+
+                for(size_t r = 0; r < num_requests; ++r)
+                {
+                    size_t size = sizes[r % sizes.size()];
+
+                    fill_rand_uniform_01(A, size*size);
+                    fill_rand_uniform_01(B, size*size);
+
+                    ServiceRequest request;
+                    request.id = r + 1;
+                    request.m = request.n = request.k = uint32_t(size);
+                    request.reserved = 0;
+                    request.a_offset = 0;
+                    request.b_offset = matrix_bytes;
+                    request.c_offset = 2*matrix_bytes;
+
+                    double request_start = time_stamp();
+                    ServiceResponse response = client.call(request);
+                    latencies[c].push_back(time_stamp() - request_start);
+                    batched[c] += response.batch;
+
+                    // The service computes in the tn layout.
+                    if(validate && r < sizes.size())
+                    {
+                        vector<T> reference(size*size);
+                        computeReference(A, B, &reference[0], size, size, true, false);
+
+                        if(maxRelativeError(C, &reference[0], size, size) > validationTolerance<T>())
+                        {
+                            throw Error(
+                                "Validation procedure reported failures for size " +
+                                to_str(size) + " of client " + to_str(c)
+                            );
+                        }
+                    }
+                }
+            }
+            catch(...)
+            {
+                errors[c] = current_exception();
+            }
+        }));
+    }
+
+    for(size_t c = 0; c < num_clients; ++c)
+    {
+        clients[c].join();
+    }
+
+    double time = time_stamp() - start;
+
+    for(size_t c = 0; c < num_clients; ++c)
+    {
+        if(errors[c])
+        {
+            rethrow_exception(errors[c]);
+        }
+    }
+
+    vector<double> all_latencies;
+    size_t all_batched = 0;
+    double flops = 0;
+
+    for(size_t c = 0; c < num_clients; ++c)
+    {
+        all_latencies.insert(all_latencies.end(), latencies[c].begin(), latencies[c].end());
+        all_batched += batched[c];
+
+        for(size_t r = 0; r < num_requests; ++r)
+        {
+            double size = double(sizes[r % sizes.size()]);
+            flops += size*size*(size + size);
+        }
+    }
+
+    std::sort(all_latencies.begin(), all_latencies.end());
+
+    auto percentile = [&](double p) -> double
+    {
+        return all_latencies[min(all_latencies.size() - 1, size_t(p*all_latencies.size()))];
+    };
+
+    if(validate)
+    {
+        cout << "Validation of the first request of every size: PASSED\n";
+    }
+
+    cout
+        << "Latency of one request, sec. (p50 / p95 / p99 / max): "
+        << percentile(0.50) << " / " << percentile(0.95) << " / "
+        << percentile(0.99) << " / " << all_latencies.back() << "\n"
+        << "Average requests per launch seen by clients: "
+        << double(all_batched)/all_latencies.size() << "\n"
+        << "Aggregate perf: " << flops/time/1e9 << " GFLOPS\n";
+#else
+    throw CmdParser::Error("GEMM service is supported on Linux only.");
+#endif
+}
+
+
+// Square matrices in device buffers with host copies of the inputs,
+// for the modes that transfer data explicitly.
+template <typename T>
+struct DeviceGEMMOperands
+{
+    OpenCLDeviceAndHostMemory<T> A;
+    OpenCLDeviceAndHostMemory<T> B;
+    OpenCLDeviceAndHostMemory<T> C;
+    vector<T> host_A;
+    vector<T> host_B;
+    size_t size;
+    size_t stride;
+
+    DeviceGEMMOperands (OpenCLBasic& oclobjects, size_t size, size_t stride) :
+        host_A(size*stride),
+        host_B(size*stride),
+        size(size),
+        stride(stride)
+    {
+        fill_rand_uniform_01(&host_A[0], size*stride);
+        fill_rand_uniform_01(&host_B[0], size*stride);
+
+        OpenCLDeviceAndHostMemory<T>* buffers[3] = { &A, &B, &C };
+        const T* data[3] = { &host_A[0], &host_B[0], 0 };
+
+        for(int m = 0; m < 3; ++m)
+        {
+            cl_int err = 0;
+            buffers[m]->device = clCreateBuffer(
+                oclobjects.context,
+                CL_MEM_READ_WRITE | (data[m] ? CL_MEM_COPY_HOST_PTR : 0),
+                size*stride*sizeof(T),
+                const_cast<T*>(data[m]),
+                &err
+            );
+            SAMPLE_CHECK_ERRORS(err);
+        }
+    }
+
+    ScheduledGEMM gemm () const
+    {
+        ScheduledGEMM result = { A.device, B.device, C.device, size, stride };
+        return result;
+    }
+};
+
+
+// Runs one background multiplication of --size and --requests small
+// urgent ones of sizes from --sizes, which arrive evenly during the
+// background one. First all jobs are dispatched in the order of arrival
+// without chunking, then the background job is chunked by --chunk-ms and
+// the urgent ones have high priority. Latency of both kinds is compared.
+template <typename T>
+void gemmPriority (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable
+)
+{
+    size_t rowAlignment = requiredOpenCLAlignment(oclobjects.device);
+    cmdparser.validateParameters(oclobjects, executable, sizeof(T), rowAlignment);
+
+    size_t size = cmdparser.size.getValue();
+    size_t blocking = size/cmdparser.global_size.getValue();
+    size_t local_size = cmdparser.local_size.getValue();
+    size_t num_requests = cmdparser.requests.getValue();
+    double chunk_budget = cmdparser.chunk_ms.getValue()/1000.0;
+
+    if(cmdparser.sizes.getValue().empty() || num_requests == 0)
+    {
+        throw CmdParser::Error(
+            "Priority mode needs sizes of urgent multiplications in " +
+            cmdparser.sizes.name() + " and positive " + cmdparser.requests.name() + "."
+        );
+    }
+
+    if(chunk_budget <= 0)
+    {
+        throw CmdParser::Error(cmdparser.chunk_ms.name() + " should be positive.");
+    }
+
+    vector<size_t> sizes = sizesToRun(cmdparser);
+    for(size_t s = 0; s < sizes.size(); ++s)
+    {
+        if(sizes[s] == 0 || sizes[s] % (blocking*local_size) != 0)
+        {
+            throw CmdParser::Error(
+                "Size " + to_str(sizes[s]) + " in " + cmdparser.sizes.name() +
+                " should be a multiple of " + to_str(blocking*local_size) + "."
+            );
+        }
+    }
+
+    DeviceGEMMOperands<T> background(
+        oclobjects,
+        size,
+        paddedRowStride(cmdparser, oclobjects, size, sizeof(T), rowAlignment)
+    );
+
+    vector<unique_ptr<DeviceGEMMOperands<T>>> urgent;
+    for(size_t s = 0; s < sizes.size(); ++s)
+    {
+        urgent.push_back(
+            unique_ptr<DeviceGEMMOperands<T>>(
+                new DeviceGEMMOperands<T>(
+                    oclobjects,
+                    sizes[s],
+                    paddedRowStride(cmdparser, oclobjects, sizes[s], sizeof(T), rowAlignment)
+                )
+            )
+        );
+    }
+
+    // The background job alone gives the interval of arrivals,
+    // and warms up the kernel.
+    double background_alone = 0;
+    {
+        PriorityGEMMScheduler scheduler(oclobjects, executable, blocking, local_size, 0);
+        size_t job = scheduler.submit(background.gemm(), PRIORITY_BACKGROUND);
+        scheduler.wait();
+        background_alone = scheduler.latency(job);
+    }
+
+    double interval = background_alone/(num_requests + 1);
+
+    cout
+        << "Background multiplication of size " << size << " alone: " << background_alone << " sec.; "
+        << num_requests << " urgent ones arrive every " << interval << " sec.\n";
+
+    bool Atransposed = cmdparser.kernel_tn.isSet() or cmdparser.kernel_tt.isSet();
+    bool Btransposed = cmdparser.kernel_nt.isSet() or cmdparser.kernel_tt.isSet();
+
+    for(int prioritized = 0; prioritized < 2; ++prioritized)
+    {
+        PriorityGEMMScheduler scheduler(
+            oclobjects,
+            executable,
+            blocking,
+            local_size,
+            prioritized ? chunk_budget : 0
+        );
+
+        double start = time_stamp();
+        size_t background_job = scheduler.submit(
+            background.gemm(),
+            prioritized ? PRIORITY_BACKGROUND : PRIORITY_NORMAL
+        );
+
+        vector<size_t> urgent_jobs;
+
+        while(urgent_jobs.size() < num_requests || !scheduler.idle())
+        {
+            if(
+                urgent_jobs.size() < num_requests &&
+                time_stamp() - start >= interval*(urgent_jobs.size() + 1)
+            )
+            {
+                urgent_jobs.push_back(
+                    scheduler.submit(
+                        urgent[urgent_jobs.size() % urgent.size()]->gemm(),
+                        prioritized ? PRIORITY_HIGH : PRIORITY_NORMAL
+                    )
+                );
+            }
+
+            scheduler.dispatch();
+        }
+
+        vector<double> latencies;
+        for(size_t j = 0; j < urgent_jobs.size(); ++j)
+        {
+            latencies.push_back(scheduler.latency(urgent_jobs[j]));
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+
+        auto percentile = [&](double p) -> double
+        {
+            return latencies[min(latencies.size() - 1, size_t(p*latencies.size()))];
+        };
+
+        cout
+            << (prioritized ? "Priority classes with chunks of " + to_str(cmdparser.chunk_ms.getValue()) + " ms" : string("Order of arrival without chunking")) << ":\n"
+            << "    Urgent latency, sec. (p50 / p99 / max): "
+            << percentile(0.50) << " / " << percentile(0.99) << " / " << latencies.back() << "\n"
+            << "    Background latency: " << scheduler.latency(background_job) << " sec.\n"
+            << "    Launches: " << scheduler.launches() << "\n";
+        cout.flush();
+
+        if(cmdparser.validation.getValue())
+        {
+            vector<T> host_C(size*background.stride);
+
+            cl_int err = clEnqueueReadBuffer(
+                oclobjects.queue,
+                background.C.device,
+                CL_TRUE,
+                0,
+                host_C.size()*sizeof(T),
+                &host_C[0],
+                0, 0, 0
+            );
+            SAMPLE_CHECK_ERRORS(err);
+
+            if(
+                !checkValidity(
+                    &background.host_A[0],
+                    &background.host_B[0],
+                    &host_C[0],
+                    size,
+                    background.stride,
+                    Atransposed,
+                    Btransposed
+                )
+            )
+            {
+                throw Error("Validation procedure reported failures");
+            }
+        }
+    }
+}
+
+
+// Submits --requests multiplications of --size from each of 1, 2, 4, ...
+// producer threads up to --threads through a queue drained by
+// GEMMDispatcher, once for MutexSubmissionQueue and once for MPSCRing.
+// Producers reuse a few slots of matrices in shared buffers.
+template <typename T, typename Queue>
+void runSubmissionProducers (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable,
+    const string& queue_name,
+    size_t num_producers,
+    DeviceGEMMOperands<T>& arena,
+    size_t slots
+)
+{
+    size_t size = cmdparser.size.getValue();
+    size_t num_requests = cmdparser.requests.getValue();
+    size_t batch = cmdparser.batch.getValue();
+    size_t matrix_elements = size*size;
+
+    // Room for a few batches: producers are not stopped
+    // by the ring while the dispatcher waits for a launch.
+    Queue queue(8*batch);
+
+    GEMMDispatcher<Queue> dispatcher(
+        oclobjects,
+        executable,
+        queue,
+        arena.A.device,
+        arena.B.device,
+        arena.C.device,
+        batch,
+        cmdparser.persistent_groups.getValue(),
+        cmdparser.local_size.getValue()*cmdparser.local_size.getValue()
+    );
+
+    vector<atomic<size_t>> completed(num_producers);
+    vector<double> submit_times(num_producers, 0);
+    vector<size_t> full_waits(num_producers, 0);
+    vector<exception_ptr> errors(num_producers);
+    vector<thread> producers;
+    atomic<bool> go(false);
+
+    for(size_t p = 0; p < num_producers; ++p)
+    {
+        completed[p] = 0;
+    }
+
+    for(size_t p = 0; p < num_producers; ++p)
+    {
+        producers.push_back(thread([&, p] ()
+        {
+            try
+            {
+                GEMMSubmission submission;
+                submission.completed = &completed[p];
+                submission.task.m = submission.task.n = submission.task.k = static_cast<cl_int>(size);
+                submission.task.lda = submission.task.ldb = submission.task.ldc = static_cast<cl_int>(size);
+                submission.task.reserved = 0;
+
+                while(!go)
+                {
+                    this_thread::yield();
+                }
+
+                double start = time_stamp();
+
+                for(size_t r = 0; r < num_requests; ++r)
+                {
+                    cl_int offset = static_cast<cl_int>((p*slots + r % slots)*matrix_elements);
+                    submission.task.a_offset = submission.task.b_offset = submission.task.c_offset = offset;
+
+                    while(!queue.tryPush(submission))
+                    {
+                        if(dispatcher.failed())
+                        {
+                            throw Error("GEMM dispatcher stopped with an error");
+                        }
+
+                        ++full_waits[p];
+                        this_thread::yield();
+                    }
+                }
+
+                submit_times[p] = time_stamp() - start;
+
+                while(completed[p].load(memory_order_acquire) < num_requests)
+                {
+                    if(dispatcher.failed())
+                    {
+                        throw Error("GEMM dispatcher stopped with an error");
+                    }
+
+                    this_thread::yield();
+                }
+            }
+            catch(...)
+            {
+                errors[p] = current_exception();
+            }
+        }));
+    }
+
+    double start = time_stamp();
+    go = true;
+
+    for(size_t p = 0; p < num_producers; ++p)
+    {
+        producers[p].join();
+    }
+
+    double time = time_stamp() - start;
+    dispatcher.stop();
+
+    for(size_t p = 0; p < num_producers; ++p)
+    {
+        if(errors[p])
+        {
+            rethrow_exception(errors[p]);
+        }
+    }
+
+    double submit_time = *max_element(submit_times.begin(), submit_times.end());
+    size_t total_full_waits = 0;
+    for(size_t p = 0; p < num_producers; ++p)
+    {
+        total_full_waits += full_waits[p];
+    }
+
+    size_t total = num_producers*num_requests;
+
+    cout
+        << "    " << queue_name << ", " << num_producers << " producers: "
+        << total/submit_time << " submissions/sec., "
+        << total/time << " multiplications/sec., "
+        << double(dispatcher.dispatched())/max<size_t>(dispatcher.launches(), 1) << " per launch, "
+        << total_full_waits << " waits for a full queue\n";
+    cout.flush();
+}
+
+
+template <typename T>
+void gemmSubmissionRing (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable
+)
+{
+    cmdparser.requireKernelTN("Ring");
+
+    cmdparser.validateBatchParameters(oclobjects, sizeof(T));
+
+    size_t size = cmdparser.size.getValue();
+    size_t max_producers = cmdparser.threads.getValue();
+    if(max_producers == 0)
+    {
+        max_producers = max<size_t>(1, thread::hardware_concurrency());
+    }
+
+    if(cmdparser.requests.getValue() == 0)
+    {
+        throw CmdParser::Error(cmdparser.requests.name() + " should be positive.");
+    }
+
+    // Every producer cycles over its own matrices, packed one after another.
+    const size_t slots = 4;
+    size_t matrices = max_producers*slots;
+
+    if(double(matrices)*size*size > double(numeric_limits<int>::max()))
+    {
+        throw CmdParser::Error(
+            "Too many producers for matrix size " + to_str(size) +
+            "; offsets of matrices cannot be represented as type int."
+        );
+    }
+
+    // Rows of the arena are packed matrices of the producers.
+    DeviceGEMMOperands<T> arena(oclobjects, matrices*size, size);
+
+    cout
+        << "Submitting " << cmdparser.requests.getValue() << " multiplications of size "
+        << size << " from every producer thread, up to "
+        << cmdparser.batch.getValue() << " per launch\n";
+
+    for(size_t producers = 1; ; producers = min(2*producers, max_producers))
+    {
+        runSubmissionProducers<T, MutexSubmissionQueue<GEMMSubmission> >(
+            cmdparser, oclobjects, executable, "mutex queue", producers, arena, slots
+        );
+
+        runSubmissionProducers<T, MPSCRing<GEMMSubmission> >(
+            cmdparser, oclobjects, executable, "lock-free ring", producers, arena, slots
+        );
+
+        if(producers == max_producers)
+        {
+            break;
+        }
+    }
+
+    // Every slot computes the same product every time.
+    if(cmdparser.validation.getValue())
+    {
+        vector<T> host_C(size*size);
+
+        cl_int err = clEnqueueReadBuffer(
+            oclobjects.queue,
+            arena.C.device,
+            CL_TRUE,
+            0,
+            host_C.size()*sizeof(T),
+            &host_C[0],
+            0, 0, 0
+        );
+        SAMPLE_CHECK_ERRORS(err);
+
+        if(!checkValidity(&arena.host_A[0], &arena.host_B[0], &host_C[0], size, size, true, false))
+        {
+            throw Error("Validation procedure reported failures");
+        }
+    }
+}
+
+
+// Re-executes the multiplications of the shape trace from --trace with
+// gemm_<kernel> of every program from --programs. The kernels take M and N
+// from the NDRange, K as an argument and honour the leading dimensions, so
+// every record runs in its own shape: M and N are padded up to a multiple
+// of blocking by work-group size and of vector width each program declares
+// (--size/--global-size for blocking if it declares none) and K up to
+// a multiple of vector width; performance counts useful operations only.
+// Records of the other type of elements are skipped.
+template <typename T>
+void gemmTrace (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    const string& build_options
+)
+{
+    if(cmdparser.trace.getValue().empty())
+    {
+        throw CmdParser::Error(cmdparser.trace.name() + " should be set in trace mode.");
+    }
+
+    vector<ShapeTraceRecord> all_records = readShapeTrace(cmdparser.trace.getValue());
+
+    vector<ShapeTraceRecord> records;
+    for(size_t r = 0; r < all_records.size(); ++r)
+    {
+        if(all_records[r].element_size == sizeof(T))
+        {
+            records.push_back(all_records[r]);
+        }
+    }
+
+    cout
+        << "Shape trace " << inquotes(cmdparser.trace.getValue()) << ": "
+        << all_records.size() << " records, " << all_records.size() - records.size()
+        << " of them skipped for the other type of elements\n";
+
+    if(records.empty())
+    {
+        return;
+    }
+
+    size_t local_size = cmdparser.local_size.getValue();
+
+    if(local_size == 0)
+    {
+        throw CmdParser::Error(cmdparser.local_size.name() + " should be positive.");
+    }
+
+    vector<string> programs;
+    const string& programs_list = cmdparser.programs.getValue();
+    for(size_t pos = 0, next = 0; next != string::npos; pos = next + 1)
+    {
+        next = programs_list.find(',', pos);
+        programs.push_back(programs_list.substr(pos, next == string::npos ? string::npos : next - pos));
+    }
+
+    // Shapes are padded for each program differently: M and N to
+    // granule[p], a multiple of both blocking by work-group size and
+    // vector width of program p, K to its vector width. The leading
+    // dimension of all matrices is a multiple of every vector width.
+    vector<unique_ptr<OpenCLProgramOneKernel>> executables;
+    vector<size_t> blocking(programs.size());
+    vector<size_t> vector_width(programs.size());
+    vector<size_t> granule(programs.size());
+    size_t stride_granule = 1;
+
+    for(size_t p = 0; p < programs.size(); ++p)
+    {
+        executables.push_back(
+            unique_ptr<OpenCLProgramOneKernel>(
+                new OpenCLProgramOneKernel(
+                    oclobjects,
+                    wstring(programs[p].begin(), programs[p].end()),
+                    "",
+                    "gemm_" + cmdparser.kernel.getValue(),
+                    build_options
+                )
+            )
+        );
+
+        GEMMKernelMetadata metadata = gemmKernelMetadata(
+            executables[p]->program,
+            executables[p]->kernel,
+            oclobjects.device
+        );
+
+        blocking[p] = metadata.blocking ? metadata.blocking : cmdparser.kernelBlocking();
+        vector_width[p] = max<size_t>(metadata.vector_width, 1);
+
+        granule[p] = blocking[p]*local_size;
+        while(granule[p] % vector_width[p] != 0)
+        {
+            granule[p] += blocking[p]*local_size;
+        }
+
+        size_t multiple = stride_granule;
+        while(stride_granule % vector_width[p] != 0)
+        {
+            stride_granule += multiple;
+        }
+    }
+
+    // Distinct shapes in the order of their first appearance
+    typedef map<vector<size_t>, size_t> ShapeIndex;
+    ShapeIndex shape_index;
+    vector<vector<size_t> > shapes;
+    vector<size_t> record_shape(records.size());
+    vector<size_t> shape_count;
+    vector<double> recorded_time;
+    size_t layouts[4] = { 0 };
+    size_t stride = 0;
+
+    for(size_t r = 0; r < records.size(); ++r)
+    {
+        const ShapeTraceRecord& record = records[r];
+
+        vector<size_t> shape(3);
+        shape[0] = record.m;
+        shape[1] = record.n;
+        shape[2] = record.k;
+
+        ShapeIndex::iterator found = shape_index.find(shape);
+        if(found == shape_index.end())
+        {
+            found = shape_index.insert(make_pair(shape, shapes.size())).first;
+            shapes.push_back(shape);
+            shape_count.push_back(0);
+            recorded_time.push_back(0);
+        }
+
+        record_shape[r] = found->second;
+        shape_count[found->second] += record.batch;
+        recorded_time[found->second] += record.device_time > 0 ? record.device_time : record.host_time;
+        layouts[record.layout] += record.batch;
+
+        for(size_t p = 0; p < programs.size(); ++p)
+        {
+            stride = max(stride, round_up_aligned(max(record.m, record.n), granule[p]));
+            stride = max(stride, round_up_aligned(record.k, vector_width[p]));
+        }
+    }
+
+    stride = round_up_aligned(stride, stride_granule);
+
+    cout << "Distinct shapes: " << shapes.size() << ", layouts:";
+    for(int l = 0; l < 4; ++l)
+    {
+        cout << " " << gemmLayoutName(GEMMLayout(l)) << " " << layouts[l];
+    }
+    cout << "; all of them are replayed with gemm_" << cmdparser.kernel.getValue() << "\n";
+
+    if(stride > size_t(numeric_limits<int>::max()/stride))
+    {
+        throw Error("Shape " + to_str(stride) + " of the trace is too big for the kernels");
+    }
+
+    // All problems are placed at the beginning of the same matrices
+    // with the same leading dimensions.
+    DeviceGEMMOperands<T> operands(oclobjects, stride, stride);
+
+    bool Atransposed = cmdparser.kernel_tn.isSet() or cmdparser.kernel_tt.isSet();
+    bool Btransposed = cmdparser.kernel_nt.isSet() or cmdparser.kernel_tt.isSet();
+
+    double recorded_total = 0;
+    double useful_flops = 0;
+    for(size_t s = 0; s < shapes.size(); ++s)
+    {
+        recorded_total += recorded_time[s];
+        useful_flops += 2.0*shapes[s][0]*shapes[s][1]*shapes[s][2]*shape_count[s];
+    }
+
+    cout << "Recorded time: " << recorded_total << " sec., " << useful_flops/recorded_total/1e9 << " GFLOPS\n";
+
+    for(size_t p = 0; p < programs.size(); ++p)
+    {
+        cl_kernel kernel = executables[p]->kernel;
+        cl_int err = 0;
+
+        vector<double> replayed_time(shapes.size(), 0);
+        vector<cl_event> events;
+        double start = time_stamp();
+
+        // Records are replayed in their order; multiplications of one
+        // record are enqueued together as they were computed together.
+        for(size_t r = 0; r < records.size(); ++r)
+        {
+            size_t m = round_up_aligned(records[r].m, granule[p]);
+            size_t n = round_up_aligned(records[r].n, granule[p]);
+            size_t k = round_up_aligned(records[r].k, vector_width[p]);
+
+            setGEMMTNArgs(
+                kernel,
+                operands.A.device, stride,
+                operands.B.device, stride,
+                operands.C.device, stride,
+                k
+            );
+
+            size_t global[2] = { m/blocking[p], n/blocking[p] };
+            size_t local[2] = { local_size, local_size };
+
+            for(size_t b = 0; b < records[r].batch; ++b)
+            {
+                cl_event event = 0;
+                err = clEnqueueNDRangeKernel(oclobjects.queue, kernel, 2, 0, global, local, 0, 0, &event);
+                SAMPLE_CHECK_ERRORS(err);
+                events.push_back(event);
+            }
+
+            err = clFinish(oclobjects.queue);
+            SAMPLE_CHECK_ERRORS(err);
+
+            for(size_t e = 0; e < events.size(); ++e)
+            {
+                replayed_time[record_shape[r]] += eventExecutionTime(events[e]);
+                err = clReleaseEvent(events[e]);
+                SAMPLE_CHECK_ERRORS(err);
+            }
+
+            events.clear();
+
+            // Kernels overwrite C, so it holds the product of the
+            // first record after all of its launches. Only it is
+            // validated: the check on the host is slow.
+            if(r == 0 && cmdparser.validation.getValue())
+            {
+                vector<T> host_C(stride*stride);
+                err = clEnqueueReadBuffer(
+                    oclobjects.queue,
+                    operands.C.device,
+                    CL_TRUE,
+                    0,
+                    host_C.size()*sizeof(T),
+                    &host_C[0],
+                    0, 0, 0
+                );
+                SAMPLE_CHECK_ERRORS(err);
+
+                // The same strides as checkValidity uses,
+                // for m x n x k instead of a square
+                size_t listride = Atransposed ? 1 : stride;
+                size_t istride = Atransposed ? stride : 1;
+                size_t ljstride = Btransposed ? stride : 1;
+                size_t jstride = Btransposed ? 1 : stride;
+
+                T max_error = 0;
+                for(size_t i = 0; i < m; ++i)
+                {
+                    for(size_t j = 0; j < n; ++j)
+                    {
+                        T reference = 0;
+                        for(size_t l = 0; l < k; ++l)
+                        {
+                            reference +=
+                                operands.host_A[l*listride + i*istride] *
+                                operands.host_B[l*ljstride + j*jstride];
+                        }
+
+                        max_error = max(max_error, abs(host_C[i*stride + j] - reference)/reference);
+                    }
+                }
+
+                cout << "Maximum relative error of the first record: " << max_error << "\n";
+
+                if(max_error > validationTolerance<T>())
+                {
+                    throw Error("Validation procedure reported failures");
+                }
+            }
+        }
+
+        double host_time = time_stamp() - start;
+        double device_total = 0;
+
+        cout
+            << "\nProgram " << inquotes(programs[p]) << " (blocking " << blocking[p] << "x" << blocking[p]
+            << ", K by " << vector_width[p] << "):\n";
+
+        for(size_t s = 0; s < shapes.size(); ++s)
+        {
+            device_total += replayed_time[s];
+
+            cout
+                << "    " << shapes[s][0] << "x" << shapes[s][1] << "x" << shapes[s][2]
+                << " (" << shape_count[s] << " times): recorded " << recorded_time[s]/shape_count[s]
+                << " sec., replayed " << replayed_time[s]/shape_count[s] << " sec. per multiplication\n";
+        }
+
+        cout
+            << "    Total: device " << device_total << " sec. (" << useful_flops/device_total/1e9
+            << " GFLOPS), host " << host_time << " sec., recorded/replayed "
+            << recorded_total/device_total << "\n";
+        cout.flush();
+    }
+}
+
+// Multiplies matrices of every shape from --shapes with the launches that
+// GEMMKernelDispatcher plans for it, and reports them: the variant for the
+// bulk, the edges and NDRanges. Operands are packed: lda = ldb = k, ldc = n,
+// so any size runs.
+template <typename T>
+void gemmDispatch (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    const string& build_options
+)
+{
+    cmdparser.requireKernelTN("Dispatch");
+
+    vector<GEMMShape> shapes = shapesToRun(cmdparser);
+
+    GEMMKernelDispatcher dispatcher(
+        oclobjects,
+        defaultGEMMKernelVariants(),
+        build_options,
+        cmdparser.local_size.getValue()
+    );
+
+    cout << "Kernel variants in the order of preference:\n";
+    for(size_t v = 0; v < dispatcher.variants().size(); ++v)
+    {
+        const GEMMKernelVariant& variant = dispatcher.variants()[v];
+        cout
+            << "    " << variant.program << ": blocking " << variant.blocking
+            << "x" << variant.blocking << ", K by " << variant.vector_width << "\n";
+    }
+
+    for(size_t s = 0; s < shapes.size(); ++s)
+    {
+        size_t m = shapes[s].m;
+        size_t n = shapes[s].n;
+        size_t k = shapes[s].k;
+
+        cout << "\nShape " << m << "x" << n << "x" << k << ":\n";
+
+        vector<GEMMLaunch> launches = dispatcher.plan(m, n, k, LAYOUT_TN, k, k, n);
+
+        for(size_t l = 0; l < launches.size(); ++l)
+        {
+            const GEMMLaunch& launch = launches[l];
+
+            cout
+                << "    " << (launch.variant ? launch.variant->program : "gemm-edge.cl")
+                << ": rows " << launch.global_offset[0] << "-" << launch.rows_end
+                << ", columns " << launch.global_offset[1] << "-" << launch.columns_end
+                << ", K " << launch.k_begin << "-" << launch.k_end
+                << ", global " << launch.global_size[0] << "x" << launch.global_size[1]
+                << ", local " << launch.local_size[0] << "x" << launch.local_size[1] << "\n";
+        }
+
+        vector<T> host_A(m*k);
+        vector<T> host_B(n*k);
+        vector<T> host_C(m*n);
+        fill_rand_uniform_01(&host_A[0], host_A.size());
+        fill_rand_uniform_01(&host_B[0], host_B.size());
+
+        OpenCLDeviceAndHostMemory<T> A;
+        OpenCLDeviceAndHostMemory<T> B;
+        OpenCLDeviceAndHostMemory<T> C;
+        OpenCLDeviceAndHostMemory<T>* buffers[3] = { &A, &B, &C };
+        T* data[3] = { &host_A[0], &host_B[0], &host_C[0] };
+        size_t elements[3] = { host_A.size(), host_B.size(), host_C.size() };
+
+        for(int b = 0; b < 3; ++b)
+        {
+            cl_int err = 0;
+            buffers[b]->device = clCreateBuffer(
+                oclobjects.context,
+                CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                elements[b]*sizeof(T),
+                data[b],
+                &err
+            );
+            SAMPLE_CHECK_ERRORS(err);
+        }
+
+        double best_time = numeric_limits<double>::max();
+
+        double bulk_time = 0;
+
+        for(int i = 0; i < cmdparser.iterations.getValue(); ++i)
+        {
+            // All launches of the plan go in one submission.
+            vector<cl_event> events = dispatcher.enqueue(launches, A.device, k, B.device, k, C.device, n);
+
+            cl_int err = clWaitForEvents(cl_uint(events.size()), &events[0]);
+            SAMPLE_CHECK_ERRORS(err);
+
+            double time = 0;
+            for(size_t e = 0; e < events.size(); ++e)
+            {
+                time += eventExecutionTime(events[e]);
+            }
+
+            if(time < best_time)
+            {
+                // A shape smaller than a work-group of any variant
+                // has no bulk: everything is the edge kernel.
+                best_time = time;
+                bulk_time = launches[0].variant ? eventExecutionTime(events[0]) : 0;
+            }
+
+            for(size_t e = 0; e < events.size(); ++e)
+            {
+                err = clReleaseEvent(events[e]);
+                SAMPLE_CHECK_ERRORS(err);
+            }
+        }
+
+        if(cmdparser.iterations.getValue() > 0)
+        {
+            cout
+                << "    Device time: " << best_time << " sec., "
+                << 2.0*m*n*k/best_time/1e9 << " GFLOPS, edges "
+                << (best_time - bulk_time)/best_time*100 << "% of the time\n";
+        }
+
+        if(cmdparser.validation.getValue())
+        {
+            if(cmdparser.iterations.getValue() == 0)
+            {
+                vector<cl_event> events = dispatcher.enqueue(launches, A.device, k, B.device, k, C.device, n);
+                for(size_t e = 0; e < events.size(); ++e)
+                {
+                    cl_int err = clReleaseEvent(events[e]);
+                    SAMPLE_CHECK_ERRORS(err);
+                }
+            }
+
+            cl_int err = clEnqueueReadBuffer(
+                oclobjects.queue,
+                C.device,
+                CL_TRUE,
+                0,
+                host_C.size()*sizeof(T),
+                &host_C[0],
+                0, 0, 0
+            );
+            SAMPLE_CHECK_ERRORS(err);
+
+            // C = A*transposed(B), both with rows of k elements
+            T max_error = 0;
+            for(size_t i = 0; i < m; ++i)
+            {
+                for(size_t j = 0; j < n; ++j)
+                {
+                    T reference = 0;
+                    for(size_t l = 0; l < k; ++l)
+                    {
+                        reference += host_A[i*k + l]*host_B[j*k + l];
+                    }
+
+                    max_error = max(max_error, abs(host_C[i*n + j] - reference)/reference);
+                }
+            }
+
+            cout << "    Maximum relative error: " << max_error << "\n";
+
+            if(max_error > validationTolerance<T>())
+            {
+                throw Error("Validation procedure reported failures");
+            }
+        }
+
+        cout.flush();
+    }
+}
+
+// Reports for every kernel variant what limits the number of work-items
+// a core keeps active and flags variants that are expected to underperform,
+// without running them: see occupancy.hpp. Variants are the programs from
+// --programs with the kernel selected by --kernel if --programs is given,
+// otherwise the dispatch table. Work-groups are the ones the other modes
+// launch with: --local-size if it is given, otherwise derived for --size.
+// The register and thread limits are of the Mali Midgard model; on other
+// devices the output says so.
+template <typename T>
+void gemmOccupancy (
+    CmdParserGEMM& cmdparser,
+    OpenCLBasic& oclobjects,
+    const string& build_options
+)
+{
+    vector<GEMMKernelVariant> variants;
+
+    if(cmdparser.programs.isSet())
+    {
+        const string& programs_list = cmdparser.programs.getValue();
+        for(size_t pos = 0, next = 0; next != string::npos; pos = next + 1)
+        {
+            next = programs_list.find(',', pos);
+
+            GEMMKernelVariant variant = {
+                programs_list.substr(pos, next == string::npos ? string::npos : next - pos),
+                "gemm_" + cmdparser.kernel.getValue(),
+                LAYOUT_TN,
+                0,
+                0
+            };
+
+            variants.push_back(variant);
+        }
+    }
+    else
+    {
+        variants = defaultGEMMKernelVariants();
+    }
+
+    cl_ulong device_local_mem_size = 0;
+    cl_int err = clGetDeviceInfo(
+        oclobjects.device,
+        CL_DEVICE_LOCAL_MEM_SIZE,
+        sizeof(device_local_mem_size),
+        &device_local_mem_size,
+        0
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    size_t size = cmdparser.size.getValue();
+    vector<string> flagged;
+
+    if(!isMaliDevice(oclobjects.device))
+    {
+        cout
+            << "The device is not a Mali GPU: registers, active work-items and warnings "
+            << "below are of the Mali Midgard model, not of this device\n";
+    }
+
+    for(size_t v = 0; v < variants.size(); ++v)
+    {
+        const GEMMKernelVariant& variant = variants[v];
+
+        OpenCLProgramOneKernel executable(
+            oclobjects,
+            wstring(variant.program.begin(), variant.program.end()),
+            "",
+            variant.kernel,
+            build_options
+        );
+
+        GEMMKernelMetadata metadata = gemmKernelMetadata(
+            executable.program,
+            executable.kernel,
+            oclobjects.device
+        );
+
+        size_t blocking = max<size_t>(metadata.blocking, 1);
+        size_t edge =
+            cmdparser.local_size.isSet() ?
+            cmdparser.local_size.getValue() :
+            squareWorkGroupEdge(metadata, size/blocking, 0);
+        size_t local_size[2] = { edge, edge };
+
+        OccupancyEstimate estimate = estimateOccupancy(
+            metadata,
+            sizeof(T),
+            local_size[0]*local_size[1],
+            device_local_mem_size
+        );
+
+        cout
+            << "\nProgram " << inquotes(variant.program) << ", kernel " << variant.kernel << ":\n"
+            << "    Blocking " << metadata.blocking << "x" << metadata.blocking
+            << ", K by " << metadata.vector_width << ", estimated registers: ";
+
+        if(estimate.registers)
+        {
+            cout << estimate.registers << " (" << estimate.model_work_items << " work-items per core)\n";
+        }
+        else
+        {
+            cout << "unknown\n";
+        }
+
+        cout
+            << "    Private memory: " << metadata.private_mem_size << " bytes per work-item"
+            << ", local memory: " << metadata.local_mem_size << " of "
+            << device_local_mem_size << " bytes per work-group\n"
+            << "    Max work-group size: " << metadata.max_work_group_size
+            << ", preferred multiple: " << metadata.preferred_multiple
+            << ", work-group: " << local_size[0] << "x" << local_size[1] << "\n"
+            << "    Active work-items: " << estimate.active_work_items << " of "
+            << MALI_MAX_ACTIVE_WORK_ITEMS << ", occupancy " << estimate.occupancy*100 << "%"
+            << (estimate.spills ? ", spills registers" : "") << "\n";
+
+        for(size_t w = 0; w < estimate.warnings.size(); ++w)
+        {
+            cout << "    Warning: " << estimate.warnings[w] << "\n";
+        }
+
+        if(!estimate.warnings.empty())
+        {
+            flagged.push_back(variant.program);
+        }
+    }
+
+    cout << "\nVariants expected to underperform: ";
+    if(flagged.empty())
+    {
+        cout << "none\n";
+    }
+    else
+    {
+        for(size_t f = 0; f < flagged.size(); ++f)
+        {
+            cout << (f ? ", " : "") << flagged[f];
+        }
+        cout << "\n";
+    }
+}
+
+// Entry point for sample application, command-line parsing,
+// generic OpenCL resources allocation and deallocation.
+int main (int argc, const char** argv)
+{
+    try
+    {
+        // Define and parse command-line arguments.
+        CmdParserGEMM cmdparser(argc, argv);
+        cmdparser.parse();
+
+        // Immediatly exit if user wanted to see the usage information only.
+        if(cmdparser.help.isSet())
+        {
+            return 0;
+        }
+
+        HostAllocationPolicy allocation_policy;
+        allocation_policy.huge_pages = parseHugePages(cmdparser.huge_pages.getValue());
+        parseNUMAPlacement(cmdparser.numa.getValue(), allocation_policy.numa, allocation_policy.numa_nodes);
+        setHostAllocationPolicy(allocation_policy);
+
+        cout << "Host memory for matrices: " << hostAllocationPolicyToStr(allocation_policy) << "\n";
+
+        // Trace mode reads the trace, the others append their multiplications to it.
+        unique_ptr<ShapeTraceWriter> trace;
+        if(!cmdparser.trace.getValue().empty() && !cmdparser.mode_trace.isSet())
+        {
+            trace.reset(new ShapeTraceWriter(cmdparser.trace.getValue()));
+            cout << "Shapes of multiplications are traced to " << inquotes(cmdparser.trace.getValue()) << "\n";
+        }
+
+        // The native host engine does not need any OpenCL objects.
+        if(cmdparser.backend_cpu.isSet())
+        {
+            if(cmdparser.arithmetic_float.isSet())
+            {
+                gemmCPU<float>(cmdparser, trace.get());
+            }
+            else if(cmdparser.arithmetic_double.isSet())
+            {
+                gemmCPU<double>(cmdparser, trace.get());
+            }
+
+            return 0;
+        }
+
+        // Clients of the GEMM service do not need any OpenCL objects.
+        if(cmdparser.mode_load.isSet())
+        {
+            if(cmdparser.arithmetic_float.isSet())
+            {
+                gemmServiceLoad<float>(cmdparser);
+            }
+            else if(cmdparser.arithmetic_double.isSet())
+            {
+                gemmServiceLoad<double>(cmdparser);
+            }
+
+            return 0;
+        }
+
+        // Form build options string from given parameters: macros definitions to pass into kernels
+        string build_options =
+            "-DT=" + cmdparser.arithmetic.getValue() +
+            // " -cl-nv-maxrregcount=4" +
+            (cmdparser.arithmetic_double.isSet() ? " -DSAMPLE_NEEDS_DOUBLE" : "") +
+            " -DTILE_SIZE_M=" + to_str(cmdparser.tile_size_M.getValue()) +
+            " -DTILE_GROUP_M=" + to_str(cmdparser.tile_group_M.getValue()) +
+            " -DTILE_SIZE_N=" + to_str(cmdparser.tile_size_N.getValue()) +
+            " -DTILE_GROUP_N=" + to_str(cmdparser.tile_group_N.getValue()) +
+            " -DTILE_SIZE_K=" + to_str(cmdparser.tile_size_K.getValue());
+
+        cout << "Build program options: " << inquotes(build_options) << "\n";
+
+        // Tenants mode compares contexts with and without partitioning
+        // and creates them itself.
+        if(cmdparser.mode_tenants.isSet())
+        {
+            if(cmdparser.arithmetic_float.isSet())
+            {
+                gemmTenants<float>(cmdparser, build_options);
+            }
+            else if(cmdparser.arithmetic_double.isSet())
+            {
+                gemmTenants<double>(cmdparser, build_options);
+            }
+
+            return 0;
+        }
+
+        // Create the necessary OpenCL objects up to device queue.
+        OpenCLBasic oclobjects(
+            cmdparser.platform.getValue(),
+            cmdparser.device_type.getValue(),
+            cmdparser.device.getValue(),
+            CL_QUEUE_PROFILING_ENABLE,
+            0,
+            cmdparser.device_partition.getValue()
+        );
+
+        if(cmdparser.mode_dispatch.isSet())
+        {
+            // Variants accumulate in float vectors.
+            if(!cmdparser.arithmetic_float.isSet())
+            {
+                throw CmdParser::Error("Dispatch mode supports float arithmetic only.");
+            }
+
+            gemmDispatch<float>(cmdparser, oclobjects, build_options);
+
+            return 0;
+        }
+
+        if(cmdparser.mode_occupancy.isSet())
+        {
+            // Variants accumulate in float vectors.
+            if(!cmdparser.arithmetic_float.isSet())
+            {
+                throw CmdParser::Error("Occupancy mode supports float arithmetic only.");
+            }
+
+            gemmOccupancy<float>(cmdparser, oclobjects, build_options);
+
+            return 0;
+        }
+
+        if(cmdparser.mode_trace.isSet())
+        {
+            if(cmdparser.arithmetic_float.isSet())
+            {
+                gemmTrace<float>(cmdparser, oclobjects, build_options);
+            }
+            else if(cmdparser.arithmetic_double.isSet())
+            {
+                gemmTrace<double>(cmdparser, oclobjects, build_options);
+            }
+
+            return 0;
+        }
+
+        if(cmdparser.mode_persistent.isSet())
+        {
+            OpenCLProgramOneKernel executable(
+                oclobjects,
+                L"gemm-persistent.cl",
+                "",
+                "gemm_tn_persistent",
+                build_options
+            );
+
+            if(cmdparser.arithmetic_float.isSet())
+            {
+                gemmPersistent<float>(cmdparser, oclobjects, executable);
+            }
+            else if(cmdparser.arithmetic_double.isSet())
+            {
+                gemmPersistent<double>(cmdparser, oclobjects, executable);
+            }
+
+            return 0;
+        }
+
+        if(cmdparser.mode_serve.isSet())
+        {
+            OpenCLProgramOneKernel executable(
+                oclobjects,
+                L"gemm-persistent.cl",
+                "",
+                "gemm_tn_persistent",
+                build_options
+            );
+
+            if(cmdparser.arithmetic_float.isSet())
+            {
+                gemmServe<float>(cmdparser, oclobjects, executable, trace.get());
+            }
+            else if(cmdparser.arithmetic_double.isSet())
+            {
+                gemmServe<double>(cmdparser, oclobjects, executable, trace.get());
+            }
+
+            return 0;
+        }
+
+        if(cmdparser.mode_ring.isSet())
+        {
+            OpenCLProgramOneKernel executable(
+                oclobjects,
+                L"gemm-persistent.cl",
+                "",
+                "gemm_tn_persistent",
+                build_options
+            );
+
+            if(cmdparser.arithmetic_float.isSet())
+            {
+                gemmSubmissionRing<float>(cmdparser, oclobjects, executable);
+            }
+            else if(cmdparser.arithmetic_double.isSet())
+            {
+                gemmSubmissionRing<double>(cmdparser, oclobjects, executable);
+            }
+
+            return 0;
+        }
+
+        if(cmdparser.mode_fused.isSet())
+        {
+            OpenCLProgramMultipleKernels program(
+                oclobjects,
+                L"gemm-fused.cl",
+                "",
+                build_options
+            );
+
+            if(cmdparser.arithmetic_float.isSet())
+            {
+                gemmFused<float>(cmdparser, oclobjects, program);
+            }
+            else if(cmdparser.arithmetic_double.isSet())
+            {
+                gemmFused<double>(cmdparser, oclobjects, program);
+            }
+
+            return 0;
+        }
+
+        // Build kernel
+        OpenCLProgramOneKernel executable(
+            oclobjects,
+            L"gemm.cl",
+            "",
+            "gemm_" + cmdparser.kernel.getValue(),
+            build_options
+        );
+
+        cmdparser.deriveNDRange(oclobjects, executable);
+
+        cout
+            << "NDRange: global size " << cmdparser.global_size.getValue()
+            << ", local size " << cmdparser.local_size.getValue() << "\n";
+
+        if(cmdparser.mode_image.isSet())
+        {
+            OpenCLProgramOneKernel image_executable(
+                oclobjects,
+                L"gemm-image.cl",
+                "",
+                "gemm_tn_image",
+                build_options
+            );
+
+            // Image kernels read float texels only, the check is inside.
+            gemmImage<float>(cmdparser, oclobjects, executable, image_executable);
+
+            return 0;
+        }
+
+        if(cmdparser.mode_pool.isSet())
+        {
+            if(cmdparser.arithmetic_float.isSet())
+            {
+                gemmPool<float>(cmdparser, oclobjects, executable);
+            }
+            else if(cmdparser.arithmetic_double.isSet())
+            {
+                gemmPool<double>(cmdparser, oclobjects, executable);
+            }
+
+            return 0;
+        }
+
+        if(cmdparser.mode_replay.isSet())
+        {
+            if(cmdparser.arithmetic_float.isSet())
+            {
+                gemmReplay<float>(cmdparser, oclobjects, executable);
+            }
+            else if(cmdparser.arithmetic_double.isSet())
+            {
+                gemmReplay<double>(cmdparser, oclobjects, executable);
+            }
+
+            return 0;
+        }
+
+        if(cmdparser.mode_async.isSet())
+        {
+            if(cmdparser.arithmetic_float.isSet())
+            {
+                gemmAsync<float>(cmdparser, oclobjects, executable);
+            }
+            else if(cmdparser.arithmetic_double.isSet())
+            {
+                gemmAsync<double>(cmdparser, oclobjects, executable);
+            }
+
+            return 0;
+        }
+
+        if(cmdparser.mode_coroutine.isSet())
+        {
+            if(cmdparser.arithmetic_float.isSet())
+            {
+                gemmCoroutines<float>(cmdparser, oclobjects, executable);
+            }
+            else if(cmdparser.arithmetic_double.isSet())
+            {
+                gemmCoroutines<double>(cmdparser, oclobjects, executable);
+            }
+
+            return 0;
+        }
+
+        if(cmdparser.mode_priority.isSet())
+        {
+            if(cmdparser.arithmetic_float.isSet())
+            {
+                gemmPriority<float>(cmdparser, oclobjects, executable);
+            }
+            else if(cmdparser.arithmetic_double.isSet())
+            {
+                gemmPriority<double>(cmdparser, oclobjects, executable);
+            }
+
+            return 0;
+        }
+
+        if(cmdparser.mode_multi.isSet())
+        {
+            if(cmdparser.arithmetic_float.isSet())
+            {
+                gemmMulti<float>(cmdparser, oclobjects, executable);
+            }
+            else if(cmdparser.arithmetic_double.isSet())
+            {
+                gemmMulti<double>(cmdparser, oclobjects, executable);
+            }
+
+            return 0;
+        }
+
+        if(cmdparser.mode_hetero.isSet())
+        {
+            if(cmdparser.arithmetic_float.isSet())
+            {
+                gemmHetero<float>(cmdparser, oclobjects, executable);
+            }
+            else if(cmdparser.arithmetic_double.isSet())
+            {
+                gemmHetero<double>(cmdparser, oclobjects, executable);
+            }
+
+            return 0;
+        }
+
+        if(cmdparser.mode_strassen.isSet())
+        {
+            OpenCLProgramMultipleKernels matrix_ops(
+                oclobjects,
+                L"matrix-ops.cl",
+                "",
+                build_options
+            );
+
+            if(cmdparser.arithmetic_float.isSet())
+            {
+                gemmStrassen<float>(cmdparser, oclobjects, executable, matrix_ops);
+            }
+            else if(cmdparser.arithmetic_double.isSet())
+            {
+                gemmStrassen<double>(cmdparser, oclobjects, executable, matrix_ops);
+            }
+
+            return 0;
+        }
 
         // Call gemm with required type of elements
         if(cmdparser.arithmetic_float.isSet())
         {
-            gemm<float>(cmdparser, oclobjects, executable);
+            gemm<float>(cmdparser, oclobjects, executable, trace.get());
         }
         else if(cmdparser.arithmetic_double.isSet())
         {
-            gemm<double>(cmdparser, oclobjects, executable);
+            gemm<double>(cmdparser, oclobjects, executable, trace.get());
         }
 
         // All resource deallocations happen in destructors of helper objects.
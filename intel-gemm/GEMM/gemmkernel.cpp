@@ -0,0 +1,55 @@
+// Arguments of GEMM kernels, see gemmkernel.hpp.
+
+
+#include "basic.hpp"
+#include "gemmkernel.hpp"
+
+
+void setGEMMOperandArgs (
+    cl_kernel kernel,
+    cl_mem A,
+    size_t lda,
+    cl_mem B,
+    size_t ldb,
+    cl_mem C,
+    size_t ldc
+)
+{
+    cl_int ld[3] = {
+        static_cast<cl_int>(lda),
+        static_cast<cl_int>(ldb),
+        static_cast<cl_int>(ldc)
+    };
+
+    cl_int err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &A);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(kernel, 1, sizeof(cl_int), &ld[0]);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(kernel, 2, sizeof(cl_mem), &B);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(kernel, 3, sizeof(cl_int), &ld[1]);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(kernel, 4, sizeof(cl_mem), &C);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(kernel, 5, sizeof(cl_int), &ld[2]);
+    SAMPLE_CHECK_ERRORS(err);
+}
+
+
+void setGEMMTNArgs (
+    cl_kernel kernel,
+    cl_mem A,
+    size_t lda,
+    cl_mem B,
+    size_t ldb,
+    cl_mem C,
+    size_t ldc,
+    size_t k
+)
+{
+    setGEMMOperandArgs(kernel, A, lda, B, ldb, C, ldc);
+
+    cl_int cl_k = static_cast<cl_int>(k);
+    cl_int err = clSetKernelArg(kernel, 6, sizeof(cl_int), &cl_k);
+    SAMPLE_CHECK_ERRORS(err);
+}
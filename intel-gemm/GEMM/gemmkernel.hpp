@@ -0,0 +1,45 @@
+// Arguments of GEMM kernels.
+//
+// gemm_nn, gemm_nt, gemm_tn and gemm_tt from gemm.cl and its variants share
+// the signature
+//
+//     (A, lda, B, ldb, C, ldc, k)
+//
+// where leading dimensions are in elements and k is the length of the
+// dot-product direction; M and N are given by the global size times blocking.
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_KERNEL_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_KERNEL_HPP_
+
+#include <cstddef>
+
+#include <CL/cl.h>
+
+
+// Sets all seven arguments of a GEMM kernel.
+void setGEMMTNArgs (
+    cl_kernel kernel,
+    cl_mem A,
+    size_t lda,
+    cl_mem B,
+    size_t ldb,
+    cl_mem C,
+    size_t ldc,
+    size_t k
+);
+
+// Sets the operands and their leading dimensions only, arguments 0 to 5;
+// kernels with other arguments after them (gemm_tn_edge) set the rest.
+void setGEMMOperandArgs (
+    cl_kernel kernel,
+    cl_mem A,
+    size_t lda,
+    cl_mem B,
+    size_t ldb,
+    cl_mem C,
+    size_t ldc
+);
+
+
+#endif  // end of the include guard
@@ -0,0 +1,308 @@
+// Shape-based selection of GEMM kernels, see kerneldispatch.hpp.
+
+
+#include <algorithm>
+
+#include "basic.hpp"
+#include "gemmkernel.hpp"
+#include "kerneldispatch.hpp"
+#include "ndrange.hpp"
+
+using namespace std;
+
+
+vector<GEMMKernelVariant> defaultGEMMKernelVariants ()
+{
+    // program, kernel, layout; blocking and vector width are
+    // declared by the programs, see ndrange.hpp
+    static const GEMMKernelVariant variants[] = {
+        { "gemm-blocking-4x4-vload8.cl", "gemm_tn", LAYOUT_TN, 0, 0 },
+        { "gemm-blocking-4x4-vload4.cl", "gemm_tn", LAYOUT_TN, 0, 0 },
+        { "gemm-blocking-2x2-vload8.cl", "gemm_tn", LAYOUT_TN, 0, 0 },
+        { "gemm-blocking-2x2-vload4.cl", "gemm_tn", LAYOUT_TN, 0, 0 },
+        { "gemm-noblock-vload16.cl", "gemm_tn", LAYOUT_TN, 0, 0 },
+        { "gemm-noblock-vload8.cl", "gemm_tn", LAYOUT_TN, 0, 0 }
+    };
+
+    return vector<GEMMKernelVariant>(variants, variants + sizeof(variants)/sizeof(variants[0]));
+}
+
+
+GEMMKernelDispatcher::GEMMKernelDispatcher (
+    OpenCLBasic& oclobjects,
+    const vector<GEMMKernelVariant>& variants,
+    const string& build_options,
+    size_t max_local_size
+) :
+    oclobjects(oclobjects),
+    table(variants),
+    edge_group_size(1)
+{
+    for(size_t v = 0; v < table.size(); ++v)
+    {
+        const string& file_name = table[v].program;
+
+        programs.push_back(
+            unique_ptr<OpenCLProgramMultipleKernels>(
+                new OpenCLProgramMultipleKernels(
+                    oclobjects,
+                    wstring(file_name.begin(), file_name.end()),
+                    "",
+                    build_options
+                )
+            )
+        );
+
+        GEMMKernelMetadata metadata = gemmKernelMetadata(
+            programs.back()->program,
+            (*programs.back())[table[v].kernel],
+            oclobjects.device
+        );
+
+        if(table[v].blocking == 0)
+        {
+            table[v].blocking = metadata.blocking;
+        }
+
+        if(table[v].vector_width == 0)
+        {
+            table[v].vector_width = metadata.vector_width;
+        }
+
+        if(table[v].blocking == 0 || table[v].vector_width == 0)
+        {
+            throw Error(
+                "Program " + inquotes(file_name) +
+                " does not declare GEMM_BLOCKING and GEMM_VECTOR_WIDTH"
+            );
+        }
+
+        group_sizes.push_back(squareWorkGroupEdge(metadata, 0, max_local_size));
+    }
+
+    edge.reset(
+        new OpenCLProgramOneKernel(
+            oclobjects,
+            L"gemm-edge.cl",
+            "",
+            "gemm_tn_edge",
+            build_options
+        )
+    );
+
+    edge_group_size = squareWorkGroupEdge(
+        gemmKernelMetadata(edge->program, edge->kernel, oclobjects.device),
+        0,
+        max_local_size
+    );
+}
+
+
+GEMMLaunch GEMMKernelDispatcher::edgeLaunch (
+    size_t rows_begin,
+    size_t columns_begin,
+    size_t rows_end,
+    size_t columns_end,
+    size_t k_begin,
+    size_t k_end,
+    bool accumulate
+)
+{
+    GEMMLaunch launch;
+    launch.variant = 0;
+    launch.kernel = edge->kernel;
+    launch.global_offset[0] = rows_begin;
+    launch.global_offset[1] = columns_begin;
+    launch.global_size[0] = round_up_aligned(rows_end - rows_begin, edge_group_size);
+    launch.global_size[1] = round_up_aligned(columns_end - columns_begin, edge_group_size);
+    launch.local_size[0] = edge_group_size;
+    launch.local_size[1] = edge_group_size;
+    launch.rows_end = rows_end;
+    launch.columns_end = columns_end;
+    launch.k_begin = k_begin;
+    launch.k_end = k_end;
+    launch.accumulate = accumulate;
+    return launch;
+}
+
+
+vector<GEMMLaunch> GEMMKernelDispatcher::plan (
+    size_t m,
+    size_t n,
+    size_t k,
+    GEMMLayout layout,
+    size_t lda,
+    size_t ldb,
+    size_t ldc
+)
+{
+    if(layout != LAYOUT_TN || ldc < n || lda < k || ldb < k)
+    {
+        throw Error(
+            "No GEMM kernel supports " + to_str(m) + "x" + to_str(n) + "x" + to_str(k) +
+            " in " + gemmLayoutName(layout) + " layout with the given leading dimensions"
+        );
+    }
+
+    // The variant with the largest bulk: an exact fit without edges
+    // if there is one, otherwise the one that leaves the smallest part
+    // of m*n*k to the slow edge kernel. Ties go to aligned leading
+    // dimensions (vloadn needs alignment to elements only, but unaligned
+    // rows are slower) and then to the order of the table.
+    size_t chosen = table.size();
+    size_t chosen_m = 0, chosen_n = 0, chosen_k = 0;
+    size_t chosen_volume = 0;
+
+    for(int aligned = 1; aligned >= 0; --aligned)
+    {
+        for(size_t v = 0; v < table.size(); ++v)
+        {
+            const GEMMKernelVariant& variant = table[v];
+            size_t width = variant.vector_width;
+
+            if(
+                variant.layout != layout ||
+                (aligned && (lda % width != 0 || ldb % width != 0))
+            )
+            {
+                continue;
+            }
+
+            size_t granule = variant.blocking*group_sizes[v];
+            size_t bulk_m = m/granule*granule;
+            size_t bulk_n = n/granule*granule;
+            size_t bulk_k = k/width*width;
+            size_t volume = bulk_m*bulk_n*bulk_k;
+
+            if(volume > chosen_volume)
+            {
+                chosen = v;
+                chosen_m = bulk_m;
+                chosen_n = bulk_n;
+                chosen_k = bulk_k;
+                chosen_volume = volume;
+            }
+        }
+    }
+
+    vector<GEMMLaunch> launches;
+
+    if(chosen < table.size())
+    {
+        const GEMMKernelVariant& variant = table[chosen];
+
+        GEMMLaunch bulk;
+        bulk.variant = &variant;
+        bulk.kernel = (*programs[chosen])[variant.kernel];
+        bulk.global_offset[0] = 0;
+        bulk.global_offset[1] = 0;
+        bulk.global_size[0] = chosen_m/variant.blocking;
+        bulk.global_size[1] = chosen_n/variant.blocking;
+        bulk.local_size[0] = group_sizes[chosen];
+        bulk.local_size[1] = group_sizes[chosen];
+        bulk.rows_end = chosen_m;
+        bulk.columns_end = chosen_n;
+        bulk.k_begin = 0;
+        bulk.k_end = chosen_k;
+        bulk.accumulate = false;
+        launches.push_back(bulk);
+
+        if(chosen_k < k)
+        {
+            launches.push_back(edgeLaunch(0, 0, chosen_m, chosen_n, chosen_k, k, true));
+        }
+
+        // Right columns for all rows, then bottom rows of the bulk columns
+        if(chosen_n < n)
+        {
+            launches.push_back(edgeLaunch(0, chosen_n, m, n, 0, k, false));
+        }
+
+        if(chosen_m < m)
+        {
+            launches.push_back(edgeLaunch(chosen_m, 0, m, chosen_n, 0, k, false));
+        }
+    }
+
+    // Smaller than a work-group of any variant
+    if(launches.empty())
+    {
+        launches.push_back(edgeLaunch(0, 0, m, n, 0, k, false));
+    }
+
+    return launches;
+}
+
+
+vector<cl_event> GEMMKernelDispatcher::enqueue (
+    const vector<GEMMLaunch>& launches,
+    cl_mem A,
+    size_t lda,
+    cl_mem B,
+    size_t ldb,
+    cl_mem C,
+    size_t ldc
+)
+{
+    vector<cl_event> events;
+
+    try
+    {
+        for(size_t i = 0; i < launches.size(); ++i)
+        {
+            const GEMMLaunch& launch = launches[i];
+            cl_kernel kernel = launch.kernel;
+
+            if(launch.variant)
+            {
+                setGEMMTNArgs(kernel, A, lda, B, ldb, C, ldc, launch.k_end);
+            }
+            else
+            {
+                setGEMMOperandArgs(kernel, A, lda, B, ldb, C, ldc);
+
+                cl_int edge_args[5] = {
+                    static_cast<cl_int>(launch.rows_end),
+                    static_cast<cl_int>(launch.columns_end),
+                    static_cast<cl_int>(launch.k_begin),
+                    static_cast<cl_int>(launch.k_end),
+                    launch.accumulate ? 1 : 0
+                };
+
+                for(int a = 0; a < 5; ++a)
+                {
+                    cl_int err = clSetKernelArg(kernel, 6 + a, sizeof(cl_int), &edge_args[a]);
+                    SAMPLE_CHECK_ERRORS(err);
+                }
+            }
+
+            // The remainder of K is added to the bulk, the first launch.
+            cl_event event = 0;
+            cl_int err = clEnqueueNDRangeKernel(
+                oclobjects.queue,
+                kernel,
+                2,
+                launch.global_offset,
+                launch.global_size,
+                launch.local_size,
+                launch.accumulate ? 1 : 0,
+                launch.accumulate ? &events[0] : 0,
+                &event
+            );
+            SAMPLE_CHECK_ERRORS(err);
+
+            events.push_back(event);
+        }
+    }
+    catch(...)
+    {
+        for(size_t i = 0; i < events.size(); ++i)
+        {
+            clReleaseEvent(events[i]);
+        }
+
+        throw;
+    }
+
+    return events;
+}
@@ -0,0 +1,142 @@
+// Shape-based selection of GEMM kernels.
+//
+// The kernel of the other modes is fixed at startup by --kernel and by the
+// program pushed as gemm.cl, while no single variant is the best one, or
+// even applicable, for every shape: a 4x4-blocked kernel needs M and N
+// divisible by 4 and vload8 needs K divisible by 8. GEMMKernelDispatcher
+// keeps several compiled variants and selects one per call from M, N, K,
+// layout and alignment of the leading dimensions. A variant that divides
+// the shape exactly is preferred, the first one in the order of the table,
+// the fastest first.
+//
+// Sizes that no variant divides, like 1000 or 3001, are split: a variant
+// computes the bulk, the largest part of C with whole work-groups and K
+// rounded down to its vector width, and gemm_tn_edge from gemm-edge.cl
+// computes the remaining rows, columns and the remainder of K by launches
+// enqueued right after the bulk. The variant with the largest bulk is
+// chosen, so the slow edge kernel gets as little of M*N*K as possible.
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_KERNELDISPATCH_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_KERNELDISPATCH_HPP_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <CL/cl.h>
+
+#include "oclobject.hpp"
+#include "shapetrace.hpp"
+
+
+// Kernel with the arguments of gemm_tn from gemm.cl:
+// (A, lda, B, ldb, C, ldc, k); the grid gives M and N.
+struct GEMMKernelVariant
+{
+    std::string program;    // file name of the program
+    std::string kernel;     // kernel name in the program
+    GEMMLayout layout;
+    size_t blocking;        // rows and columns of C computed by one work-item
+    size_t vector_width;    // K and leading dimensions of A and B should be its multiples
+                            // (0 for both: declared by the program, see ndrange.hpp)
+};
+
+// Variants of gemm_tn shipped with the sample, the fastest first.
+std::vector<GEMMKernelVariant> defaultGEMMKernelVariants ();
+
+
+// One launch of a multiplication: a blocked variant for the bulk of C or
+// the edge kernel for the rows and columns from global_offset till
+// rows_end and columns_end. Sums are over K from k_begin till k_end.
+struct GEMMLaunch
+{
+    const GEMMKernelVariant* variant;   // 0 for the edge kernel
+    cl_kernel kernel;
+    size_t global_offset[2];
+    size_t global_size[2];
+    size_t local_size[2];
+    size_t rows_end;
+    size_t columns_end;
+    size_t k_begin;
+    size_t k_end;
+    bool accumulate;    // adds to C: the remainder of K of the bulk
+};
+
+
+class GEMMKernelDispatcher
+{
+public:
+
+    // Builds the programs of all variants and of the edge kernel with
+    // build_options. Work-groups are square, max_local_size work-items in
+    // each dimension or smaller if the kernel does not allow it, see
+    // squareWorkGroupEdge.
+    GEMMKernelDispatcher (
+        OpenCLBasic& oclobjects,
+        const std::vector<GEMMKernelVariant>& variants,
+        const std::string& build_options,
+        size_t max_local_size
+    );
+
+    // Launches for C (m x n) = op(A) (m x k) * op(B) (k x n): the bulk by
+    // the variant that covers the most of m*n*k, preferably with leading
+    // dimensions of A and B aligned to its vector width and then the first
+    // one in the table, then the edges. Throws Error if no kernel supports
+    // the layout.
+    std::vector<GEMMLaunch> plan (
+        size_t m,
+        size_t n,
+        size_t k,
+        GEMMLayout layout,
+        size_t lda,
+        size_t ldb,
+        size_t ldc
+    );
+
+    // Sets the arguments and enqueues the launches of a plan; the launch
+    // with the remainder of K waits for the bulk. Returns events of all
+    // launches in the order of the plan; the caller releases them.
+    // The queue is in-order, so the last one completes the multiplication.
+    std::vector<cl_event> enqueue (
+        const std::vector<GEMMLaunch>& launches,
+        cl_mem A,
+        size_t lda,
+        cl_mem B,
+        size_t ldb,
+        cl_mem C,
+        size_t ldc
+    );
+
+    const std::vector<GEMMKernelVariant>& variants () const
+    {
+        return table;
+    }
+
+private:
+
+    OpenCLBasic& oclobjects;
+    std::vector<GEMMKernelVariant> table;
+    std::vector<std::unique_ptr<OpenCLProgramMultipleKernels> > programs;  // one per variant
+    std::vector<size_t> group_sizes;   // work-group edge for each variant
+    std::unique_ptr<OpenCLProgramOneKernel> edge;
+    size_t edge_group_size;
+
+    GEMMLaunch edgeLaunch (
+        size_t rows_begin,
+        size_t columns_begin,
+        size_t rows_end,
+        size_t columns_end,
+        size_t k_begin,
+        size_t k_end,
+        bool accumulate
+    );
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    GEMMKernelDispatcher (const GEMMKernelDispatcher&);
+    GEMMKernelDispatcher& operator= (const GEMMKernelDispatcher&);
+};
+
+
+#endif  // end of the include guard
@@ -0,0 +1,244 @@
+// Matrix shared between the host and an OpenCL device, see matrix.hpp.
+
+
+#include <cassert>
+#include <utility>
+
+#include "basic.hpp"
+#include "matrix.hpp"
+
+using namespace std;
+
+
+template <typename T>
+Matrix<T>::Matrix () :
+    oclobjects(0),
+    num_rows(0),
+    num_columns(0),
+    leading_dimension(0),
+    matrix_layout(ROW_MAJOR),
+    mapped(false),
+    map_flags(0),
+    host_valid(true),
+    device_valid(true),
+    sync_count(0)
+{
+}
+
+
+template <typename T>
+Matrix<T>::Matrix (
+    OpenCLBasic& oclobjects,
+    size_t rows,
+    size_t columns,
+    size_t stride,
+    MatrixLayout layout
+) :
+    oclobjects(&oclobjects),
+    num_rows(rows),
+    num_columns(columns),
+    leading_dimension(stride),
+    matrix_layout(layout),
+    mapped(false),
+    map_flags(0),
+    // Nothing has been written yet, so there is nothing to transfer.
+    host_valid(true),
+    device_valid(true),
+    sync_count(0)
+{
+    assert(stride >= (layout == ROW_MAJOR ? columns : rows));
+
+    memory.host = (T*)aligned_malloc(
+        zeroCopySizeAlignment(memorySize(), oclobjects.device),
+        zeroCopyPtrAlignment(oclobjects.device)
+    );
+
+    cl_int err = 0;
+    memory.device = clCreateBuffer(
+        oclobjects.context,
+        CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,
+        memorySize(),
+        memory.host,
+        &err
+    );
+    SAMPLE_CHECK_ERRORS(err);
+}
+
+
+template <typename T>
+Matrix<T>::Matrix (Matrix&& other) :
+    oclobjects(other.oclobjects),
+    memory(std::move(other.memory)),
+    num_rows(other.num_rows),
+    num_columns(other.num_columns),
+    leading_dimension(other.leading_dimension),
+    matrix_layout(other.matrix_layout),
+    mapped(other.mapped),
+    map_flags(other.map_flags),
+    host_valid(other.host_valid),
+    device_valid(other.device_valid),
+    sync_count(other.sync_count)
+{
+    other.oclobjects = 0;
+    other.mapped = false;
+}
+
+
+template <typename T>
+Matrix<T>& Matrix<T>::operator= (Matrix&& other)
+{
+    if(this != &other)
+    {
+        if(mapped)
+        {
+            // Host memory is released below: unmap should be finished.
+            unmap();
+
+            cl_int err = clFinish(oclobjects->queue);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+
+        oclobjects = other.oclobjects;
+        memory = std::move(other.memory);
+        num_rows = other.num_rows;
+        num_columns = other.num_columns;
+        leading_dimension = other.leading_dimension;
+        matrix_layout = other.matrix_layout;
+        mapped = other.mapped;
+        map_flags = other.map_flags;
+        host_valid = other.host_valid;
+        device_valid = other.device_valid;
+        sync_count = other.sync_count;
+
+        other.oclobjects = 0;
+        other.mapped = false;
+    }
+
+    return *this;
+}
+
+
+template <typename T>
+Matrix<T>::~Matrix ()
+{
+    try
+    {
+        if(mapped)
+        {
+            unmap();
+
+            cl_int err = clFinish(oclobjects->queue);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+    }
+    catch(...)
+    {
+        destructorException();
+    }
+}
+
+
+template <typename T>
+size_t Matrix<T>::memorySize () const
+{
+    return (matrix_layout == ROW_MAJOR ? num_rows : num_columns)*leading_dimension*sizeof(T);
+}
+
+
+template <typename T>
+T* Matrix<T>::host (MatrixAccess access)
+{
+    assert(oclobjects);
+
+    cl_map_flags flags =
+        ((access & ACCESS_READ) ? CL_MAP_READ : 0) |
+        ((access & ACCESS_WRITE) ? CL_MAP_WRITE : 0);
+
+    // Mapped for reading only, but now it will be written:
+    // written data is transferred by unmap only if it was mapped for writing.
+    if(mapped && (map_flags & flags) != flags)
+    {
+        unmap();
+    }
+
+    // The device has not written the matrix since the last synchronization:
+    // the host memory already holds the latest data and reading it needs
+    // no map. Writing does, the unmap transfers the data to the device.
+    if(!mapped && host_valid && access == ACCESS_READ)
+    {
+        return memory.host;
+    }
+
+    if(!mapped)
+    {
+        // With ACCESS_WRITE alone the device data is not read:
+        // it is going to be overwritten.
+        cl_int err = 0;
+        clEnqueueMapBuffer(
+            oclobjects->queue,
+            memory.device,
+            CL_TRUE,
+            flags,
+            0,
+            memorySize(),
+            0, 0, 0,
+            &err
+        );
+        SAMPLE_CHECK_ERRORS(err);
+
+        mapped = true;
+        map_flags = flags;
+        ++sync_count;
+        host_valid = true;
+    }
+
+    if(access & ACCESS_WRITE)
+    {
+        device_valid = false;
+    }
+
+    return memory.host;
+}
+
+
+template <typename T>
+cl_mem Matrix<T>::device (MatrixAccess access)
+{
+    assert(oclobjects);
+
+    // Kernels may read a buffer mapped for reading (OpenCL 1.2): while the
+    // device copy is valid and is only read, the mapping stays for the host.
+    if(mapped && (!device_valid || (access & ACCESS_WRITE)))
+    {
+        unmap();
+    }
+
+    if(access & ACCESS_WRITE)
+    {
+        host_valid = false;
+    }
+
+    return memory.device;
+}
+
+
+template <typename T>
+void Matrix<T>::unmap ()
+{
+    assert(mapped);
+
+    cl_int err = clEnqueueUnmapMemObject(oclobjects->queue, memory.device, memory.host, 0, 0, 0);
+    SAMPLE_CHECK_ERRORS(err);
+
+    mapped = false;
+    ++sync_count;
+
+    if(map_flags & CL_MAP_WRITE)
+    {
+        device_valid = true;
+    }
+}
+
+
+template class Matrix<float>;
+template class Matrix<double>;
@@ -0,0 +1,119 @@
+// Matrix shared between the host and an OpenCL device with lazy
+// synchronization.
+//
+// The matrix knows its shape, stride and layout, and on which side the
+// latest data is. Memory is aligned host memory wrapped with
+// CL_MEM_USE_HOST_PTR buffer. host() maps the buffer only if it is not
+// mapped yet, and device() unmaps it only if it is mapped, so a sequence
+// of host accesses or of kernel launches costs no map/unmap commands
+// between them. Residency removes more of them: the host reads without
+// a map while the device has not written the matrix, and kernels that
+// only read it leave a read mapping in place. Matrices can be moved, so
+// they can be returned from functions and kept in containers.
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_MATRIX_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_MATRIX_HPP_
+
+#include <cstddef>
+
+#include <CL/cl.h>
+
+#include "oclobject.hpp"
+
+
+enum MatrixLayout
+{
+    ROW_MAJOR,      // element (i, j) is at i*stride + j
+    COLUMN_MAJOR    // element (i, j) is at j*stride + i
+};
+
+enum MatrixAccess
+{
+    ACCESS_READ = 1,
+    ACCESS_WRITE = 2,   // alone means the whole matrix is overwritten
+    ACCESS_READ_WRITE = ACCESS_READ | ACCESS_WRITE
+};
+
+
+template <typename T>
+class Matrix
+{
+public:
+
+    // Matrix without memory, to be assigned later.
+    Matrix ();
+
+    // stride is the number of elements between the beginnings of
+    // consecutive rows (ROW_MAJOR) or columns (COLUMN_MAJOR).
+    Matrix (
+        OpenCLBasic& oclobjects,
+        size_t rows,
+        size_t columns,
+        size_t stride,
+        MatrixLayout layout = ROW_MAJOR
+    );
+
+    Matrix (Matrix&& other);
+    Matrix& operator= (Matrix&& other);
+
+    ~Matrix ();
+
+    size_t rows () const { return num_rows; }
+    size_t columns () const { return num_columns; }
+    size_t stride () const { return leading_dimension; }
+    MatrixLayout layout () const { return matrix_layout; }
+
+    // Position of element (i, j) from the beginning of the memory.
+    size_t index (size_t i, size_t j) const
+    {
+        return matrix_layout == ROW_MAJOR ? i*leading_dimension + j : j*leading_dimension + i;
+    }
+
+    // Size of the memory in bytes.
+    size_t memorySize () const;
+
+    // Residency: where the latest data is. Both are true when
+    // neither side has modified the matrix since the last synchronization.
+    bool hostValid () const { return host_valid; }
+    bool deviceValid () const { return device_valid; }
+
+    // Host pointer valid till the next device() call. Maps the buffer
+    // if it is not mapped with the access yet, unless the access is
+    // ACCESS_READ and the host data is valid; blocks till it is done.
+    T* host (MatrixAccess access = ACCESS_READ_WRITE);
+
+    // Buffer for kernel arguments. Unmaps the buffer if it is mapped,
+    // unless it is mapped for reading and the kernels only read it;
+    // the unmap command is enqueued to the queue before the kernels
+    // that will use the buffer.
+    cl_mem device (MatrixAccess access = ACCESS_READ_WRITE);
+
+    // Number of map and unmap commands enqueued so far.
+    size_t synchronizations () const { return sync_count; }
+
+private:
+
+    void unmap ();
+
+    OpenCLBasic* oclobjects;
+    OpenCLDeviceAndHostMemory<T> memory;
+
+    size_t num_rows;
+    size_t num_columns;
+    size_t leading_dimension;
+    MatrixLayout matrix_layout;
+
+    bool mapped;
+    cl_map_flags map_flags;
+    bool host_valid;
+    bool device_valid;
+    size_t sync_count;
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    Matrix (const Matrix&);
+    Matrix& operator= (const Matrix&);
+};
+
+
+#endif  // end of the include guard
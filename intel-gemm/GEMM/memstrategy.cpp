@@ -0,0 +1,370 @@
+// Matrix storage with selectable memory strategy, see memstrategy.hpp.
+
+
+#include <cassert>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+
+#ifdef __linux__
+#include <dlfcn.h>
+#endif
+
+#include "basic.hpp"
+#include "memstrategy.hpp"
+
+using namespace std;
+
+
+// The sample is built with OpenCL 1.1 headers, so the part of OpenCL 2.0
+// API for SVM is declared here and loaded from the library at run time.
+#ifndef CL_VERSION_2_0
+
+typedef cl_bitfield cl_svm_mem_flags;
+typedef cl_bitfield cl_device_svm_capabilities;
+
+#define CL_DEVICE_SVM_CAPABILITIES              0x1053
+#define CL_DEVICE_SVM_COARSE_GRAIN_BUFFER       (1 << 0)
+#define CL_DEVICE_SVM_FINE_GRAIN_BUFFER         (1 << 1)
+#define CL_MEM_SVM_FINE_GRAIN_BUFFER            (1 << 10)
+
+#endif
+
+
+namespace
+{
+
+struct SVMFunctions
+{
+    typedef void* (CL_API_CALL *SVMAlloc) (cl_context, cl_svm_mem_flags, size_t, cl_uint);
+    typedef void (CL_API_CALL *SVMFree) (cl_context, void*);
+    typedef cl_int (CL_API_CALL *SetKernelArgSVMPointer) (cl_kernel, cl_uint, const void*);
+    typedef cl_int (CL_API_CALL *EnqueueSVMMap) (
+        cl_command_queue, cl_bool, cl_map_flags, void*, size_t, cl_uint, const cl_event*, cl_event*
+    );
+    typedef cl_int (CL_API_CALL *EnqueueSVMUnmap) (
+        cl_command_queue, void*, cl_uint, const cl_event*, cl_event*
+    );
+
+    SVMAlloc alloc;
+    SVMFree free;
+    SetKernelArgSVMPointer setKernelArg;
+    EnqueueSVMMap map;
+    EnqueueSVMUnmap unmap;
+
+    SVMFunctions () :
+        alloc(0), free(0), setKernelArg(0), map(0), unmap(0)
+    {
+#ifdef __linux__
+        // Core functions are exported by the OpenCL library the sample is linked with.
+        alloc = (SVMAlloc)dlsym(RTLD_DEFAULT, "clSVMAlloc");
+        free = (SVMFree)dlsym(RTLD_DEFAULT, "clSVMFree");
+        setKernelArg = (SetKernelArgSVMPointer)dlsym(RTLD_DEFAULT, "clSetKernelArgSVMPointer");
+        map = (EnqueueSVMMap)dlsym(RTLD_DEFAULT, "clEnqueueSVMMap");
+        unmap = (EnqueueSVMUnmap)dlsym(RTLD_DEFAULT, "clEnqueueSVMUnmap");
+#endif
+    }
+
+    bool available () const
+    {
+        return alloc && free && setKernelArg && map && unmap;
+    }
+};
+
+
+const SVMFunctions& svmFunctions ()
+{
+    static SVMFunctions functions;
+    return functions;
+}
+
+
+bool isSVM (MemoryStrategy strategy)
+{
+    return strategy == MEMORY_SVM_COARSE || strategy == MEMORY_SVM_FINE;
+}
+
+}
+
+
+MemoryStrategy parseMemoryStrategy (const string& name)
+{
+    if(name == "use-host-ptr")
+    {
+        return MEMORY_USE_HOST_PTR;
+    }
+
+    if(name == "alloc-host-ptr")
+    {
+        return MEMORY_ALLOC_HOST_PTR;
+    }
+
+    if(name == "copy")
+    {
+        return MEMORY_COPY;
+    }
+
+    if(name == "svm-coarse")
+    {
+        return MEMORY_SVM_COARSE;
+    }
+
+    if(name == "svm-fine")
+    {
+        return MEMORY_SVM_FINE;
+    }
+
+    throw Error("Cannot recognize " + inquotes(name) + " as a memory strategy");
+}
+
+
+void checkMemoryStrategy (MemoryStrategy strategy, OpenCLBasic& oclobjects)
+{
+    if(!isSVM(strategy))
+    {
+        return;
+    }
+
+    if(!svmFunctions().available())
+    {
+        throw Error("OpenCL library does not provide OpenCL 2.0 SVM functions");
+    }
+
+    size_t version_length = 0;
+    cl_int err = clGetDeviceInfo(oclobjects.device, CL_DEVICE_VERSION, 0, 0, &version_length);
+    SAMPLE_CHECK_ERRORS(err);
+
+    vector<char> version(version_length);
+    err = clGetDeviceInfo(oclobjects.device, CL_DEVICE_VERSION, version_length, &version[0], 0);
+    SAMPLE_CHECK_ERRORS(err);
+
+    // Format is "OpenCL <major>.<minor> <vendor-specific information>"
+    int major = 0;
+    if(strncmp(&version[0], "OpenCL ", 7) == 0)
+    {
+        major = atoi(&version[0] + 7);
+    }
+
+    if(major < 2)
+    {
+        throw Error(
+            "SVM requires OpenCL 2.0 device; device version is " +
+            inquotes(string(&version[0]))
+        );
+    }
+
+    cl_device_svm_capabilities capabilities = 0;
+    err = clGetDeviceInfo(
+        oclobjects.device,
+        CL_DEVICE_SVM_CAPABILITIES,
+        sizeof(capabilities),
+        &capabilities,
+        0
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    cl_device_svm_capabilities required =
+        strategy == MEMORY_SVM_FINE ?
+        CL_DEVICE_SVM_FINE_GRAIN_BUFFER :
+        CL_DEVICE_SVM_COARSE_GRAIN_BUFFER;
+
+    if(!(capabilities & required))
+    {
+        throw Error(
+            string("Device does not support ") +
+            (strategy == MEMORY_SVM_FINE ? "fine" : "coarse") +
+            "-grain buffer SVM"
+        );
+    }
+}
+
+
+MatrixStorage::MatrixStorage (
+    OpenCLBasic& oclobjects,
+    MemoryStrategy strategy,
+    size_t size,
+    size_t alignment
+) :
+    oclobjects(oclobjects),
+    memory_strategy(strategy),
+    size(size),
+    buffer(0),
+    host(0),
+    svm(0),
+    mapped(0),
+    access_flags(0)
+{
+    cl_int err = 0;
+
+    switch(strategy)
+    {
+        case MEMORY_USE_HOST_PTR:
+            host = aligned_malloc(zeroCopySizeAlignment(size, oclobjects.device), alignment);
+            buffer = clCreateBuffer(oclobjects.context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, size, host, &err);
+            SAMPLE_CHECK_ERRORS(err);
+            break;
+
+        case MEMORY_ALLOC_HOST_PTR:
+            buffer = clCreateBuffer(oclobjects.context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, 0, &err);
+            SAMPLE_CHECK_ERRORS(err);
+            break;
+
+        case MEMORY_COPY:
+            host = aligned_malloc(size, alignment);
+            buffer = clCreateBuffer(oclobjects.context, CL_MEM_READ_WRITE, size, 0, &err);
+            SAMPLE_CHECK_ERRORS(err);
+            break;
+
+        case MEMORY_SVM_COARSE:
+        case MEMORY_SVM_FINE:
+            checkMemoryStrategy(strategy, oclobjects);
+
+            svm = svmFunctions().alloc(
+                oclobjects.context,
+                CL_MEM_READ_WRITE | (strategy == MEMORY_SVM_FINE ? CL_MEM_SVM_FINE_GRAIN_BUFFER : 0),
+                size,
+                cl_uint(alignment)
+            );
+
+            if(!svm)
+            {
+                throw Error("clSVMAlloc failed to allocate " + to_str(size) + " bytes");
+            }
+            break;
+    }
+}
+
+
+MatrixStorage::~MatrixStorage ()
+{
+    try
+    {
+        if(mapped)
+        {
+            endHostAccess();
+        }
+
+        if(buffer)
+        {
+            cl_int err = clReleaseMemObject(buffer);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+
+        if(svm)
+        {
+            svmFunctions().free(oclobjects.context, svm);
+        }
+
+        aligned_free(host);
+    }
+    catch(...)
+    {
+        destructorException();
+    }
+}
+
+
+void* MatrixStorage::beginHostAccess (cl_map_flags flags)
+{
+    assert(!mapped);
+
+    cl_int err = 0;
+    access_flags = flags;
+
+    switch(memory_strategy)
+    {
+        case MEMORY_USE_HOST_PTR:
+        case MEMORY_ALLOC_HOST_PTR:
+            mapped = clEnqueueMapBuffer(
+                oclobjects.queue,
+                buffer,
+                CL_TRUE,
+                flags,
+                0,
+                size,
+                0, 0, 0,
+                &err
+            );
+            SAMPLE_CHECK_ERRORS(err);
+            break;
+
+        case MEMORY_COPY:
+            if(flags & CL_MAP_READ)
+            {
+                err = clEnqueueReadBuffer(oclobjects.queue, buffer, CL_TRUE, 0, size, host, 0, 0, 0);
+                SAMPLE_CHECK_ERRORS(err);
+            }
+            mapped = host;
+            break;
+
+        case MEMORY_SVM_COARSE:
+            err = svmFunctions().map(oclobjects.queue, CL_TRUE, flags, svm, size, 0, 0, 0);
+            SAMPLE_CHECK_ERRORS(err);
+            mapped = svm;
+            break;
+
+        case MEMORY_SVM_FINE:
+            // Fine-grain SVM is coherent at synchronization points.
+            err = clFinish(oclobjects.queue);
+            SAMPLE_CHECK_ERRORS(err);
+            mapped = svm;
+            break;
+    }
+
+    return mapped;
+}
+
+
+void MatrixStorage::endHostAccess ()
+{
+    assert(mapped);
+
+    cl_int err = 0;
+
+    switch(memory_strategy)
+    {
+        case MEMORY_USE_HOST_PTR:
+        case MEMORY_ALLOC_HOST_PTR:
+            err = clEnqueueUnmapMemObject(oclobjects.queue, buffer, mapped, 0, 0, 0);
+            SAMPLE_CHECK_ERRORS(err);
+            break;
+
+        case MEMORY_COPY:
+            if(access_flags & CL_MAP_WRITE)
+            {
+                err = clEnqueueWriteBuffer(oclobjects.queue, buffer, CL_TRUE, 0, size, host, 0, 0, 0);
+                SAMPLE_CHECK_ERRORS(err);
+            }
+            break;
+
+        case MEMORY_SVM_COARSE:
+            err = svmFunctions().unmap(oclobjects.queue, svm, 0, 0, 0);
+            SAMPLE_CHECK_ERRORS(err);
+            break;
+
+        case MEMORY_SVM_FINE:
+            break;
+    }
+
+    mapped = 0;
+
+    err = clFinish(oclobjects.queue);
+    SAMPLE_CHECK_ERRORS(err);
+}
+
+
+void MatrixStorage::setKernelArg (cl_kernel kernel, cl_uint index)
+{
+    cl_int err = 0;
+
+    if(isSVM(memory_strategy))
+    {
+        err = svmFunctions().setKernelArg(kernel, index, svm);
+    }
+    else
+    {
+        err = clSetKernelArg(kernel, index, sizeof(cl_mem), &buffer);
+    }
+
+    SAMPLE_CHECK_ERRORS(err);
+}
@@ -0,0 +1,89 @@
+// Storage of one matrix shared between the host and an OpenCL device with
+// a selectable memory strategy. Which strategy is the fastest differs from
+// driver to driver, so all of them are available from the command line:
+//   - use-host-ptr: aligned_malloc memory wrapped with CL_MEM_USE_HOST_PTR
+//   - alloc-host-ptr: memory allocated by the driver with CL_MEM_ALLOC_HOST_PTR
+//   - copy: a device-only buffer and a separate host copy, explicit write/read
+//   - svm-coarse, svm-fine: OpenCL 2.0 shared virtual memory with coarse- or
+//     fine-grain buffer sharing, when the library and the device support it
+// The first two are accessed from the host through map/unmap.
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_MEMSTRATEGY_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_MEMSTRATEGY_HPP_
+
+#include <string>
+
+#include <CL/cl.h>
+
+#include "oclobject.hpp"
+
+
+enum MemoryStrategy
+{
+    MEMORY_USE_HOST_PTR,
+    MEMORY_ALLOC_HOST_PTR,
+    MEMORY_COPY,
+    MEMORY_SVM_COARSE,
+    MEMORY_SVM_FINE
+};
+
+// Parses the name of a strategy as given in --memory option.
+MemoryStrategy parseMemoryStrategy (const std::string& name);
+
+// Checks if the strategy can be used with a given device: SVM strategies
+// need OpenCL 2.0 library and device capabilities; throws Error otherwise.
+void checkMemoryStrategy (MemoryStrategy strategy, OpenCLBasic& oclobjects);
+
+
+class MatrixStorage
+{
+public:
+
+    // size is in bytes; alignment is for host memory allocated by the sample
+    MatrixStorage (
+        OpenCLBasic& oclobjects,
+        MemoryStrategy strategy,
+        size_t size,
+        size_t alignment
+    );
+
+    ~MatrixStorage ();
+
+    // Makes the matrix accessible by the host and returns its host pointer;
+    // with CL_MAP_READ the current content from the device is visible.
+    // Blocks till the data is available.
+    void* beginHostAccess (cl_map_flags flags);
+
+    // Returns the matrix to the device after beginHostAccess;
+    // with CL_MAP_WRITE given there, host modifications are transferred.
+    // Blocks till the transfer is finished, so it can be timed.
+    void endHostAccess ();
+
+    // Sets the matrix as argument of a kernel.
+    void setKernelArg (cl_kernel kernel, cl_uint index);
+
+    MemoryStrategy strategy () const
+    {
+        return memory_strategy;
+    }
+
+private:
+
+    OpenCLBasic& oclobjects;
+    MemoryStrategy memory_strategy;
+    size_t size;
+
+    cl_mem buffer;      // all strategies except SVM
+    void* host;         // aligned_malloc memory for use-host-ptr and copy
+    void* svm;          // SVM allocation
+    void* mapped;       // host pointer while accessed by the host
+    cl_map_flags access_flags;
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    MatrixStorage (const MatrixStorage&);
+    MatrixStorage& operator= (const MatrixStorage&);
+};
+
+
+#endif  // end of the include guard
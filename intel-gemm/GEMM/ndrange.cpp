@@ -0,0 +1,120 @@
+// NDRange of GEMM kernels derived from their blocking, see ndrange.hpp.
+
+
+#include <cstdlib>
+#include <vector>
+
+#include "basic.hpp"
+#include "ndrange.hpp"
+
+using namespace std;
+
+
+size_t programDefine (const string& source, const string& name)
+{
+    string directive = "#define " + name;
+
+    for(size_t pos = source.find(directive); pos != string::npos; pos = source.find(directive, pos + 1))
+    {
+        // Whole lines only: not GEMM_BLOCKING_X or a commented out one
+        size_t line_start = source.rfind('\n', pos);
+        line_start = line_start == string::npos ? 0 : line_start + 1;
+        size_t end = pos + directive.size();
+
+        if(
+            source.find_first_not_of(" \t", line_start) != pos ||
+            end >= source.size() || (source[end] != ' ' && source[end] != '\t')
+        )
+        {
+            continue;
+        }
+
+        return size_t(strtoul(source.c_str() + end, 0, 10));
+    }
+
+    return 0;
+}
+
+
+GEMMKernelMetadata gemmKernelMetadata (
+    cl_program program,
+    cl_kernel kernel,
+    cl_device_id device
+)
+{
+    GEMMKernelMetadata metadata;
+
+    size_t source_size = 0;
+    cl_int err = clGetProgramInfo(program, CL_PROGRAM_SOURCE, 0, 0, &source_size);
+    SAMPLE_CHECK_ERRORS(err);
+
+    vector<char> source(source_size + 1, 0);
+    err = clGetProgramInfo(program, CL_PROGRAM_SOURCE, source_size, &source[0], 0);
+    SAMPLE_CHECK_ERRORS(err);
+
+    string text(&source[0]);
+    metadata.blocking = programDefine(text, "GEMM_BLOCKING");
+    metadata.vector_width = programDefine(text, "GEMM_VECTOR_WIDTH");
+
+    err = clGetKernelWorkGroupInfo(
+        kernel,
+        device,
+        CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE,
+        sizeof(metadata.preferred_multiple),
+        &metadata.preferred_multiple,
+        0
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    metadata.max_work_group_size = kernelMaxWorkGroupSize(kernel, device);
+
+    err = clGetKernelWorkGroupInfo(
+        kernel,
+        device,
+        CL_KERNEL_PRIVATE_MEM_SIZE,
+        sizeof(metadata.private_mem_size),
+        &metadata.private_mem_size,
+        0
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    err = clGetKernelWorkGroupInfo(
+        kernel,
+        device,
+        CL_KERNEL_LOCAL_MEM_SIZE,
+        sizeof(metadata.local_mem_size),
+        &metadata.local_mem_size,
+        0
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    size_t max_work_item_sizes[3] = {0};
+    deviceMaxWorkItemSizes(device, max_work_item_sizes);
+    metadata.max_work_item_sizes[0] = max_work_item_sizes[0];
+    metadata.max_work_item_sizes[1] = max_work_item_sizes[1];
+
+    return metadata;
+}
+
+
+size_t squareWorkGroupEdge (
+    const GEMMKernelMetadata& metadata,
+    size_t grid,
+    size_t max_local_size
+)
+{
+    size_t edge = 1;
+
+    while(
+        4*edge*edge <= metadata.max_work_group_size &&
+        2*edge <= metadata.max_work_item_sizes[0] &&
+        2*edge <= metadata.max_work_item_sizes[1] &&
+        (!max_local_size || 2*edge <= max_local_size) &&
+        (!grid || grid % (2*edge) == 0)
+    )
+    {
+        edge *= 2;
+    }
+
+    return edge;
+}
@@ -0,0 +1,60 @@
+// NDRange of GEMM kernels derived from their blocking.
+//
+// A kernel that computes b x b elements of C per work-item needs a global
+// size of size/b in each dimension; with --global-size set independently
+// a wrong value computes garbage or does useless work without any error.
+// GEMM programs declare their blocking as macros in the source:
+//
+//     #define GEMM_BLOCKING 4        // rows and columns of C per work-item
+//     #define GEMM_VECTOR_WIDTH 8    // step of the loop over K
+//
+// and use them in the kernel code, so the declaration cannot go stale. The
+// host reads them back from CL_PROGRAM_SOURCE (no kernel attribute queries
+// are needed, they are not in OpenCL 1.1) and takes the limits of
+// work-groups from the kernel: the maximum work-group size and its
+// preferred multiple.
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_NDRANGE_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_NDRANGE_HPP_
+
+#include <cstddef>
+#include <string>
+
+#include <CL/cl.h>
+
+
+struct GEMMKernelMetadata
+{
+    size_t blocking;        // 0 if the program does not declare GEMM_BLOCKING
+    size_t vector_width;    // 0 if the program does not declare GEMM_VECTOR_WIDTH
+    size_t max_work_group_size;
+    size_t preferred_multiple;      // CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE
+    size_t max_work_item_sizes[2];  // of the device in dimensions 0 and 1
+    cl_ulong private_mem_size;      // per work-item, spilled registers included
+    cl_ulong local_mem_size;        // per work-group
+};
+
+GEMMKernelMetadata gemmKernelMetadata (
+    cl_program program,
+    cl_kernel kernel,
+    cl_device_id device
+);
+
+// Value of "#define name <integer>" in the source, 0 if there is no such line.
+size_t programDefine (const std::string& source, const std::string& name);
+
+
+// Edge of the square work-group GEMM kernels are launched with: the
+// largest power of two e that divides grid (the global size in each
+// dimension, 0 if any one is fine), is at most max_local_size (0 for no
+// limit) and fits the kernel and the device with e*e work-items. More
+// work-items in a group give the scheduler more threads to hide latency.
+size_t squareWorkGroupEdge (
+    const GEMMKernelMetadata& metadata,
+    size_t grid,
+    size_t max_local_size
+);
+
+
+#endif  // end of the include guard
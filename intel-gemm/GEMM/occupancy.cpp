@@ -0,0 +1,137 @@
+// Occupancy and register-pressure estimates for GEMM kernel variants,
+// see occupancy.hpp.
+
+
+#include <algorithm>
+
+#include "basic.hpp"
+#include "occupancy.hpp"
+
+using namespace std;
+
+
+bool isMaliDevice (cl_device_id device)
+{
+    cl_device_info queries[2] = { CL_DEVICE_NAME, CL_DEVICE_VENDOR };
+
+    for(int q = 0; q < 2; ++q)
+    {
+        size_t size = 0;
+        cl_int err = clGetDeviceInfo(device, queries[q], 0, 0, &size);
+        SAMPLE_CHECK_ERRORS(err);
+
+        vector<char> value(size + 1, 0);
+        err = clGetDeviceInfo(device, queries[q], size, &value[0], 0);
+        SAMPLE_CHECK_ERRORS(err);
+
+        string text(&value[0]);
+        if(text.find("Mali") != string::npos || text.find("ARM") != string::npos)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+size_t maliActiveWorkItems (size_t registers)
+{
+    if(registers <= 4)
+    {
+        return MALI_MAX_ACTIVE_WORK_ITEMS;
+    }
+
+    if(registers <= 8)
+    {
+        return MALI_MAX_ACTIVE_WORK_ITEMS/2;
+    }
+
+    // Above 16 registers the rest is spilled, still with 64 work-items.
+    return MALI_MAX_ACTIVE_WORK_ITEMS/4;
+}
+
+
+OccupancyEstimate estimateOccupancy (
+    const GEMMKernelMetadata& metadata,
+    size_t size_of_element,
+    size_t work_group_size,
+    cl_ulong device_local_mem_size
+)
+{
+    OccupancyEstimate estimate;
+    estimate.registers = 0;
+    estimate.model_work_items = MALI_MAX_ACTIVE_WORK_ITEMS;
+    estimate.spills = metadata.private_mem_size > 0;
+
+    if(metadata.blocking && metadata.vector_width)
+    {
+        size_t per_register = max<size_t>(16/size_of_element, 1);
+        size_t b = metadata.blocking;
+
+        size_t accumulators = (b*b + per_register - 1)/per_register;
+        size_t operands = 2*((b*metadata.vector_width + per_register - 1)/per_register);
+
+        estimate.registers = accumulators + operands + 1;
+        estimate.model_work_items = maliActiveWorkItems(estimate.registers);
+        estimate.spills = estimate.spills || estimate.registers > 16;
+    }
+
+    // The driver lowers the maximum work-group size with register use.
+    size_t active = min(estimate.model_work_items, metadata.max_work_group_size);
+
+    if(metadata.local_mem_size > 0)
+    {
+        size_t groups = size_t(device_local_mem_size/metadata.local_mem_size);
+        active = min(active, groups*work_group_size);
+    }
+
+    // Only whole work-groups are active.
+    active = work_group_size ? active/work_group_size*work_group_size : 0;
+
+    estimate.active_work_items = active;
+    estimate.occupancy = double(active)/MALI_MAX_ACTIVE_WORK_ITEMS;
+
+    if(metadata.private_mem_size > 0)
+    {
+        estimate.warnings.push_back(
+            "uses " + to_str(metadata.private_mem_size) +
+            " bytes of private memory per work-item: registers are spilled"
+        );
+    }
+    else if(estimate.registers > 16)
+    {
+        estimate.warnings.push_back(
+            "estimated " + to_str(estimate.registers) + " registers exceed 16: spills are likely"
+        );
+    }
+
+    if(metadata.blocking == 0)
+    {
+        estimate.warnings.push_back("blocking is not declared, registers are not estimated");
+    }
+
+    if(active == 0)
+    {
+        estimate.warnings.push_back(
+            "work-group of " + to_str(work_group_size) + " work-items does not fit in one core"
+        );
+    }
+    else if(estimate.occupancy < 0.5)
+    {
+        estimate.warnings.push_back(
+            "only " + to_str(active) + " of " + to_str(MALI_MAX_ACTIVE_WORK_ITEMS) +
+            " work-items active: memory latency is poorly hidden"
+        );
+    }
+
+    if(metadata.preferred_multiple > 1 && work_group_size % metadata.preferred_multiple != 0)
+    {
+        estimate.warnings.push_back(
+            "work-group of " + to_str(work_group_size) +
+            " work-items is not a multiple of preferred " + to_str(metadata.preferred_multiple)
+        );
+    }
+
+    return estimate;
+}
@@ -0,0 +1,61 @@
+// Occupancy and register-pressure estimates for GEMM kernel variants.
+//
+// On Mali Midgard GPUs a shader core keeps up to 256 work-items active,
+// but only 128 if a work-item uses more than 4 of 128-bit registers and
+// only 64 above 8 of them; above 16 the compiler spills registers to
+// memory (see register-constraints.png). Fewer active work-items hide
+// memory latency worse, so a variant with a bigger blocking can be slower
+// than a smaller one. The estimate combines what the driver reports for
+// the compiled kernel (maximum work-group size, which Mali lowers with
+// register use, private memory of spilled registers, local memory) with
+// a register count estimated from the blocking the program declares:
+// accumulators for blocking x blocking elements of C plus vectors of
+// blocking rows of A and of B, vector width elements each, plus one
+// register for addresses and counters.
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_OCCUPANCY_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_OCCUPANCY_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <CL/cl.h>
+
+#include "ndrange.hpp"
+
+
+// Maximum number of active work-items on one Mali Midgard core
+const size_t MALI_MAX_ACTIVE_WORK_ITEMS = 256;
+
+
+struct OccupancyEstimate
+{
+    size_t registers;       // estimated 128-bit registers per work-item, 0 if blocking is unknown
+    size_t model_work_items;    // active work-items per core for that number of registers
+    size_t active_work_items;   // also limited by the driver, local memory and whole work-groups
+    double occupancy;           // active_work_items of MALI_MAX_ACTIVE_WORK_ITEMS
+    bool spills;
+    std::vector<std::string> warnings;  // reasons to expect a variant to underperform
+};
+
+
+// True if CL_DEVICE_NAME or CL_DEVICE_VENDOR names Mali or ARM:
+// the model below is of Mali Midgard cores only.
+bool isMaliDevice (cl_device_id device);
+
+// Active work-items per core for registers used by a work-item.
+size_t maliActiveWorkItems (size_t registers);
+
+// work_group_size is the number of work-items in the work-groups the
+// variant is launched with; device_local_mem_size is CL_DEVICE_LOCAL_MEM_SIZE.
+OccupancyEstimate estimateOccupancy (
+    const GEMMKernelMetadata& metadata,
+    size_t size_of_element,
+    size_t work_group_size,
+    cl_ulong device_local_mem_size
+);
+
+
+#endif  // end of the include guard
@@ -0,0 +1,204 @@
+// Selection of the row stride of matrices in device memory, see padding.hpp.
+
+
+#include <cassert>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "basic.hpp"
+#include "padding.hpp"
+#include "gemmkernel.hpp"
+
+using namespace std;
+
+
+namespace
+{
+
+// Zero-filled device buffer released at the end of the scope.
+struct ProbeBuffer
+{
+    cl_mem buffer;
+
+    ProbeBuffer (cl_context context, size_t size) :
+        buffer(0)
+    {
+        // Content does not affect the result, but uninitialized memory
+        // can hold denormals or NaNs, which are slower on some devices.
+        vector<char> zeros(size, 0);
+
+        cl_int err = 0;
+        buffer = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, size, &zeros[0], &err);
+        SAMPLE_CHECK_ERRORS(err);
+    }
+
+    ~ProbeBuffer ()
+    {
+        try
+        {
+            cl_int err = clReleaseMemObject(buffer);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+        catch(...)
+        {
+            destructorException();
+        }
+    }
+
+private:
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    ProbeBuffer (const ProbeBuffer&);
+    ProbeBuffer& operator= (const ProbeBuffer&);
+};
+
+}
+
+
+PaddingPolicy parsePaddingPolicy (const string& name)
+{
+    if(name == "none")
+    {
+        return PADDING_NONE;
+    }
+
+    if(name == "model")
+    {
+        return PADDING_MODEL;
+    }
+
+    if(name == "probe")
+    {
+        return PADDING_PROBE;
+    }
+
+    throw Error("Cannot recognize " + inquotes(name) + " as a padding policy");
+}
+
+
+size_t paddingGranularity (cl_device_id device, size_t row_alignment)
+{
+    cl_uint cacheline = 0;
+    cl_int err = clGetDeviceInfo(
+        device,
+        CL_DEVICE_GLOBAL_MEM_CACHELINE_SIZE,
+        sizeof(cacheline),
+        &cacheline,
+        0
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    // Padding by whole granules keeps rows aligned.
+    return round_up_aligned(max(size_t(cacheline), row_alignment), row_alignment);
+}
+
+
+size_t modelRowStride (
+    PaddingPolicy policy,
+    size_t size,
+    size_t size_of_element,
+    size_t row_alignment,
+    size_t granularity
+)
+{
+    size_t stride = round_up_aligned(size*size_of_element, row_alignment);
+
+    // Rows that already start at different offsets inside the interleaving
+    // period cannot collide systematically; otherwise an even multiple of
+    // granularity maps every second row (and for large powers of two
+    // every row) to the same bank.
+    if(policy == PADDING_MODEL && stride % granularity == 0 && (stride/granularity) % 2 == 0)
+    {
+        stride += granularity;
+    }
+
+    assert(stride % size_of_element == 0);
+    return stride/size_of_element;
+}
+
+
+size_t probeRowStride (
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable,
+    size_t size,
+    size_t size_of_element,
+    size_t row_alignment,
+    size_t granularity,
+    const size_t global_size[2],
+    const size_t local_size[2],
+    size_t candidates,
+    size_t launches
+)
+{
+    assert(candidates > 0 && launches > 0);
+    assert(granularity % size_of_element == 0);
+
+    size_t aligned = modelRowStride(PADDING_NONE, size, size_of_element, row_alignment, granularity);
+    size_t step = granularity/size_of_element;
+    size_t max_stride = aligned + (candidates - 1)*step;
+
+    if(max_stride > size_t(numeric_limits<int>::max()))
+    {
+        throw Error(
+            "Memory row stride in elements " + to_str(max_stride) +
+            " cannot be represented as type int, which can be maximum " +
+            to_str(numeric_limits<int>::max()) + "."
+        );
+    }
+
+    // The same buffers serve all candidates: they are big enough for the largest stride.
+    size_t buffer_size = size*max_stride*size_of_element;
+    ProbeBuffer A(oclobjects.context, buffer_size);
+    ProbeBuffer B(oclobjects.context, buffer_size);
+    ProbeBuffer C(oclobjects.context, buffer_size);
+
+    cl_kernel kernel = executable.kernel;
+    size_t best_stride = aligned;
+    double best_time = numeric_limits<double>::max();
+
+    for(size_t c = 0; c < candidates; ++c)
+    {
+        size_t stride = aligned + c*step;
+        setGEMMTNArgs(kernel, A.buffer, stride, B.buffer, stride, C.buffer, stride, size);
+
+        double time = numeric_limits<double>::max();
+
+        // The first launch is a warm-up and is not counted.
+        for(size_t l = 0; l <= launches; ++l)
+        {
+            double start = time_stamp();
+
+            cl_int err = clEnqueueNDRangeKernel(
+                oclobjects.queue,
+                kernel,
+                2,
+                0,
+                global_size,
+                local_size,
+                0, 0, 0
+            );
+            SAMPLE_CHECK_ERRORS(err);
+
+            err = clFinish(oclobjects.queue);
+            SAMPLE_CHECK_ERRORS(err);
+
+            if(l > 0)
+            {
+                time = min(time, time_stamp() - start);
+            }
+        }
+
+        cout
+            << "Padding probe: row stride " << stride*size_of_element << " bytes, "
+            << "kernel time " << time << " sec.\n";
+
+        if(time < best_time)
+        {
+            best_time = time;
+            best_stride = stride;
+        }
+    }
+
+    return best_stride;
+}
@@ -0,0 +1,71 @@
+// Selection of the row stride of matrices in device memory.
+//
+// When the row stride is a large power of two, the same column of
+// neighbouring rows falls into the same memory bank or channel: work-items
+// that read rows i, i+1, ... at once are served one after another instead
+// of in parallel. A few cache lines of padding at the end of each row
+// spread such accesses over the banks. Policies:
+//   - none: the stride is only rounded up to the row alignment
+//   - model: the stride is made an odd multiple of the interleaving
+//     granularity of the device, so consecutive rows start in different banks
+//   - probe: the kernel is timed with several candidate strides and
+//     the fastest of them is taken
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_PADDING_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_PADDING_HPP_
+
+#include <string>
+
+#include <CL/cl.h>
+
+#include "oclobject.hpp"
+
+
+enum PaddingPolicy
+{
+    PADDING_NONE,
+    PADDING_MODEL,
+    PADDING_PROBE
+};
+
+// Parses the name of a policy as given in --padding option.
+PaddingPolicy parsePaddingPolicy (const std::string& name);
+
+// Granularity of address interleaving between memory banks assumed by
+// the model: global memory cache line of the device rounded up to
+// a multiple of the row alignment.
+size_t paddingGranularity (cl_device_id device, size_t row_alignment);
+
+// Row stride in elements for size x size matrix: size rounded up to
+// row_alignment and, for PADDING_MODEL, padded to an odd multiple of
+// granularity. PADDING_PROBE is not handled here, see probeRowStride.
+size_t modelRowStride (
+    PaddingPolicy policy,
+    size_t size,
+    size_t size_of_element,
+    size_t row_alignment,
+    size_t granularity
+);
+
+// Runs the kernel, which has gemm_tn argument list, on temporary
+// zero-filled size x size matrices with row strides
+// aligned + c*granularity for c in [0, candidates), where aligned is
+// size rounded up to row_alignment, and returns the stride in elements
+// with the smallest time of the given number of launches.
+// Kernel arguments are left set to the temporary buffers.
+size_t probeRowStride (
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable,
+    size_t size,
+    size_t size_of_element,
+    size_t row_alignment,
+    size_t granularity,
+    const size_t global_size[2],
+    const size_t local_size[2],
+    size_t candidates,
+    size_t launches
+);
+
+
+#endif  // end of the include guard
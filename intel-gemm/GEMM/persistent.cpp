@@ -0,0 +1,205 @@
+// Host side of the persistent-threads GEMM mode, see persistent.hpp.
+
+
+#include <algorithm>
+
+#include "persistent.hpp"
+
+using namespace std;
+
+
+PersistentGEMMQueue::PersistentGEMMQueue (
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable,
+    size_t capacity,
+    size_t num_groups,
+    size_t group_size
+) :
+    oclobjects(oclobjects),
+    executable(executable),
+    capacity(capacity),
+    num_groups(num_groups),
+    group_size(group_size),
+    tasks(0),
+    head(0),
+    mapped_tasks(0),
+    num_tasks(0),
+    head_zero(0)
+{
+    assert(capacity > 0);
+
+    if(this->num_groups == 0)
+    {
+        cl_uint compute_units = 0;
+        cl_int err = clGetDeviceInfo(
+            oclobjects.device,
+            CL_DEVICE_MAX_COMPUTE_UNITS,
+            sizeof(compute_units),
+            &compute_units,
+            0
+        );
+        SAMPLE_CHECK_ERRORS(err);
+
+        // Two work-groups per compute unit let one group hide
+        // the latency of taking the next task by another.
+        this->num_groups = 2*max<cl_uint>(compute_units, 1);
+    }
+
+    this->group_size = max<size_t>(
+        1,
+        min(group_size, kernelMaxWorkGroupSize(executable.kernel, oclobjects.device))
+    );
+
+    cl_int err = 0;
+
+    tasks = clCreateBuffer(
+        oclobjects.context,
+        CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR,
+        capacity*sizeof(GEMMTask),
+        0,
+        &err
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    head = clCreateBuffer(
+        oclobjects.context,
+        CL_MEM_READ_WRITE,
+        sizeof(cl_int),
+        0,
+        &err
+    );
+    SAMPLE_CHECK_ERRORS(err);
+}
+
+
+PersistentGEMMQueue::~PersistentGEMMQueue ()
+{
+    try
+    {
+        if(mapped_tasks)
+        {
+            cl_int err = clEnqueueUnmapMemObject(oclobjects.queue, tasks, mapped_tasks, 0, 0, 0);
+            SAMPLE_CHECK_ERRORS(err);
+            err = clFinish(oclobjects.queue);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+
+        if(head)
+        {
+            cl_int err = clReleaseMemObject(head);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+
+        if(tasks)
+        {
+            cl_int err = clReleaseMemObject(tasks);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+    }
+    catch(...)
+    {
+        destructorException();
+    }
+}
+
+
+void PersistentGEMMQueue::map ()
+{
+    assert(!mapped_tasks);
+
+    // Blocking map waits for the previous launch in the in-order
+    // queue, so the tasks are not overwritten while being read.
+    cl_int err = 0;
+    mapped_tasks = (GEMMTask*)clEnqueueMapBuffer(
+        oclobjects.queue,
+        tasks,
+        CL_TRUE,
+        CL_MAP_WRITE,
+        0,
+        capacity*sizeof(GEMMTask),
+        0, 0, 0,
+        &err
+    );
+    SAMPLE_CHECK_ERRORS(err);
+}
+
+
+void PersistentGEMMQueue::append (const GEMMTask& task)
+{
+    if(num_tasks >= capacity)
+    {
+        throw Error(
+            "Persistent GEMM queue is full; capacity is " +
+            to_str(capacity) + " tasks"
+        );
+    }
+
+    if(!mapped_tasks)
+    {
+        map();
+    }
+
+    mapped_tasks[num_tasks++] = task;
+}
+
+
+cl_event PersistentGEMMQueue::launch (
+    cl_mem A,
+    cl_mem B,
+    cl_mem C,
+    size_t first,
+    size_t count
+)
+{
+    assert(first + count <= num_tasks);
+
+    cl_int err = 0;
+
+    if(mapped_tasks)
+    {
+        err = clEnqueueUnmapMemObject(oclobjects.queue, tasks, mapped_tasks, 0, 0, 0);
+        SAMPLE_CHECK_ERRORS(err);
+        mapped_tasks = 0;
+    }
+
+    // head_zero is a member, so the non-blocking write can read it later
+    err = clEnqueueWriteBuffer(oclobjects.queue, head, CL_FALSE, 0, sizeof(head_zero), &head_zero, 0, 0, 0);
+    SAMPLE_CHECK_ERRORS(err);
+
+    cl_int first_task = static_cast<cl_int>(first);
+    cl_int end_task = static_cast<cl_int>(first + count);
+
+    err = clSetKernelArg(executable.kernel, 0, sizeof(cl_mem), &tasks);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(executable.kernel, 1, sizeof(cl_int), &first_task);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(executable.kernel, 2, sizeof(cl_int), &end_task);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(executable.kernel, 3, sizeof(cl_mem), &head);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(executable.kernel, 4, sizeof(cl_mem), &A);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(executable.kernel, 5, sizeof(cl_mem), &B);
+    SAMPLE_CHECK_ERRORS(err);
+    err = clSetKernelArg(executable.kernel, 6, sizeof(cl_mem), &C);
+    SAMPLE_CHECK_ERRORS(err);
+
+    size_t global_size = num_groups*group_size;
+
+    cl_event event = 0;
+    err = clEnqueueNDRangeKernel(
+        oclobjects.queue,
+        executable.kernel,
+        1,
+        0,
+        &global_size,
+        &group_size,
+        0, 0, &event
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    err = clFlush(oclobjects.queue);
+    SAMPLE_CHECK_ERRORS(err);
+
+    return event;
+}
@@ -0,0 +1,119 @@
+// Host side of the persistent-threads GEMM mode.
+//
+// Small multiplications are appended by the host to a work queue that lives
+// in a device buffer. One launch of gemm_tn_persistent (see gemm-persistent.cl)
+// with a fixed grid of work-groups then drains the whole queue, so the kernel
+// launch latency is paid once per batch instead of once per multiplication.
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_PERSISTENT_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_PERSISTENT_HPP_
+
+#include <CL/cl.h>
+
+#include "oclobject.hpp"
+
+
+// Descriptor of one multiplication in the work queue:
+// C[i*ldc + j] = sum over l of A[i*lda + l] * B[j*ldb + l]
+// for 0 <= i < m, 0 <= j < n, 0 <= l < k.
+// Offsets are in elements from the beginning of the corresponding buffer.
+// Layout should match TASK_INTS descriptor in gemm-persistent.cl.
+struct GEMMTask
+{
+    cl_int m;
+    cl_int n;
+    cl_int k;
+    cl_int lda;
+    cl_int ldb;
+    cl_int ldc;
+    cl_int a_offset;
+    cl_int b_offset;
+    cl_int c_offset;
+    cl_int reserved;
+};
+
+
+// Work queue for gemm_tn_persistent kernel.
+// The queue is a CL_MEM_ALLOC_HOST_PTR buffer, which is kept mapped while
+// the host appends tasks and is unmapped right before the launch.
+class PersistentGEMMQueue
+{
+public:
+
+    // Creates the queue for up to capacity tasks.
+    // num_groups == 0 selects two work-groups per compute unit;
+    // group_size is limited by the maximum work-group size for the kernel.
+    PersistentGEMMQueue (
+        OpenCLBasic& oclobjects,
+        OpenCLProgramOneKernel& executable,
+        size_t capacity,
+        size_t num_groups,
+        size_t group_size
+    );
+
+    ~PersistentGEMMQueue ();
+
+    // Appends one task. Blocks if the previous launch is still
+    // reading the queue.
+    void append (const GEMMTask& task);
+
+    // Launches a single kernel that executes count tasks starting
+    // from first over matrices A, B and C. The tasks stay in the queue.
+    // Returned event should be released by the caller.
+    cl_event launch (cl_mem A, cl_mem B, cl_mem C, size_t first, size_t count);
+
+    // Removes all tasks; the next append waits till the launches
+    // that read them are finished.
+    void clear ()
+    {
+        num_tasks = 0;
+    }
+
+    // Launches all appended tasks and empties the queue.
+    cl_event flush (cl_mem A, cl_mem B, cl_mem C)
+    {
+        cl_event event = launch(A, B, C, 0, num_tasks);
+        clear();
+        return event;
+    }
+
+    size_t size () const
+    {
+        return num_tasks;
+    }
+
+    size_t numGroups () const
+    {
+        return num_groups;
+    }
+
+    size_t groupSize () const
+    {
+        return group_size;
+    }
+
+private:
+
+    void map ();
+
+    OpenCLBasic& oclobjects;
+    OpenCLProgramOneKernel& executable;
+
+    size_t capacity;
+    size_t num_groups;
+    size_t group_size;
+
+    cl_mem tasks;   // capacity descriptors
+    cl_mem head;    // one int: index of the next task to take
+    GEMMTask* mapped_tasks; // non-zero when tasks buffer is mapped
+    size_t num_tasks;
+    const cl_int head_zero; // source for resetting head before each launch
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    PersistentGEMMQueue (const PersistentGEMMQueue&);
+    PersistentGEMMQueue& operator= (const PersistentGEMMQueue&);
+};
+
+
+#endif  // end of the include guard
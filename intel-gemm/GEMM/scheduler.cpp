@@ -0,0 +1,255 @@
+// Priority-aware dispatch of GEMM with row-panel chunking, see scheduler.hpp.
+
+
+#include <algorithm>
+#include <cassert>
+
+#include "basic.hpp"
+#include "scheduler.hpp"
+#include "gemmkernel.hpp"
+
+using namespace std;
+
+
+PriorityGEMMScheduler::PriorityGEMMScheduler (
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable,
+    size_t blocking,
+    size_t local_size,
+    double chunk_budget,
+    size_t max_in_flight
+) :
+    oclobjects(oclobjects),
+    kernel(executable.kernel),
+    blocking(blocking),
+    local_size(local_size),
+    chunk_budget(chunk_budget),
+    max_in_flight(max<size_t>(max_in_flight, 1)),
+    pending_jobs(0),
+    launch_count(0),
+    throughput(0)
+{
+    assert(blocking > 0 && local_size > 0);
+}
+
+
+PriorityGEMMScheduler::~PriorityGEMMScheduler ()
+{
+    try
+    {
+        cl_int err = clFinish(oclobjects.queue);
+        SAMPLE_CHECK_ERRORS(err);
+
+        for(size_t i = 0; i < in_flight.size(); ++i)
+        {
+            err = clReleaseEvent(in_flight[i].event);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+    }
+    catch(...)
+    {
+        destructorException();
+    }
+}
+
+
+size_t PriorityGEMMScheduler::submit (const ScheduledGEMM& gemm, GEMMPriority priority)
+{
+    if(gemm.size == 0 || gemm.size % (blocking*local_size) != 0)
+    {
+        throw Error(
+            "Size " + to_str(gemm.size) + " of scheduled GEMM should be a positive multiple of " +
+            to_str(blocking*local_size) + " (blocking by work-group size)"
+        );
+    }
+
+    Job job;
+    job.gemm = gemm;
+    job.priority = priority;
+    job.next_row = 0;
+    job.chunks_in_flight = 0;
+    job.finished = false;
+    job.submit_time = time_stamp();
+    job.finish_time = 0;
+
+    jobs.push_back(job);
+    classes[priority].push_back(jobs.size() - 1);
+    ++pending_jobs;
+
+    return jobs.size() - 1;
+}
+
+
+void PriorityGEMMScheduler::dispatch ()
+{
+    retire();
+
+    bool enqueued = false;
+
+    while(in_flight.size() < max_in_flight)
+    {
+        int priority = 0;
+        while(priority < GEMM_PRIORITY_CLASSES && classes[priority].empty())
+        {
+            ++priority;
+        }
+
+        if(priority == GEMM_PRIORITY_CLASSES)
+        {
+            break;
+        }
+
+        size_t job = classes[priority].front();
+        enqueueChunk(job);
+        enqueued = true;
+
+        if(jobs[job].next_row == jobs[job].gemm.size)
+        {
+            classes[priority].pop_front();
+        }
+    }
+
+    // Chunks should start without waiting for a blocking call.
+    if(enqueued)
+    {
+        cl_int err = clFlush(oclobjects.queue);
+        SAMPLE_CHECK_ERRORS(err);
+    }
+}
+
+
+void PriorityGEMMScheduler::wait ()
+{
+    while(!idle())
+    {
+        dispatch();
+
+        if(!in_flight.empty())
+        {
+            cl_int err = clWaitForEvents(1, &in_flight.front().event);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+    }
+}
+
+
+void PriorityGEMMScheduler::retire ()
+{
+    // The queue is in-order, so chunks finish in the order of enqueuing.
+    while(!in_flight.empty())
+    {
+        Chunk& chunk = in_flight.front();
+
+        cl_int status = CL_COMPLETE;
+        cl_int err = clGetEventInfo(
+            chunk.event,
+            CL_EVENT_COMMAND_EXECUTION_STATUS,
+            sizeof(status),
+            &status,
+            0
+        );
+        SAMPLE_CHECK_ERRORS(err);
+
+        if(status < 0)
+        {
+            throw Error("GEMM chunk terminated with error " + opencl_error_to_str(status));
+        }
+
+        if(status != CL_COMPLETE)
+        {
+            break;
+        }
+
+        Job& job = jobs[chunk.job];
+        double size = double(job.gemm.size);
+        double time = eventExecutionTime(chunk.event);
+
+        if(time > 0)
+        {
+            double chunk_throughput = chunk.rows*size*(size + size)/time;
+
+            // Smoothed, so one slow chunk does not halve the next ones.
+            throughput = throughput == 0 ? chunk_throughput : 0.75*throughput + 0.25*chunk_throughput;
+        }
+
+        err = clReleaseEvent(chunk.event);
+        SAMPLE_CHECK_ERRORS(err);
+
+        --job.chunks_in_flight;
+        if(job.chunks_in_flight == 0 && job.next_row == job.gemm.size)
+        {
+            job.finished = true;
+            job.finish_time = time_stamp();
+            --pending_jobs;
+        }
+
+        in_flight.pop_front();
+    }
+}
+
+
+size_t PriorityGEMMScheduler::chunkRows (const Job& job) const
+{
+    size_t remaining = job.gemm.size - job.next_row;
+
+    if(chunk_budget <= 0)
+    {
+        return remaining;
+    }
+
+    // Rows of a chunk are a multiple of the rows of one work-group.
+    size_t panel = blocking*local_size;
+
+    // The first chunk measures the throughput.
+    if(throughput == 0)
+    {
+        return panel;
+    }
+
+    double size = double(job.gemm.size);
+    double rows = chunk_budget*throughput/(size*(size + size));
+    size_t panels = max<size_t>(1, size_t(rows/panel));
+
+    return min(remaining, panels*panel);
+}
+
+
+void PriorityGEMMScheduler::enqueueChunk (size_t job_index)
+{
+    Job& job = jobs[job_index];
+    size_t rows = chunkRows(job);
+
+    setGEMMTNArgs(
+        kernel,
+        job.gemm.A, job.gemm.ld,
+        job.gemm.B, job.gemm.ld,
+        job.gemm.C, job.gemm.ld,
+        job.gemm.size
+    );
+
+    // Rows of C are along dimension 0: the offset selects the panel.
+    size_t global_offset[2] = { job.next_row/blocking, 0 };
+    size_t global_size[2] = { rows/blocking, job.gemm.size/blocking };
+    size_t local[2] = { local_size, local_size };
+
+    Chunk chunk;
+    chunk.job = job_index;
+    chunk.rows = rows;
+    chunk.event = 0;
+
+    cl_int err = clEnqueueNDRangeKernel(
+        oclobjects.queue,
+        kernel,
+        2,
+        global_offset,
+        global_size,
+        local,
+        0, 0, &chunk.event
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    in_flight.push_back(chunk);
+    job.next_row += rows;
+    ++job.chunks_in_flight;
+    ++launch_count;
+}
@@ -0,0 +1,149 @@
+// Priority-aware dispatch of GEMM with row-panel chunking.
+//
+// The device queue is in-order: a small urgent multiplication enqueued
+// after a huge one waits till the huge one is finished. The scheduler
+// keeps jobs in priority classes and enqueues them incrementally, as
+// chunks of rows of C (launches with a global work offset), with at most
+// a few chunks in the device queue at a time. A high-priority job then
+// waits for the chunks already in the queue only.
+//
+// Chunk size comes from a time budget: the throughput measured from
+// profiling events of finished chunks gives the number of rows that fit
+// in the budget. Short chunks also keep every launch below GPU watchdog
+// limits. The queue should be created with CL_QUEUE_PROFILING_ENABLE.
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_SCHEDULER_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_SCHEDULER_HPP_
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#include <CL/cl.h>
+
+#include "oclobject.hpp"
+
+
+enum GEMMPriority
+{
+    PRIORITY_HIGH = 0,
+    PRIORITY_NORMAL = 1,
+    PRIORITY_BACKGROUND = 2
+};
+
+const int GEMM_PRIORITY_CLASSES = 3;
+
+
+// C = A*B for size x size matrices with row stride ld laid out as the
+// kernel from gemm.cl expects.
+struct ScheduledGEMM
+{
+    cl_mem A;
+    cl_mem B;
+    cl_mem C;
+    size_t size;
+    size_t ld;
+};
+
+
+class PriorityGEMMScheduler
+{
+public:
+
+    // blocking is the number of elements of C computed by one work-item in
+    // each dimension. chunk_budget is the target execution time of one
+    // chunk in seconds; 0 disables chunking, every job is one launch.
+    // max_in_flight is the number of chunks kept in the device queue.
+    PriorityGEMMScheduler (
+        OpenCLBasic& oclobjects,
+        OpenCLProgramOneKernel& executable,
+        size_t blocking,
+        size_t local_size,
+        double chunk_budget,
+        size_t max_in_flight = 2
+    );
+
+    // Waits for all chunks in the device queue.
+    ~PriorityGEMMScheduler ();
+
+    // Adds a job and returns its identifier. Jobs of one priority class
+    // are dispatched in the order of submission. Nothing is enqueued
+    // till the next dispatch.
+    size_t submit (const ScheduledGEMM& gemm, GEMMPriority priority);
+
+    // Retires finished chunks and enqueues the next chunks of the most
+    // urgent jobs while the device queue has room. Does not block.
+    void dispatch ();
+
+    // Dispatches till all submitted jobs are finished.
+    void wait ();
+
+    bool idle () const
+    {
+        return in_flight.empty() && pending_jobs == 0;
+    }
+
+    bool finished (size_t job) const
+    {
+        return jobs[job].finished;
+    }
+
+    // Host time from submission till the last chunk is retired, in seconds.
+    double latency (size_t job) const
+    {
+        return jobs[job].finish_time - jobs[job].submit_time;
+    }
+
+    size_t launches () const
+    {
+        return launch_count;
+    }
+
+private:
+
+    struct Job
+    {
+        ScheduledGEMM gemm;
+        GEMMPriority priority;
+        size_t next_row;        // first row of C that is not enqueued yet
+        size_t chunks_in_flight;
+        bool finished;
+        double submit_time;
+        double finish_time;
+    };
+
+    struct Chunk
+    {
+        size_t job;
+        size_t rows;
+        cl_event event;
+    };
+
+    OpenCLBasic& oclobjects;
+    cl_kernel kernel;
+    size_t blocking;
+    size_t local_size;
+    double chunk_budget;
+    size_t max_in_flight;
+
+    std::vector<Job> jobs;
+    std::deque<size_t> classes[GEMM_PRIORITY_CLASSES];  // jobs with rows to enqueue
+    std::deque<Chunk> in_flight;    // in the order of the in-order queue
+    size_t pending_jobs;            // submitted and not finished
+    size_t launch_count;
+
+    // Measured device throughput of chunks in FLOPS, 0 till the first one
+    double throughput;
+
+    void retire ();
+    void enqueueChunk (size_t job);
+    size_t chunkRows (const Job& job) const;
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    PriorityGEMMScheduler (const PriorityGEMMScheduler&);
+    PriorityGEMMScheduler& operator= (const PriorityGEMMScheduler&);
+};
+
+
+#endif  // end of the include guard
@@ -0,0 +1,952 @@
+// Local GEMM service: a long-lived daemon and its client library,
+// see service.hpp.
+
+
+#include "service.hpp"
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "basic.hpp"
+
+using namespace std;
+
+
+namespace
+{
+
+volatile sig_atomic_t service_stop = 0;
+
+void stopService (int)
+{
+    service_stop = 1;
+}
+
+
+string systemErrorToStr (const string& call)
+{
+    return call + " failed: " + strerror(errno);
+}
+
+
+sockaddr_un socketAddress (const string& path)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if(path.empty() || path.size() >= sizeof(address.sun_path))
+    {
+        throw Error(
+            "Socket path " + inquotes(path) + " should be from 1 to " +
+            to_str(sizeof(address.sun_path) - 1) + " characters long"
+        );
+    }
+
+    strcpy(address.sun_path, path.c_str());
+    return address;
+}
+
+
+// Sends all bytes, returns false if the peer is gone.
+// An attached descriptor is sent with the first byte.
+bool sendFully (int fd, const void* data, size_t size, int attached_fd = -1)
+{
+    const char* bytes = static_cast<const char*>(data);
+
+    while(size > 0)
+    {
+        iovec io = { const_cast<char*>(bytes), size };
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &io;
+        message.msg_iovlen = 1;
+
+        char control[CMSG_SPACE(sizeof(int))];
+        if(attached_fd >= 0)
+        {
+            memset(control, 0, sizeof(control));
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+
+            cmsghdr* header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(header), &attached_fd, sizeof(int));
+        }
+
+        ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if(sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if(sent <= 0)
+        {
+            return false;
+        }
+
+        bytes += sent;
+        size -= sent;
+        attached_fd = -1;
+    }
+
+    return true;
+}
+
+
+// Receives exactly size bytes, returns false if the peer is gone.
+bool receiveFully (int fd, void* data, size_t size)
+{
+    char* bytes = static_cast<char*>(data);
+
+    while(size > 0)
+    {
+        ssize_t received = recv(fd, bytes, size, 0);
+        if(received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if(received <= 0)
+        {
+            return false;
+        }
+
+        bytes += received;
+        size -= received;
+    }
+
+    return true;
+}
+
+
+// Receives up to size bytes without blocking. Returns the number of bytes
+// received, 0 if none are available yet, or -1 if the peer is gone.
+// If attached_fd is given, a descriptor sent with the data is stored to it.
+ssize_t receiveAvailable (int fd, void* data, size_t size, int* attached_fd = 0)
+{
+    for(;;)
+    {
+        iovec io = { data, size };
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &io;
+        message.msg_iovlen = 1;
+
+        char control[CMSG_SPACE(sizeof(int))];
+        if(attached_fd)
+        {
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+        }
+
+        ssize_t received = recvmsg(fd, &message, MSG_DONTWAIT);
+        if(received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if(received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return 0;
+        }
+
+        if(received <= 0)
+        {
+            return -1;
+        }
+
+        if(attached_fd)
+        {
+            for(cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header))
+            {
+                if(header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+                {
+                    memcpy(attached_fd, CMSG_DATA(header), sizeof(int));
+                }
+            }
+        }
+
+        return received;
+    }
+}
+
+
+// Sends as many of size bytes as the socket takes without blocking.
+// Returns the number of bytes sent or -1 if the peer is gone.
+ssize_t sendAvailable (int fd, const void* data, size_t size)
+{
+    for(;;)
+    {
+        ssize_t sent = send(fd, data, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if(sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return 0;
+        }
+
+        return sent < 0 ? -1 : sent;
+    }
+}
+
+
+bool readable (int fd)
+{
+    pollfd descriptor = { fd, POLLIN, 0 };
+    return poll(&descriptor, 1, 0) > 0 && (descriptor.revents & POLLIN);
+}
+
+
+// Anonymous file for the shared memory segment: it is unlinked at once,
+// so it disappears with the last descriptor and mapping.
+int createSegmentFile (size_t size)
+{
+    const char* directories[] = { "/dev/shm", "/data/local/tmp", "/tmp" };
+
+    for(size_t d = 0; d < sizeof(directories)/sizeof(directories[0]); ++d)
+    {
+        string path = string(directories[d]) + "/intelgemm-segment-XXXXXX";
+        vector<char> name(path.begin(), path.end());
+        name.push_back(0);
+
+        int fd = mkstemp(&name[0]);
+        if(fd < 0)
+        {
+            continue;
+        }
+
+        unlink(&name[0]);
+
+        if(ftruncate(fd, off_t(size)) != 0)
+        {
+            close(fd);
+            throw Error(systemErrorToStr("ftruncate for shared memory segment"));
+        }
+
+        return fd;
+    }
+
+    throw Error("Cannot create a file for shared memory segment in /dev/shm or /tmp");
+}
+
+
+// Checks that a matrix of rows x columns elements at offset lies inside of the segment.
+bool insideSegment (uint64_t offset, uint64_t rows, uint64_t columns, size_t element_size, size_t segment_size)
+{
+    uint64_t elements = segment_size/element_size;
+    return
+        offset % element_size == 0 &&
+        offset <= segment_size &&
+        columns <= elements/rows &&
+        rows*columns*element_size <= segment_size - offset;
+}
+
+}
+
+
+GEMMServiceClient::GEMMServiceClient (
+    const string& socket_path,
+    size_t segment_size,
+    size_t element_size
+) :
+    socket_fd(-1),
+    segment_base(0),
+    segment_size(segment_size)
+{
+    sockaddr_un address = socketAddress(socket_path);
+
+    socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(socket_fd < 0)
+    {
+        throw Error(systemErrorToStr("socket"));
+    }
+
+    if(connect(socket_fd, (sockaddr*)&address, sizeof(address)) != 0)
+    {
+        string message = systemErrorToStr("connect to " + inquotes(socket_path));
+        close(socket_fd);
+        throw Error(message + "; is the daemon started with --mode serve?");
+    }
+
+    int segment_fd = -1;
+
+    try
+    {
+        segment_fd = createSegmentFile(segment_size);
+
+        void* base = mmap(0, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, segment_fd, 0);
+        if(base == MAP_FAILED)
+        {
+            throw Error(systemErrorToStr("mmap for shared memory segment"));
+        }
+
+        segment_base = static_cast<char*>(base);
+
+        ServiceHello hello;
+        hello.magic = SERVICE_MAGIC;
+        hello.element_size = uint32_t(element_size);
+        hello.segment_size = segment_size;
+
+        ServiceResponse response;
+
+        if(
+            !sendFully(socket_fd, &hello, sizeof(hello), segment_fd) ||
+            !receiveFully(socket_fd, &response, sizeof(response))
+        )
+        {
+            throw Error("GEMM service closed the connection");
+        }
+
+        // The daemon keeps its own mapping.
+        close(segment_fd);
+        segment_fd = -1;
+
+        if(response.status != SERVICE_OK)
+        {
+            throw Error(
+                "GEMM service rejected the connection; elements of " +
+                to_str(element_size) + " bytes may not match its arithmetic"
+            );
+        }
+    }
+    catch(...)
+    {
+        if(segment_fd >= 0)
+        {
+            close(segment_fd);
+        }
+
+        if(segment_base)
+        {
+            munmap(segment_base, segment_size);
+        }
+
+        close(socket_fd);
+        throw;
+    }
+}
+
+
+GEMMServiceClient::~GEMMServiceClient ()
+{
+    munmap(segment_base, segment_size);
+    close(socket_fd);
+}
+
+
+void GEMMServiceClient::submit (const ServiceRequest& request)
+{
+    if(!sendFully(socket_fd, &request, sizeof(request)))
+    {
+        throw Error("GEMM service closed the connection");
+    }
+}
+
+
+ServiceResponse GEMMServiceClient::receive ()
+{
+    ServiceResponse response;
+    if(!receiveFully(socket_fd, &response, sizeof(response)))
+    {
+        throw Error("GEMM service closed the connection");
+    }
+
+    return response;
+}
+
+
+ServiceResponse GEMMServiceClient::call (const ServiceRequest& request)
+{
+    submit(request);
+    ServiceResponse response = receive();
+
+    if(response.status != SERVICE_OK)
+    {
+        throw Error(
+            "GEMM service failed request " + to_str(request.id) + " of " +
+            to_str(request.m) + "x" + to_str(request.n) + "x" + to_str(request.k) +
+            " with status " + to_str(response.status)
+        );
+    }
+
+    return response;
+}
+
+
+template <typename T>
+GEMMService<T>::GEMMService (
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable,
+    const string& socket_path,
+    size_t max_batch,
+    size_t num_groups,
+    size_t group_size,
+    size_t pool_capacity,
+    ShapeTraceWriter* trace
+) :
+    oclobjects(oclobjects),
+    work_queue(oclobjects, executable, max_batch, num_groups, group_size),
+    pool(oclobjects, pool_capacity),
+    socket_path(socket_path),
+    max_batch(max_batch),
+    listen_fd(-1),
+    trace(trace)
+{
+    sockaddr_un address = socketAddress(socket_path);
+
+    // A socket left by a daemon that was killed
+    struct stat info;
+    if(stat(socket_path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+    {
+        unlink(socket_path.c_str());
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listen_fd < 0)
+    {
+        throw Error(systemErrorToStr("socket"));
+    }
+
+    if(
+        bind(listen_fd, (sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listen_fd, SOMAXCONN) != 0
+    )
+    {
+        string message = systemErrorToStr("bind to " + inquotes(socket_path));
+        close(listen_fd);
+        throw Error(message);
+    }
+}
+
+
+template <typename T>
+GEMMService<T>::~GEMMService ()
+{
+    while(!connections.empty())
+    {
+        disconnect(connections.begin()->first);
+    }
+
+    close(listen_fd);
+    unlink(socket_path.c_str());
+}
+
+
+template <typename T>
+void GEMMService<T>::run ()
+{
+    struct sigaction action, old_int, old_term;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopService;
+
+    // No SA_RESTART: poll returns on the signal.
+    sigaction(SIGINT, &action, &old_int);
+    sigaction(SIGTERM, &action, &old_term);
+    service_stop = 0;
+
+    try
+    {
+        vector<pollfd> descriptors;
+
+        while(!service_stop)
+        {
+            descriptors.clear();
+
+            pollfd listening = { listen_fd, POLLIN, 0 };
+            descriptors.push_back(listening);
+
+            // Responses that did not fit in the socket wait for POLLOUT.
+            for(typename map<int, Connection>::const_iterator i = connections.begin(); i != connections.end(); ++i)
+            {
+                short events = POLLIN | (i->second.output.empty() ? 0 : POLLOUT);
+                pollfd client = { i->first, events, 0 };
+                descriptors.push_back(client);
+            }
+
+            if(poll(&descriptors[0], descriptors.size(), -1) < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+
+                throw Error(systemErrorToStr("poll"));
+            }
+
+            if(descriptors[0].revents & POLLIN)
+            {
+                accept();
+            }
+
+            for(size_t d = 1; d < descriptors.size(); ++d)
+            {
+                if(descriptors[d].revents & POLLOUT)
+                {
+                    flush(descriptors[d].fd);
+                }
+
+                if(!(descriptors[d].revents & ~POLLOUT))
+                {
+                    continue;
+                }
+
+                // Everything a client has sent so far joins this round.
+                bool open = true;
+                do
+                {
+                    open = receive(descriptors[d].fd);
+                }
+                while(open && readable(descriptors[d].fd));
+
+                if(!open)
+                {
+                    disconnect(descriptors[d].fd);
+                }
+            }
+
+            execute();
+        }
+    }
+    catch(...)
+    {
+        sigaction(SIGINT, &old_int, 0);
+        sigaction(SIGTERM, &old_term, 0);
+        throw;
+    }
+
+    sigaction(SIGINT, &old_int, 0);
+    sigaction(SIGTERM, &old_term, 0);
+}
+
+
+template <typename T>
+void GEMMService<T>::accept ()
+{
+    int fd = ::accept(listen_fd, 0, 0);
+    if(fd < 0)
+    {
+        return;
+    }
+
+    connections[fd] = Connection();
+    ++stats.clients;
+}
+
+
+template <typename T>
+bool GEMMService<T>::receive (int fd)
+{
+    Connection& connection = connections[fd];
+
+    // The socket is read without blocking: a message that has arrived
+    // in part is kept in the connection and completed by later rounds.
+    size_t message_size = connection.segment_base ? sizeof(ServiceRequest) : sizeof(ServiceHello);
+    size_t received = connection.message.size();
+    connection.message.resize(message_size);
+
+    int segment_fd = -1;
+    ssize_t count = receiveAvailable(
+        fd,
+        &connection.message[received],
+        message_size - received,
+        connection.segment_base ? 0 : &segment_fd
+    );
+
+    connection.message.resize(received + max<ssize_t>(count, 0));
+
+    if(segment_fd >= 0)
+    {
+        if(connection.segment_fd >= 0)
+        {
+            close(connection.segment_fd);
+        }
+
+        connection.segment_fd = segment_fd;
+    }
+
+    if(count < 0)
+    {
+        return false;
+    }
+
+    if(connection.message.size() < message_size)
+    {
+        return true;
+    }
+
+    if(!connection.segment_base)
+    {
+        ServiceHello hello;
+        memcpy(&hello, &connection.message[0], sizeof(hello));
+        connection.message.clear();
+
+        segment_fd = connection.segment_fd;
+        connection.segment_fd = -1;
+
+        void* base = MAP_FAILED;
+        struct stat info;
+
+        // The segment should be as large as the client says:
+        // pages beyond the end of the file fault with SIGBUS.
+        if(
+            segment_fd >= 0 &&
+            hello.magic == SERVICE_MAGIC &&
+            hello.element_size == sizeof(T) &&
+            hello.segment_size > 0 &&
+            fstat(segment_fd, &info) == 0 &&
+            uint64_t(info.st_size) >= hello.segment_size
+        )
+        {
+            base = mmap(0, hello.segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, segment_fd, 0);
+        }
+
+        if(segment_fd >= 0)
+        {
+            close(segment_fd);
+        }
+
+        if(base == MAP_FAILED)
+        {
+            respond(fd, 0, SERVICE_BAD_REQUEST, 0);
+            return false;
+        }
+
+        connection.segment_base = static_cast<char*>(base);
+        connection.segment_size = hello.segment_size;
+        respond(fd, 0, SERVICE_OK, 0);
+        return true;
+    }
+
+    Pending pending_request;
+    pending_request.fd = fd;
+    memcpy(&pending_request.request, &connection.message[0], sizeof(pending_request.request));
+    connection.message.clear();
+
+    const ServiceRequest& request = pending_request.request;
+
+    bool valid =
+        request.m > 0 && request.n > 0 && request.k > 0 &&
+        insideSegment(request.a_offset, request.m, request.k, sizeof(T), connection.segment_size) &&
+        insideSegment(request.b_offset, request.n, request.k, sizeof(T), connection.segment_size) &&
+        insideSegment(request.c_offset, request.m, request.n, sizeof(T), connection.segment_size) &&
+        uint64_t(request.m)*request.k <= uint64_t(INT_MAX) &&
+        uint64_t(request.n)*request.k <= uint64_t(INT_MAX) &&
+        uint64_t(request.m)*request.n <= uint64_t(INT_MAX);
+
+    if(!valid)
+    {
+        ++stats.rejected;
+        respond(fd, request.id, SERVICE_BAD_REQUEST, 0);
+        return true;
+    }
+
+    pending.push_back(pending_request);
+    return true;
+}
+
+
+template <typename T>
+void GEMMService<T>::disconnect (int fd)
+{
+    typename map<int, Connection>::iterator connection = connections.find(fd);
+    if(connection == connections.end())
+    {
+        return;
+    }
+
+    if(connection->second.segment_base)
+    {
+        munmap(connection->second.segment_base, connection->second.segment_size);
+    }
+
+    if(connection->second.segment_fd >= 0)
+    {
+        close(connection->second.segment_fd);
+    }
+
+    close(fd);
+    connections.erase(connection);
+
+    // Requests of the client are not computed anymore.
+    size_t kept = 0;
+    for(size_t i = 0; i < pending.size(); ++i)
+    {
+        if(pending[i].fd != fd)
+        {
+            pending[kept++] = pending[i];
+        }
+    }
+    pending.resize(kept);
+}
+
+
+template <typename T>
+void GEMMService<T>::respond (int fd, uint64_t id, ServiceStatus status, size_t batch)
+{
+    ServiceResponse response;
+    response.id = id;
+    response.status = status;
+    response.batch = uint32_t(batch);
+
+    vector<char>& output = connections[fd].output;
+    const char* bytes = reinterpret_cast<const char*>(&response);
+    output.insert(output.end(), bytes, bytes + sizeof(response));
+    flush(fd);
+}
+
+
+template <typename T>
+void GEMMService<T>::flush (int fd)
+{
+    vector<char>& output = connections[fd].output;
+    if(output.empty())
+    {
+        return;
+    }
+
+    // A client that is gone is noticed by the next poll.
+    ssize_t sent = sendAvailable(fd, &output[0], output.size());
+    if(sent < 0)
+    {
+        output.clear();
+    }
+    else
+    {
+        output.erase(output.begin(), output.begin() + sent);
+    }
+}
+
+
+namespace
+{
+
+template <typename Pending>
+bool shapeLess (const Pending& a, const Pending& b)
+{
+    if(a.request.m != b.request.m)
+    {
+        return a.request.m < b.request.m;
+    }
+
+    if(a.request.n != b.request.n)
+    {
+        return a.request.n < b.request.n;
+    }
+
+    return a.request.k < b.request.k;
+}
+
+}
+
+
+template <typename T>
+void GEMMService<T>::execute ()
+{
+    // Requests of the same shape become neighbours,
+    // and are coalesced into batches.
+    stable_sort(pending.begin(), pending.end(), shapeLess<Pending>);
+
+    for(size_t first = 0; first < pending.size(); )
+    {
+        const ServiceRequest& shape = pending[first].request;
+
+        // Offsets of the batch in A, B and C buffers should fit in int.
+        size_t largest = max(
+            size_t(shape.m)*shape.k,
+            max(size_t(shape.n)*shape.k, size_t(shape.m)*shape.n)
+        );
+        size_t limit = max<size_t>(1, min(max_batch, size_t(INT_MAX)/largest));
+
+        size_t count = 1;
+        while(
+            first + count < pending.size() &&
+            count < limit &&
+            !shapeLess(pending[first], pending[first + count]) &&
+            !shapeLess(pending[first + count], pending[first])
+        )
+        {
+            ++count;
+        }
+
+        executeBatch(&pending[first], count);
+        first += count;
+    }
+
+    pending.clear();
+}
+
+
+template <typename T>
+void GEMMService<T>::executeBatch (const Pending* requests, size_t count)
+{
+    const ServiceRequest& shape = requests[0].request;
+    size_t a_elements = size_t(shape.m)*shape.k;
+    size_t b_elements = size_t(shape.n)*shape.k;
+    size_t c_elements = size_t(shape.m)*shape.n;
+    double start = time_stamp();
+    cl_event event = 0;
+
+    try
+    {
+        PooledMemory<T> A(pool, count*a_elements);
+        PooledMemory<T> B(pool, count*b_elements);
+        PooledMemory<T> C(pool, count*c_elements);
+
+        cl_int err = 0;
+
+        // Gather inputs of all requests of the batch
+        OpenCLDeviceAndHostMemory<T>* inputs[2] = { A.memory, B.memory };
+        size_t input_elements[2] = { a_elements, b_elements };
+
+        for(int m = 0; m < 2; ++m)
+        {
+            clEnqueueMapBuffer(
+                oclobjects.queue,
+                inputs[m]->device,
+                CL_TRUE,
+                CL_MAP_WRITE,
+                0,
+                count*input_elements[m]*sizeof(T),
+                0, 0, 0,
+                &err
+            );
+            SAMPLE_CHECK_ERRORS(err);
+
+            for(size_t r = 0; r < count; ++r)
+            {
+                const ServiceRequest& request = requests[r].request;
+                const char* segment = connections[requests[r].fd].segment_base;
+
+                memcpy(
+                    inputs[m]->host + r*input_elements[m],
+                    segment + (m == 0 ? request.a_offset : request.b_offset),
+                    input_elements[m]*sizeof(T)
+                );
+            }
+
+            err = clEnqueueUnmapMemObject(oclobjects.queue, inputs[m]->device, inputs[m]->host, 0, 0, 0);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+
+        GEMMTask task;
+        task.m = static_cast<cl_int>(shape.m);
+        task.n = static_cast<cl_int>(shape.n);
+        task.k = static_cast<cl_int>(shape.k);
+        task.lda = task.k;
+        task.ldb = task.k;
+        task.ldc = task.n;
+        task.reserved = 0;
+
+        work_queue.clear();
+        for(size_t r = 0; r < count; ++r)
+        {
+            task.a_offset = static_cast<cl_int>(r*a_elements);
+            task.b_offset = static_cast<cl_int>(r*b_elements);
+            task.c_offset = static_cast<cl_int>(r*c_elements);
+            work_queue.append(task);
+        }
+
+        event = work_queue.flush(A.memory->device, B.memory->device, C.memory->device);
+
+        // Blocking map waits for the launch in the in-order queue.
+        clEnqueueMapBuffer(
+            oclobjects.queue,
+            C.memory->device,
+            CL_TRUE,
+            CL_MAP_READ,
+            0,
+            count*c_elements*sizeof(T),
+            0, 0, 0,
+            &err
+        );
+        SAMPLE_CHECK_ERRORS(err);
+
+        for(size_t r = 0; r < count; ++r)
+        {
+            memcpy(
+                connections[requests[r].fd].segment_base + requests[r].request.c_offset,
+                C.memory->host + r*c_elements,
+                c_elements*sizeof(T)
+            );
+        }
+
+        err = clEnqueueUnmapMemObject(oclobjects.queue, C.memory->device, C.memory->host, 0, 0, 0);
+        SAMPLE_CHECK_ERRORS(err);
+
+        // Blocks go back to the pool when nothing uses them.
+        err = clFinish(oclobjects.queue);
+        SAMPLE_CHECK_ERRORS(err);
+
+        if(trace)
+        {
+            trace->record(
+                shape.m, shape.n, shape.k,
+                LAYOUT_TN,
+                sizeof(T),
+                time_stamp() - start,
+                eventExecutionTime(event),
+                count
+            );
+        }
+
+        err = clReleaseEvent(event);
+        event = 0;
+        SAMPLE_CHECK_ERRORS(err);
+    }
+    catch(const exception& error)
+    {
+        // Only the requests of this batch fail,
+        // the daemon keeps serving the others.
+        cerr
+            << "GEMM service failed a launch of " << count << " requests of "
+            << shape.m << "x" << shape.n << "x" << shape.k << ": " << error.what() << "\n";
+
+        if(event)
+        {
+            clReleaseEvent(event);
+        }
+
+        stats.failed += count;
+
+        for(size_t r = 0; r < count; ++r)
+        {
+            respond(requests[r].fd, requests[r].request.id, SERVICE_FAILED, count);
+        }
+
+        return;
+    }
+
+    ++stats.launches;
+    stats.requests += count;
+
+    for(size_t r = 0; r < count; ++r)
+    {
+        respond(requests[r].fd, requests[r].request.id, SERVICE_OK, count);
+    }
+}
+
+
+template class GEMMService<float>;
+template class GEMMService<double>;
+
+#endif  // __linux__
@@ -0,0 +1,226 @@
+// Local GEMM service: a long-lived daemon and its client library.
+//
+// Every run of the sample pays for platform and device selection, context
+// creation and kernel compilation before the first multiplication. The
+// daemon pays it once: it owns the OpenCL objects and the compiled
+// gemm_tn_persistent kernel and serves multiplications for clients that
+// connect to a Unix domain socket.
+//
+// Matrices do not go through the socket. A client creates a shared memory
+// segment and passes its file descriptor with the first message; requests
+// then only carry shapes and offsets in the segment, and the daemon writes
+// results back to it. Requests of the same shape that arrive while the
+// daemon is busy are coalesced: they are executed by one launch of the
+// persistent kernel, up to the batch size of the daemon.
+//
+// The service uses POSIX sockets and shared memory and is available on
+// Linux (including Android) only.
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_SERVICE_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_SERVICE_HPP_
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <CL/cl.h>
+
+#include "oclobject.hpp"
+#include "persistent.hpp"
+#include "bufferpool.hpp"
+#include "shapetrace.hpp"
+
+
+const uint32_t SERVICE_MAGIC = 0x47454d4d;  // "GEMM"
+
+enum ServiceStatus
+{
+    SERVICE_OK = 0,
+    SERVICE_BAD_REQUEST = 1,    // inconsistent shape or offsets
+    SERVICE_FAILED = 2          // the daemon could not compute it
+};
+
+// First message of a client; the descriptor of the shared memory segment
+// of segment_size bytes is attached to it. The daemon answers with
+// a ServiceResponse with id 0.
+struct ServiceHello
+{
+    uint32_t magic;
+    uint32_t element_size;  // sizeof(float) or sizeof(double), should match the daemon
+    uint64_t segment_size;
+};
+
+// C = A*transposed(B) in the tn layout of gemm_tn kernels: A is m x k,
+// B is n x k and C is m x n, all packed by rows at byte offsets in the
+// segment of the client.
+struct ServiceRequest
+{
+    uint64_t id;
+    uint32_t m;
+    uint32_t n;
+    uint32_t k;
+    uint32_t reserved;
+    uint64_t a_offset;
+    uint64_t b_offset;
+    uint64_t c_offset;
+};
+
+struct ServiceResponse
+{
+    uint64_t id;
+    int32_t status;     // ServiceStatus
+    uint32_t batch;     // number of requests in the launch that computed this one
+};
+
+
+// Connection of a client to the daemon with its shared memory segment.
+// Requests can be pipelined: several submit calls before receive.
+class GEMMServiceClient
+{
+public:
+
+    GEMMServiceClient (
+        const std::string& socket_path,
+        size_t segment_size,
+        size_t element_size
+    );
+
+    ~GEMMServiceClient ();
+
+    // Shared memory segment for matrices of requests
+    char* segment ()
+    {
+        return segment_base;
+    }
+
+    size_t segmentSize () const
+    {
+        return segment_size;
+    }
+
+    void submit (const ServiceRequest& request);
+
+    // Blocks till the next response; responses come in the order
+    // of execution, which may differ from the order of submission.
+    ServiceResponse receive ();
+
+    // Submits and waits for the only outstanding request.
+    // Throws Error if it is not computed.
+    ServiceResponse call (const ServiceRequest& request);
+
+private:
+
+    int socket_fd;
+    char* segment_base;
+    size_t segment_size;
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    GEMMServiceClient (const GEMMServiceClient&);
+    GEMMServiceClient& operator= (const GEMMServiceClient&);
+};
+
+
+struct GEMMServiceStatistics
+{
+    size_t clients;     // connections accepted
+    size_t requests;    // requests computed
+    size_t rejected;    // requests answered with SERVICE_BAD_REQUEST
+    size_t failed;      // requests answered with SERVICE_FAILED
+    size_t launches;    // launches of the persistent kernel
+
+    GEMMServiceStatistics () :
+        clients(0), requests(0), rejected(0), failed(0), launches(0)
+    {
+    }
+};
+
+
+// The daemon. Single-threaded: it waits for requests with poll and
+// executes everything received since the previous round. Sockets are read
+// and written without blocking: a message that arrives in parts is kept
+// till the rest comes and responses a client does not read yet are kept
+// till its socket is writable, so a slow client does not stall the others.
+template <typename T>
+class GEMMService
+{
+public:
+
+    // executable is gemm_tn_persistent from gemm-persistent.cl;
+    // max_batch is the maximum number of requests in one launch.
+    // Every launch is appended to trace, if it is not 0, as one record
+    // with the number of requests it computes.
+    GEMMService (
+        OpenCLBasic& oclobjects,
+        OpenCLProgramOneKernel& executable,
+        const std::string& socket_path,
+        size_t max_batch,
+        size_t num_groups,
+        size_t group_size,
+        size_t pool_capacity,
+        ShapeTraceWriter* trace = 0
+    );
+
+    ~GEMMService ();
+
+    // Serves clients till SIGINT or SIGTERM.
+    void run ();
+
+    const GEMMServiceStatistics& statistics () const
+    {
+        return stats;
+    }
+
+private:
+
+    struct Connection
+    {
+        char* segment_base;     // 0 till the hello message
+        size_t segment_size;
+        int segment_fd;         // attached to a hello that is not complete yet, or -1
+        std::vector<char> message;  // bytes of a message received so far
+        std::vector<char> output;   // responses the socket has not taken yet
+
+        Connection () :
+            segment_base(0),
+            segment_size(0),
+            segment_fd(-1)
+        {
+        }
+    };
+
+    struct Pending
+    {
+        int fd;
+        ServiceRequest request;
+    };
+
+    OpenCLBasic& oclobjects;
+    PersistentGEMMQueue work_queue;
+    BufferPool<T> pool;
+    std::string socket_path;
+    size_t max_batch;
+    int listen_fd;
+    std::map<int, Connection> connections;
+    std::vector<Pending> pending;
+    GEMMServiceStatistics stats;
+    ShapeTraceWriter* trace;
+
+    void accept ();
+    bool receive (int fd);  // false if the connection is closed
+    void disconnect (int fd);
+    void respond (int fd, uint64_t id, ServiceStatus status, size_t batch);
+    void flush (int fd);    // sends buffered responses without blocking
+    void execute ();
+    void executeBatch (const Pending* requests, size_t count);
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    GEMMService (const GEMMService&);
+    GEMMService& operator= (const GEMMService&);
+};
+
+
+#endif  // end of the include guard
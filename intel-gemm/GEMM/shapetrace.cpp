@@ -0,0 +1,136 @@
+// Binary trace of the shapes of GEMM calls, see shapetrace.hpp.
+
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "basic.hpp"
+#include "shapetrace.hpp"
+
+using namespace std;
+
+
+// Records are written as they are in memory.
+static_assert(sizeof(ShapeTraceRecord) == 32, "unexpected padding in ShapeTraceRecord");
+
+
+GEMMLayout gemmLayout (bool Atransposed, bool Btransposed)
+{
+    return GEMMLayout((Atransposed ? 2 : 0) + (Btransposed ? 1 : 0));
+}
+
+
+const char* gemmLayoutName (GEMMLayout layout)
+{
+    static const char* names[] = { "nn", "nt", "tn", "tt" };
+    return names[layout];
+}
+
+
+ShapeTraceWriter::ShapeTraceWriter (const string& file_name) :
+    file(0),
+    start_time(time_stamp()),
+    record_count(0)
+{
+    file = fopen(file_name.c_str(), "wb");
+    if(!file)
+    {
+        throw Error("Cannot create shape trace file " + inquotes(file_name));
+    }
+
+    ShapeTraceHeader header;
+    memcpy(header.magic, SHAPE_TRACE_MAGIC, sizeof(header.magic));
+    header.record_size = sizeof(ShapeTraceRecord);
+    header.reserved = 0;
+
+    if(fwrite(&header, sizeof(header), 1, file) != 1)
+    {
+        fclose(file);
+        throw Error("Cannot write shape trace file " + inquotes(file_name));
+    }
+}
+
+
+ShapeTraceWriter::~ShapeTraceWriter ()
+{
+    try
+    {
+        if(fclose(file) != 0)
+        {
+            throw Error("Cannot write shape trace file");
+        }
+    }
+    catch(...)
+    {
+        destructorException();
+    }
+}
+
+
+void ShapeTraceWriter::record (
+    size_t m,
+    size_t n,
+    size_t k,
+    GEMMLayout layout,
+    size_t element_size,
+    double host_time,
+    double device_time,
+    size_t batch
+)
+{
+    ShapeTraceRecord record;
+    record.m = static_cast<uint32_t>(m);
+    record.n = static_cast<uint32_t>(n);
+    record.k = static_cast<uint32_t>(k);
+    record.layout = static_cast<uint8_t>(layout);
+    record.element_size = static_cast<uint8_t>(element_size);
+    record.batch = static_cast<uint16_t>(min<size_t>(batch, numeric_limits<uint16_t>::max()));
+    record.host_time = static_cast<float>(host_time);
+    record.device_time = static_cast<float>(device_time);
+    record.timestamp = time_stamp() - start_time;
+
+    lock_guard<mutex> lock(file_mutex);
+
+    if(fwrite(&record, sizeof(record), 1, file) != 1)
+    {
+        throw Error("Cannot write shape trace record");
+    }
+
+    ++record_count;
+}
+
+
+vector<ShapeTraceRecord> readShapeTrace (const string& file_name)
+{
+    FILE* file = fopen(file_name.c_str(), "rb");
+    if(!file)
+    {
+        throw Error("Cannot open shape trace file " + inquotes(file_name));
+    }
+
+    ShapeTraceHeader header;
+    vector<ShapeTraceRecord> records;
+    bool valid =
+        fread(&header, sizeof(header), 1, file) == 1 &&
+        memcmp(header.magic, SHAPE_TRACE_MAGIC, sizeof(header.magic)) == 0 &&
+        header.record_size == sizeof(ShapeTraceRecord);
+
+    ShapeTraceRecord record;
+    while(valid && fread(&record, sizeof(record), 1, file) == 1)
+    {
+        valid = record.layout <= LAYOUT_TT && record.m && record.n && record.k;
+        records.push_back(record);
+    }
+
+    // A partial record at the end is left by a writer that was killed.
+    valid = valid && !ferror(file);
+    fclose(file);
+
+    if(!valid)
+    {
+        throw Error("File " + inquotes(file_name) + " is not a valid shape trace");
+    }
+
+    return records;
+}
@@ -0,0 +1,112 @@
+// Binary trace of the shapes of GEMM calls.
+//
+// Benchmarks of one square --size tell little about a kernel under the
+// traffic of a real application, which mixes many shapes. The trace keeps
+// shape, layout, type of elements and timing of every multiplication in
+// fixed-size records, so a long run costs 32 bytes per call. A recorded
+// trace is re-executed by trace mode with other kernels or parameters.
+//
+// File format: ShapeTraceHeader, then ShapeTraceRecord till the end of the
+// file, both in the byte order of the host that wrote them.
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_SHAPETRACE_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_SHAPETRACE_HPP_
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+
+// Layout of operands as in the names of the kernels: C = op(A)*op(B)
+// where the first letter is about A, the second one is about B.
+enum GEMMLayout
+{
+    LAYOUT_NN = 0,
+    LAYOUT_NT = 1,
+    LAYOUT_TN = 2,
+    LAYOUT_TT = 3
+};
+
+GEMMLayout gemmLayout (bool Atransposed, bool Btransposed);
+
+// "nn", "nt", "tn" or "tt"
+const char* gemmLayoutName (GEMMLayout layout);
+
+
+const char SHAPE_TRACE_MAGIC[8] = { 'G', 'E', 'M', 'M', 'T', 'R', 'C', '1' };
+
+struct ShapeTraceHeader
+{
+    char magic[8];          // SHAPE_TRACE_MAGIC
+    uint32_t record_size;   // sizeof(ShapeTraceRecord)
+    uint32_t reserved;
+};
+
+
+// C (m x n) = op(A) (m x k) * op(B) (k x n)
+struct ShapeTraceRecord
+{
+    uint32_t m;
+    uint32_t n;
+    uint32_t k;
+    uint8_t layout;         // GEMMLayout
+    uint8_t element_size;   // 4 for float, 8 for double
+    uint16_t batch;         // multiplications executed by the same launch
+    float host_time;        // seconds, of the whole launch
+    float device_time;      // seconds, of the whole launch; 0 if unknown
+    double timestamp;       // seconds since the trace is opened
+};
+
+
+// Appends records to a trace file; record can be called from any thread.
+// The file is created anew.
+class ShapeTraceWriter
+{
+public:
+
+    explicit ShapeTraceWriter (const std::string& file_name);
+
+    // Flushes and closes the file.
+    ~ShapeTraceWriter ();
+
+    // batch is the number of multiplications of the same shape that are
+    // computed together, with the times of all of them.
+    void record (
+        size_t m,
+        size_t n,
+        size_t k,
+        GEMMLayout layout,
+        size_t element_size,
+        double host_time,
+        double device_time,
+        size_t batch = 1
+    );
+
+    size_t records () const
+    {
+        return record_count;
+    }
+
+private:
+
+    std::FILE* file;
+    std::mutex file_mutex;
+    double start_time;
+    size_t record_count;
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    ShapeTraceWriter (const ShapeTraceWriter&);
+    ShapeTraceWriter& operator= (const ShapeTraceWriter&);
+};
+
+
+// Reads all records of a trace file. Throws Error if the file
+// cannot be read or is not a trace.
+std::vector<ShapeTraceRecord> readShapeTrace (const std::string& file_name);
+
+
+#endif  // end of the include guard
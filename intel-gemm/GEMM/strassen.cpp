@@ -0,0 +1,341 @@
+// Host-orchestrated Strassen-Winograd multiplication, see strassen.hpp.
+
+
+#include <algorithm>
+
+#include "strassen.hpp"
+#include "gemmkernel.hpp"
+
+using namespace std;
+
+
+StrassenGEMM::StrassenGEMM (
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& gemm_executable,
+    OpenCLProgramMultipleKernels& matrix_ops,
+    size_t size_of_element,
+    size_t blocking,
+    size_t local_size
+) :
+    oclobjects(oclobjects),
+    gemm_executable(gemm_executable),
+    matrix_ops(matrix_ops),
+    size_of_element(size_of_element),
+    blocking(blocking),
+    local_size(local_size),
+    leaf_multiplications(0),
+    elementwise_operations(0)
+{
+    assert(blocking > 0);
+    assert(local_size > 0);
+}
+
+
+StrassenGEMM::~StrassenGEMM ()
+{
+    try
+    {
+        for(size_t l = 0; l < workspace.size(); ++l)
+        {
+            cl_mem buffers[3] = { workspace[l].x, workspace[l].y, workspace[l].p };
+
+            for(int b = 0; b < 3; ++b)
+            {
+                if(buffers[b])
+                {
+                    cl_int err = clReleaseMemObject(buffers[b]);
+                    SAMPLE_CHECK_ERRORS(err);
+                }
+            }
+        }
+    }
+    catch(...)
+    {
+        destructorException();
+    }
+}
+
+
+void StrassenGEMM::reserve (size_t n, size_t levels)
+{
+    if(workspace.size() < levels)
+    {
+        Workspace empty = { 0, 0, 0, 0 };
+        workspace.resize(levels, empty);
+    }
+
+    for(size_t l = levels; l > 0; --l, n /= 2)
+    {
+        Workspace& level = workspace[l - 1];
+        size_t size = (n/2)*(n/2)*size_of_element;
+
+        if(level.size >= size)
+        {
+            continue;
+        }
+
+        // Commands that still use the smaller buffers keep them alive.
+        cl_mem* buffers[3] = { &level.x, &level.y, &level.p };
+        for(int b = 0; b < 3; ++b)
+        {
+            if(*buffers[b])
+            {
+                cl_int err = clReleaseMemObject(*buffers[b]);
+                SAMPLE_CHECK_ERRORS(err);
+                *buffers[b] = 0;
+            }
+
+            cl_int err = 0;
+            *buffers[b] = clCreateBuffer(oclobjects.context, CL_MEM_READ_WRITE, size, 0, &err);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+
+        level.size = size;
+    }
+}
+
+
+bool StrassenGEMM::isLeafSize (size_t n) const
+{
+    // gemm_tn kernels walk the dot-product direction by up to 16 elements
+    return
+        n > 0 &&
+        n % 16 == 0 &&
+        n % blocking == 0 &&
+        (n/blocking) % local_size == 0;
+}
+
+
+size_t StrassenGEMM::depth (size_t n, size_t cutoff) const
+{
+    size_t levels = 0;
+
+    for(size_t m = n; m > cutoff && m % 2 == 0; m /= 2)
+    {
+        ++levels;
+    }
+
+    while(levels > 0 && !isLeafSize(n >> levels))
+    {
+        --levels;
+    }
+
+    return levels;
+}
+
+
+void StrassenGEMM::multiply (
+    const StrassenMatrix& A,
+    const StrassenMatrix& B,
+    const StrassenMatrix& C,
+    size_t n,
+    size_t levels
+)
+{
+    if(levels == 0)
+    {
+        leaf(A, B, C, n);
+        return;
+    }
+
+    assert(n % 2 == 0);
+
+    // Winograd variant of Strassen algorithm scheduled with three temporaries
+    // per level: operands X, Y and product P; C quadrants accumulate results.
+    // In the tn layout B holds transposed matrix, so quadrant (p, q) of the
+    // mathematical right operand is the transposed quadrant (q, p) of B.
+
+    size_t h = n/2;
+
+    StrassenMatrix a11 = A.quadrant(0, 0, h);
+    StrassenMatrix a12 = A.quadrant(0, 1, h);
+    StrassenMatrix a21 = A.quadrant(1, 0, h);
+    StrassenMatrix a22 = A.quadrant(1, 1, h);
+
+    StrassenMatrix b11 = B.quadrant(0, 0, h);
+    StrassenMatrix b12 = B.quadrant(1, 0, h);
+    StrassenMatrix b21 = B.quadrant(0, 1, h);
+    StrassenMatrix b22 = B.quadrant(1, 1, h);
+
+    StrassenMatrix c11 = C.quadrant(0, 0, h);
+    StrassenMatrix c12 = C.quadrant(0, 1, h);
+    StrassenMatrix c21 = C.quadrant(1, 0, h);
+    StrassenMatrix c22 = C.quadrant(1, 1, h);
+
+    reserve(n, levels);
+    const Workspace& temporaries = workspace[levels - 1];
+
+    StrassenMatrix X(temporaries.x, 0, h);
+    StrassenMatrix Y(temporaries.y, 0, h);
+    StrassenMatrix P(temporaries.p, 0, h);
+
+    // P7 = (A11 - A21)(B22 - B12)
+    sub(X, a11, a21, h);
+    sub(Y, b22, b12, h);
+    multiply(X, Y, P, h, levels - 1);
+    copy(c21, P, h);
+
+    // P5 = (A21 + A22)(B12 - B11)
+    add(X, a21, a22, h);
+    sub(Y, b12, b11, h);
+    multiply(X, Y, P, h, levels - 1);
+    copy(c22, P, h);
+
+    // P6 = (A21 + A22 - A11)(B22 - B12 + B11)
+    sub(X, X, a11, h);
+    sub(Y, b22, Y, h);
+    multiply(X, Y, P, h, levels - 1);
+    copy(c12, P, h);
+
+    // P4 = A22 (B22 - B12 + B11 - B21)
+    sub(Y, Y, b21, h);
+    copy(X, a22, h);
+    multiply(X, Y, P, h, levels - 1);
+    copy(c11, P, h);
+
+    // P3 = (A12 - A22 - A21 + A11) B22
+    sub(X, a12, X, h);
+    sub(X, X, a21, h);
+    add(X, X, a11, h);
+    copy(Y, b22, h);
+    multiply(X, Y, P, h, levels - 1);
+
+    add(c21, c21, c12, h);  // P6 + P7
+    add(c12, c12, c22, h);  // P5 + P6
+    add(c22, c22, c21, h);  // P5 + P6 + P7
+    sub(c21, c21, c11, h);  // P6 + P7 - P4
+    add(c12, c12, P, h);    // P3 + P5 + P6
+
+    // P1 = A11 B11
+    copy(X, a11, h);
+    copy(Y, b11, h);
+    multiply(X, Y, P, h, levels - 1);
+
+    add(c12, c12, P, h);
+    add(c21, c21, P, h);
+    add(c22, c22, P, h);
+    copy(c11, P, h);
+
+    // P2 = A12 B21
+    copy(X, a12, h);
+    copy(Y, b21, h);
+    multiply(X, Y, P, h, levels - 1);
+
+    add(c11, c11, P, h);
+}
+
+
+void StrassenGEMM::leaf (
+    const StrassenMatrix& A,
+    const StrassenMatrix& B,
+    const StrassenMatrix& C,
+    size_t n
+)
+{
+    // gemm_tn kernels address matrices from the beginning of the buffer
+    if(A.offset != 0 || B.offset != 0 || C.offset != 0)
+    {
+        throw Error("gemm_tn can multiply matrices without offsets only");
+    }
+
+    if(!isLeafSize(n))
+    {
+        throw Error(
+            "Matrix size " + to_str(n) + " cannot be multiplied by gemm_tn "
+            "with blocking " + to_str(blocking) + " and local size " +
+            to_str(local_size)
+        );
+    }
+
+    cl_kernel kernel = gemm_executable.kernel;
+    setGEMMTNArgs(kernel, A.buffer, A.ld, B.buffer, B.ld, C.buffer, C.ld, n);
+
+    size_t global_size[2] = { n/blocking, n/blocking };
+    size_t local[2] = { local_size, local_size };
+
+    cl_int err = clEnqueueNDRangeKernel(
+        oclobjects.queue,
+        kernel,
+        2,
+        0,
+        global_size,
+        local,
+        0, 0, 0
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    ++leaf_multiplications;
+}
+
+
+void StrassenGEMM::add (
+    const StrassenMatrix& C,
+    const StrassenMatrix& A,
+    const StrassenMatrix& B,
+    size_t n
+)
+{
+    elementwise(matrix_ops["matrix_add"], C, A, &B, n);
+}
+
+
+void StrassenGEMM::sub (
+    const StrassenMatrix& C,
+    const StrassenMatrix& A,
+    const StrassenMatrix& B,
+    size_t n
+)
+{
+    elementwise(matrix_ops["matrix_sub"], C, A, &B, n);
+}
+
+
+void StrassenGEMM::copy (
+    const StrassenMatrix& C,
+    const StrassenMatrix& A,
+    size_t n
+)
+{
+    elementwise(matrix_ops["matrix_copy"], C, A, 0, n);
+}
+
+
+void StrassenGEMM::elementwise (
+    cl_kernel kernel,
+    const StrassenMatrix& C,
+    const StrassenMatrix& A,
+    const StrassenMatrix* B,
+    size_t n
+)
+{
+    const StrassenMatrix* operands[3] = { &C, &A, B };
+    cl_uint arg = 0;
+
+    for(size_t i = 0; i < 3 && operands[i]; ++i)
+    {
+        cl_int offset = static_cast<cl_int>(operands[i]->offset);
+        cl_int ld = static_cast<cl_int>(operands[i]->ld);
+
+        cl_int err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &operands[i]->buffer);
+        SAMPLE_CHECK_ERRORS(err);
+        err = clSetKernelArg(kernel, arg++, sizeof(cl_int), &offset);
+        SAMPLE_CHECK_ERRORS(err);
+        err = clSetKernelArg(kernel, arg++, sizeof(cl_int), &ld);
+        SAMPLE_CHECK_ERRORS(err);
+    }
+
+    size_t global_size[2] = { n, n };
+
+    cl_int err = clEnqueueNDRangeKernel(
+        oclobjects.queue,
+        kernel,
+        2,
+        0,
+        global_size,
+        0,
+        0, 0, 0
+    );
+    SAMPLE_CHECK_ERRORS(err);
+
+    ++elementwise_operations;
+}
@@ -0,0 +1,146 @@
+// Host-orchestrated Strassen-Winograd multiplication.
+//
+// The problem is split recursively into quadrants; each level does 7
+// multiplications of half size and 15 additions instead of 8 multiplications.
+// Multiplications at the bottom of the recursion are dispatched to the regular
+// gemm_tn kernel from gemm.cl, additions to the kernels from matrix-ops.cl.
+// All matrices are in the tn layout of gemm_tn: C = A * transposed(B), where
+// rows of A and rows of B are stored contiguously.
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_STRASSEN_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_STRASSEN_HPP_
+
+#include <vector>
+
+#include <CL/cl.h>
+
+#include "oclobject.hpp"
+
+
+// Square sub-matrix of a buffer: element (i, j) is at offset + i*ld + j.
+struct StrassenMatrix
+{
+    cl_mem buffer;
+    size_t offset;  // in elements
+    size_t ld;  // row stride in elements
+
+    StrassenMatrix (cl_mem buffer, size_t offset, size_t ld) :
+        buffer(buffer),
+        offset(offset),
+        ld(ld)
+    {
+    }
+
+    // Quadrant (row, column) of this matrix; half is the quadrant size.
+    StrassenMatrix quadrant (size_t row, size_t column, size_t half) const
+    {
+        return StrassenMatrix(buffer, offset + row*half*ld + column*half, ld);
+    }
+};
+
+
+class StrassenGEMM
+{
+public:
+
+    // gemm_executable holds gemm_tn kernel; each its work-item computes
+    // blocking x blocking elements of C, work-groups are local_size x local_size.
+    // matrix_ops holds kernels from matrix-ops.cl.
+    StrassenGEMM (
+        OpenCLBasic& oclobjects,
+        OpenCLProgramOneKernel& gemm_executable,
+        OpenCLProgramMultipleKernels& matrix_ops,
+        size_t size_of_element,
+        size_t blocking,
+        size_t local_size
+    );
+
+    ~StrassenGEMM ();
+
+    // Number of recursion levels for matrix size n: halves n while it is
+    // greater than cutoff and the half still can be multiplied by gemm_tn.
+    size_t depth (size_t n, size_t cutoff) const;
+
+    // Allocates temporaries for multiplications of n x n matrices with
+    // given number of levels, so that multiply does not allocate them.
+    void reserve (size_t n, size_t levels);
+
+    // Enqueues C = A * transposed(B) for n x n matrices with given
+    // number of recursion levels; 0 levels is a single gemm_tn launch,
+    // which requires A, B and C to start at the beginning of their buffers.
+    void multiply (
+        const StrassenMatrix& A,
+        const StrassenMatrix& B,
+        const StrassenMatrix& C,
+        size_t n,
+        size_t levels
+    );
+
+    // Number of gemm_tn launches and elementwise operations
+    // enqueued since construction.
+    size_t leafMultiplications () const
+    {
+        return leaf_multiplications;
+    }
+
+    size_t elementwiseOperations () const
+    {
+        return elementwise_operations;
+    }
+
+private:
+
+    // true if n x n matrices can be multiplied by gemm_tn directly
+    bool isLeafSize (size_t n) const;
+
+    void leaf (
+        const StrassenMatrix& A,
+        const StrassenMatrix& B,
+        const StrassenMatrix& C,
+        size_t n
+    );
+
+    // C = A + B, C = A - B and C = A for n x n matrices
+    void add (const StrassenMatrix& C, const StrassenMatrix& A, const StrassenMatrix& B, size_t n);
+    void sub (const StrassenMatrix& C, const StrassenMatrix& A, const StrassenMatrix& B, size_t n);
+    void copy (const StrassenMatrix& C, const StrassenMatrix& A, size_t n);
+
+    void elementwise (
+        cl_kernel kernel,
+        const StrassenMatrix& C,
+        const StrassenMatrix& A,
+        const StrassenMatrix* B,
+        size_t n
+    );
+
+    // Temporaries X, Y and P of one recursion level. Calls on the same
+    // level follow each other in the in-order queue, so they share them.
+    struct Workspace
+    {
+        cl_mem x;
+        cl_mem y;
+        cl_mem p;
+        size_t size;    // in bytes, of each of them
+    };
+
+    OpenCLBasic& oclobjects;
+    OpenCLProgramOneKernel& gemm_executable;
+    OpenCLProgramMultipleKernels& matrix_ops;
+    size_t size_of_element;
+    size_t blocking;
+    size_t local_size;
+
+    // By the number of levels below the one that uses the workspace
+    std::vector<Workspace> workspace;
+
+    size_t leaf_multiplications;
+    size_t elementwise_operations;
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    StrassenGEMM (const StrassenGEMM&);
+    StrassenGEMM& operator= (const StrassenGEMM&);
+};
+
+
+#endif  // end of the include guard
@@ -0,0 +1,139 @@
+// Lock-free multi-producer submission of GEMM requests, see submitring.hpp.
+
+
+#include <chrono>
+#include <vector>
+
+#include "basic.hpp"
+#include "submitring.hpp"
+
+using namespace std;
+
+
+template <typename Queue>
+GEMMDispatcher<Queue>::GEMMDispatcher (
+    OpenCLBasic& oclobjects,
+    OpenCLProgramOneKernel& executable,
+    Queue& queue,
+    cl_mem A,
+    cl_mem B,
+    cl_mem C,
+    size_t max_batch,
+    size_t num_groups,
+    size_t group_size
+) :
+    oclobjects(oclobjects),
+    work_queue(oclobjects, executable, max_batch, num_groups, group_size),
+    queue(queue),
+    A(A),
+    B(B),
+    C(C),
+    max_batch(max_batch),
+    stopping(false),
+    failure(false),
+    launch_count(0),
+    dispatch_count(0)
+{
+    worker = thread(&GEMMDispatcher::run, this);
+}
+
+
+template <typename Queue>
+GEMMDispatcher<Queue>::~GEMMDispatcher ()
+{
+    stopping = true;
+    if(worker.joinable())
+    {
+        worker.join();
+    }
+}
+
+
+template <typename Queue>
+void GEMMDispatcher<Queue>::stop ()
+{
+    stopping = true;
+    if(worker.joinable())
+    {
+        worker.join();
+    }
+
+    if(error)
+    {
+        rethrow_exception(error);
+    }
+}
+
+
+template <typename Queue>
+void GEMMDispatcher<Queue>::run ()
+{
+    try
+    {
+        vector<atomic<size_t>*> completed;
+        GEMMSubmission submission;
+        size_t idle_rounds = 0;
+
+        for(;;)
+        {
+            completed.clear();
+            work_queue.clear();
+
+            // Read before the drain: if it is set, every submission
+            // made before stop() is in the queue by now.
+            bool stop_seen = stopping;
+
+            while(completed.size() < max_batch && queue.tryPop(submission))
+            {
+                work_queue.append(submission.task);
+                completed.push_back(submission.completed);
+            }
+
+            if(completed.empty())
+            {
+                // The queue was empty after stop(): submissions
+                // before it are all executed.
+                if(stop_seen)
+                {
+                    break;
+                }
+
+                // Spin shortly for low latency, then back off.
+                if(++idle_rounds < 64)
+                {
+                    this_thread::yield();
+                }
+                else
+                {
+                    this_thread::sleep_for(chrono::microseconds(50));
+                }
+
+                continue;
+            }
+
+            idle_rounds = 0;
+
+            cl_event event = work_queue.flush(A, B, C);
+            cl_int err = clWaitForEvents(1, &event);
+            clReleaseEvent(event);
+            SAMPLE_CHECK_ERRORS(err);
+
+            ++launch_count;
+            dispatch_count += completed.size();
+
+            for(size_t i = 0; i < completed.size(); ++i)
+            {
+                completed[i]->fetch_add(1, memory_order_release);
+            }
+        }
+    }
+    catch(...)
+    {
+        error = current_exception();
+        failure = true;
+    }
+}
+
+
+template class GEMMDispatcher<MPSCRing<GEMMSubmission> >;
+template class GEMMDispatcher<MutexSubmissionQueue<GEMMSubmission> >;
@@ -0,0 +1,273 @@
+// Lock-free multi-producer submission of GEMM requests.
+//
+// Services that embed the sample submit multiplications from many host
+// threads. A mutex in front of the device queue serializes all of them.
+// MPSCRing is a bounded ring buffer where producers only take a slot with
+// one compare-and-swap on the tail, and a single consumer reads slots
+// without atomic read-modify-write operations at all (the bounded queue
+// with per-slot sequence numbers by D. Vyukov, specialized for one
+// consumer). GEMMDispatcher is that consumer: its thread drains the ring,
+// batches the requests into the work queue of the persistent kernel and
+// launches them.
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_SUBMITRING_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_SUBMITRING_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <CL/cl.h>
+
+#include "oclobject.hpp"
+#include "persistent.hpp"
+
+
+template <typename T>
+class MPSCRing
+{
+public:
+
+    // capacity is rounded up to a power of two
+    explicit MPSCRing (size_t capacity) :
+        mask(0),
+        tail(0),
+        head(0)
+    {
+        size_t rounded = 1;
+        while(rounded < capacity)
+        {
+            rounded *= 2;
+        }
+
+        mask = rounded - 1;
+        cells.reset(new Cell[rounded]);
+
+        for(size_t i = 0; i < rounded; ++i)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Can be called by any thread. Returns false if the ring is full.
+    bool tryPush (const T& value)
+    {
+        size_t position = tail.load(std::memory_order_relaxed);
+        Cell* cell = 0;
+
+        for(;;)
+        {
+            cell = &cells[position & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            ptrdiff_t difference = ptrdiff_t(sequence) - ptrdiff_t(position);
+
+            if(difference == 0)
+            {
+                // The slot is free: take it unless another producer did.
+                if(tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if(difference < 0)
+            {
+                // The consumer has not read the slot of the previous round yet.
+                return false;
+            }
+            else
+            {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = value;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Should be called by one consumer thread only.
+    // Returns false if the ring is empty.
+    bool tryPop (T& value)
+    {
+        Cell& cell = cells[head & mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+
+        if(ptrdiff_t(sequence) - ptrdiff_t(head + 1) < 0)
+        {
+            return false;
+        }
+
+        value = cell.value;
+
+        // The slot is free for the producers of the next round.
+        cell.sequence.store(head + mask + 1, std::memory_order_release);
+        ++head;
+        return true;
+    }
+
+    size_t capacity () const
+    {
+        return mask + 1;
+    }
+
+private:
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+
+    // Producers and the consumer work on different cache lines.
+    char padding_before_tail[64];
+    std::atomic<size_t> tail;
+    char padding_before_head[64];
+    size_t head;
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    MPSCRing (const MPSCRing&);
+    MPSCRing& operator= (const MPSCRing&);
+};
+
+
+// Bounded queue with the same interface protected by a mutex,
+// the baseline for MPSCRing.
+template <typename T>
+class MutexSubmissionQueue
+{
+public:
+
+    explicit MutexSubmissionQueue (size_t capacity) :
+        queue_capacity(capacity)
+    {
+    }
+
+    bool tryPush (const T& value)
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+
+        if(queue.size() >= queue_capacity)
+        {
+            return false;
+        }
+
+        queue.push_back(value);
+        return true;
+    }
+
+    bool tryPop (T& value)
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+
+        if(queue.empty())
+        {
+            return false;
+        }
+
+        value = queue.front();
+        queue.pop_front();
+        return true;
+    }
+
+    size_t capacity () const
+    {
+        return queue_capacity;
+    }
+
+private:
+
+    std::mutex queue_mutex;
+    std::deque<T> queue;
+    size_t queue_capacity;
+};
+
+
+// One multiplication submitted to GEMMDispatcher: the task for the
+// persistent kernel with offsets in the buffers of the dispatcher, and
+// a counter the dispatcher increments when the task is computed.
+struct GEMMSubmission
+{
+    GEMMTask task;
+    std::atomic<size_t>* completed;
+};
+
+
+// Consumer thread of a submission queue (MPSCRing or MutexSubmissionQueue
+// of GEMMSubmission). It takes up to max_batch submissions, executes them
+// by one launch of gemm_tn_persistent over buffers A, B and C and waits
+// for it; the OpenCL queue should not be used by others meanwhile.
+template <typename Queue>
+class GEMMDispatcher
+{
+public:
+
+    GEMMDispatcher (
+        OpenCLBasic& oclobjects,
+        OpenCLProgramOneKernel& executable,
+        Queue& queue,
+        cl_mem A,
+        cl_mem B,
+        cl_mem C,
+        size_t max_batch,
+        size_t num_groups,
+        size_t group_size
+    );
+
+    // Stops the thread without rethrowing its errors.
+    ~GEMMDispatcher ();
+
+    // Executes the submissions in the queue, stops the thread
+    // and rethrows an exception of the thread if any.
+    void stop ();
+
+    size_t launches () const
+    {
+        return launch_count;
+    }
+
+    size_t dispatched () const
+    {
+        return dispatch_count;
+    }
+
+    // The thread is stopped by an error: submissions
+    // may stay in the queue forever.
+    bool failed () const
+    {
+        return failure;
+    }
+
+private:
+
+    OpenCLBasic& oclobjects;
+    PersistentGEMMQueue work_queue;
+    Queue& queue;
+    cl_mem A;
+    cl_mem B;
+    cl_mem C;
+    size_t max_batch;
+
+    std::atomic<bool> stopping;
+    std::atomic<bool> failure;
+    std::exception_ptr error;
+    size_t launch_count;
+    size_t dispatch_count;
+    std::thread worker;
+
+    void run ();
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    GEMMDispatcher (const GEMMDispatcher&);
+    GEMMDispatcher& operator= (const GEMMDispatcher&);
+};
+
+
+#endif  // end of the include guard
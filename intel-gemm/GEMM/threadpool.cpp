@@ -0,0 +1,384 @@
+// Work-stealing thread pool for the host GEMM engine, see threadpool.hpp.
+
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "basic.hpp"
+#include "threadpool.hpp"
+
+using namespace std;
+
+
+namespace
+{
+
+// Pins the calling thread to a given CPU; negative cpu means no pinning.
+void pinCurrentThread (int cpu)
+{
+    if(cpu < 0)
+    {
+        return;
+    }
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    // pid 0 stands for the calling thread
+    if(sched_setaffinity(0, sizeof(set), &set) != 0)
+    {
+        cerr << "[ WARNING ] Cannot pin thread to CPU " << cpu << ".\n";
+    }
+#else
+    cerr << "[ WARNING ] Thread affinity is not supported on this platform.\n";
+#endif
+}
+
+
+// Pins the calling thread to cpu for the lifetime of the object and then
+// restores its previous affinity, so threads it spawns afterwards, like
+// the ones of the OpenCL runtime, are not confined to one CPU.
+class ScopedPin
+{
+public:
+
+    explicit ScopedPin (int cpu) :
+        saved(false)
+    {
+        if(cpu < 0)
+        {
+            return;
+        }
+
+#ifdef __linux__
+        saved = sched_getaffinity(0, sizeof(mask), &mask) == 0;
+#endif
+        pinCurrentThread(cpu);
+    }
+
+    ~ScopedPin ()
+    {
+#ifdef __linux__
+        if(saved)
+        {
+            sched_setaffinity(0, sizeof(mask), &mask);
+        }
+#endif
+    }
+
+private:
+
+#ifdef __linux__
+    cpu_set_t mask;
+#endif
+    bool saved;
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    ScopedPin (const ScopedPin&);
+    ScopedPin& operator= (const ScopedPin&);
+};
+
+}
+
+
+vector<int> parseCPUList (const string& cpu_list)
+{
+    vector<int> result;
+
+    if(cpu_list.empty() || cpu_list == "none")
+    {
+        return result;
+    }
+
+    for(size_t pos = 0, next = 0; next != string::npos; pos = next + 1)
+    {
+        next = cpu_list.find(',', pos);
+        string item = cpu_list.substr(pos, next == string::npos ? string::npos : next - pos);
+
+        size_t dash = item.find('-');
+        if(dash == string::npos)
+        {
+            result.push_back(str_to<int>(item));
+        }
+        else
+        {
+            int first = str_to<int>(item.substr(0, dash));
+            int last = str_to<int>(item.substr(dash + 1));
+
+            if(first > last)
+            {
+                throw Error("Wrong CPU range " + inquotes(item) + " in CPU list");
+            }
+
+            for(int cpu = first; cpu <= last; ++cpu)
+            {
+                result.push_back(cpu);
+            }
+        }
+    }
+
+    for(size_t i = 0; i < result.size(); ++i)
+    {
+        if(result[i] < 0)
+        {
+            throw Error("Negative CPU number in CPU list " + inquotes(cpu_list));
+        }
+    }
+
+    return result;
+}
+
+
+WorkStealingPool::WorkStealingPool (size_t num_threads, const vector<int>& cpus) :
+    cpus(cpus),
+    current_task(0),
+    remaining(0),
+    generation(0),
+    stopping(false),
+    active_workers(0)
+{
+    if(num_threads == 0)
+    {
+        num_threads = max<size_t>(1, thread::hardware_concurrency());
+    }
+
+    for(size_t i = 0; i < num_threads; ++i)
+    {
+        workers.push_back(new Worker);
+    }
+
+    executed.resize(num_threads);
+    stolen.resize(num_threads);
+
+    // The calling thread is worker 0, it is pinned by run().
+    for(size_t i = 1; i < num_threads; ++i)
+    {
+        threads.push_back(thread(&WorkStealingPool::workerLoop, this, i));
+    }
+}
+
+
+WorkStealingPool::~WorkStealingPool ()
+{
+    {
+        unique_lock<mutex> lock(state_mutex);
+        stopping = true;
+    }
+    start_condition.notify_all();
+
+    for(size_t i = 0; i < threads.size(); ++i)
+    {
+        threads[i].join();
+    }
+
+    for(size_t i = 0; i < workers.size(); ++i)
+    {
+        delete workers[i];
+    }
+}
+
+
+void WorkStealingPool::run (size_t num_tasks, const Task& task)
+{
+    size_t num_workers = workers.size();
+
+    // Initial distribution: contiguous ranges keep neighbouring tiles,
+    // which share packed panels in cache, on the same worker.
+    for(size_t w = 0; w < num_workers; ++w)
+    {
+        size_t begin = num_tasks*w/num_workers;
+        size_t end = num_tasks*(w + 1)/num_workers;
+
+        unique_lock<mutex> lock(workers[w]->mutex);
+        workers[w]->tasks.clear();
+        for(size_t t = begin; t < end; ++t)
+        {
+            workers[w]->tasks.push_back(t);
+        }
+    }
+
+    fill(executed.begin(), executed.end(), 0);
+    fill(stolen.begin(), stolen.end(), 0);
+
+    {
+        unique_lock<mutex> lock(state_mutex);
+        current_task = &task;
+        remaining = num_tasks;
+        error = exception_ptr();
+        active_workers = num_workers - 1;
+        ++generation;
+    }
+    start_condition.notify_all();
+
+    {
+        ScopedPin pin(cpus.empty() ? -1 : cpus[0]);
+        execute(0);
+    }
+
+    {
+        unique_lock<mutex> lock(state_mutex);
+        while(active_workers > 0)
+        {
+            done_condition.wait(lock);
+        }
+        current_task = 0;
+    }
+
+    if(error)
+    {
+        rethrow_exception(error);
+    }
+}
+
+
+void WorkStealingPool::workerLoop (size_t worker)
+{
+    if(!cpus.empty())
+    {
+        pinCurrentThread(cpus[worker % cpus.size()]);
+    }
+
+    size_t seen_generation = 0;
+
+    for(;;)
+    {
+        {
+            unique_lock<mutex> lock(state_mutex);
+            while(!stopping && generation == seen_generation)
+            {
+                start_condition.wait(lock);
+            }
+
+            if(stopping)
+            {
+                return;
+            }
+
+            seen_generation = generation;
+        }
+
+        execute(worker);
+
+        {
+            unique_lock<mutex> lock(state_mutex);
+            --active_workers;
+        }
+        done_condition.notify_all();
+    }
+}
+
+
+void WorkStealingPool::execute (size_t worker)
+{
+    size_t task = 0;
+
+    while(remaining > 0 && (takeOwn(worker, task) || steal(worker, task)))
+    {
+        try
+        {
+            (*current_task)(task, worker);
+        }
+        catch(...)
+        {
+            unique_lock<mutex> lock(state_mutex);
+            if(!error)
+            {
+                error = current_exception();
+            }
+        }
+
+        ++executed[worker];
+        --remaining;
+    }
+}
+
+
+bool WorkStealingPool::takeOwn (size_t worker, size_t& task)
+{
+    Worker& own = *workers[worker];
+    unique_lock<mutex> lock(own.mutex);
+
+    if(own.tasks.empty())
+    {
+        return false;
+    }
+
+    task = own.tasks.front();
+    own.tasks.pop_front();
+    return true;
+}
+
+
+bool WorkStealingPool::steal (size_t worker, size_t& task)
+{
+    size_t num_workers = workers.size();
+
+    for(size_t i = 1; i < num_workers; ++i)
+    {
+        Worker& victim = *workers[(worker + i) % num_workers];
+        unique_lock<mutex> lock(victim.mutex);
+
+        if(!victim.tasks.empty())
+        {
+            // The back of the victim's range is the farthest
+            // from what the victim is working on now.
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            ++stolen[worker];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+template <typename T>
+void cpuGEMMParallel (
+    const CPUGEMMProblem<T>& problem,
+    WorkStealingPool& pool,
+    vector<CPUGEMMWorkspace<T>*>& workspaces,
+    size_t tile_rows,
+    size_t tile_columns
+)
+{
+    assert(workspaces.size() >= pool.size());
+    assert(tile_rows > 0 && tile_columns > 0);
+
+    size_t row_tiles = (problem.m + tile_rows - 1)/tile_rows;
+    size_t column_tiles = (problem.n + tile_columns - 1)/tile_columns;
+
+    // Tiles are numbered row by row, so a contiguous range of tasks
+    // mostly shares the same rows of A.
+    pool.run(
+        row_tiles*column_tiles,
+        [&](size_t task, size_t worker)
+        {
+            size_t row = task/column_tiles*tile_rows;
+            size_t column = task%column_tiles*tile_columns;
+
+            cpuGEMMTile(
+                problem,
+                row,
+                min(row + tile_rows, problem.m),
+                column,
+                min(column + tile_columns, problem.n),
+                *workspaces[worker]
+            );
+        }
+    );
+}
+
+
+template void cpuGEMMParallel<float> (
+    const CPUGEMMProblem<float>&, WorkStealingPool&, vector<CPUGEMMWorkspace<float>*>&, size_t, size_t
+);
+template void cpuGEMMParallel<double> (
+    const CPUGEMMProblem<double>&, WorkStealingPool&, vector<CPUGEMMWorkspace<double>*>&, size_t, size_t
+);
@@ -0,0 +1,121 @@
+// Work-stealing thread pool for the host GEMM engine.
+//
+// Each worker owns a deque of tasks. A worker takes tasks from the front of
+// its own deque and, when it is empty, steals from the back of the others.
+// On asymmetric (big.LITTLE) core sets the fast cores finish their share
+// earlier and then take the remaining tasks of the slow ones, instead of
+// waiting for them as with static partitioning.
+
+
+#ifndef _INTEL_OPENCL_SAMPLE_GEMM_THREADPOOL_HPP_
+#define _INTEL_OPENCL_SAMPLE_GEMM_THREADPOOL_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+
+#include "cpugemm.hpp"
+
+
+// Parses CPU list for thread affinity. Supported formats:
+//   - "" or "none": no affinity is set
+//   - comma-separated list of CPU numbers and ranges, for example
+//     "0-3" or "4,5,6,7" or "0,2-3": worker i is pinned to the
+//     (i mod list length)-th CPU of the list
+std::vector<int> parseCPUList (const std::string& cpu_list);
+
+
+class WorkStealingPool
+{
+public:
+
+    // Task receives its index and the index of the worker executing it.
+    typedef std::function<void (size_t task, size_t worker)> Task;
+
+    // num_threads == 0 creates one worker per hardware thread.
+    // cpus is a list of CPUs for pinning the workers, see parseCPUList.
+    WorkStealingPool (size_t num_threads, const std::vector<int>& cpus);
+    ~WorkStealingPool ();
+
+    size_t size () const
+    {
+        return workers.size();
+    }
+
+    // Executes task(i, worker) for i in [0, num_tasks) and waits for
+    // all of them. Tasks are initially split into contiguous ranges,
+    // one range per worker. The calling thread is used as worker 0 and
+    // is pinned to the first CPU of the list only while it executes tasks.
+    void run (size_t num_tasks, const Task& task);
+
+    // Number of tasks executed by each worker and the number of them
+    // that were stolen from other workers during the last run.
+    const std::vector<size_t>& executedTasks () const
+    {
+        return executed;
+    }
+
+    const std::vector<size_t>& stolenTasks () const
+    {
+        return stolen;
+    }
+
+private:
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    void workerLoop (size_t worker);
+    void execute (size_t worker);
+    bool takeOwn (size_t worker, size_t& task);
+    bool steal (size_t worker, size_t& task);
+
+    std::vector<Worker*> workers;
+    std::vector<std::thread> threads;
+    std::vector<int> cpus;
+
+    std::vector<size_t> executed;
+    std::vector<size_t> stolen;
+
+    // current run
+    const Task* current_task;
+    std::atomic<size_t> remaining;
+    std::exception_ptr error;   // first exception thrown by a task
+    size_t generation;
+    bool stopping;
+
+    std::mutex state_mutex;
+    std::condition_variable start_condition;
+    std::condition_variable done_condition;
+    size_t active_workers;
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    WorkStealingPool (const WorkStealingPool&);
+    WorkStealingPool& operator= (const WorkStealingPool&);
+};
+
+
+// Multi-threaded version of cpuGEMM: C is split into tiles of
+// tile_rows x tile_columns, which are executed by the pool.
+// One workspace per pool worker is needed.
+template <typename T>
+void cpuGEMMParallel (
+    const CPUGEMMProblem<T>& problem,
+    WorkStealingPool& pool,
+    std::vector<CPUGEMMWorkspace<T>*>& workspaces,
+    size_t tile_rows,
+    size_t tile_columns
+);
+
+
+#endif  // end of the include guard
@@ -31,6 +31,8 @@
 
 #ifdef __linux__
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <libgen.h>
 #elif defined(_WIN32) || defined(WIN32)
@@ -110,6 +112,208 @@ string opencl_error_to_str (cl_int error)
 
 
 
+namespace
+{
+
+HostAllocationPolicy host_allocation_policy;
+
+// The system uses one bit less than given in the size of node mask.
+const int max_numa_node = int(sizeof(unsigned long)*8) - 2;
+// Nodes that do not exist are ignored by the system.
+const unsigned long all_numa_nodes = (1UL << (max_numa_node + 1)) - 1;
+
+// Stored right before the aligned pointer returned by aligned_malloc.
+struct AllocationHeader
+{
+    char* orig;     // beginning of the allocated region
+    size_t mapped;  // length of mmap-ed region, 0 for heap allocations
+};
+
+#ifdef __linux__
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+
+const size_t huge_page_size = 2*1024*1024;
+
+// Allocates memory directly from the OS to control its pages.
+char* map_region (size_t length, const HostAllocationPolicy& policy)
+{
+    void* region = MAP_FAILED;
+
+    if(policy.huge_pages == HUGE_PAGES_EXPLICIT)
+    {
+        region = mmap(0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        static bool warned = false;
+        if(region == MAP_FAILED && !warned)
+        {
+            std::cerr
+                << "[ WARNING ] Cannot allocate explicit huge pages (see /proc/sys/vm/nr_hugepages), "
+                << "transparent huge pages are used instead.\n";
+            warned = true;
+        }
+    }
+
+    if(region == MAP_FAILED)
+    {
+        region = mmap(0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(region == MAP_FAILED)
+        {
+            throw std::bad_alloc();
+        }
+
+        if(policy.huge_pages != HUGE_PAGES_NONE)
+        {
+            // Only a hint: THP can be disabled in the system.
+            madvise(region, length, MADV_HUGEPAGE);
+        }
+    }
+
+    if(policy.numa != NUMA_DEFAULT)
+    {
+        // Policy is applied before the first touch, so it places all pages.
+        // The system call is used directly to avoid dependency on libnuma.
+        unsigned long nodes = policy.numa_nodes;
+        int mode = policy.numa == NUMA_BIND ? MPOL_BIND : MPOL_INTERLEAVE;
+
+        if(syscall(SYS_mbind, region, length, mode, &nodes, sizeof(nodes)*8, 0) != 0)
+        {
+            static bool warned = false;
+            if(!warned)
+            {
+                std::cerr << "[ WARNING ] Cannot set NUMA policy for host memory: errno " << errno << ".\n";
+                warned = true;
+            }
+        }
+    }
+
+    return (char*)region;
+}
+
+#endif
+
+}
+
+
+void setHostAllocationPolicy (const HostAllocationPolicy& policy)
+{
+#ifndef __linux__
+    if(policy.huge_pages != HUGE_PAGES_NONE || policy.numa != NUMA_DEFAULT)
+    {
+        throw Error("Huge pages and NUMA placement are supported on Linux only");
+    }
+#endif
+
+    host_allocation_policy = policy;
+}
+
+
+const HostAllocationPolicy& hostAllocationPolicy ()
+{
+    return host_allocation_policy;
+}
+
+
+HugePages parseHugePages (const string& name)
+{
+    if(name == "none")
+    {
+        return HUGE_PAGES_NONE;
+    }
+
+    if(name == "transparent")
+    {
+        return HUGE_PAGES_TRANSPARENT;
+    }
+
+    if(name == "explicit")
+    {
+        return HUGE_PAGES_EXPLICIT;
+    }
+
+    throw Error("Cannot recognize " + inquotes(name) + " as a huge pages mode");
+}
+
+
+void parseNUMAPlacement (const string& spec, NUMAPlacement& placement, unsigned long& nodes)
+{
+    placement = NUMA_DEFAULT;
+    nodes = 0;
+
+    if(spec.empty() || spec == "none")
+    {
+        return;
+    }
+
+    if(spec == "interleave")
+    {
+        placement = NUMA_INTERLEAVE;
+        nodes = all_numa_nodes;
+        return;
+    }
+
+    size_t colon = spec.find(':');
+    string kind = spec.substr(0, colon);
+
+    if(colon == string::npos || (kind != "bind" && kind != "interleave"))
+    {
+        throw Error(
+            "Cannot recognize " + inquotes(spec) + " as NUMA placement; "
+            "expected none, bind:<nodes>, interleave or interleave:<nodes>"
+        );
+    }
+
+    placement = kind == "bind" ? NUMA_BIND : NUMA_INTERLEAVE;
+
+    string list = spec.substr(colon + 1);
+    for(size_t pos = 0, next = 0; next != string::npos; pos = next + 1)
+    {
+        next = list.find(',', pos);
+        string item = list.substr(pos, next == string::npos ? string::npos : next - pos);
+
+        size_t dash = item.find('-');
+        int first = str_to<int>(item.substr(0, dash));
+        int last = dash == string::npos ? first : str_to<int>(item.substr(dash + 1));
+
+        if(first < 0 || first > last || last > max_numa_node)
+        {
+            throw Error(
+                "Wrong NUMA node range " + inquotes(item) + ": nodes from 0 to " +
+                to_str(max_numa_node) + " are supported"
+            );
+        }
+
+        for(int node = first; node <= last; ++node)
+        {
+            nodes |= 1UL << node;
+        }
+    }
+}
+
+
+string hostAllocationPolicyToStr (const HostAllocationPolicy& policy)
+{
+    const char* huge_pages[] = { "none", "transparent", "explicit" };
+    const char* numa[] = { "default", "bind", "interleave" };
+
+    std::ostringstream result;
+    result << "huge pages: " << huge_pages[policy.huge_pages] << ", NUMA: " << numa[policy.numa];
+
+    if(policy.numa != NUMA_DEFAULT && policy.numa_nodes != all_numa_nodes)
+    {
+        result << ", nodes mask 0x" << std::hex << policy.numa_nodes;
+    }
+
+    return result.str();
+}
+
+
 void* aligned_malloc (size_t size, size_t alignment)
 {
     // a number of requirements should be met
@@ -124,17 +328,46 @@ void* aligned_malloc (size_t size, size_t alignment)
     assert(size >= sizeof(void*));
     assert(size/sizeof(void*)*sizeof(void*) == size);
 
-    // allocate extra memory and convert to size_t to perform calculations
-    char* orig = new char[size + alignment + sizeof(void*)];
+    const HostAllocationPolicy& policy = host_allocation_policy;
+    char* orig = 0;
+    size_t mapped = 0;
+
+#ifdef __linux__
+    if(
+        (policy.huge_pages != HUGE_PAGES_NONE || policy.numa != NUMA_DEFAULT) &&
+        size >= policy.threshold
+    )
+    {
+        // Data starts at a huge page boundary to be covered by
+        // the minimal number of huge pages.
+        if(policy.huge_pages != HUGE_PAGES_NONE && alignment < huge_page_size)
+        {
+            alignment = huge_page_size;
+        }
+
+        // MAP_HUGETLB requires length to be a multiple of the huge page size
+        mapped = round_up_aligned(size + alignment + sizeof(AllocationHeader), huge_page_size);
+        orig = map_region(mapped, policy);
+    }
+#endif
+
+    if(!orig)
+    {
+        // allocate extra memory and convert to size_t to perform calculations
+        orig = new char[size + alignment + sizeof(AllocationHeader)];
+    }
+
     // calculate an aligned position in the allocated region
     // assumption: (size_t)orig does not lose lower bits
     char* aligned =
         orig + (
-        (((size_t)orig + alignment + sizeof(void*)) & ~(alignment - 1)) -
+        (((size_t)orig + alignment + sizeof(AllocationHeader) - 1) & ~(alignment - 1)) -
         (size_t)orig
         );
     // save the original pointer to use it in aligned_free
-    *((char**)aligned - 1) = orig;
+    AllocationHeader* header = (AllocationHeader*)aligned - 1;
+    header->orig = orig;
+    header->mapped = mapped;
     return aligned;
 }
 
@@ -142,7 +375,18 @@ void* aligned_malloc (size_t size, size_t alignment)
 void aligned_free (void *aligned)
 {
     if(!aligned)return; // behaves as delete: calling with 0 is NOP
-    delete [] *((char**)aligned - 1);
+
+    AllocationHeader* header = (AllocationHeader*)aligned - 1;
+
+#ifdef __linux__
+    if(header->mapped)
+    {
+        munmap(header->orig, header->mapped);
+        return;
+    }
+#endif
+
+    delete [] header->orig;
 }
 
 
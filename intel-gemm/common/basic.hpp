@@ -65,6 +65,56 @@ void* aligned_malloc (size_t size, size_t alignment);
 void aligned_free (void *aligned);
 
 
+// Page size and NUMA placement of large host allocations made by
+// aligned_malloc. Big matrices cause many TLB misses with 4 KB pages,
+// and on multi-socket hosts they can land on a remote memory node.
+enum HugePages
+{
+    HUGE_PAGES_NONE,        // regular heap allocation
+    HUGE_PAGES_TRANSPARENT, // mmap + madvise(MADV_HUGEPAGE)
+    HUGE_PAGES_EXPLICIT     // mmap with MAP_HUGETLB from the reserved pool,
+                            // falls back to transparent if the pool is empty
+};
+
+enum NUMAPlacement
+{
+    NUMA_DEFAULT,       // first-touch policy of the OS
+    NUMA_BIND,          // only the given nodes
+    NUMA_INTERLEAVE     // pages are interleaved over the given nodes
+};
+
+struct HostAllocationPolicy
+{
+    HugePages huge_pages;
+    NUMAPlacement numa;
+    unsigned long numa_nodes;   // bit mask of nodes for NUMA_BIND and NUMA_INTERLEAVE
+    size_t threshold;           // smaller allocations always use the heap
+
+    HostAllocationPolicy () :
+        huge_pages(HUGE_PAGES_NONE),
+        numa(NUMA_DEFAULT),
+        numa_nodes(0),
+        threshold(2*1024*1024)
+    {
+    }
+};
+
+// Sets the policy for all subsequent aligned_malloc calls.
+void setHostAllocationPolicy (const HostAllocationPolicy& policy);
+const HostAllocationPolicy& hostAllocationPolicy ();
+
+// Parses "none", "transparent" or "explicit".
+HugePages parseHugePages (const string& name);
+
+// Parses NUMA placement: "none", "bind:<nodes>", "interleave" (all nodes)
+// or "interleave:<nodes>", where <nodes> is a comma-separated list of
+// node numbers and ranges, for example "0" or "0-1,3".
+void parseNUMAPlacement (const string& spec, NUMAPlacement& placement, unsigned long& nodes);
+
+// Textual description of the policy for reporting.
+string hostAllocationPolicyToStr (const HostAllocationPolicy& policy);
+
+
 // Represent a given value as a string and enclose in quotes
 template <typename T>
 string inquotes (const T& x, const char* q = "\"")
@@ -435,7 +435,9 @@ CmdParserCommon::CmdParserCommon(int argc, const char** argv) :
         'd',
         "device",
         "<number-or-string>",
-        "Selects the device on which all stuff is executed.",
+        "Selects the device on which all stuff is executed. Several devices "
+            "for multi mode can be given as a comma-separated list, or all "
+            "devices of the type as all.",
         "0"
     )
 {
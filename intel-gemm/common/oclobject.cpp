@@ -26,6 +26,11 @@
 #include <fstream>
 #include <algorithm>
 #include <cstring>
+#include <cstdio>
+#include <stdint.h>
+#ifdef __linux__
+#include <dlfcn.h>
+#endif
 #include <CL/cl.h>
 
 #include "oclobject.hpp"
@@ -35,12 +40,61 @@ using std::cerr;
 using std::vector;
 
 
+// The sample is built with OpenCL 1.1 headers, so the part of OpenCL 1.2
+// API for sub-devices is declared here and loaded from the library at run time.
+#ifndef CL_VERSION_1_2
+
+typedef intptr_t cl_device_partition_property;
+
+#define CL_DEVICE_PARTITION_EQUALLY                 0x1086
+#define CL_DEVICE_PARTITION_BY_COUNTS               0x1087
+#define CL_DEVICE_PARTITION_BY_COUNTS_LIST_END      0x0
+#define CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN      0x1088
+#define CL_DEVICE_AFFINITY_DOMAIN_NUMA              (1 << 0)
+#define CL_DEVICE_AFFINITY_DOMAIN_L4_CACHE          (1 << 1)
+#define CL_DEVICE_AFFINITY_DOMAIN_L3_CACHE          (1 << 2)
+#define CL_DEVICE_AFFINITY_DOMAIN_L2_CACHE          (1 << 3)
+#define CL_DEVICE_AFFINITY_DOMAIN_L1_CACHE          (1 << 4)
+#define CL_DEVICE_AFFINITY_DOMAIN_NEXT_PARTITIONABLE (1 << 5)
+
+#endif
+
+typedef cl_int (CL_API_CALL *CreateSubDevices) (
+    cl_device_id, const cl_device_partition_property*, cl_uint, cl_device_id*, cl_uint*
+);
+
+
+OpenCLSubDevices::~OpenCLSubDevices ()
+{
+    try
+    {
+        for(size_t i = 0; i < devices.size(); ++i)
+        {
+            cl_int err = devices[i].release(devices[i].device);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+    }
+    catch(...)
+    {
+        destructorException();
+    }
+}
+
+
+void OpenCLSubDevices::add (cl_device_id device, ReleaseDevice release)
+{
+    SubDevice sub_device = { device, release };
+    devices.push_back(sub_device);
+}
+
+
 OpenCLBasic::OpenCLBasic (
     const string& platform_name_or_index,
     const string& device_type,
     const string& device_name_or_index,
     cl_command_queue_properties queue_properties,
-    const cl_context_properties* additional_context_props
+    const cl_context_properties* additional_context_props,
+    const string& partition
 ) :
     platform(0),
     device(0),
@@ -49,6 +103,7 @@ OpenCLBasic::OpenCLBasic (
 {
     selectPlatform(platform_name_or_index);
     selectDevice(device_name_or_index, device_type);
+    partitionDevices(partition);
     createContext(additional_context_props);
     createQueue(queue_properties);
 }
@@ -60,9 +115,9 @@ OpenCLBasic::~OpenCLBasic ()
     {
         // Release objects in the opposite order of creation
 
-        if(queue)
+        for(size_t i = 0; i < queues.size(); ++i)
         {
-            cl_int err = clReleaseCommandQueue(queue);
+            cl_int err = clReleaseCommandQueue(queues[i]);
             SAMPLE_CHECK_ERRORS(err);
         }
 
@@ -71,6 +126,8 @@ OpenCLBasic::~OpenCLBasic ()
             cl_int err = clReleaseContext(context);
             SAMPLE_CHECK_ERRORS(err);
         }
+
+        // sub_devices are released by their holder after this.
     }
     catch(...)
     {
@@ -221,13 +278,13 @@ void OpenCLBasic::selectDevice (const string& device_name_or_index, const string
 
     SAMPLE_CHECK_ERRORS(err);
 
-    vector<cl_device_id> devices(num_of_devices);
+    vector<cl_device_id> available(num_of_devices);
 
     err = clGetDeviceIDs(
         platform,
         device_type,
         num_of_devices,
-        &devices[0],
+        &available[0],
         0
     );
     SAMPLE_CHECK_ERRORS(err);
@@ -235,22 +292,26 @@ void OpenCLBasic::selectDevice (const string& device_name_or_index, const string
     if(num_of_devices>1)
     {// sort devices by name to be sure that order is not changed from run to run
      // it is supposed that different devices have different names
-        sort(devices.begin(),devices.end(), device_comp);
+        sort(available.begin(),available.end(), device_comp);
     }
 
-    cl_uint selected_device_index = num_of_devices;
-    bool by_index = false;
+    // Several devices can be requested as a comma-separated list,
+    // each item is an index or a name; "all" selects all of them.
+    bool select_all = device_name_or_index == "all";
+    vector<string> requested;
 
-    if(is_number(device_name_or_index))
+    for(size_t pos = 0, next = 0; !select_all && next != string::npos; pos = next + 1)
     {
-        // Select device by index:
-        by_index = true;
-        selected_device_index = str_to<int>(device_name_or_index);
-        // does not return here; need to look at the complete devices list
+        next = device_name_or_index.find(',', pos);
+        requested.push_back(
+            device_name_or_index.substr(
+                pos,
+                next == string::npos ? string::npos : next - pos
+            )
+        );
     }
 
-    // this is ignored in case when we have device already selected by index
-    string required_device_subname = device_name_or_index;
+    vector<size_t> selected_device_index(requested.size(), num_of_devices);
 
     cout << "Devices (" << num_of_devices;
     if(device_type != CL_DEVICE_TYPE_ALL)
@@ -264,7 +325,7 @@ void OpenCLBasic::selectDevice (const string& device_name_or_index, const string
         // Get the length for the i-th device name
         size_t device_name_length = 0;
         err = clGetDeviceInfo(
-            devices[i],
+            available[i],
             CL_DEVICE_NAME,
             0,
             0,
@@ -276,7 +337,7 @@ void OpenCLBasic::selectDevice (const string& device_name_or_index, const string
         // use vector for automatic memory management
         vector<char> device_name(device_name_length);
         err = clGetDeviceInfo(
-            devices[i],
+            available[i],
             CL_DEVICE_NAME,
             device_name_length,
             &device_name[0],
@@ -286,51 +347,87 @@ void OpenCLBasic::selectDevice (const string& device_name_or_index, const string
 
         cout << "    [" << i << "] " << &device_name[0];
 
+        bool selected = select_all;
+
         // decide if this i-th device is what you are looking for
-        // select the first matched skipping the next one if any
-        if(
-            (
-                by_index &&
-                selected_device_index == i  // we already selected the device by index
-            ) || 
-            (
-                !by_index &&
-                string(&device_name[0]).find(required_device_subname) != string::npos &&
-                selected_device_index == num_of_devices   // haven't selected yet
+        // for every requested item select the first matched skipping the next one if any
+        for(size_t r = 0; r < requested.size(); ++r)
+        {
+            bool by_index = is_number(requested[r]);
+
+            if(
+                (
+                    by_index &&
+                    str_to<cl_uint>(requested[r]) == i  // we already selected the device by index
+                ) ||
+                (
+                    !by_index &&
+                    string(&device_name[0]).find(requested[r]) != string::npos &&
+                    selected_device_index[r] == num_of_devices   // haven't selected yet
+                )
             )
-        )
+            {
+                selected = true;
+                selected_device_index[r] = i;
+            }
+        }
+
+        if(selected)
         {
             cout << " [Selected]";
-            selected_device_index = i;
             // do not stop here, just see all available devices
         }
 
-        // TODO Something when more than one device matches a given subname
-
         cout << endl;
     }
 
-    if(by_index && selected_device_index >= num_of_devices)
+    devices.clear();
+
+    if(select_all)
     {
-        throw Error(
-            "Given index of device (" + device_name_or_index + ") "
-            "is out of range of available devices" +
-            (device_type != CL_DEVICE_TYPE_ALL ?
-                " (among devices of type " + device_type_name + ")" :
-                string("")
-            )
-        );
+        if(num_of_devices == 0)
+        {
+            throw Error("There are no devices of type " + device_type_name);
+        }
+
+        devices = available;
     }
 
-    if(!by_index && selected_device_index >= num_of_devices)
+    for(size_t r = 0; r < requested.size(); ++r)
     {
-        throw Error(
-            "There is no found device with name containing \"" +
-            required_device_subname + "\" as a substring\n"
-        );
+        if(is_number(requested[r]) && selected_device_index[r] >= num_of_devices)
+        {
+            throw Error(
+                "Given index of device (" + requested[r] + ") "
+                "is out of range of available devices" +
+                (device_type != CL_DEVICE_TYPE_ALL ?
+                    " (among devices of type " + device_type_name + ")" :
+                    string("")
+                )
+            );
+        }
+
+        if(!is_number(requested[r]) && selected_device_index[r] >= num_of_devices)
+        {
+            throw Error(
+                "There is no found device with name containing \"" +
+                requested[r] + "\" as a substring\n"
+            );
+        }
+
+        cl_device_id selected = available[selected_device_index[r]];
+
+        if(find(devices.begin(), devices.end(), selected) != devices.end())
+        {
+            throw Error(
+                "Device " + requested[r] + " is selected more than once"
+            );
+        }
+
+        devices.push_back(selected);
     }
 
-    device = devices[selected_device_index];
+    device = devices[0];
 }
 
 
@@ -405,6 +502,212 @@ std::vector<cl_device_id> selectDevices (
 }
 
 
+// Property list for clCreateSubDevices if core is true, otherwise for
+// clCreateSubDevicesEXT; Property is the type of its elements.
+template <typename Property>
+static vector<Property> partitionProperties (const DevicePartition& partition, bool core)
+{
+    vector<Property> properties;
+
+    switch(partition.scheme)
+    {
+        case DevicePartition::EQUALLY:
+            properties.push_back(core ? CL_DEVICE_PARTITION_EQUALLY : CL_DEVICE_PARTITION_EQUALLY_EXT);
+            properties.push_back(Property(partition.compute_units[0]));
+            break;
+
+        case DevicePartition::BY_COUNTS:
+            properties.push_back(core ? CL_DEVICE_PARTITION_BY_COUNTS : CL_DEVICE_PARTITION_BY_COUNTS_EXT);
+
+            for(size_t i = 0; i < partition.compute_units.size(); ++i)
+            {
+                properties.push_back(Property(partition.compute_units[i]));
+            }
+
+            properties.push_back(
+                core ? CL_DEVICE_PARTITION_BY_COUNTS_LIST_END : Property(CL_PARTITION_BY_COUNTS_LIST_END_EXT)
+            );
+            break;
+
+        case DevicePartition::BY_AFFINITY_DOMAIN:
+        {
+            static const Property core_domains[] = {
+                CL_DEVICE_AFFINITY_DOMAIN_NUMA,
+                CL_DEVICE_AFFINITY_DOMAIN_L1_CACHE,
+                CL_DEVICE_AFFINITY_DOMAIN_L2_CACHE,
+                CL_DEVICE_AFFINITY_DOMAIN_L3_CACHE,
+                CL_DEVICE_AFFINITY_DOMAIN_L4_CACHE,
+                CL_DEVICE_AFFINITY_DOMAIN_NEXT_PARTITIONABLE
+            };
+
+            static const Property ext_domains[] = {
+                CL_AFFINITY_DOMAIN_NUMA_EXT,
+                CL_AFFINITY_DOMAIN_L1_CACHE_EXT,
+                CL_AFFINITY_DOMAIN_L2_CACHE_EXT,
+                CL_AFFINITY_DOMAIN_L3_CACHE_EXT,
+                CL_AFFINITY_DOMAIN_L4_CACHE_EXT,
+                CL_AFFINITY_DOMAIN_NEXT_FISSIONABLE_EXT
+            };
+
+            properties.push_back(
+                core ? CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN : CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN_EXT
+            );
+            properties.push_back(core ? core_domains[partition.domain] : ext_domains[partition.domain]);
+            break;
+        }
+
+        case DevicePartition::NONE:
+            break;
+    }
+
+    properties.push_back(core ? 0 : Property(CL_PROPERTIES_LIST_END_EXT));
+    return properties;
+}
+
+
+// true if CL_DEVICE_VERSION of the device is "OpenCL 1.2" or later
+static bool deviceSupportsOpenCL12 (cl_device_id device)
+{
+    using namespace std;
+
+    size_t version_length = 0;
+    cl_int err = clGetDeviceInfo(device, CL_DEVICE_VERSION, 0, 0, &version_length);
+    SAMPLE_CHECK_ERRORS(err);
+
+    vector<char> version(version_length);
+    err = clGetDeviceInfo(device, CL_DEVICE_VERSION, version_length, &version[0], 0);
+    SAMPLE_CHECK_ERRORS(err);
+
+    // "OpenCL <major>.<minor> <vendor-specific information>"
+    int major = 0;
+    int minor = 0;
+    if(sscanf(&version[0], "OpenCL %d.%d", &major, &minor) != 2)
+    {
+        return false;
+    }
+
+    return major > 1 || (major == 1 && minor >= 2);
+}
+
+
+void OpenCLBasic::partitionDevices (const string& partition)
+{
+    using namespace std;
+
+    DevicePartition parsed = parseDevicePartition(partition);
+
+    if(parsed.scheme == DevicePartition::NONE)
+    {
+        return;
+    }
+
+    // Core functions of OpenCL 1.2 are exported by the OpenCL library the
+    // sample is linked with; devices of OpenCL 1.1 fall back to the extension.
+    CreateSubDevices create_core = 0;
+    OpenCLSubDevices::ReleaseDevice release_core = 0;
+#ifdef __linux__
+    create_core = (CreateSubDevices)dlsym(RTLD_DEFAULT, "clCreateSubDevices");
+    release_core = (OpenCLSubDevices::ReleaseDevice)dlsym(RTLD_DEFAULT, "clReleaseDevice");
+#endif
+
+    vector<intptr_t> core_properties = partitionProperties<intptr_t>(parsed, true);
+    // cl_device_partition_property_ext is a 64-bit integer in both cases
+    vector<unsigned long long> ext_properties = partitionProperties<unsigned long long>(parsed, false);
+
+    vector<cl_device_id> partitioned;
+
+    for(size_t i = 0; i < devices.size(); ++i)
+    {
+        vector<cl_device_id> created;
+        OpenCLSubDevices::ReleaseDevice release = 0;
+
+        if(create_core && release_core && deviceSupportsOpenCL12(devices[i]))
+        {
+            const cl_device_partition_property* properties =
+                (const cl_device_partition_property*)&core_properties[0];
+
+            cl_uint num_of_sub_devices = 0;
+            cl_int err = create_core(devices[i], properties, 0, 0, &num_of_sub_devices);
+            SAMPLE_CHECK_ERRORS(err);
+
+            created.resize(num_of_sub_devices);
+            err = create_core(devices[i], properties, num_of_sub_devices, &created[0], 0);
+            SAMPLE_CHECK_ERRORS(err);
+
+            release = release_core;
+        }
+        else
+        {
+            size_t extensions_length = 0;
+            cl_int err = clGetDeviceInfo(devices[i], CL_DEVICE_EXTENSIONS, 0, 0, &extensions_length);
+            SAMPLE_CHECK_ERRORS(err);
+
+            vector<char> extensions(extensions_length);
+            err = clGetDeviceInfo(devices[i], CL_DEVICE_EXTENSIONS, extensions_length, &extensions[0], 0);
+            SAMPLE_CHECK_ERRORS(err);
+
+            clCreateSubDevicesEXT_fn create_ext =
+                (clCreateSubDevicesEXT_fn)clGetExtensionFunctionAddress("clCreateSubDevicesEXT");
+            clReleaseDeviceEXT_fn release_ext =
+                (clReleaseDeviceEXT_fn)clGetExtensionFunctionAddress("clReleaseDeviceEXT");
+
+            if(
+                string(&extensions[0]).find("cl_ext_device_fission") == string::npos ||
+                !create_ext || !release_ext
+            )
+            {
+                throw Error(
+                    "Device " + to_str(i) + " supports neither OpenCL 1.2 sub-devices "
+                    "nor cl_ext_device_fission extension and cannot be partitioned"
+                );
+            }
+
+            const cl_device_partition_property_ext* properties =
+                (const cl_device_partition_property_ext*)&ext_properties[0];
+
+            cl_uint num_of_sub_devices = 0;
+            err = create_ext(devices[i], properties, 0, 0, &num_of_sub_devices);
+            SAMPLE_CHECK_ERRORS(err);
+
+            created.resize(num_of_sub_devices);
+            err = create_ext(devices[i], properties, num_of_sub_devices, &created[0], 0);
+            SAMPLE_CHECK_ERRORS(err);
+
+            release = release_ext;
+        }
+
+        for(size_t j = 0; j < created.size(); ++j)
+        {
+            sub_devices.add(created[j], release);
+        }
+
+        partitioned.insert(partitioned.end(), created.begin(), created.end());
+
+        cout << "Device " << i << " is partitioned by " << inquotes(partition) << " into " << created.size() << " sub-devices:";
+
+        for(size_t j = 0; j < created.size(); ++j)
+        {
+            cl_uint compute_units = 0;
+            cl_int err = clGetDeviceInfo(
+                created[j],
+                CL_DEVICE_MAX_COMPUTE_UNITS,
+                sizeof(compute_units),
+                &compute_units,
+                0
+            );
+            SAMPLE_CHECK_ERRORS(err);
+
+            cout << " " << compute_units;
+        }
+
+        cout << " compute units\n";
+    }
+
+    devices = partitioned;
+    device = devices[0];
+}
+
+
 void OpenCLBasic::createContext (const cl_context_properties* additional_context_props)
 {
     using namespace std;
@@ -446,7 +749,12 @@ void OpenCLBasic::createContext (const cl_context_properties* additional_context
     context_props.back() = 0;
 
     cl_int err = 0;
-    context = clCreateContext(&context_props[0], 1, &device, 0, 0, &err);
+    context = clCreateContext(
+        &context_props[0],
+        cl_uint(devices.size()),
+        &devices[0],
+        0, 0, &err
+    );
     SAMPLE_CHECK_ERRORS(err);
 }
 
@@ -459,9 +767,17 @@ void OpenCLBasic::createQueue (cl_command_queue_properties queue_properties)
         throw Error("Device is not selected");
     }
 
-    cl_int err = 0;
-    queue = clCreateCommandQueue(context, device, queue_properties, &err);
-    SAMPLE_CHECK_ERRORS(err);
+    // One queue per device; the first one is also available as queue
+    for(size_t i = 0; i < devices.size(); ++i)
+    {
+        cl_int err = 0;
+        cl_command_queue device_queue =
+            clCreateCommandQueue(context, devices[i], queue_properties, &err);
+        SAMPLE_CHECK_ERRORS(err);
+        queues.push_back(device_queue);
+    }
+
+    queue = queues[0];
 }
 
 
@@ -667,7 +983,13 @@ OpenCLProgram::OpenCLProgram (
         copy(program_text.begin(), program_text.end(), program_text_prepared.begin());
     }
 
-    program = createAndBuildProgram(program_text_prepared, oclobjects.context, 1, &oclobjects.device, build_options);
+    program = createAndBuildProgram(
+        program_text_prepared,
+        oclobjects.context,
+        oclobjects.devices.size(),
+        &oclobjects.devices[0],
+        build_options
+    );
 }
 
 
@@ -834,3 +1156,89 @@ cl_device_type parseDeviceType (const string& device_type_name)
     }
     return device_type;
 }
+
+
+DevicePartition parseDevicePartition (const string& partition)
+{
+    using namespace std;
+
+    DevicePartition result;
+    result.scheme = DevicePartition::NONE;
+    result.domain = DevicePartition::NUMA;
+
+    if(partition.empty() || partition == "none")
+    {
+        return result;
+    }
+
+    size_t colon = partition.find(':');
+    string kind = partition.substr(0, colon);
+    string value = colon == string::npos ? string() : partition.substr(colon + 1);
+
+    if(value.empty())
+    {
+        throw Error("Device partition " + inquotes(partition) + " has no value after colon");
+    }
+
+    if(kind == "equally")
+    {
+        result.scheme = DevicePartition::EQUALLY;
+        result.compute_units.push_back(str_to<size_t>(value));
+    }
+    else if(kind == "counts")
+    {
+        result.scheme = DevicePartition::BY_COUNTS;
+
+        for(size_t pos = 0, next = 0; next != string::npos; pos = next + 1)
+        {
+            next = value.find(',', pos);
+            result.compute_units.push_back(
+                str_to<size_t>(
+                    value.substr(pos, next == string::npos ? string::npos : next - pos)
+                )
+            );
+        }
+    }
+    else if(kind == "affinity")
+    {
+        result.scheme = DevicePartition::BY_AFFINITY_DOMAIN;
+
+        if(value == "numa")
+        {
+            result.domain = DevicePartition::NUMA;
+        }
+        else if(value == "l1")
+        {
+            result.domain = DevicePartition::L1_CACHE;
+        }
+        else if(value == "l2")
+        {
+            result.domain = DevicePartition::L2_CACHE;
+        }
+        else if(value == "l3")
+        {
+            result.domain = DevicePartition::L3_CACHE;
+        }
+        else if(value == "l4")
+        {
+            result.domain = DevicePartition::L4_CACHE;
+        }
+        else if(value == "next")
+        {
+            result.domain = DevicePartition::NEXT_PARTITIONABLE;
+        }
+        else
+        {
+            throw Error("Cannot recognize " + inquotes(value) + " as an affinity domain");
+        }
+    }
+    else
+    {
+        throw Error(
+            "Cannot recognize " + inquotes(partition) + " as a device partition; "
+            "should be equally:<n>, counts:<n1>,<n2>,... or affinity:<domain>"
+        );
+    }
+
+    return result;
+}
@@ -28,6 +28,7 @@
 #define _INTEL_OPENCL_SAMPLE_OCLOBJECT_HPP_
 
 #include <CL/cl.h>
+#include <CL/cl_ext.h>
 #include <string>
 #include <vector>
 #include <map>
@@ -73,6 +74,37 @@ cl_program createAndBuildProgram (
     const string& build_options
 );
 
+
+// Sub-devices of a partitioned device. They are created by core
+// clCreateSubDevices of OpenCL 1.2 or by clCreateSubDevicesEXT of
+// cl_ext_device_fission, and each is released by the matching function.
+class OpenCLSubDevices
+{
+public:
+
+    typedef cl_int (CL_API_CALL *ReleaseDevice) (cl_device_id device);
+
+    OpenCLSubDevices () {}
+    ~OpenCLSubDevices ();
+
+    void add (cl_device_id device, ReleaseDevice release);
+
+private:
+
+    struct SubDevice
+    {
+        cl_device_id device;
+        ReleaseDevice release;
+    };
+
+    std::vector<SubDevice> devices;
+
+    // Disable copying and assignment to avoid incorrect resource deallocation.
+    OpenCLSubDevices (const OpenCLSubDevices&);
+    OpenCLSubDevices& operator= (const OpenCLSubDevices&);
+};
+
+
 // Helper structure to initialize and hold basic OpenCL objects.
 // Contains platform, device, context and queue.
 // Platfrom and device are selected by given attributes (see the constructor);
@@ -86,15 +118,23 @@ struct OpenCLBasic
     cl_context context;
     cl_command_queue queue;
 
+    // All selected devices and a queue for each of them; the context spans
+    // all of them. device and queue are the first elements.
+    std::vector<cl_device_id> devices;
+    std::vector<cl_command_queue> queues;
+
     // Initializes all objects by given attributes:
     //   - for platform: platfrom name substring (for example, "Intel") or index (for example, "1")
-    //   - for device: device name substring or index
+    //   - for device: device name substring or index; several devices can be selected
+    //        by a comma-separated list of them, or all devices of the type by "all"
     //   - for device type: name of the device type (for example, "cpu"); see all supported
     //        device types in parseDeviceType description
     //   - for queue: by queue properties
     //   - for context: optional additional options for context creation; it is last, because
     //     it is used less frequently than queue properties; this is a null-terminated list of
     //     options similar to that clCreateContext receives.
+    //   - for partition: optional partitioning of the selected devices into sub-devices,
+    //     see parseDevicePartition; the sub-devices replace their parent in devices.
     // In case of empty string for platfrom or device the first available item is selected.
     // In case when device_type is not empty, it limits the set of devices with devices
     // with a given type only; so device_name_or_index is searched among the devices of
@@ -104,19 +144,25 @@ struct OpenCLBasic
         const string& device_type,
         const string& device_name_or_index="0", //default is the first device in the filtered list
         cl_command_queue_properties queue_properties = CL_QUEUE_PROFILING_ENABLE,
-        const cl_context_properties* additional_context_props = 0
+        const cl_context_properties* additional_context_props = 0,
+        const string& partition = ""
     );
 
     ~OpenCLBasic ();
 
 private:
 
+    // Sub-devices created by partitioning; the holder releases them after
+    // the destructor releases the context, or if the constructor throws.
+    OpenCLSubDevices sub_devices;
+
     void selectPlatform (const string& platform_name_or_index)
     {
         platform = ::selectPlatform(platform_name_or_index);
     }
 
     void selectDevice (const string& device_name_or_index, const string& device_type_name);
+    void partitionDevices (const string& partition);
     void createContext (const cl_context_properties* additional_context_props);
     void createQueue (cl_command_queue_properties queue_properties = 0);
 
@@ -212,6 +258,8 @@ private:
 // automatic resource deallocation. When deallocating, the destructor
 // use aligned_free to deallocate memory by host pointer. So it requires
 // that memory allocation happens by aligned_malloc.
+// It can be moved, which passes the ownership, so it can be returned
+// from functions and kept in containers.
 template <typename T>
 struct OpenCLDeviceAndHostMemory
 {
@@ -224,6 +272,32 @@ struct OpenCLDeviceAndHostMemory
     {
     }
 
+    OpenCLDeviceAndHostMemory (OpenCLDeviceAndHostMemory&& other) :
+        device(other.device),
+        host(other.host)
+    {
+        other.device = 0;
+        other.host = 0;
+    }
+
+    OpenCLDeviceAndHostMemory& operator= (OpenCLDeviceAndHostMemory&& other)
+    {
+        if(this != &other)
+        {
+            // Release own resources by the destructor of a temporary.
+            OpenCLDeviceAndHostMemory released;
+            released.device = device;
+            released.host = host;
+
+            device = other.device;
+            host = other.host;
+            other.device = 0;
+            other.host = 0;
+        }
+
+        return *this;
+    }
+
     ~OpenCLDeviceAndHostMemory ();
 
 private:
@@ -264,5 +338,43 @@ OpenCLDeviceAndHostMemory<T>::~OpenCLDeviceAndHostMemory ()
 cl_device_type parseDeviceType (const string& device_type_name);
 
 
+// Partitioning of a device into sub-devices. Core OpenCL 1.2 and
+// cl_ext_device_fission encode it with different property values,
+// so it is kept independent of both.
+struct DevicePartition
+{
+    enum Scheme
+    {
+        NONE,
+        EQUALLY,
+        BY_COUNTS,
+        BY_AFFINITY_DOMAIN
+    };
+
+    enum AffinityDomain
+    {
+        NUMA,
+        L1_CACHE,
+        L2_CACHE,
+        L3_CACHE,
+        L4_CACHE,
+        NEXT_PARTITIONABLE
+    };
+
+    Scheme scheme;
+    std::vector<size_t> compute_units;  // per sub-device: one value if EQUALLY, a list if BY_COUNTS
+    AffinityDomain domain;  // if BY_AFFINITY_DOMAIN
+};
+
+// Parse textual representation of device partitioning.
+// Supported formats for textual representation:
+//   - no partitioning: "none" or empty string "" (returns scheme NONE)
+//   - equally: "equally:<n>", sub-devices of n compute units each
+//   - by counts: "counts:<n1>,<n2>,...", sub-devices of given numbers of compute units
+//   - by affinity domain: "affinity:<domain>", where domain is one of
+//     "numa", "l1", "l2", "l3", "l4" or "next" (next fissionable domain)
+DevicePartition parseDevicePartition (const string& partition);
+
+
 
 #endif  // end of the include guard
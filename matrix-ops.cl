@@ -0,0 +1,54 @@
+// Elementwise operations on strided matrices used by host-orchestrated
+// algorithms. Element (i, j) of a matrix is at index offset + i*ld + j,
+// the NDRange is (rows, columns). Output may alias any of the inputs.
+
+__kernel void matrix_copy (
+    __global T * C,
+    int c_offset,
+    int ldc,
+    __global const T * A,
+    int a_offset,
+    int lda
+)
+{
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+
+    C[c_offset + i * ldc + j] = A[a_offset + i * lda + j];
+}
+
+__kernel void matrix_add (
+    __global T * C,
+    int c_offset,
+    int ldc,
+    __global const T * A,
+    int a_offset,
+    int lda,
+    __global const T * B,
+    int b_offset,
+    int ldb
+)
+{
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+
+    C[c_offset + i * ldc + j] = A[a_offset + i * lda + j] + B[b_offset + i * ldb + j];
+}
+
+__kernel void matrix_sub (
+    __global T * C,
+    int c_offset,
+    int ldc,
+    __global const T * A,
+    int a_offset,
+    int lda,
+    __global const T * B,
+    int b_offset,
+    int ldb
+)
+{
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+
+    C[c_offset + i * ldc + j] = A[a_offset + i * lda + j] - B[b_offset + i * ldb + j];
+}
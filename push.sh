@@ -12,3 +12,23 @@ then
 else
   adb push $1 $TEST_PATH/gemm.cl
 fi
+
+# kernels used by the other modes are loaded under their own names
+for KERNEL_FILE in gemm-persistent.cl matrix-ops.cl gemm-fused.cl
+do
+  adb push $KERNEL_FILE $TEST_PATH/$KERNEL_FILE
+done
+
+# variants of gemm_tn selected by shape in dispatch mode and the edge kernel
+for KERNEL_FILE in gemm-blocking-4x4-vload8.cl gemm-blocking-4x4-vload4.cl gemm-blocking-2x2-vload8.cl gemm-blocking-2x2-vload4.cl gemm-noblock-vload16.cl gemm-noblock-vload8.cl gemm-edge.cl
+do
+  adb push $KERNEL_FILE $TEST_PATH/$KERNEL_FILE
+done
+
+# texture-path kernel for image mode, its blocking should match gemm.cl
+if [ -z $3 ]
+then
+  adb push gemm-image-4x4.cl $TEST_PATH/gemm-image.cl
+else
+  adb push $3 $TEST_PATH/gemm-image.cl
+fi